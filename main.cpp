@@ -8,8 +8,15 @@
 #include <algorithm>
 #include <array>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <initializer_list>
+#include <mutex>
+#include <thread>
 
 #define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -19,50 +26,97 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-struct Vertex {
-    glm::vec2 pos;
-    glm::vec3 color;
-    glm::vec2 texCoord;
-
-    static VkVertexInputBindingDescription getBindingDescription() {
-        VkVertexInputBindingDescription bindingDescription = {};
-        bindingDescription.binding = 0;
-        bindingDescription.stride = sizeof(Vertex);
-        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-        return bindingDescription;
-    }
-
-    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
-        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
-
-        attributeDescriptions[0].binding = 0;
-        attributeDescriptions[0].location = 0;
-        attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-        attributeDescriptions[0].offset = offsetof(Vertex, pos);
-
-        attributeDescriptions[1].binding = 0;
-        attributeDescriptions[1].location = 1;
-        attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[1].offset = offsetof(Vertex, color);
-
-        attributeDescriptions[2].binding = 0;
-        attributeDescriptions[2].location = 2;
-        attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-        attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
-
-        return attributeDescriptions;
-    }
-};
+#include "mesh.hpp"
+#include "vertex_layout.hpp"
+#include "vfs.hpp"
+#include "shader_hot_reload.hpp"
+#include "pipeline_layout_cache.hpp"
+#include "pipeline_variant_cache.hpp"
+#include "render_graph.hpp"
+#include "resolution_scaler.hpp"
+#include "profiler.hpp"
+#include "gpu_memory_tracker.hpp"
+#include "simulation.hpp"
+#include "job_system.hpp"
+#include "ecs.hpp"
+#include "scene.hpp"
+#include "voxel_world.hpp"
+#include "spatial_hash_grid.hpp"
+#include "occlusion_culler.hpp"
+#include "voxel_light.hpp"
+#include "terrain_lod.hpp"
+#include "terrain_renderer.hpp"
+#include "particle_system.hpp"
+#include "frame_capture.hpp"
+#include "frame_log.hpp"
+#include "frame_timing.hpp"
 
 struct UniformBufferObject {
-    glm::mat4 model;
     glm::mat4 view;
     glm::mat4 proj;
 };
 
+// Depth state of a pipeline drawing the scene.
+struct DepthState {
+    bool test;
+    bool write;
+    VkCompareOp compareOp;
+};
+
+// Dequantization constants for MeshVertexLayout::Packed positions.
+struct MeshDecodeConstants {
+    glm::vec4 positionOrigin;
+    glm::vec4 positionExtent;
+};
+
 const int WIDTH = 800;
 const int HEIGHT = 600;
+// The mesh is drawn as a stack of entities, back to front, so that depth
+// testing has overdraw to remove.
+const uint32_t SCENE_LAYERS = 16;
+const float SCENE_LAYER_SPACING = 0.05f;
+const uint32_t MAX_INSTANCES = 4096;
+// Distinct mesh and texture pairs drawn in one frame.
+const uint32_t MAX_DRAW_BATCHES = 256;
+// The scene renders at a scale of the window resolution that keeps GPU time
+// within the frame budget, and is upscaled into the swapchain image.
+const float FRAME_BUDGET_MILLISECONDS = 1000.0f / 60.0f;
+const float MIN_RENDER_SCALE = 0.5f;
+const uint32_t MIN_TEXTURE_MIP_LEVELS = 4;
+const double SIMULATION_TICKS_PER_SECOND = 60.0;
+const size_t TEXTURE_ROWS_PER_JOB = 16;
+const glm::vec3 CAMERA_POSITION(2.0f, 2.0f, 2.0f);
+const glm::vec3 CAMERA_TARGET(0.0f, 0.0f, 0.0f);
+const float CAMERA_FOV_DEGREES = 30.0f;
+// The terrain is a slab of blocks below the scene, centred on the origin.
+const int TERRAIN_HALF_WIDTH = 32;
+const int TERRAIN_DEPTH = 16;
+const BlockId TERRAIN_BLOCK = 1;
+// Lamps are buried in a grid a few blocks down, lighting the pits dug to them.
+const BlockId LAMP_BLOCK = 2;
+const uint8_t LAMP_LIGHT = 14;
+const int LAMP_SPACING = 16;
+const int LAMP_DEPTH = 4;
+// Terrain chunks are meshed out to this distance, coarser where the detail lost
+// would span fewer than this many pixels.
+const float TERRAIN_VIEW_DISTANCE = 256.0f;
+const float TERRAIN_LOD_PIXEL_ERROR = 4.0f;
+// Chunk meshes share buffers of these sizes, and up to TERRAIN_UPLOAD_BYTES of
+// new meshes are uploaded each frame.
+const VkDeviceSize TERRAIN_VERTEX_BYTES = 64 << 20;
+const VkDeviceSize TERRAIN_INDEX_BYTES = 32 << 20;
+const VkDeviceSize TERRAIN_UPLOAD_BYTES = 8 << 20;
+const float ENTITY_GRID_CELL_SIZE = 2.0f;
+const float DIG_REACH = 16.0f;
+// Each dug block throws a burst of dust that settles on top of the terrain.
+const uint32_t MAX_PARTICLES = 1 << 16;
+const uint32_t DIG_PARTICLE_COUNT = 4096;
+const glm::vec4 DIG_PARTICLE_COLOR(0.45f, 0.35f, 0.25f, 0.8f);
+const float PARTICLE_FLOOR_HEIGHT = 0.0f;
+const DepthState depthTestWrite = {true, true, VK_COMPARE_OP_LESS};
+const DepthState depthTestEqual = {true, false, VK_COMPARE_OP_EQUAL};
+// Views of the DEBUG_VIEW specialization constant in shader.frag.
+const uint32_t DEBUG_VIEW_COUNT = 3;
 const std::vector<const char*> validationLayers = {
     "VK_LAYER_KHRONOS_validation",
     "VK_LAYER_LUNARG_monitor"
@@ -70,14 +124,44 @@ const std::vector<const char*> validationLayers = {
 const std::vector<const char*> deviceExtensions = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
-const std::vector<Vertex> vertices = {
-    {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
-    {{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
-    {{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
-    {{-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}}
+const std::vector<ShaderSource> shaderSources = {
+    {"shaders/shader.vert", "shaders/build/vert.spv"},
+    {"shaders/shader_packed.vert", "shaders/build/vert_packed.spv"},
+    {"shaders/shader.frag", "shaders/build/frag.spv"}
 };
-const std::vector<uint16_t> indices = {
-    0, 1, 2, 2, 3, 0
+
+// Without a window, frames are rendered into an image of the window's size and
+// the run ends after this many unless told otherwise.
+const uint64_t OFFSCREEN_FRAME_LIMIT = 300;
+// A replay regresses when its median or 95th percentile frame time is this much
+// over the baseline's, past the first frames, which still build pipelines and
+// terrain meshes.
+const float DEFAULT_REGRESSION_THRESHOLD = 0.10f;
+const size_t TIMING_WARMUP_FRAMES = 30;
+
+// Set from the command line.
+struct GameOptions {
+    // Renders without a window or swapchain.
+    bool offscreen = false;
+    // Every frame is written here when not empty.
+    std::string captureDirectory;
+    CaptureFormat captureFormat = CaptureFormat::Png;
+    // Ends the run after this many frames; 0 for no limit.
+    uint64_t frameLimit = 0;
+    // The run is recorded to this frame log when not empty.
+    std::string recordPath;
+    // Replays this frame log in place of live input and the simulation thread.
+    std::string replayPath;
+    // Replays at the recorded pace instead of as fast as possible.
+    bool pacedReplay = false;
+    // Per-frame CPU and GPU times are written here when not empty.
+    std::string timingsPath;
+    // The run fails when its times regress past regressionThreshold against these.
+    std::string baselinePath;
+    float regressionThreshold = DEFAULT_REGRESSION_THRESHOLD;
+    // Pipeline variants listed here are compiled before the first frame, and the
+    // ones used by the run are added to it.
+    std::string pipelineListPath;
 };
 
 struct QueueFamilyIndices {
@@ -97,30 +181,83 @@ struct SwapChainSupportDetails {
 
 class Game {
     public:
+    explicit Game(const GameOptions& options) : options(options) {
+        if (isReplaying()) {
+            replayLog = FrameLogReader::read(options.replayPath);
+            uint64_t recordedFrames = replayLog.frames.size();
+            this->options.frameLimit = options.frameLimit == 0 ? recordedFrames : std::min(options.frameLimit, recordedFrames);
+        }
+        else if (options.offscreen && options.frameLimit == 0) {
+            this->options.frameLimit = OFFSCREEN_FRAME_LIMIT;
+        }
+        if (!options.baselinePath.empty()) {
+            baselineTimings = readFrameTimings(options.baselinePath);
+        }
+    }
+
     void run() {
+        observeAssetReads();
+        mountAssets();
         initWindow();
         initVulkan();
+        startFrameLog();
+        if (!isReplaying()) {
+            simulation.start();
+        }
         mainLoop();
+        simulation.stop();
         cleanup();
+        if (frameLogWriter.isOpen()) {
+            frameLogWriter.close();
+            std::cout << "Recorded " << frameNumber << " frames to " << options.recordPath << std::endl;
+        }
+        reportFrameTimings();
     }
     
     private:
+    GameOptions options;
+    JobSystem jobSystem;
+    Vfs vfs;
     GLFWwindow* window;
     VkInstance instance;
     VkPhysicalDevice physicalDevice;
     VkDevice device;
     VkSurfaceKHR surface;
     VkQueue presentQueue;
-    VkSwapchainKHR swapChain;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+    // Offscreen, the swapchain is a single image of our own.
+    VkDeviceMemory offscreenImageMemory = VK_NULL_HANDLE;
     std::vector<VkImage> swapChainImages;
     std::vector<VkImageView> swapChainImageViews;
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
-    VkDescriptorSetLayout descriptorSetLayout;
-    VkPipelineLayout pipelineLayout;
-    VkRenderPass renderPass;
-    VkPipeline graphicsPipeline;
-    std::vector<VkFramebuffer> swapChainFramebuffers;
+    PipelineLayoutCache pipelineLayoutCache;
+    const ProgramLayout* graphicsProgram = nullptr;
+    VkPipelineCache pipelineCache;
+    RenderGraph renderGraph;
+    PipelineVariantCache pipelineVariants;
+    PipelineVariantKey graphicsPipelineKey;
+    PipelineVariantKey graphicsPipelineDepthEqualKey;
+    PipelineVariantKey depthPrepassPipelineKey;
+    uint32_t debugView = 0;
+    bool debugViewKeyDown = false;
+    ShaderHotReload shaderHotReload;
+    VkFormat depthFormat;
+    bool depthPrepass = false;
+    bool depthPrepassKeyDown = false;
+    bool profilerKeyDown = false;
+    VkQueryPool statisticsQueryPool = VK_NULL_HANDLE;
+    bool statisticsQueryPending = false;
+    uint64_t fragmentInvocations = 0;
+    uint32_t statisticsFrames = 0;
+    std::chrono::steady_clock::time_point statisticsReportTime;
+    ResolutionScaler resolutionScaler{FRAME_BUDGET_MILLISECONDS, MIN_RENDER_SCALE, 1.0f};
+    VkExtent2D renderExtent;
+    bool swapChainSupportsUpscale;
+    VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+    bool timestampQueryPending = false;
+    float timestampPeriod;
+    uint64_t timestampMask;
     VkCommandPool commandPool;
     VkCommandBuffer commandBuffer;
     VkSemaphore imageAvailableSemaphore;
@@ -133,14 +270,97 @@ class Game {
     VkBuffer uniformBuffer;
     VkDeviceMemory uniformBufferMemory;
     void *uniformBufferMapped;
+    VkBuffer instanceBuffer;
+    VkDeviceMemory instanceBufferMemory;
+    glm::mat4 *instanceBufferMapped;
+    World world;
+    SceneSystems sceneSystems;
+    std::vector<DrawBatch> drawBatches;
+    OcclusionCuller occlusionCuller;
+    ParticleSystem particleSystem;
+    double particleTime = 0.0;
+    float particleDeltaSeconds = 0.0f;
+    float particleGpuMilliseconds = 0.0f;
+    FrameCapture frameCapture;
+    // Frames submitted so far.
+    uint64_t frameNumber = 0;
+    FrameLogWriter frameLogWriter;
+    FrameLog replayLog;
+    // Input handled and assets read since the last frame was recorded or
+    // replayed. Assets are also read by the shader hot reload thread.
+    std::vector<InputEvent> frameInputs;
+    std::mutex frameLoadsMutex;
+    std::vector<ResourceLoad> frameLoads;
+    std::chrono::steady_clock::time_point frameLogStartTime;
+    uint64_t replayedInputFrame = UINT64_MAX;
+    uint64_t replayDivergedFrames = 0;
+    uint64_t replayLoadMismatches = 0;
+    std::vector<FrameTiming> frameTimings;
+    std::vector<FrameTiming> baselineTimings;
+    uint64_t particlesSimulated = 0;
+    float particleGpuTotal = 0.0f;
+    uint32_t particleFrames = 0;
+    std::chrono::steady_clock::time_point particleReportTime;
+    bool occlusionKeyDown = false;
+    OcclusionStatistics occlusionTotals = {};
+    float occlusionGpuMilliseconds = 0.0f;
+    uint32_t occlusionFrames = 0;
+    std::chrono::steady_clock::time_point occlusionReportTime;
+    VoxelWorld terrain;
+    VoxelLight terrainLight{jobSystem};
+    TerrainLod terrainLod{jobSystem, TERRAIN_VIEW_DISTANCE, TERRAIN_LOD_PIXEL_ERROR};
+    TerrainRenderer terrainRenderer;
+    bool terrainLodKeyDown = false;
+    SpatialHashGrid entityGrid{ENTITY_GRID_CELL_SIZE};
+    bool digButtonDown = false;
     VkDescriptorPool descriptorPool;
     VkDescriptorSet descriptorSet;
+    GpuMemoryTracker memoryTracker;
+    bool memoryBudgetSupported;
+    std::chrono::steady_clock::time_point overlayUpdateTime;
+    float gpuFrameMilliseconds = 0.0f;
     VkImage textureImage;
     VkDeviceMemory textureImageMemory;
+    uint32_t textureMipLevels;
+    uint32_t textureSkippedMips = 0;
+    // The decoded mip chain, so that giving up a level under memory pressure only
+    // uploads the rest again. Levels given up are released.
+    std::vector<std::vector<stbi_uc>> textureLevels;
+    std::vector<VkExtent2D> textureLevelExtents;
     VkImageView textureImageView;
     VkSampler textureSampler;
+    Mesh mesh;
+    Simulation simulation{SIMULATION_TICKS_PER_SECOND, stepSimulation};
+
+    // Game logic, run on the simulation thread.
+    static void stepSimulation(SimulationState& state, double deltaSeconds) {
+        state.modelAngle += static_cast<float>(deltaSeconds) * glm::radians(90.0f);
+    }
+
+    // Packs are searched ahead of directories, so where the source tree is
+    // present the pack is left unmounted, or it would shadow edited assets and
+    // hot-reloaded shaders.
+    void mountAssets() {
+        std::string baseDirectory = executableDirectory();
+        std::string packPath = baseDirectory + "/dig.pack";
+        bool sourceTree = false;
+
+#ifdef DIG_ASSET_DIRECTORY
+        sourceTree = std::filesystem::is_directory(DIG_ASSET_DIRECTORY);
+        if (sourceTree) {
+            vfs.mountDirectory(DIG_ASSET_DIRECTORY);
+        }
+#endif
+        if (!sourceTree && std::filesystem::exists(packPath)) {
+            vfs.mountPack(packPath);
+        }
+        vfs.mountDirectory(baseDirectory);
+    }
 
     void initWindow() {
+        if (options.offscreen) {
+            return;
+        }
         glfwInit();
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
         glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
@@ -153,23 +373,38 @@ class Game {
         createSurface();
         pickPhysicalDevice();
         createLogicalDevice();
+        createMemoryTracker();
         createSwapChain();
         createImageViews();
-        createRenderPass();
-        createDescriptorSetLayout();
+        renderGraph.init(device, physicalDevice, &memoryTracker);
+        depthFormat = findDepthFormat();
+        loadMesh();
+        createScene();
+        createPipelineCache();
         createGraphicsPipeline();
-        createFramebuffers();
         createCommandPool();
+        loadTexture();
         createTextureImage();
         createTextureImageView();
         createTextureSampler();
         createVertexBuffer();
         createIndexBuffer();
+        mesh.release();
         createUniformBuffer();
+        createInstanceBuffer();
+        createOcclusionCuller();
+        createParticleSystem();
+        createTerrainRenderer();
         createDescriptorPool();
         createDescriptorSets();
         createCommandBuffer();
         createSyncObjects();
+        createStatisticsQueryPool();
+        createTimestampQueryPool();
+        if (isCapturing()) {
+            createFrameCapture();
+        }
+        startShaderHotReload();
     }
 
     void createInstance() {
@@ -182,7 +417,7 @@ class Game {
         appInfo.apiVersion = VK_API_VERSION_1_3;
 
         uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        const char** glfwExtensions = options.offscreen ? nullptr : glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
         VkInstanceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -198,6 +433,9 @@ class Game {
     }
 
     void createSurface() {
+        if (options.offscreen) {
+            return;
+        }
         if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
             throw std::runtime_error("Failed to create window surface");
         }
@@ -226,8 +464,50 @@ class Game {
         }
     }
 
+    // Everything createLogicalDevice() enables unconditionally must be checked
+    // here, as there is no fallback once the device is chosen.
     bool isDeviceSuitable(VkPhysicalDevice device) {
-        return findQueueFamilies(device).isComplete();
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_3) {
+            return false;
+        }
+
+        VkPhysicalDeviceVulkan13Features vulkan13Features = {};
+        vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+        VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        vulkan12Features.pNext = &vulkan13Features;
+
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &vulkan12Features;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        bool featuresSupported = vulkan13Features.dynamicRendering && vulkan13Features.synchronization2
+                                 && vulkan12Features.separateDepthStencilLayouts
+                                 && features.features.samplerAnisotropy && features.features.drawIndirectFirstInstance;
+        if (!featuresSupported) {
+            return false;
+        }
+
+        return findQueueFamilies(device).isComplete() && (options.offscreen || checkDeviceExtensionSupport(device));
+    }
+
+    bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+        std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+        for (const auto& extension : availableExtensions) {
+            requiredExtensions.erase(extension.extensionName);
+        }
+
+        return requiredExtensions.empty();
     }
 
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
@@ -270,16 +550,45 @@ class Game {
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
         VkPhysicalDeviceFeatures deviceFeatures = {};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
+        deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+        // Indirect draws select their range of the visible instance buffer.
+        deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+
+        // Rendering and barriers are recorded by the render graph.
+        VkPhysicalDeviceVulkan13Features vulkan13Features = {};
+        vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+        vulkan13Features.synchronization2 = VK_TRUE;
+        vulkan13Features.dynamicRendering = VK_TRUE;
+
+        // The depth buffer may have a stencil aspect (see findDepthFormat()), which
+        // the render graph leaves alone, using depth-only layouts and barriers.
+        VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        vulkan12Features.pNext = &vulkan13Features;
+        vulkan12Features.separateDepthStencilLayouts = VK_TRUE;
 
         VkDeviceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
         createInfo.queueCreateInfoCount = queueCreateInfos.size();
-        createInfo.enabledExtensionCount = deviceExtensions.size();
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        std::vector<const char*> enabledExtensions;
+        if (!options.offscreen) {
+            enabledExtensions = deviceExtensions;
+        }
+        memoryBudgetSupported = GpuMemoryTracker::isBudgetExtensionSupported(physicalDevice);
+        if (memoryBudgetSupported) {
+            enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
+        createInfo.enabledExtensionCount = enabledExtensions.size();
+        createInfo.ppEnabledExtensionNames = enabledExtensions.data();
         createInfo.pEnabledFeatures = &deviceFeatures;
+        createInfo.pNext = &vulkan12Features;
 
         if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
             throw std::runtime_error("Failed to create logical device");
@@ -288,7 +597,25 @@ class Game {
         vkGetDeviceQueue(device, indices.presentationFamily.value(), 0, &presentQueue);
     }
 
+    void createMemoryTracker() {
+        memoryTracker.init(device, physicalDevice, memoryBudgetSupported);
+
+        // Near the budget, textures give up their most detailed mip level. Cold
+        // assets would be evicted here too once there are more than the resident
+        // mesh and texture.
+        memoryTracker.addPressureHandler([this](MemoryPressure pressure) {
+            if (pressure != MemoryPressure::Normal) {
+                reduceTextureResolution();
+            }
+        });
+    }
+
     void createSwapChain() {
+        if (options.offscreen) {
+            createOffscreenTarget();
+            return;
+        }
+
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
 
         VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
@@ -310,6 +637,16 @@ class Game {
         createInfo.minImageCount = imageCount;
         createInfo.imageArrayLayers = 1;
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        swapChainSupportsUpscale = (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0;
+        if (swapChainSupportsUpscale) {
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        }
+        if (isCapturing()) {
+            if ((swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) == 0) {
+                throw std::runtime_error("Failed to create swap chain: frames cannot be copied out for capture");
+            }
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
         createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
         createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
         createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
@@ -327,6 +664,49 @@ class Game {
         vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
     }
 
+    // Stands in for the swapchain without a window, in the format the windowed
+    // path prefers, so captures from both compare equal.
+    void createOffscreenTarget() {
+        swapChainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
+        swapChainExtent = {static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT)};
+        swapChainSupportsUpscale = true;
+
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = swapChainExtent.width;
+        imageInfo.extent.height = swapChainExtent.height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = swapChainImageFormat;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkImage image;
+        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create offscreen image");
+        }
+        memoryTracker.trackObject(image, VK_OBJECT_TYPE_IMAGE, MemoryCategory::Attachment);
+
+        VkMemoryRequirements memoryRequirements;
+        vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memoryRequirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        if (memoryTracker.allocate(allocInfo, MemoryCategory::Attachment, &offscreenImageMemory) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate offscreen image memory");
+        }
+        vkBindImageMemory(device, image, offscreenImageMemory, 0);
+        swapChainImages = {image};
+    }
+
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device) {
         SwapChainSupportDetails details;
 
@@ -375,13 +755,16 @@ class Game {
             return capabilities.currentExtent;
         }
 
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+
         VkExtent2D actualExtent;
-        actualExtent.width = std::clamp(static_cast<uint32_t>(WIDTH), capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
-        actualExtent.height = std::clamp(static_cast<uint32_t>(HEIGHT), capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+        actualExtent.width = std::clamp(static_cast<uint32_t>(width), capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+        actualExtent.height = std::clamp(static_cast<uint32_t>(height), capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
         return actualExtent;
     }
 
-    VkImageView createImageView(VkImage image, VkFormat format) {
+    VkImageView createImageView(VkImage image, VkFormat format, uint32_t mipLevels = 1) {
         VkImageViewCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         createInfo.image = image;
@@ -397,7 +780,7 @@ class Game {
         createInfo.subresourceRange.baseArrayLayer = 0;
         createInfo.subresourceRange.baseMipLevel = 0;
         createInfo.subresourceRange.layerCount = 1;
-        createInfo.subresourceRange.levelCount = 1;
+        createInfo.subresourceRange.levelCount = mipLevels;
 
         VkImageView imageView;
         if (vkCreateImageView(device, &createInfo, nullptr, &imageView) != VK_SUCCESS) {
@@ -414,76 +797,152 @@ class Game {
         }
     }
 
-    void createRenderPass() {
-        VkAttachmentDescription colorAttachment = {};
-        colorAttachment.format = swapChainImageFormat;
-        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-        VkAttachmentReference colorAttachmentRef = {};
-        colorAttachmentRef.attachment = 0;
-        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    // Attachments sized to the swapchain, like the depth buffer, live in the render
+    // graph and follow the new extent on the next frame.
+    void recreateSwapChain() {
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        while (width == 0 || height == 0) {
+            glfwWaitEvents();
+            glfwGetFramebufferSize(window, &width, &height);
+        }
 
-        VkSubpassDescription subpass = {};
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 1;
-        subpass.pColorAttachments = &colorAttachmentRef;
+        vkDeviceWaitIdle(device);
+        cleanupSwapChain();
+        createSwapChain();
+        createImageViews();
 
-        VkSubpassDependency subpassDependency = {};
-        subpassDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        subpassDependency.dstSubpass = 0;
-        subpassDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        subpassDependency.srcAccessMask = 0;
-        subpassDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        subpassDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        // The ring is sized to the swapchain.
+        if (isCapturing()) {
+            frameCapture.collect();
+            frameCapture.destroy();
+            createFrameCapture();
+        }
+    }
 
-        VkRenderPassCreateInfo renderPassInfo = {};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassInfo.attachmentCount = 1;
-        renderPassInfo.pAttachments = &colorAttachment;
-        renderPassInfo.subpassCount = 1;
-        renderPassInfo.pSubpasses = &subpass;
-        renderPassInfo.dependencyCount = 1;
-        renderPassInfo.pDependencies = &subpassDependency;
-        
-        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create render pass");
+    void cleanupSwapChain() {
+        for (const auto& imageView : swapChainImageViews) {
+            vkDestroyImageView(device, imageView, nullptr);
+        }
+        if (options.offscreen) {
+            memoryTracker.untrackObject(swapChainImages[0]);
+            vkDestroyImage(device, swapChainImages[0], nullptr);
+            memoryTracker.free(offscreenImageMemory);
+            return;
         }
+        vkDestroySwapchainKHR(device, swapChain, nullptr);
     }
 
-    void createDescriptorSetLayout() {
-        VkDescriptorSetLayoutBinding uboLayoutBinding = {};
-        uboLayoutBinding.binding = 0;
-        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        uboLayoutBinding.descriptorCount = 1;
-        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    VkFormat findDepthFormat() {
+        const std::vector<VkFormat> candidates = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D16_UNORM};
+
+        for (VkFormat format : candidates) {
+            VkFormatProperties properties;
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+            // The depth pyramid for occlusion culling is built by sampling it.
+            VkFormatFeatureFlags required = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+            if ((properties.optimalTilingFeatures & required) == required) {
+                return format;
+            }
+        }
 
-        VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
-        samplerLayoutBinding.binding = 1;
-        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        samplerLayoutBinding.descriptorCount = 1;
-        samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        throw std::runtime_error("Failed to find supported depth format");
+    }
 
-        std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};
+    void createPipelineCache() {
+        pipelineLayoutCache.init(device);
 
-        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-        layoutInfo.pBindings = bindings.data();
+        VkPipelineCacheCreateInfo cacheInfo = {};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
 
-        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create descriptor set layout");
+        if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline cache");
         }
     }
 
+    // Compiles the scene's pipelines, and every variant in the pipeline list, on
+    // the job system before the first frame.
     void createGraphicsPipeline() {
-        auto vertShaderCode = readFile("shaders/build/vert.spv");
-        auto fragShaderCode = readFile("shaders/build/frag.spv");
+        PipelineVariantKey key;
+        key.vertexShader = mesh.vertexLayout() == MeshVertexLayout::Packed ? "shaders/build/vert_packed.spv" : "shaders/build/vert.spv";
+        key.fragmentShader = "shaders/build/frag.spv";
+        key.vertexLayout = mesh.vertexLayout();
+        key.blend = true;
+        key.colorFormat = swapChainImageFormat;
+        key.depthFormat = depthFormat;
+
+        Asset vertShaderCode = vfs.read(key.vertexShader);
+        Asset fragShaderCode = vfs.read(key.fragmentShader);
+        graphicsProgram = &pipelineLayoutCache.getProgramLayout({&vertShaderCode, &fragShaderCode});
+
+        graphicsPipelineKey = withDepthState(key, depthTestWrite);
+        graphicsPipelineDepthEqualKey = withDepthState(key, depthTestEqual);
+        depthPrepassPipelineKey = graphicsPipelineKey;
+        depthPrepassPipelineKey.depthOnly = true;
+
+        pipelineVariants.init(device, jobSystem, vfs, [this](const Vfs& shaderFiles, const PipelineVariantKey& variant, const VkSpecializationInfo& specialization) {
+            return buildGraphicsPipeline(shaderFiles, variant, specialization);
+        });
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<PipelineVariantKey> keys = {graphicsPipelineKey, graphicsPipelineDepthEqualKey, depthPrepassPipelineKey};
+        if (!options.pipelineListPath.empty()) {
+            std::vector<PipelineVariantKey> listed = PipelineVariantCache::readVariantList(options.pipelineListPath);
+            keys.insert(keys.end(), listed.begin(), listed.end());
+        }
+        pipelineVariants.precompile(keys);
+        pipelineVariants.waitForCompiles();
+
+        char milliseconds[16];
+        std::snprintf(milliseconds, sizeof(milliseconds), "%.1f", std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+        std::cout << "Compiled " << pipelineVariants.getStatistics().variants << " pipeline variants in " << milliseconds << " ms" << std::endl;
+    }
+
+    // Adds the variants used this run to the pipeline list, for the next run to
+    // precompile.
+    void destroyPipelineVariants() {
+        PipelineVariantStatistics statistics = pipelineVariants.getStatistics();
+        char milliseconds[16];
+        std::snprintf(milliseconds, sizeof(milliseconds), "%.2f", statistics.compileMilliseconds);
+        std::cout << statistics.variants << " pipeline variants, " << milliseconds << " ms per compile, " << statistics.fallbacks << " generic fallbacks" << std::endl;
+
+        if (!options.pipelineListPath.empty()) {
+            PipelineVariantCache::writeVariantList(options.pipelineListPath, pipelineVariants.getKeys());
+        }
+        pipelineVariants.destroy();
+    }
+
+    static PipelineVariantKey withDepthState(PipelineVariantKey key, DepthState depth) {
+        key.depthTest = depth.test;
+        key.depthWrite = depth.write;
+        key.depthCompareOp = depth.compareOp;
+        return key;
+    }
+
+    // The shaded variant of key itself, or the one specialized for the debug view.
+    PipelineVariantKey withDebugView(const PipelineVariantKey& key) const {
+        if (debugView == 0) {
+            return key;
+        }
+        PipelineVariantKey variant = key;
+        variant.specialization = {debugView};
+        return variant;
+    }
+
+    // Called from job threads, so it only reads state that stays fixed after
+    // initialization. A depth-only pipeline drops the fragment stage and color
+    // output but keeps the full program's layout.
+    VkPipeline buildGraphicsPipeline(const Vfs& shaderFiles, const PipelineVariantKey& key, const VkSpecializationInfo& specialization) {
+        Asset vertShaderCode = shaderFiles.read(key.vertexShader);
+        Asset fragShaderCode = shaderFiles.read(key.fragmentShader);
+
+        // Descriptor sets are allocated once against the initial layout, so a reload
+        // may change shader code but not the resources it binds.
+        const ProgramLayout& program = pipelineLayoutCache.getProgramLayout({&vertShaderCode, &fragShaderCode});
+        if (program.pipelineLayout != graphicsProgram->pipelineLayout) {
+            throw std::runtime_error("Shader resource layout changed, restart to apply");
+        }
 
         VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
         VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
@@ -493,12 +952,14 @@ class Game {
         vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
         vertShaderStageInfo.module = vertShaderModule;
         vertShaderStageInfo.pName = "main";
+        vertShaderStageInfo.pSpecializationInfo = &specialization;
 
         VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
         fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
         fragShaderStageInfo.module = fragShaderModule;
         fragShaderStageInfo.pName = "main";
+        fragShaderStageInfo.pSpecializationInfo = &specialization;
 
         VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
 
@@ -507,39 +968,29 @@ class Game {
             VK_DYNAMIC_STATE_SCISSOR
         };
 
-        auto bindingDescription = Vertex::getBindingDescription();
-        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+        VkPipelineDynamicStateCreateInfo dynamicStateInfo = {};
+        dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicStateInfo.pDynamicStates = dynamicStates.data();
+
+        VertexInputDescription vertexInput = program.getVertexInput(getVertexLayout(key.vertexLayout));
 
         VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
         vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 1;
-        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-        vertexInputInfo.vertexAttributeDescriptionCount = attributeDescriptions.size();
-        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexInput.bindings.size());
+        vertexInputInfo.pVertexBindingDescriptions = vertexInput.bindings.data();
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInput.attributes.size());
+        vertexInputInfo.pVertexAttributeDescriptions = vertexInput.attributes.data();
 
         VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
         inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
         inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
         inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
 
-        VkViewport viewport = {};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = static_cast<float>(swapChainExtent.width);
-        viewport.height = static_cast<float>(swapChainExtent.height);
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-
-        VkRect2D scissor = {};
-        scissor.offset = {0, 0};
-        scissor.extent = swapChainExtent;
-
         VkPipelineViewportStateCreateInfo viewportInfo = {};
         viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
         viewportInfo.viewportCount = 1;
-        viewportInfo.pViewports = &viewport;
         viewportInfo.scissorCount = 1;
-        viewportInfo.pScissors = &scissor;
 
         VkPipelineRasterizationStateCreateInfo rasterizerInfo = {};
         rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -547,7 +998,7 @@ class Game {
         rasterizerInfo.rasterizerDiscardEnable = VK_FALSE;
         rasterizerInfo.polygonMode = VK_POLYGON_MODE_FILL;
         rasterizerInfo.lineWidth = 1.0f;
-        rasterizerInfo.cullMode = VK_CULL_MODE_NONE;
+        rasterizerInfo.cullMode = key.cullMode;
         rasterizerInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
         rasterizerInfo.depthBiasEnable = VK_FALSE;
 
@@ -556,9 +1007,17 @@ class Game {
         multisamplingInfo.sampleShadingEnable = VK_FALSE;
         multisamplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
+        VkPipelineDepthStencilStateCreateInfo depthStencilInfo = {};
+        depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencilInfo.depthTestEnable = key.depthTest ? VK_TRUE : VK_FALSE;
+        depthStencilInfo.depthWriteEnable = key.depthWrite ? VK_TRUE : VK_FALSE;
+        depthStencilInfo.depthCompareOp = key.depthCompareOp;
+        depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
+        depthStencilInfo.stencilTestEnable = VK_FALSE;
+
         VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
         colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachment.blendEnable = VK_TRUE;
+        colorBlendAttachment.blendEnable = key.blend ? VK_TRUE : VK_FALSE;
         colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
         colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
         colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
@@ -569,42 +1028,45 @@ class Game {
         VkPipelineColorBlendStateCreateInfo colorBlendInfo = {};
         colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
         colorBlendInfo.logicOpEnable = VK_FALSE;
-        colorBlendInfo.attachmentCount = 1;
+        colorBlendInfo.attachmentCount = key.depthOnly ? 0 : 1;
         colorBlendInfo.pAttachments = &colorBlendAttachment;
 
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 1;
-        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-
-        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create pipeline layout");
-        }
+        VkPipelineRenderingCreateInfo renderingInfo = {};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        renderingInfo.colorAttachmentCount = key.depthOnly ? 0 : 1;
+        renderingInfo.pColorAttachmentFormats = &key.colorFormat;
+        renderingInfo.depthAttachmentFormat = key.depthFormat;
 
         VkGraphicsPipelineCreateInfo pipelineInfo = {};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2;
+        pipelineInfo.pNext = &renderingInfo;
+        pipelineInfo.stageCount = key.depthOnly ? 1 : 2;
         pipelineInfo.pStages = shaderStages;
         pipelineInfo.pVertexInputState = &vertexInputInfo;
         pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
         pipelineInfo.pViewportState = &viewportInfo;
         pipelineInfo.pRasterizationState = &rasterizerInfo;
         pipelineInfo.pMultisampleState = &multisamplingInfo;
+        pipelineInfo.pDepthStencilState = &depthStencilInfo;
         pipelineInfo.pColorBlendState = &colorBlendInfo;
-        pipelineInfo.pDynamicState = nullptr;
-        pipelineInfo.layout = pipelineLayout;
-        pipelineInfo.renderPass = renderPass;
-        pipelineInfo.subpass = 0;
+        pipelineInfo.pDynamicState = &dynamicStateInfo;
+        pipelineInfo.layout = program.pipelineLayout;
+        pipelineInfo.renderPass = VK_NULL_HANDLE;
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create graphics pipeline");
-        }
+        VkPipeline pipeline;
+        VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
 
         vkDestroyShaderModule(device, vertShaderModule, nullptr);
         vkDestroyShaderModule(device, fragShaderModule, nullptr);
+
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create graphics pipeline");
+        }
+
+        return pipeline;
     }
 
-    VkShaderModule createShaderModule(const std::vector<char>& code) {
+    VkShaderModule createShaderModule(const Asset& code) {
         VkShaderModuleCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
         createInfo.codeSize = code.size();
@@ -618,26 +1080,6 @@ class Game {
         return shaderModule;
     }
 
-    void createFramebuffers() {
-        swapChainFramebuffers.resize(swapChainImageViews.size());
-        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            VkImageView attachments[] = {swapChainImageViews[i]};
-
-            VkFramebufferCreateInfo framebufferInfo = {};
-            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferInfo.renderPass = renderPass;
-            framebufferInfo.attachmentCount = 1;
-            framebufferInfo.pAttachments = attachments;
-            framebufferInfo.width = swapChainExtent.width;
-            framebufferInfo.height = swapChainExtent.height;
-            framebufferInfo.layers = 1;
-
-            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
-                throw std::runtime_error("Failed to create framebuffer");
-            }
-        }
-    }
-
     void createCommandPool() {
         QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
 
@@ -651,34 +1093,74 @@ class Game {
         }
     }
 
-    void createTextureImage() {
+    // Decodes the texture and builds its full mip chain on the CPU, once.
+    void loadTexture() {
         int texWidth, texHeight, texChannels;
-        stbi_uc *pixels = stbi_load("textures/cat.png", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-        VkDeviceSize imageSize = texWidth * texHeight * 4;
+        Asset textureAsset = readFile("textures/cat.png");
+        stbi_uc *pixels = stbi_load_from_memory(textureAsset.data(), static_cast<int>(textureAsset.size()), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
 
         if (!pixels) {
             throw std::runtime_error("Failed to load texture image");
         }
 
+        textureLevels.clear();
+        textureLevelExtents.clear();
+        textureLevels.emplace_back(pixels, pixels + static_cast<size_t>(texWidth) * texHeight * 4);
+        textureLevelExtents.push_back({static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight)});
+        stbi_image_free(pixels);
+
+        while (textureLevelExtents.back().width > 1 || textureLevelExtents.back().height > 1) {
+            VkExtent2D extent = textureLevelExtents.back();
+            textureLevels.push_back(downsampleTexture(textureLevels.back(), extent));
+            textureLevelExtents.push_back({std::max(1u, extent.width / 2), std::max(1u, extent.height / 2)});
+        }
+    }
+
+    // Uploads the mip chain loaded by loadTexture(); textureSkippedMips levels
+    // are left off the top when memory is short.
+    void createTextureImage() {
+        const std::vector<std::vector<stbi_uc>>& levels = textureLevels;
+        const std::vector<VkExtent2D>& levelExtents = textureLevelExtents;
+
+        uint32_t firstLevel = std::min(textureSkippedMips, static_cast<uint32_t>(levels.size()) - 1);
+        textureMipLevels = static_cast<uint32_t>(levels.size()) - firstLevel;
+
+        VkDeviceSize imageSize = 0;
+        std::vector<VkBufferImageCopy> regions;
+        for (uint32_t level = firstLevel; level < levels.size(); level++) {
+            VkBufferImageCopy region = {};
+            region.bufferOffset = imageSize;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = level - firstLevel;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = {0, 0, 0};
+            region.imageExtent = {levelExtents[level].width, levelExtents[level].height, 1};
+            regions.push_back(region);
+
+            imageSize += levels[level].size();
+        }
+
         VkBuffer stagingBuffer;
         VkDeviceMemory stagingBufferMemory;
 
-        createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+        createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging, stagingBuffer, stagingBufferMemory);
 
         void *data;
         vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-        memcpy(data, pixels, static_cast<size_t>(imageSize));
+        for (size_t i = 0; i < regions.size(); i++) {
+            const std::vector<stbi_uc>& level = levels[firstLevel + i];
+            memcpy(static_cast<char *>(data) + regions[i].bufferOffset, level.data(), level.size());
+        }
         vkUnmapMemory(device, stagingBufferMemory);
 
-        stbi_image_free(pixels);
-
         VkImageCreateInfo imageInfo = {};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         imageInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageInfo.extent.width = static_cast<uint32_t>(texWidth);
-        imageInfo.extent.height = static_cast<uint32_t>(texHeight);
+        imageInfo.extent.width = levelExtents[firstLevel].width;
+        imageInfo.extent.height = levelExtents[firstLevel].height;
         imageInfo.extent.depth = 1;
-        imageInfo.mipLevels = 1;
+        imageInfo.mipLevels = textureMipLevels;
         imageInfo.arrayLayers = 1;
         imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
         imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
@@ -690,6 +1172,7 @@ class Game {
         if (vkCreateImage(device, &imageInfo, nullptr, &textureImage) != VK_SUCCESS) {
             throw std::runtime_error("Failed to create texture image");
         }
+        memoryTracker.trackObject(textureImage, VK_OBJECT_TYPE_IMAGE, MemoryCategory::Texture);
 
         VkMemoryRequirements memoryRequirements;
         vkGetImageMemoryRequirements(device, textureImage, &memoryRequirements);
@@ -699,83 +1182,96 @@ class Game {
         allocInfo.allocationSize = memoryRequirements.size;
         allocInfo.memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &textureImageMemory) != VK_SUCCESS) {
+        if (memoryTracker.allocate(allocInfo, MemoryCategory::Texture, &textureImageMemory) != VK_SUCCESS) {
             throw std::runtime_error("Failed to allocate texture image memory");
         }
 
         vkBindImageMemory(device, textureImage, textureImageMemory, 0);
 
-        transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-        copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-        transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
-    }
-
-    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
         VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        recordImageTransition(commandBuffer, textureImage, VK_IMAGE_ASPECT_COLOR_BIT, ImageUsage::Undefined, ImageUsage::TransferDst, textureMipLevels);
+        vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+        recordImageTransition(commandBuffer, textureImage, VK_IMAGE_ASPECT_COLOR_BIT, ImageUsage::TransferDst, ImageUsage::SampledGraphics, textureMipLevels);
+        endSingleTimeCommands(commandBuffer);
 
-        VkImageMemoryBarrier barrier = {};
-        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.oldLayout = oldLayout;
-        barrier.newLayout = newLayout;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.image = image;
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.layerCount = 1;
-        barrier.subresourceRange.levelCount = 1;
-
-        VkPipelineStageFlags sourceStage;
-        VkPipelineStageFlags destinationStage;
-
-        if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-            barrier.srcAccessMask = 0;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        destroyBuffer(stagingBuffer, stagingBufferMemory);
 
-            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-            destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        // Skipped levels never come back.
+        for (uint32_t level = 0; level < firstLevel; level++) {
+            std::vector<stbi_uc>().swap(textureLevels[level]);
         }
-        else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    }
 
-            sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-            destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-        }
-        else {
-            throw std::runtime_error("Unsupported layout transition");
-        }
+    // 2x2 box filter, averaged in linear space since the texture is sRGB. Rows
+    // are filtered in parallel.
+    std::vector<stbi_uc> downsampleTexture(const std::vector<stbi_uc>& source, VkExtent2D extent) {
+        uint32_t width = std::max(1u, extent.width / 2);
+        uint32_t height = std::max(1u, extent.height / 2);
+        std::vector<stbi_uc> destination(static_cast<size_t>(width) * height * 4);
 
-        vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        jobSystem.parallelFor(0, height, jobSystem.batchSizeFor(height, TEXTURE_ROWS_PER_JOB), [&](size_t firstRow, size_t lastRow) {
+            for (size_t y = firstRow; y < lastRow; y++) {
+                downsampleTextureRow(source, extent, &destination[y * width * 4], width, static_cast<uint32_t>(y));
+            }
+        });
 
-        endSingleTimeCommands(commandBuffer);
+        return destination;
     }
 
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    static void downsampleTextureRow(const std::vector<stbi_uc>& source, VkExtent2D extent, stbi_uc *row, uint32_t width, uint32_t y) {
+        auto toLinear = [](stbi_uc value) {
+            float c = value / 255.0f;
+            return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        };
+        auto toSrgb = [](float c) {
+            c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+            return static_cast<stbi_uc>(std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f));
+        };
 
-        VkBufferImageCopy region = {};
-        region.bufferOffset = 0;
-        region.bufferRowLength = 0;
-        region.bufferImageHeight = 0;
+        uint32_t y0 = std::min(y * 2, extent.height - 1), y1 = std::min(y * 2 + 1, extent.height - 1);
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t x0 = std::min(x * 2, extent.width - 1), x1 = std::min(x * 2 + 1, extent.width - 1);
+            const stbi_uc *texels[4] = {
+                &source[(static_cast<size_t>(y0) * extent.width + x0) * 4],
+                &source[(static_cast<size_t>(y0) * extent.width + x1) * 4],
+                &source[(static_cast<size_t>(y1) * extent.width + x0) * 4],
+                &source[(static_cast<size_t>(y1) * extent.width + x1) * 4]
+            };
+
+            stbi_uc *texel = &row[x * 4];
+            for (int channel = 0; channel < 3; channel++) {
+                float sum = 0.0f;
+                for (const stbi_uc *sample : texels) {
+                    sum += toLinear(sample[channel]);
+                }
+                texel[channel] = toSrgb(sum / 4.0f);
+            }
+            texel[3] = static_cast<stbi_uc>((texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3] + 2) / 4);
+        }
+    }
 
-        region.imageOffset = {0, 0, 0};
-        region.imageExtent = {width, height, 1};
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.baseArrayLayer = 0;
-        region.imageSubresource.layerCount = 1;
-        region.imageSubresource.mipLevel = 0;
+    // Called under memory pressure, when the GPU is done with the previous frame.
+    void reduceTextureResolution() {
+        if (textureMipLevels <= MIN_TEXTURE_MIP_LEVELS) {
+            return;
+        }
 
-        vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        textureSkippedMips++;
+        destroyTextureImage();
+        createTextureImage();
+        createTextureImageView();
+        writeTextureDescriptor();
+        std::cout << "Memory pressure: texture reduced to " << textureMipLevels << " mip levels" << std::endl;
+    }
 
-        endSingleTimeCommands(commandBuffer);
+    void destroyTextureImage() {
+        vkDestroyImageView(device, textureImageView, nullptr);
+        memoryTracker.untrackObject(textureImage);
+        vkDestroyImage(device, textureImage, nullptr);
+        memoryTracker.free(textureImageMemory);
     }
 
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory) {
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryCategory category, VkBuffer &buffer, VkDeviceMemory &bufferMemory) {
         VkBufferCreateInfo bufferInfo = {};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.size = size;
@@ -785,6 +1281,7 @@ class Game {
         if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
             throw std::runtime_error("Failed to create buffer");
         }
+        memoryTracker.trackObject(buffer, VK_OBJECT_TYPE_BUFFER, category);
 
         VkMemoryRequirements memoryRequirements;
         vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
@@ -794,13 +1291,19 @@ class Game {
         allocInfo.allocationSize = memoryRequirements.size;
         allocInfo.memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, properties);
 
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
+        if (memoryTracker.allocate(allocInfo, category, &bufferMemory) != VK_SUCCESS) {
             throw std::runtime_error("Failed to allocate buffer memory");
         }
 
         vkBindBufferMemory(device, buffer, bufferMemory, 0);
     }
 
+    void destroyBuffer(VkBuffer buffer, VkDeviceMemory bufferMemory) {
+        memoryTracker.untrackObject(buffer);
+        vkDestroyBuffer(device, buffer, nullptr);
+        memoryTracker.free(bufferMemory);
+    }
+
     VkCommandBuffer beginSingleTimeCommands() {
         VkCommandBufferAllocateInfo allocInfo = {};
         allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -846,7 +1349,7 @@ class Game {
     }
 
     void createTextureImageView() {
-        textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB);
+        textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, textureMipLevels);
     }
 
     void createTextureSampler() {
@@ -875,64 +1378,260 @@ class Game {
         samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
         samplerInfo.mipLodBias = 0;
         samplerInfo.minLod = 0;
-        samplerInfo.maxLod = 0;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
         if (vkCreateSampler(device, &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS) {
             throw std::runtime_error("Failed to create texture sampler");
         }
     }
 
+    void loadMesh() {
+        mesh.load(vfs, "meshes/build/quad.mesh");
+    }
+
     void createVertexBuffer() {
-        VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+        VkDeviceSize bufferSize = mesh.vertexDataSize();
 
         VkBuffer stagingBuffer;
         VkDeviceMemory stagingBufferMemory;
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging, stagingBuffer, stagingBufferMemory);
 
         void *data;
         vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, vertices.data(), bufferSize);
+        memcpy(data, mesh.vertexData(), bufferSize);
         vkUnmapMemory(device, stagingBufferMemory);
 
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Buffer, vertexBuffer, vertexBufferMemory);
         copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        destroyBuffer(stagingBuffer, stagingBufferMemory);
     }
 
     void createIndexBuffer() {
-        VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+        VkDeviceSize bufferSize = mesh.indexDataSize();
 
         VkBuffer stagingBuffer;
         VkDeviceMemory stagingBufferMemory;
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging, stagingBuffer, stagingBufferMemory);
 
         void *data;
         vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, indices.data(), bufferSize);
+        memcpy(data, mesh.indexData(), bufferSize);
         vkUnmapMemory(device, stagingBufferMemory);
 
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Buffer, indexBuffer, indexBufferMemory);
         copyBuffer(stagingBuffer, indexBuffer, bufferSize);
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        destroyBuffer(stagingBuffer, stagingBufferMemory);
     }
 
     void createUniformBuffer() {
         VkDeviceSize bufferSize = sizeof(UniformBufferObject);
 
-        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffer, uniformBufferMemory);
+        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Buffer, uniformBuffer, uniformBufferMemory);
         vkMapMemory(device, uniformBufferMemory, 0, bufferSize, 0, &uniformBufferMapped);
     }
 
+    // Per-instance model matrices, written by the scene systems every frame.
+    void createInstanceBuffer() {
+        VkDeviceSize bufferSize = sizeof(glm::mat4) * MAX_INSTANCES;
+
+        createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Buffer, instanceBuffer, instanceBufferMemory);
+        vkMapMemory(device, instanceBufferMemory, 0, bufferSize, 0, reinterpret_cast<void **>(&instanceBufferMapped));
+    }
+
+    void createOcclusionCuller() {
+        occlusionCuller.init(device, physicalDevice, memoryTracker, pipelineLayoutCache, pipelineCache, vfs, MAX_INSTANCES, MAX_DRAW_BATCHES);
+        occlusionReportTime = std::chrono::steady_clock::now();
+    }
+
+    bool isCapturing() const {
+        return !options.captureDirectory.empty();
+    }
+
+    // Offscreen runs are for tests, which need every frame; windowed captures
+    // drop frames rather than hold the frame rate back.
+    void createFrameCapture() {
+        frameCapture.init(device, physicalDevice, memoryTracker, jobSystem, swapChainExtent, swapChainImageFormat, options.captureDirectory, options.captureFormat, options.offscreen);
+    }
+
+    bool isReplaying() const {
+        return !options.replayPath.empty();
+    }
+
+    bool isTimingFrames() const {
+        return !options.timingsPath.empty() || !options.baselinePath.empty();
+    }
+
+    // Asset reads go into the frame log, or are checked against it on replay.
+    void observeAssetReads() {
+        if (options.recordPath.empty() && !isReplaying()) {
+            return;
+        }
+        vfs.setReadObserver([this](const std::string& path, size_t size) {
+            std::lock_guard<std::mutex> lock(frameLoadsMutex);
+            frameLoads.push_back({path, size});
+        });
+    }
+
+    // Sorted, since pipeline variants read their shaders from job threads in no
+    // particular order.
+    std::vector<ResourceLoad> takeFrameLoads() {
+        std::vector<ResourceLoad> loads;
+        {
+            std::lock_guard<std::mutex> lock(frameLoadsMutex);
+            loads.swap(frameLoads);
+        }
+        std::sort(loads.begin(), loads.end(), [](const ResourceLoad& a, const ResourceLoad& b) {
+            return a.path != b.path ? a.path < b.path : a.size < b.size;
+        });
+        return loads;
+    }
+
+    // A recording only replays into a frame of the same size, at the same tick rate.
+    void startFrameLog() {
+        if (!options.recordPath.empty()) {
+            frameLogWriter.open(options.recordPath, swapChainExtent.width, swapChainExtent.height, simulation.getTickSeconds());
+        }
+        if (!isReplaying()) {
+            return;
+        }
+        const FrameLogHeader& header = replayLog.header;
+        if (header.width != swapChainExtent.width || header.height != swapChainExtent.height) {
+            throw std::runtime_error("Failed to replay " + options.replayPath + ": recorded at " + std::to_string(header.width) + "x" + std::to_string(header.height)
+                                     + ", rendering at " + std::to_string(swapChainExtent.width) + "x" + std::to_string(swapChainExtent.height));
+        }
+        if (header.tickSeconds != simulation.getTickSeconds()) {
+            throw std::runtime_error("Failed to replay " + options.replayPath + ": recorded at a different simulation tick rate");
+        }
+    }
+
+    // Applies the input recorded for the next frame in place of live input, after
+    // waiting for the frame's recorded time when pacing.
+    void replayInput() {
+        if (replayedInputFrame == frameNumber) {
+            return;
+        }
+        replayedInputFrame = frameNumber;
+
+        const FrameRecord& frame = replayLog.frames[frameNumber];
+        if (options.pacedReplay) {
+            if (frameNumber == 0) {
+                frameLogStartTime = std::chrono::steady_clock::now();
+            }
+            std::this_thread::sleep_until(frameLogStartTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(frame.wallSeconds)));
+        }
+        for (const InputEvent& input : frame.inputs) {
+            applyInput(input);
+        }
+    }
+
+    // The state to draw this frame, from the simulation thread or, on replay,
+    // stepped to the recorded tick. Records or checks the frame on the way.
+    SimulationState sampleSimulation() {
+        SimulationState state;
+        if (isReplaying()) {
+            const FrameRecord& frame = replayLog.frames[frameNumber];
+            state = simulation.sampleTick(frame.state.tick, frame.blend);
+            if (state.time != frame.state.time || state.modelAngle != frame.state.modelAngle) {
+                replayDivergedFrames++;
+            }
+            if (takeFrameLoads() != frame.loads) {
+                replayLoadMismatches++;
+            }
+            resolutionScaler.setScale(frame.renderScale);
+        }
+        else {
+            float blend;
+            state = simulation.sample(std::chrono::steady_clock::now(), &blend);
+            if (frameLogWriter.isOpen()) {
+                if (frameNumber == 0) {
+                    frameLogStartTime = std::chrono::steady_clock::now();
+                }
+                FrameRecord frame;
+                frame.state = state;
+                frame.blend = blend;
+                frame.renderScale = resolutionScaler.getScale();
+                frame.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - frameLogStartTime).count();
+                frame.inputs = frameInputs;
+                frame.loads = takeFrameLoads();
+                frameLogWriter.writeFrame(frame);
+            }
+        }
+        frameInputs.clear();
+        return state;
+    }
+
+    // Called once the run is over. Throws when the timings regressed.
+    void reportFrameTimings() {
+        if (isReplaying()) {
+            std::cout << "Replayed " << frameNumber << " frames of " << options.replayPath;
+            if (replayDivergedFrames > 0) {
+                std::cout << ", " << replayDivergedFrames << " diverged from the recorded simulation state";
+            }
+            if (replayLoadMismatches > 0) {
+                std::cout << ", " << replayLoadMismatches << " read different assets than recorded";
+            }
+            std::cout << std::endl;
+        }
+        if (!options.timingsPath.empty()) {
+            writeFrameTimings(options.timingsPath, frameTimings);
+            std::cout << "Frame timings written to " << options.timingsPath << std::endl;
+        }
+        if (options.baselinePath.empty()) {
+            return;
+        }
+
+        TimingComparison comparison = compareFrameTimings(baselineTimings, frameTimings, options.regressionThreshold, TIMING_WARMUP_FRAMES);
+        std::cout << comparison.report;
+        if (comparison.regressed) {
+            throw std::runtime_error("Frame timings regressed more than " + std::to_string(static_cast<int>(options.regressionThreshold * 100.0f + 0.5f)) + "% against " + options.baselinePath);
+        }
+    }
+
+    void createParticleSystem() {
+        particleSystem.init(device, physicalDevice, memoryTracker, pipelineLayoutCache, pipelineCache, vfs, swapChainImageFormat, depthFormat, MAX_PARTICLES);
+        particleReportTime = std::chrono::steady_clock::now();
+    }
+
+    void createTerrainRenderer() {
+        terrainRenderer.init(device, physicalDevice, memoryTracker, pipelineLayoutCache, pipelineCache, vfs, swapChainImageFormat, depthFormat, TERRAIN_VERTEX_BYTES, TERRAIN_INDEX_BYTES, TERRAIN_UPLOAD_BYTES);
+    }
+
+    void createScene() {
+        const MeshFileHeader& header = mesh.getHeader();
+        glm::vec3 boundsMin(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+        glm::vec3 boundsMax(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+
+        for (uint32_t layer = 0; layer < SCENE_LAYERS; layer++) {
+            Entity entity = world.create();
+            Transform transform;
+            transform.position = glm::vec3(0.0f, 0.0f, SCENE_LAYER_SPACING * layer);
+            world.add(entity, transform);
+            world.add(entity, MeshId{0});
+            world.add(entity, TextureId{0});
+            world.add(entity, Bounds{boundsMin, boundsMax, boundsMin, boundsMax});
+            world.add(entity, Spin{glm::vec3(0.0f, 0.0f, 1.0f)});
+        }
+
+        for (int z = -TERRAIN_DEPTH; z < 0; z++) {
+            for (int y = -TERRAIN_HALF_WIDTH; y < TERRAIN_HALF_WIDTH; y++) {
+                for (int x = -TERRAIN_HALF_WIDTH; x < TERRAIN_HALF_WIDTH; x++) {
+                    terrain.setBlock(glm::ivec3(x, y, z), TERRAIN_BLOCK);
+                }
+            }
+        }
+        for (int y = -TERRAIN_HALF_WIDTH + LAMP_SPACING / 2; y < TERRAIN_HALF_WIDTH; y += LAMP_SPACING) {
+            for (int x = -TERRAIN_HALF_WIDTH + LAMP_SPACING / 2; x < TERRAIN_HALF_WIDTH; x += LAMP_SPACING) {
+                terrain.setBlock(glm::ivec3(x, y, -LAMP_DEPTH), LAMP_BLOCK);
+            }
+        }
+        terrainLight.setEmission(LAMP_BLOCK, LAMP_LIGHT);
+        terrainLight.build(terrain);
+    }
+
     void createDescriptorPool() {
-        std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSizes[0].descriptorCount = 1;
-        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        poolSizes[1].descriptorCount = 1;
+        std::vector<VkDescriptorPoolSize> poolSizes = graphicsProgram->getPoolSizes(1);
 
         VkDescriptorPoolCreateInfo poolInfo = {};
         poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -950,7 +1649,7 @@ class Game {
         allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
         allocInfo.descriptorPool = descriptorPool;
         allocInfo.descriptorSetCount = 1;
-        allocInfo.pSetLayouts = &descriptorSetLayout;
+        allocInfo.pSetLayouts = &graphicsProgram->setLayouts[0];
 
         if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
             throw std::runtime_error("Failed to allocate descriptor sets");
@@ -966,27 +1665,78 @@ class Game {
         imageInfo.imageView = textureImageView;
         imageInfo.sampler = textureSampler;
 
-        std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+        VkDescriptorBufferInfo instanceInfo = {};
+        instanceInfo.buffer = instanceBuffer;
+        instanceInfo.offset = 0;
+        instanceInfo.range = sizeof(glm::mat4) * MAX_INSTANCES;
+
+        const ReflectedBinding& uboBinding = graphicsProgram->getBinding("ubo");
+        const ReflectedBinding& samplerBinding = graphicsProgram->getBinding("texSampler");
+        VkDescriptorBufferInfo visibleInstanceInfo = {};
+        visibleInstanceInfo.buffer = occlusionCuller.getVisibleInstanceBuffer();
+        visibleInstanceInfo.offset = 0;
+        visibleInstanceInfo.range = occlusionCuller.getVisibleInstanceBufferSize();
+
+        const ReflectedBinding& instanceBinding = graphicsProgram->getBinding("instances");
+        const ReflectedBinding& visibleInstanceBinding = graphicsProgram->getBinding("visibleInstances");
+
+        std::array<VkWriteDescriptorSet, 4> descriptorWrites = {};
 
         descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         descriptorWrites[0].dstSet = descriptorSet;
-        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstBinding = uboBinding.binding;
         descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[0].descriptorType = uboBinding.type;
         descriptorWrites[0].descriptorCount = 1;
         descriptorWrites[0].pBufferInfo = &bufferInfo;
 
         descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         descriptorWrites[1].dstSet = descriptorSet;
-        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].dstBinding = samplerBinding.binding;
         descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[1].descriptorType = samplerBinding.type;
         descriptorWrites[1].descriptorCount = 1;
         descriptorWrites[1].pImageInfo = &imageInfo;
 
+        descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[2].dstSet = descriptorSet;
+        descriptorWrites[2].dstBinding = instanceBinding.binding;
+        descriptorWrites[2].dstArrayElement = 0;
+        descriptorWrites[2].descriptorType = instanceBinding.type;
+        descriptorWrites[2].descriptorCount = 1;
+        descriptorWrites[2].pBufferInfo = &instanceInfo;
+
+        descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[3].dstSet = descriptorSet;
+        descriptorWrites[3].dstBinding = visibleInstanceBinding.binding;
+        descriptorWrites[3].dstArrayElement = 0;
+        descriptorWrites[3].descriptorType = visibleInstanceBinding.type;
+        descriptorWrites[3].descriptorCount = 1;
+        descriptorWrites[3].pBufferInfo = &visibleInstanceInfo;
+
         vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
     }
 
+    void writeTextureDescriptor() {
+        VkDescriptorImageInfo imageInfo = {};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = textureImageView;
+        imageInfo.sampler = textureSampler;
+
+        const ReflectedBinding& samplerBinding = graphicsProgram->getBinding("texSampler");
+
+        VkWriteDescriptorSet descriptorWrite = {};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = descriptorSet;
+        descriptorWrite.dstBinding = samplerBinding.binding;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = samplerBinding.type;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+    }
+
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
         VkPhysicalDeviceMemoryProperties memoryProperties;
         vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
@@ -1027,7 +1777,189 @@ class Game {
         }
     }
 
+    // Counts fragment shader invocations per frame so the effect of the depth
+    // prepass on overdraw can be measured. Not every device supports this.
+    void createStatisticsQueryPool() {
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+        if (!supportedFeatures.pipelineStatisticsQuery) {
+            return;
+        }
+
+        VkQueryPoolCreateInfo queryPoolInfo = {};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        queryPoolInfo.queryCount = 1;
+        queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+        if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &statisticsQueryPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create query pool");
+        }
+        statisticsReportTime = std::chrono::steady_clock::now();
+    }
+
+    // Called once the previous frame's fence has signaled.
+    void collectPipelineStatistics() {
+        if (!statisticsQueryPending) {
+            return;
+        }
+
+        uint64_t invocations = 0;
+        if (vkGetQueryPoolResults(device, statisticsQueryPool, 0, 1, sizeof(invocations), &invocations, sizeof(invocations), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+            fragmentInvocations += invocations;
+            statisticsFrames++;
+        }
+        statisticsQueryPending = false;
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - statisticsReportTime >= std::chrono::seconds(1) && statisticsFrames > 0) {
+            std::cout << "Depth prepass " << (depthPrepass ? "on" : "off") << ": " << fragmentInvocations / statisticsFrames
+                      << " fragment shader invocations per frame (" << SCENE_LAYERS << " layers, " << renderExtent.width << "x" << renderExtent.height << ")" << std::endl;
+            fragmentInvocations = 0;
+            statisticsFrames = 0;
+            statisticsReportTime = now;
+        }
+    }
+
+    // Called once the previous frame's fence has signaled, after its GPU time has
+    // been collected. Reports per-frame averages once a second, so toggling
+    // occlusion culling shows what it saves.
+    void collectOcclusionStatistics() {
+        OcclusionStatistics statistics = occlusionCuller.getStatistics();
+        occlusionTotals.earlyDrawn += statistics.earlyDrawn;
+        occlusionTotals.lateDrawn += statistics.lateDrawn;
+        occlusionTotals.occluded += statistics.occluded;
+        occlusionTotals.frustumCulled += statistics.frustumCulled + sceneSystems.getCulledCount();
+        occlusionGpuMilliseconds += gpuFrameMilliseconds;
+        occlusionFrames++;
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - occlusionReportTime >= std::chrono::seconds(1)) {
+            char gpuTime[16];
+            std::snprintf(gpuTime, sizeof(gpuTime), "%.2f", occlusionGpuMilliseconds / occlusionFrames);
+            std::cout << "Occlusion culling " << (occlusionCuller.isEnabled() ? "on" : "off") << ": " << occlusionTotals.earlyDrawn / occlusionFrames
+                      << " drawn early, " << occlusionTotals.lateDrawn / occlusionFrames << " drawn late, " << occlusionTotals.occluded / occlusionFrames
+                      << " occluded, " << occlusionTotals.frustumCulled / occlusionFrames << " frustum culled per frame, GPU " << gpuTime << " ms" << std::endl;
+            resetOcclusionStatistics();
+            occlusionReportTime = now;
+        }
+    }
+
+    // Called after collectGpuFrameTime. Reports the particle passes' cost once a
+    // second as particles simulated per millisecond of GPU time.
+    void collectParticleStatistics() {
+        ParticleStatistics statistics = particleSystem.getStatistics();
+        particlesSimulated += statistics.simulated;
+        particleGpuTotal += particleGpuMilliseconds;
+        particleFrames++;
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - particleReportTime >= std::chrono::seconds(1)) {
+            if (particlesSimulated > 0 && particleGpuTotal > 0.0f) {
+                char gpuTime[16];
+                std::snprintf(gpuTime, sizeof(gpuTime), "%.3f", particleGpuTotal / particleFrames);
+                std::cout << "Particles: " << statistics.alive << " alive, " << particlesSimulated / particleFrames << " simulated per frame, GPU "
+                          << gpuTime << " ms, " << static_cast<uint64_t>(particlesSimulated / particleGpuTotal) << " per ms" << std::endl;
+            }
+            particlesSimulated = 0;
+            particleGpuTotal = 0.0f;
+            particleFrames = 0;
+            particleReportTime = now;
+        }
+    }
+
+    void resetOcclusionStatistics() {
+        occlusionTotals = {};
+        occlusionGpuMilliseconds = 0.0f;
+        occlusionFrames = 0;
+    }
+
+    // Measures GPU time per frame for the resolution scaler, and that of the
+    // particle passes.
+    void createTimestampQueryPool() {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+        uint32_t validBits = queueFamilies[indices.graphicsFamily.value()].timestampValidBits;
+        if (validBits == 0) {
+            return;
+        }
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        timestampPeriod = properties.limits.timestampPeriod;
+        timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+        VkQueryPoolCreateInfo queryPoolInfo = {};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = 4;
+
+        if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create query pool");
+        }
+        particleSystem.setTimestampQueries(timestampQueryPool, 2);
+    }
+
+    // Called once the previous frame's fence has signaled.
+    void collectGpuFrameTime() {
+        if (!timestampQueryPending) {
+            return;
+        }
+        timestampQueryPending = false;
+
+        uint64_t timestamps[4];
+        if (vkGetQueryPoolResults(device, timestampQueryPool, 0, 4, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+            return;
+        }
+
+        float gpuMilliseconds = static_cast<float>(((timestamps[1] - timestamps[0]) & timestampMask) * timestampPeriod / 1e6);
+        resolutionScaler.update(gpuMilliseconds);
+        PROFILE_COUNTER("GPU frame ms", gpuMilliseconds);
+        PROFILE_COUNTER("Render scale", resolutionScaler.getScale());
+        gpuFrameMilliseconds = gpuMilliseconds;
+        if (isTimingFrames() && !frameTimings.empty()) {
+            frameTimings.back().gpuMilliseconds = gpuMilliseconds;
+        }
+        particleGpuMilliseconds = static_cast<float>(((timestamps[3] - timestamps[2]) & timestampMask) * timestampPeriod / 1e6);
+    }
+
+    // The window title doubles as the stats overlay, refreshed once a second.
+    void updateOverlay() {
+        if (options.offscreen) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now - overlayUpdateTime < std::chrono::seconds(1)) {
+            return;
+        }
+        overlayUpdateTime = now;
+
+        char gpuTime[16];
+        std::snprintf(gpuTime, sizeof(gpuTime), "%.2f", gpuFrameMilliseconds);
+        TerrainLodStatistics terrainStatistics = terrainLod.getStatistics();
+        TerrainRenderStatistics terrainDraws = terrainRenderer.getStatistics();
+        char terrainMeshes[96];
+        std::snprintf(terrainMeshes, sizeof(terrainMeshes), "terrain %u of %u chunks drawn, %zu triangles in %.1f MB", terrainDraws.drawn, terrainDraws.chunks,
+                      terrainStatistics.triangles, terrainDraws.residentBytes / (1024.0 * 1024.0));
+        VoxelLightStatistics light = terrainLight.getStatistics();
+        char relit[80] = "";
+        if (light.edits > 0) {
+            std::snprintf(relit, sizeof(relit), ", last relight %zu blocks on %u jobs in %.2f ms", light.blocksRelit, light.jobs, light.milliseconds);
+        }
+        std::string title = "Dig (render scale " + std::to_string(static_cast<int>(resolutionScaler.getScale() * 100.0f + 0.5f)) + "%, GPU "
+            + gpuTime + " ms, " + memoryTracker.getSummary() + ", " + std::to_string(sceneSystems.getCulledCount()) + " culled, "
+            + std::to_string(occlusionCuller.getStatistics().occluded) + " occluded, " + terrainMeshes + (terrainLod.isLodEnabled() ? "" : ", LOD off") + relit + ")";
+        glfwSetWindowTitle(window, title.c_str());
+    }
+
     void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        PROFILE_ZONE("recordCommandBuffer");
+
         VkCommandBufferBeginInfo beginInfo = {};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
@@ -1035,71 +1967,476 @@ class Game {
             throw std::runtime_error("Failed to begin recording command buffer");
         }
 
-        VkRenderPassBeginInfo renderPassInfo = {};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = swapChainExtent;
+        if (timestampQueryPool != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(commandBuffer, timestampQueryPool, 0, 4);
+            vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, timestampQueryPool, 0);
+        }
+
+        // Acquired images hold nothing worth keeping; the barrier into the first pass
+        // chains onto the acquire semaphore wait, which covers both ways of writing it.
+        ImageState acquiredState = {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED};
+
+        renderGraph.reset();
+        ImageUsage backbufferUsage = options.offscreen ? ImageUsage::TransferSrc : ImageUsage::Present;
+        RenderGraphImage backbuffer = renderGraph.importImage("backbuffer", swapChainImages[imageIndex], swapChainImageViews[imageIndex], swapChainImageFormat, swapChainExtent, VK_IMAGE_ASPECT_COLOR_BIT, acquiredState, backbufferUsage);
+
+        // Scaled targets are allocated at full size and rendered into their top-left
+        // corner, so a scale change never reallocates them.
+        renderExtent = swapChainSupportsUpscale ? resolutionScaler.scaleExtent(swapChainExtent) : swapChainExtent;
+        bool upscale = renderExtent.width != swapChainExtent.width || renderExtent.height != swapChainExtent.height;
+
+        RenderGraphImage sceneColor = upscale ? renderGraph.createImage("scene color", swapChainImageFormat, swapChainExtent, VK_IMAGE_ASPECT_COLOR_BIT) : backbuffer;
+        RenderGraphImage depth = renderGraph.createImage("depth", depthFormat, swapChainExtent, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+        OcclusionFrame occlusion = occlusionCuller.addEarlyPasses(renderGraph, cameraProjection() * cameraView(), swapChainExtent);
+        bool occlusionCulling = occlusionCuller.isEnabled();
+        ParticleFrame particles = particleSystem.addSimulationPasses(renderGraph, particleDeltaSeconds, PARTICLE_FLOOR_HEIGHT);
+        TerrainFrame terrainFrame = terrainRenderer.addUploadPass(renderGraph);
+
+        // Looked up once per frame. A debug view draws with the shaded pipelines
+        // until its own variant has compiled.
+        VkPipeline graphicsPipeline = pipelineVariants.get(withDebugView(graphicsPipelineKey));
+        VkPipeline graphicsPipelineDepthEqual = pipelineVariants.get(withDebugView(graphicsPipelineDepthEqualKey));
+        VkPipeline depthPrepassPipeline = pipelineVariants.get(depthPrepassPipelineKey);
+
+        // With the prepass, the main pass only shades the visible surface: it tests
+        // for equality against the laid-down depth and never writes it.
+        //
+        // Occlusion culling splits the pass that lays down depth in two. The first
+        // half draws what the early cull pass found visible; the depth pyramid is
+        // built from that, and the second half draws what the late cull pass
+        // recovers against it, on top of what the first half left. The terrain is
+        // drawn in the first half, ahead of the scene, as the main occluder.
+        if (depthPrepass) {
+            renderGraph.addPass("depth prepass", [&](RenderPassBuilder& pass) {
+                pass.depthAttachment(depth, VK_ATTACHMENT_LOAD_OP_CLEAR, true);
+                pass.renderArea(renderExtent);
+                TerrainRenderer::useDraws(pass, terrainFrame);
+                OcclusionCuller::useDraws(pass, occlusion);
+            }, [this, depthPrepassPipeline](VkCommandBuffer commandBuffer, const RenderGraph&) {
+                recordTerrain(commandBuffer, TerrainPass::DepthOnly);
+                recordScene(commandBuffer, depthPrepassPipeline, {CullPhase::Early});
+            });
+        }
+        else {
+            renderGraph.addPass("main", [&](RenderPassBuilder& pass) {
+                pass.colorAttachment(sceneColor, VK_ATTACHMENT_LOAD_OP_CLEAR, {{0.0f, 0.0f, 0.0f, 1.0f}});
+                pass.depthAttachment(depth, VK_ATTACHMENT_LOAD_OP_CLEAR, true);
+                pass.renderArea(renderExtent);
+                TerrainRenderer::useDraws(pass, terrainFrame);
+                OcclusionCuller::useDraws(pass, occlusion);
+            }, [this, graphicsPipeline](VkCommandBuffer commandBuffer, const RenderGraph&) {
+                recordTerrain(commandBuffer, TerrainPass::Shaded);
+                recordScene(commandBuffer, graphicsPipeline, {CullPhase::Early});
+            });
+        }
+
+        if (occlusionCulling) {
+            occlusionCuller.addLatePasses(renderGraph, occlusion, depth, renderExtent);
+
+            if (depthPrepass) {
+                renderGraph.addPass("depth prepass late", [&](RenderPassBuilder& pass) {
+                    pass.depthAttachment(depth, VK_ATTACHMENT_LOAD_OP_LOAD, true);
+                    pass.renderArea(renderExtent);
+                    OcclusionCuller::useDraws(pass, occlusion);
+                }, [this, depthPrepassPipeline](VkCommandBuffer commandBuffer, const RenderGraph&) {
+                    recordScene(commandBuffer, depthPrepassPipeline, {CullPhase::Late});
+                });
+            }
+            else {
+                renderGraph.addPass("main late", [&](RenderPassBuilder& pass) {
+                    pass.colorAttachment(sceneColor, VK_ATTACHMENT_LOAD_OP_LOAD);
+                    pass.depthAttachment(depth, VK_ATTACHMENT_LOAD_OP_LOAD, true);
+                    pass.renderArea(renderExtent);
+                    OcclusionCuller::useDraws(pass, occlusion);
+                }, [this, graphicsPipeline](VkCommandBuffer commandBuffer, const RenderGraph&) {
+                    recordScene(commandBuffer, graphicsPipeline, {CullPhase::Late});
+                });
+            }
+        }
+
+        if (depthPrepass) {
+            renderGraph.addPass("main", [&](RenderPassBuilder& pass) {
+                pass.colorAttachment(sceneColor, VK_ATTACHMENT_LOAD_OP_CLEAR, {{0.0f, 0.0f, 0.0f, 1.0f}});
+                pass.depthAttachment(depth, VK_ATTACHMENT_LOAD_OP_LOAD, false);
+                pass.renderArea(renderExtent);
+                TerrainRenderer::useDraws(pass, terrainFrame);
+                OcclusionCuller::useDraws(pass, occlusion);
+            }, [this, occlusionCulling, graphicsPipelineDepthEqual](VkCommandBuffer commandBuffer, const RenderGraph&) {
+                recordTerrain(commandBuffer, TerrainPass::ShadedDepthEqual);
+                if (occlusionCulling) {
+                    recordScene(commandBuffer, graphicsPipelineDepthEqual, {CullPhase::Early, CullPhase::Late});
+                }
+                else {
+                    recordScene(commandBuffer, graphicsPipelineDepthEqual, {CullPhase::Early});
+                }
+            });
+        }
+
+        // Blended over everything opaque, tested against its depth.
+        renderGraph.addPass("particles", [&](RenderPassBuilder& pass) {
+            pass.colorAttachment(sceneColor, VK_ATTACHMENT_LOAD_OP_LOAD);
+            pass.depthAttachment(depth, VK_ATTACHMENT_LOAD_OP_LOAD, false);
+            pass.renderArea(renderExtent);
+            ParticleSystem::useDraws(pass, particles);
+        }, [this](VkCommandBuffer commandBuffer, const RenderGraph&) {
+            setSceneViewport(commandBuffer);
+            particleSystem.recordDraw(commandBuffer, cameraView(), cameraProjection());
+        });
+
+        occlusionCuller.finish(renderGraph, occlusion);
+
+        if (upscale) {
+            renderGraph.addPass("upscale", [&](RenderPassBuilder& pass) {
+                pass.useImage(sceneColor, ImageUsage::TransferSrc);
+                pass.useImage(backbuffer, ImageUsage::TransferDst);
+            }, [this, sceneColor, backbuffer](VkCommandBuffer commandBuffer, const RenderGraph& graph) {
+                recordUpscale(commandBuffer, graph.getImage(sceneColor), graph.getImage(backbuffer));
+            });
+        }
+
+        if (isCapturing()) {
+            frameCapture.addReadbackPass(renderGraph, backbuffer, frameNumber);
+        }
+
+        {
+            PROFILE_ZONE("renderGraph.compile");
+            renderGraph.compile();
+        }
+
+        if (statisticsQueryPool != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(commandBuffer, statisticsQueryPool, 0, 1);
+            vkCmdBeginQuery(commandBuffer, statisticsQueryPool, 0, 0);
+        }
+
+        renderGraph.execute(commandBuffer);
 
-        VkClearValue clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
-        renderPassInfo.clearValueCount = 1;
-        renderPassInfo.pClearValues = &clearColor;
+        if (statisticsQueryPool != VK_NULL_HANDLE) {
+            vkCmdEndQuery(commandBuffer, statisticsQueryPool, 0);
+            statisticsQueryPending = true;
+        }
+
+        if (timestampQueryPool != VK_NULL_HANDLE) {
+            vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, timestampQueryPool, 1);
+            timestampQueryPending = true;
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record command buffer");
+        }
+    }
+
+    // Bilinear upscale of the rendered area to the whole swapchain image.
+    void recordUpscale(VkCommandBuffer commandBuffer, VkImage source, VkImage destination) {
+        VkImageBlit blit = {};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = 0;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+        blit.srcOffsets[0] = {0, 0, 0};
+        blit.srcOffsets[1] = {static_cast<int32_t>(renderExtent.width), static_cast<int32_t>(renderExtent.height), 1};
+        blit.dstSubresource = blit.srcSubresource;
+        blit.dstOffsets[0] = {0, 0, 0};
+        blit.dstOffsets[1] = {static_cast<int32_t>(swapChainExtent.width), static_cast<int32_t>(swapChainExtent.height), 1};
+
+        vkCmdBlitImage(commandBuffer, source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+    }
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    void recordTerrain(VkCommandBuffer commandBuffer, TerrainPass pass) {
+        setSceneViewport(commandBuffer);
+        terrainRenderer.recordDraw(commandBuffer, pass, cameraProjection() * cameraView());
+    }
+
+    // Draws the given phases' lists of the occlusion culler's indirect draws.
+    void recordScene(VkCommandBuffer commandBuffer, VkPipeline pipeline, std::initializer_list<CullPhase> phases) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        setSceneViewport(commandBuffer);
 
         VkBuffer vertexBuffers[] = {vertexBuffer};
         VkDeviceSize offsets[] = {0};
         vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
-        vkCmdDrawIndexed(commandBuffer, indices.size(), 1, 0, 0, 0);
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, mesh.indexType());
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsProgram->pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+
+        if (mesh.vertexLayout() == MeshVertexLayout::Packed) {
+            const MeshFileHeader& header = mesh.getHeader();
+            MeshDecodeConstants decodeConstants = {};
+            decodeConstants.positionOrigin = glm::vec4(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2], 0.0f);
+            decodeConstants.positionExtent = glm::vec4(header.boundsMax[0] - header.boundsMin[0], header.boundsMax[1] - header.boundsMin[1], header.boundsMax[2] - header.boundsMin[2], 0.0f);
+            vkCmdPushConstants(commandBuffer, graphicsProgram->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(decodeConstants), &decodeConstants);
+        }
+        // There is one mesh and one texture, bound above, so batches only differ in
+        // their instance range for now.
+        for (CullPhase phase : phases) {
+            occlusionCuller.recordDraws(commandBuffer, phase);
+        }
+    }
 
-        vkCmdEndRenderPass(commandBuffer);
+    // Scene passes render into the top-left renderExtent of their targets.
+    void setSceneViewport(VkCommandBuffer commandBuffer) {
+        VkViewport viewport = {};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = static_cast<float>(renderExtent.width);
+        viewport.height = static_cast<float>(renderExtent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to record command buffer");
+        VkRect2D scissor = {};
+        scissor.offset = {0, 0};
+        scissor.extent = renderExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    }
+
+    // Only in development builds, where shader sources sit in the asset directory.
+    void startShaderHotReload() {
+#ifdef DIG_ASSET_DIRECTORY
+        for (const auto& shader : shaderSources) {
+            shaderHotReload.addShader(shader);
         }
+
+        shaderHotReload.addListener([this](const Vfs& shaderFiles, const std::string& path) {
+            pipelineVariants.reload(shaderFiles, path);
+        });
+#ifdef DIG_GLSLC
+        shaderHotReload.start(DIG_ASSET_DIRECTORY, DIG_GLSLC);
+#else
+        shaderHotReload.start(DIG_ASSET_DIRECTORY);
+#endif
+#endif
     }
 
     void mainLoop() {
-        while (!glfwWindowShouldClose(window)) {
-            glfwPollEvents();
+        PROFILE_THREAD("main");
+
+        while (options.offscreen || !glfwWindowShouldClose(window)) {
+            if (options.frameLimit > 0 && frameNumber >= options.frameLimit) {
+                break;
+            }
+            if (!options.offscreen) {
+                {
+                    PROFILE_ZONE("glfwPollEvents");
+                    glfwPollEvents();
+                }
+                if (!isReplaying()) {
+                    handleInput();
+                }
+            }
+            if (isReplaying()) {
+                replayInput();
+            }
             drawFrame();
+
+            if (Profiler::isCapturing()) {
+                Profiler::collect();
+            }
         }
         vkDeviceWaitIdle(device);
+        // The last frame's GPU time.
+        collectGpuFrameTime();
+
+        if (Profiler::isCapturing()) {
+            writeProfile();
+        }
+    }
+
+    void writeProfile() {
+        Profiler::stop();
+
+        std::string path = "dig-" + std::to_string(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now())) + ".json";
+        uint64_t dropped = Profiler::writeChromeTrace(path);
+        std::cout << "Profile written to " << path;
+        if (dropped > 0) {
+            std::cout << " (" << dropped << " events dropped)";
+        }
+        std::cout << std::endl;
+    }
+
+    // Digs out the terrain block under ndc, unless an entity is in the way.
+    void dig(glm::vec2 ndc) {
+        glm::mat4 inverseViewProjection = glm::inverse(cameraProjection() * cameraView());
+        glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, 0.0f, 1.0f);
+        glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+        glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+        glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+        VoxelHit block = terrain.raycast(origin, direction, DIG_REACH);
+        SpatialRayHit entity = entityGrid.raycast(origin, direction, block.hit ? block.distance : DIG_REACH);
+        if (!(entity.entity == NULL_ENTITY)) {
+            return;
+        }
+        if (block.hit) {
+            terrainLight.setBlock(terrain, block.block, AIR);
+
+            ParticleBurst burst = {};
+            burst.position = glm::vec3(block.block) + 0.5f + glm::vec3(block.normal) * 0.5f;
+            burst.direction = glm::vec3(block.normal);
+            burst.color = DIG_PARTICLE_COLOR;
+            burst.count = DIG_PARTICLE_COUNT;
+            burst.speed = 3.0f;
+            burst.spread = 0.8f;
+            burst.lifetime = 1.5f;
+            particleSystem.emit(burst);
+        }
+    }
+
+    // Everything input does to the game goes through here, so that it can be
+    // recorded and replayed.
+    void applyInput(const InputEvent& input) {
+        switch (input.action) {
+            case InputAction::ToggleDepthPrepass:
+                depthPrepass = !depthPrepass;
+                fragmentInvocations = 0;
+                statisticsFrames = 0;
+                break;
+            case InputAction::ToggleOcclusionCulling:
+                occlusionCuller.setEnabled(!occlusionCuller.isEnabled());
+                resetOcclusionStatistics();
+                break;
+            case InputAction::ToggleTerrainLod:
+                terrainLod.setLodEnabled(!terrainLod.isLodEnabled());
+                break;
+            case InputAction::Dig:
+                dig(input.point);
+                break;
+            case InputAction::CycleDebugView:
+                debugView = (debugView + 1) % DEBUG_VIEW_COUNT;
+                break;
+        }
+        frameInputs.push_back(input);
+    }
+
+    // P toggles the depth prepass, O toggles occlusion culling, L toggles terrain
+    // LOD, V cycles the debug views, F9 starts and stops a CPU profile capture,
+    // the left mouse button digs.
+    void handleInput() {
+        bool keyDown = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+        if (keyDown && !depthPrepassKeyDown) {
+            applyInput({InputAction::ToggleDepthPrepass});
+        }
+        depthPrepassKeyDown = keyDown;
+
+        keyDown = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+        if (keyDown && !occlusionKeyDown) {
+            applyInput({InputAction::ToggleOcclusionCulling});
+        }
+        occlusionKeyDown = keyDown;
+
+        keyDown = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+        if (keyDown && !terrainLodKeyDown) {
+            applyInput({InputAction::ToggleTerrainLod});
+        }
+        terrainLodKeyDown = keyDown;
+
+        keyDown = glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS;
+        if (keyDown && !debugViewKeyDown) {
+            applyInput({InputAction::CycleDebugView});
+        }
+        debugViewKeyDown = keyDown;
+
+        keyDown = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        if (keyDown && !digButtonDown) {
+            double cursorX, cursorY;
+            int windowWidth, windowHeight;
+            glfwGetCursorPos(window, &cursorX, &cursorY);
+            glfwGetWindowSize(window, &windowWidth, &windowHeight);
+            // The projection flips y, so window and clip space y both point down.
+            if (windowWidth > 0 && windowHeight > 0) {
+                glm::vec2 ndc(2.0f * static_cast<float>(cursorX) / windowWidth - 1.0f, 2.0f * static_cast<float>(cursorY) / windowHeight - 1.0f);
+                applyInput({InputAction::Dig, ndc});
+            }
+        }
+        digButtonDown = keyDown;
+
+#ifdef DIG_PROFILER
+        keyDown = glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS;
+        if (keyDown && !profilerKeyDown) {
+            if (Profiler::isCapturing()) {
+                writeProfile();
+            }
+            else {
+                Profiler::start();
+            }
+        }
+        profilerKeyDown = keyDown;
+#endif
     }
 
     void drawFrame() {
-        vkWaitForFences(device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
-        vkResetFences(device, 1, &inFlightFence);
+        PROFILE_ZONE("drawFrame");
 
-        uint32_t imageIndex;
-        vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+        {
+            PROFILE_ZONE("vkWaitForFences");
+            vkWaitForFences(device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
+        }
+        auto cpuStart = std::chrono::steady_clock::now();
+        collectPipelineStatistics();
+        collectGpuFrameTime();
+        collectOcclusionStatistics();
+        collectParticleStatistics();
+        if (isCapturing()) {
+            frameCapture.collect();
+        }
+        memoryTracker.update();
+        updateOverlay();
 
+        pipelineVariants.update();
+
+        uint32_t imageIndex = 0;
+        VkResult result = VK_SUCCESS;
+        if (!options.offscreen) {
+            PROFILE_ZONE("vkAcquireNextImageKHR");
+            result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+        }
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            recreateSwapChain();
+            return;
+        }
+        else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            throw std::runtime_error("Failed to acquire swap chain image");
+        }
+
+        // Only reset once work is certain to be submitted, or the next wait deadlocks.
+        vkResetFences(device, 1, &inFlightFence);
+
+        updateScene();
         updateUniformBuffer();
 
         vkResetCommandBuffer(commandBuffer, 0);
         recordCommandBuffer(commandBuffer, imageIndex);
 
         VkSemaphore waitSemaphores[] = {imageAvailableSemaphore};
-        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT};
 
         VkSemaphore signalSemaphores[] = {renderFinishedSemaphore};
 
         VkSubmitInfo submitInfo = {};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.waitSemaphoreCount = 1;
+        // Offscreen there is nothing to acquire or present.
+        submitInfo.waitSemaphoreCount = options.offscreen ? 0 : 1;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
-        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.signalSemaphoreCount = options.offscreen ? 0 : 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &commandBuffer;
 
-        if (vkQueueSubmit(presentQueue, 1, &submitInfo, inFlightFence) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to submit draw command buffer");
+        {
+            PROFILE_ZONE("vkQueueSubmit");
+            if (vkQueueSubmit(presentQueue, 1, &submitInfo, inFlightFence) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to submit draw command buffer");
+            }
+        }
+        if (isTimingFrames()) {
+            FrameTiming timing;
+            timing.cpuMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - cpuStart).count();
+            frameTimings.push_back(timing);
+        }
+        frameNumber++;
+
+        if (options.offscreen) {
+            return;
         }
 
         VkSwapchainKHR swapChains[] = {swapChain};
@@ -1111,81 +2448,170 @@ class Game {
         presentInfo.pSwapchains = swapChains;
         presentInfo.pImageIndices = &imageIndex;
 
-        vkQueuePresentKHR(presentQueue, &presentInfo);
+        {
+            PROFILE_ZONE("vkQueuePresentKHR");
+            result = vkQueuePresentKHR(presentQueue, &presentInfo);
+        }
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+            recreateSwapChain();
+        }
+        else if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to present swap chain image");
+        }
+    }
+
+    // Runs the scene systems on the latest simulation state. The previous frame's
+    // fence has signaled, so the instance buffer is free to overwrite.
+    void updateScene() {
+        PROFILE_ZONE("updateScene");
+
+        // Relights this frame's edits while the scene updates.
+        terrainLight.beginUpdate();
+
+        SimulationState state = sampleSimulation();
+
+        particleDeltaSeconds = static_cast<float>(state.time - particleTime);
+        particleTime = state.time;
+
+        SceneSystems::applySpin(world, jobSystem, state.modelAngle);
+        SceneSystems::updateBounds(world);
+        SceneSystems::updateSpatialGrid(world, entityGrid);
+        sceneSystems.buildDrawList(world, jobSystem, cameraProjection() * cameraView(), instanceBufferMapped, MAX_INSTANCES, drawBatches, occlusionCuller.getObjects());
+        occlusionCuller.prepare(drawBatches, sceneSystems.getInstanceCount(), mesh.indexCount());
+        world.clearChanged();
+
+        terrainLight.endUpdate();
+        float projectionScale = swapChainExtent.height / (2.0f * std::tan(glm::radians(CAMERA_FOV_DEGREES) / 2.0f));
+        terrainLod.update(terrain, terrainLight, CAMERA_POSITION, projectionScale);
+        terrainRenderer.update(terrainLod, cameraProjection() * cameraView());
     }
 
-    void updateUniformBuffer() {
-        static auto startTime = std::chrono::high_resolution_clock::now();
+    glm::mat4 cameraView() const {
+        return glm::lookAt(CAMERA_POSITION, CAMERA_TARGET, glm::vec3(0.0f, 0.0f, 1.0f));
+    }
 
-        auto currentTime = std::chrono::high_resolution_clock::now();
-        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+    glm::mat4 cameraProjection() const {
+        glm::mat4 projection = glm::perspective(glm::radians(CAMERA_FOV_DEGREES), swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 10.0f);
+        projection[1][1] *= -1;
+        return projection;
+    }
+
+    void updateUniformBuffer() {
+        PROFILE_ZONE("updateUniformBuffer");
 
         UniformBufferObject ubo = {};
-        ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        ubo.proj = glm::perspective(glm::radians(30.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 10.0f);
-        ubo.proj[1][1] *= -1;
+        ubo.view = cameraView();
+        ubo.proj = cameraProjection();
 
         memcpy(uniformBufferMapped, &ubo, sizeof(ubo));
     }
 
     void cleanup() {
+        shaderHotReload.stop();
         vkDestroySemaphore(device, imageAvailableSemaphore, nullptr);
         vkDestroySemaphore(device, renderFinishedSemaphore, nullptr);
         vkDestroyFence(device, inFlightFence, nullptr);
+        if (isCapturing()) {
+            frameCapture.collect();
+            frameCapture.destroy();
+            CaptureStatistics capture = frameCapture.getStatistics();
+            char encodeTime[16];
+            std::snprintf(encodeTime, sizeof(encodeTime), "%.2f", capture.encodeMilliseconds);
+            std::cout << "Captured " << capture.written << " frames to " << options.captureDirectory << ", " << capture.dropped << " dropped, "
+                      << encodeTime << " ms per frame to write" << std::endl;
+        }
         vkDestroyCommandPool(device, commandPool, nullptr);
-        for (const auto& framebuffer : swapChainFramebuffers) {
-            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        if (statisticsQueryPool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(device, statisticsQueryPool, nullptr);
         }
-        vkDestroyPipeline(device, graphicsPipeline, nullptr);
-        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-        vkDestroyRenderPass(device, renderPass, nullptr);
-        for (const auto& imageView : swapChainImageViews) {
-            vkDestroyImageView(device, imageView, nullptr);
+        if (timestampQueryPool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(device, timestampQueryPool, nullptr);
         }
-        vkDestroySwapchainKHR(device, swapChain, nullptr);
+        destroyPipelineVariants();
+        vkDestroyPipelineCache(device, pipelineCache, nullptr);
+        renderGraph.destroy();
+        cleanupSwapChain();
         vkDestroyDescriptorPool(device, descriptorPool, nullptr);
-        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+        pipelineLayoutCache.destroy();
         vkDestroySampler(device, textureSampler, nullptr);
-        vkDestroyImageView(device, textureImageView, nullptr);
-        vkDestroyImage(device, textureImage, nullptr);
-        vkFreeMemory(device, textureImageMemory, nullptr);
-        vkDestroyBuffer(device, uniformBuffer, nullptr);
-        vkFreeMemory(device, uniformBufferMemory, nullptr);
-        vkDestroyBuffer(device, vertexBuffer, nullptr);
-        vkFreeMemory(device, vertexBufferMemory, nullptr);
-        vkDestroyBuffer(device, indexBuffer, nullptr);
-        vkFreeMemory(device, indexBufferMemory, nullptr);
-        vkDestroySurfaceKHR(instance, surface, nullptr);
+        destroyTextureImage();
+        destroyBuffer(uniformBuffer, uniformBufferMemory);
+        destroyBuffer(instanceBuffer, instanceBufferMemory);
+        occlusionCuller.destroy();
+        particleSystem.destroy();
+        terrainRenderer.destroy();
+        destroyBuffer(vertexBuffer, vertexBufferMemory);
+        destroyBuffer(indexBuffer, indexBufferMemory);
+        memoryTracker.reportLeaks(std::cerr);
+        if (!options.offscreen) {
+            vkDestroySurfaceKHR(instance, surface, nullptr);
+        }
         vkDestroyDevice(device, nullptr);
         vkDestroyInstance(instance, nullptr);
 
-        glfwDestroyWindow(window);
-        glfwTerminate();
-    }
-
-    static std::vector<char> readFile(const std::string& filename) {
-        std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-        if (!file.is_open()) {
-            throw std::runtime_error("failed to open file!");
+        if (!options.offscreen) {
+            glfwDestroyWindow(window);
+            glfwTerminate();
         }
+    }
 
-        size_t fileSize = static_cast<size_t>(file.tellg());
-        std::vector<char> buffer(fileSize);
-
-        file.seekg(0);
-        file.read(buffer.data(), fileSize);
-        file.close();
-
-        return buffer;
+    Asset readFile(const std::string& filename) {
+        return vfs.read(filename);
     }
 };
 
-int main() {
-    Game game;
+GameOptions parseOptions(int argc, char **argv) {
+    GameOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--offscreen") {
+            options.offscreen = true;
+        }
+        else if (argument == "--capture" && hasValue) {
+            options.captureDirectory = argv[++i];
+        }
+        else if (argument == "--raw") {
+            options.captureFormat = CaptureFormat::Raw;
+        }
+        else if (argument == "--frames" && hasValue) {
+            options.frameLimit = std::stoull(argv[++i]);
+        }
+        else if (argument == "--record" && hasValue) {
+            options.recordPath = argv[++i];
+        }
+        else if (argument == "--replay" && hasValue) {
+            options.replayPath = argv[++i];
+        }
+        else if (argument == "--paced") {
+            options.pacedReplay = true;
+        }
+        else if (argument == "--timings" && hasValue) {
+            options.timingsPath = argv[++i];
+        }
+        else if (argument == "--baseline" && hasValue) {
+            options.baselinePath = argv[++i];
+        }
+        else if (argument == "--threshold" && hasValue) {
+            options.regressionThreshold = std::stof(argv[++i]);
+        }
+        else if (argument == "--pipeline-list" && hasValue) {
+            options.pipelineListPath = argv[++i];
+        }
+        else {
+            throw std::runtime_error("Usage: " + std::string(argv[0]) + " [--offscreen] [--capture <directory>] [--raw] [--frames <count>] [--record <log> | --replay <log> [--paced]]"
+                                     + " [--timings <csv>] [--baseline <csv> [--threshold <fraction>]] [--pipeline-list <file>]");
+        }
+    }
+    if (!options.recordPath.empty() && !options.replayPath.empty()) {
+        throw std::runtime_error("Cannot record and replay in the same run");
+    }
+    return options;
+}
 
+int main(int argc, char **argv) {
     try {
+        Game game(parseOptions(argc, argv));
         game.run();
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
@@ -1,3 +1,13 @@
 cd shaders
 glslc shader.vert -o build/vert.spv
-glslc shader.frag -o build/frag.spv
\ No newline at end of file
+glslc shader_packed.vert -o build/vert_packed.spv
+glslc shader.frag -o build/frag.spv
+glslc hiz_build.comp -o build/hiz_build.spv
+glslc occlusion_cull.comp -o build/occlusion_cull.spv
+glslc particle_counters.comp -o build/particle_counters.spv
+glslc particle_emit.comp -o build/particle_emit.spv
+glslc particle_simulate.comp -o build/particle_simulate.spv
+glslc particle.vert -o build/particle_vert.spv
+glslc particle.frag -o build/particle_frag.spv
+glslc terrain.vert -o build/terrain_vert.spv
+glslc terrain.frag -o build/terrain_frag.spv
\ No newline at end of file
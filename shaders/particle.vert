@@ -0,0 +1,56 @@
+#version 450
+
+// Draws each live particle as a camera-facing quad, six vertices per instance;
+// the instance count comes from the finalize step.
+struct Particle {
+    vec3 position;
+    float age;
+    vec3 velocity;
+    float lifetime;
+    vec4 color;
+};
+
+layout(std430, binding = 0) readonly buffer ParticleBuffer {
+    Particle particles[];
+} particleBuffer;
+
+layout(std430, binding = 1) readonly buffer AliveList {
+    uint indices[];
+} aliveList;
+
+layout(std430, binding = 2) readonly buffer Counters {
+    uint deadCount;
+    uint current;
+    uint aliveCount[2];
+    uint emitCount;
+    uint emitBase;
+} counters;
+
+layout(push_constant) uniform DrawConstants {
+    mat4 viewProjection;
+    // World space camera axes; w of the first is the particle size.
+    vec4 cameraRight;
+    vec4 cameraUp;
+    uint maxParticles;
+} constants;
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragCorner;
+
+const vec2 CORNERS[6] = vec2[](
+    vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+    vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0)
+);
+
+void main() {
+    uint index = aliveList.indices[counters.current * constants.maxParticles + gl_InstanceIndex];
+    Particle particle = particleBuffer.particles[index];
+    float remaining = 1.0 - particle.age / particle.lifetime;
+
+    vec2 corner = CORNERS[gl_VertexIndex];
+    float size = constants.cameraRight.w * (0.5 + 0.5 * remaining);
+    vec3 position = particle.position + (constants.cameraRight.xyz * corner.x + constants.cameraUp.xyz * corner.y) * size;
+    gl_Position = constants.viewProjection * vec4(position, 1.0);
+    fragColor = vec4(particle.color.rgb, particle.color.a * remaining);
+    fragCorner = corner;
+}
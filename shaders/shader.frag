@@ -1,5 +1,9 @@
 #version 450
 
+// 0 shades with the texture, 1 shows texture coordinates and 2 vertex colors.
+// Each view is its own pipeline variant, so the shaded one carries no branch.
+layout(constant_id = 0) const uint DEBUG_VIEW = 0;
+
 layout(binding = 1) uniform sampler2D texSampler;
 
 layout(location = 0) in vec3 fragColor;
@@ -8,5 +12,13 @@ layout(location = 1) in vec2 fragTexCoord;
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = texture(texSampler, fragTexCoord);
+    if (DEBUG_VIEW == 1) {
+        outColor = vec4(fract(fragTexCoord), 0.0, 1.0);
+    }
+    else if (DEBUG_VIEW == 2) {
+        outColor = vec4(fragColor, 1.0);
+    }
+    else {
+        outColor = texture(texSampler, fragTexCoord);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,39 @@
+#version 450
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+layout(std430, binding = 2) readonly buffer InstanceBuffer {
+    mat4 models[];
+} instances;
+
+// Indices into the instance buffer of the instances that survived culling, in
+// draw order; each indirect draw's firstInstance points at its batch's range.
+layout(std430, binding = 3) readonly buffer VisibleInstanceBuffer {
+    uint indices[];
+} visibleInstances;
+
+layout(push_constant) uniform MeshDecodeConstants {
+    vec4 positionOrigin;
+    vec4 positionExtent;
+} meshDecode;
+
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec4 inColor;
+layout(location = 2) in vec2 texCoord;
+layout(location = 3) in vec4 inNormal;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+// The depth prepass and the main pass must agree exactly for the equal test.
+invariant gl_Position;
+
+void main() {
+    vec3 position = meshDecode.positionOrigin.xyz + inPosition.xyz * meshDecode.positionExtent.xyz;
+    gl_Position = ubo.proj * ubo.view * instances.models[visibleInstances.indices[gl_InstanceIndex]] * vec4(position, 1.0);
+    fragColor = inColor.rgb;
+    fragTexCoord = texCoord;
+}
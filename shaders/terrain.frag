@@ -0,0 +1,28 @@
+#version 450
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 1) flat in uint fragBlock;
+layout(location = 2) in vec2 fragLight;
+
+layout(location = 0) out vec4 outColor;
+
+// Indexed by block id; air is never meshed, and unknown blocks show as grey.
+const vec3 BLOCK_COLORS[3] = vec3[](
+    vec3(0.5, 0.5, 0.5),
+    vec3(0.42, 0.33, 0.24),
+    vec3(1.0, 0.85, 0.45)
+);
+const vec3 SUN_DIRECTION = vec3(0.27, 0.45, 0.85);
+const vec3 BLOCK_LIGHT_COLOR = vec3(1.0, 0.8, 0.55);
+// Where neither light reaches, so that unlit tunnels are not pure black.
+const float MIN_BRIGHTNESS = 0.05;
+
+void main() {
+    vec3 color = BLOCK_COLORS[fragBlock < 3u ? fragBlock : 0u];
+    // Sky light is shaded by the sun's direction, block light from all around.
+    // Levels are squared, so light fades out visibly over the last few blocks.
+    float diffuse = 0.4 + 0.6 * max(dot(fragNormal, SUN_DIRECTION), 0.0);
+    vec2 falloff = fragLight * fragLight;
+    vec3 light = max(vec3(falloff.x * diffuse), falloff.y * BLOCK_LIGHT_COLOR);
+    outColor = vec4(color * max(light, vec3(MIN_BRIGHTNESS)), 1.0);
+}
@@ -0,0 +1,35 @@
+#version 450
+
+// Terrain chunk meshes. Positions are in blocks from the chunk's origin, which
+// is pushed for each chunk's draw.
+layout(push_constant) uniform TerrainConstants {
+    mat4 viewProjection;
+    vec4 chunkOrigin;
+} constants;
+
+layout(location = 0) in vec3 inPosition;
+// ChunkVertex's normal, block, light and padding bytes.
+layout(location = 1) in uvec4 inAttributes;
+
+layout(location = 0) out vec3 fragNormal;
+layout(location = 1) flat out uint fragBlock;
+// Sky and block light levels, 0 to 1.
+layout(location = 2) out vec2 fragLight;
+
+// The depth prepass and the main pass must agree exactly for the equal test.
+invariant gl_Position;
+
+// Indexed by ChunkMesher's face directions.
+const vec3 NORMALS[6] = vec3[](
+    vec3(1.0, 0.0, 0.0), vec3(-1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0), vec3(0.0, -1.0, 0.0),
+    vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, -1.0)
+);
+
+void main() {
+    gl_Position = constants.viewProjection * vec4(constants.chunkOrigin.xyz + inPosition, 1.0);
+    fragNormal = NORMALS[inAttributes.x];
+    fragBlock = inAttributes.y;
+    // Packed as VoxelLight stores it: sky in the low nibble, block in the high.
+    fragLight = vec2(inAttributes.z & 15u, inAttributes.z >> 4) / 15.0;
+}
@@ -0,0 +1,335 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "voxel_light.hpp"
+#include "voxel_world.hpp"
+
+// Vertex of a terrain chunk mesh. Positions are in blocks relative to the
+// chunk's origin; normal indexes the face directions of ChunkMesher. light is
+// that of the air in front of the face, packed as VoxelLight stores it.
+struct ChunkVertex {
+    float position[3];
+    uint8_t normal;
+    BlockId block;
+    uint8_t light;
+    uint8_t padding;
+};
+
+struct ChunkMesh {
+    std::vector<ChunkVertex> vertices;
+    std::vector<uint32_t> indices;
+
+    size_t getTriangleCount() const {
+        return indices.size() / 3;
+    }
+
+    size_t getByteSize() const {
+        return vertices.size() * sizeof(ChunkVertex) + indices.size() * sizeof(uint32_t);
+    }
+};
+
+// The blocks a chunk mesh at one level of detail depends on, and their light:
+// the chunk itself and the layers of its six face neighbours that the cells on
+// its border look at. Copied on the thread that owns the world, so meshing can
+// run on a worker while the world is edited.
+class ChunkSnapshot {
+    public:
+    ChunkSnapshot(const VoxelWorld& world, const VoxelLight& light, const ChunkCoord& coord, uint32_t lod) : coord(coord), lod(lod), depth(1 << lod) {
+        const Chunk *chunk = world.findChunk(coord);
+        blocks.assign(Chunk::VOLUME, AIR);
+        if (chunk != nullptr) {
+            std::memcpy(blocks.data(), chunk->data(), Chunk::VOLUME);
+        }
+        const ChunkLight *chunkLight = light.findChunk(coord);
+        lights.assign(Chunk::VOLUME, VoxelLight::OUTSIDE);
+        if (chunkLight != nullptr) {
+            std::memcpy(lights.data(), chunkLight->values.data(), Chunk::VOLUME);
+        }
+
+        for (int face = 0; face < 6; face++) {
+            int axis = face / 2;
+            int side = face % 2 == 0 ? 1 : -1;
+            ChunkCoord neighbourCoord = coord;
+            (axis == 0 ? neighbourCoord.x : axis == 1 ? neighbourCoord.y : neighbourCoord.z) += side;
+
+            std::vector<BlockId>& slab = slabs[face];
+            std::vector<uint8_t>& lightSlab = lightSlabs[face];
+            size_t slabSize = static_cast<size_t>(depth) * Chunk::SIZE * Chunk::SIZE;
+            slab.assign(slabSize, AIR);
+            lightSlab.assign(slabSize, VoxelLight::OUTSIDE);
+            const Chunk *neighbour = world.findChunk(neighbourCoord);
+            const ChunkLight *neighbourLight = light.findChunk(neighbourCoord);
+            if (neighbour == nullptr || neighbourLight == nullptr) {
+                continue;
+            }
+
+            // Layer 0 touches this chunk.
+            for (int layer = 0; layer < depth; layer++) {
+                for (int v = 0; v < Chunk::SIZE; v++) {
+                    for (int u = 0; u < Chunk::SIZE; u++) {
+                        glm::ivec3 local = planeToLocal(axis, side > 0 ? layer : Chunk::MASK - layer, u, v);
+                        slab[slabIndex(layer, u, v)] = neighbour->get(local.x, local.y, local.z);
+                        lightSlab[slabIndex(layer, u, v)] = neighbourLight->values[Chunk::indexOf(local.x, local.y, local.z)];
+                    }
+                }
+            }
+        }
+    }
+
+    const ChunkCoord& getCoord() const {
+        return coord;
+    }
+
+    uint32_t getLod() const {
+        return lod;
+    }
+
+    // Block at a position relative to the chunk's origin: inside the chunk, or
+    // within the captured layers across one of its faces. Anything else is air.
+    BlockId get(int x, int y, int z) const {
+        return lookup(blocks, slabs, x, y, z, AIR);
+    }
+
+    // Packed light at a position, as for get. Anything else is in full sky light.
+    uint8_t getLight(int x, int y, int z) const {
+        return lookup(lights, lightSlabs, x, y, z, VoxelLight::OUTSIDE);
+    }
+
+    private:
+    ChunkCoord coord;
+    uint32_t lod;
+    int depth;
+    std::vector<BlockId> blocks;
+    std::vector<uint8_t> lights;
+    // Indexed by face: +x, -x, +y, -y, +z, -z.
+    std::array<std::vector<BlockId>, 6> slabs;
+    std::array<std::vector<uint8_t>, 6> lightSlabs;
+
+    template <typename T>
+    T lookup(const std::vector<T>& inside, const std::array<std::vector<T>, 6>& faces, int x, int y, int z, T outside) const {
+        glm::ivec3 local(x, y, z);
+        int outsideAxis = -1;
+        for (int axis = 0; axis < 3; axis++) {
+            if (local[axis] < 0 || local[axis] >= Chunk::SIZE) {
+                if (outsideAxis >= 0) {
+                    return outside;
+                }
+                outsideAxis = axis;
+            }
+        }
+        if (outsideAxis < 0) {
+            return inside[Chunk::indexOf(x, y, z)];
+        }
+
+        int position = local[outsideAxis];
+        int face = 2 * outsideAxis + (position < 0 ? 1 : 0);
+        int layer = position < 0 ? -1 - position : position - Chunk::SIZE;
+        if (layer >= depth) {
+            return outside;
+        }
+        int u = local[(outsideAxis + 1) % 3];
+        int v = local[(outsideAxis + 2) % 3];
+        return faces[face][slabIndex(layer, u, v)];
+    }
+
+    static glm::ivec3 planeToLocal(int axis, int position, int u, int v) {
+        glm::ivec3 local;
+        local[axis] = position;
+        local[(axis + 1) % 3] = u;
+        local[(axis + 2) % 3] = v;
+        return local;
+    }
+
+    static size_t slabIndex(int layer, int u, int v) {
+        return (static_cast<size_t>(layer) * Chunk::SIZE + v) * Chunk::SIZE + u;
+    }
+};
+
+// Builds the mesh of a chunk at a level of detail: at LOD n, cubes of 2^n
+// blocks are merged into one cell, which is solid if at least half of its
+// blocks are and then shows the topmost of them. Only faces between a solid
+// cell and an empty one are emitted.
+//
+// Neighbouring chunks may be meshed at different LODs, whose surfaces differ
+// by up to a cell of the coarser one. To hide the cracks that opens along chunk
+// borders, faces on the border are also emitted where the cell across is solid,
+// as long as the cell is within SKIRT_CELLS of an empty cell of this chunk:
+// a skirt that hangs down from the surface and fills the gap. Neighbours more
+// than one LOD apart can still show cracks.
+//
+// Faces are lit by the brightest light within the cell in front of them;
+// skirts, which face solid cells, by the brightest around their own cell.
+class ChunkMesher {
+    public:
+    static constexpr int SKIRT_CELLS = 2;
+
+    // Face directions, matching ChunkVertex::normal.
+    static constexpr int FACE_POSITIVE_X = 0;
+    static constexpr int FACE_NEGATIVE_X = 1;
+    static constexpr int FACE_POSITIVE_Y = 2;
+    static constexpr int FACE_NEGATIVE_Y = 3;
+    static constexpr int FACE_POSITIVE_Z = 4;
+    static constexpr int FACE_NEGATIVE_Z = 5;
+
+    static ChunkMesh build(const ChunkSnapshot& snapshot) {
+        int cellSize = 1 << snapshot.getLod();
+        int cellCount = Chunk::SIZE / cellSize;
+        int stride = cellCount + 2;
+
+        // Cells of the chunk with a one-cell border taken from its neighbours;
+        // the border's edges and corners are never looked at and stay empty.
+        std::vector<BlockId> cells(static_cast<size_t>(stride) * stride * stride, AIR);
+        auto cellIndex = [stride](int x, int y, int z) {
+            return (static_cast<size_t>(z + 1) * stride + (y + 1)) * stride + (x + 1);
+        };
+        for (int z = -1; z <= cellCount; z++) {
+            for (int y = -1; y <= cellCount; y++) {
+                for (int x = -1; x <= cellCount; x++) {
+                    int outside = (x < 0 || x == cellCount) + (y < 0 || y == cellCount) + (z < 0 || z == cellCount);
+                    if (outside <= 1) {
+                        cells[cellIndex(x, y, z)] = downsample(snapshot, glm::ivec3(x, y, z) * cellSize, cellSize);
+                    }
+                }
+            }
+        }
+
+        auto isInside = [cellCount](const glm::ivec3& cell) {
+            return cell.x >= 0 && cell.y >= 0 && cell.z >= 0 && cell.x < cellCount && cell.y < cellCount && cell.z < cellCount;
+        };
+        auto nearSurface = [&](const glm::ivec3& cell) {
+            glm::ivec3 first = glm::max(cell - SKIRT_CELLS, glm::ivec3(0));
+            glm::ivec3 last = glm::min(cell + SKIRT_CELLS, glm::ivec3(cellCount - 1));
+            for (int z = first.z; z <= last.z; z++) {
+                for (int y = first.y; y <= last.y; y++) {
+                    for (int x = first.x; x <= last.x; x++) {
+                        if (cells[cellIndex(x, y, z)] == AIR) {
+                            return true;
+                        }
+                    }
+                }
+            }
+            return false;
+        };
+
+        ChunkMesh mesh;
+        for (int z = 0; z < cellCount; z++) {
+            for (int y = 0; y < cellCount; y++) {
+                for (int x = 0; x < cellCount; x++) {
+                    BlockId block = cells[cellIndex(x, y, z)];
+                    if (block == AIR) {
+                        continue;
+                    }
+
+                    glm::ivec3 cell(x, y, z);
+                    int surface = -1;
+                    for (int face = 0; face < 6; face++) {
+                        glm::ivec3 across = cell + faceNormal(face);
+                        uint8_t light;
+                        if (cells[cellIndex(across.x, across.y, across.z)] != AIR) {
+                            if (isInside(across)) {
+                                continue;
+                            }
+                            if (surface < 0) {
+                                surface = nearSurface(cell) ? 1 : 0;
+                            }
+                            if (surface == 0) {
+                                continue;
+                            }
+                            light = 0;
+                            for (int around = 0; around < 6; around++) {
+                                light = brightest(light, cellLight(snapshot, (cell + faceNormal(around)) * cellSize, cellSize));
+                            }
+                        }
+                        else {
+                            light = cellLight(snapshot, across * cellSize, cellSize);
+                        }
+                        addFace(mesh, cell * cellSize, cellSize, face, block, light);
+                    }
+                }
+            }
+        }
+        return mesh;
+    }
+
+    private:
+    static constexpr int FACE_NORMALS[6][3] = {
+        {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}
+    };
+
+    // Corners of each face of the unit cube, counter-clockwise seen from outside.
+    static constexpr uint8_t FACE_CORNERS[6][4][3] = {
+        {{1, 0, 0}, {1, 1, 0}, {1, 1, 1}, {1, 0, 1}},
+        {{0, 0, 0}, {0, 0, 1}, {0, 1, 1}, {0, 1, 0}},
+        {{0, 1, 0}, {0, 1, 1}, {1, 1, 1}, {1, 1, 0}},
+        {{0, 0, 0}, {1, 0, 0}, {1, 0, 1}, {0, 0, 1}},
+        {{0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}},
+        {{0, 0, 0}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0}}
+    };
+
+    static glm::ivec3 faceNormal(int face) {
+        return glm::ivec3(FACE_NORMALS[face][0], FACE_NORMALS[face][1], FACE_NORMALS[face][2]);
+    }
+
+    // Larger of each of two packed lights' levels.
+    static uint8_t brightest(uint8_t a, uint8_t b) {
+        return static_cast<uint8_t>(std::max(a & 0x0f, b & 0x0f) | std::max(a & 0xf0, b & 0xf0));
+    }
+
+    static uint8_t cellLight(const ChunkSnapshot& snapshot, const glm::ivec3& origin, int cellSize) {
+        uint8_t light = 0;
+        for (int z = 0; z < cellSize; z++) {
+            for (int y = 0; y < cellSize; y++) {
+                for (int x = 0; x < cellSize; x++) {
+                    light = brightest(light, snapshot.getLight(origin.x + x, origin.y + y, origin.z + z));
+                }
+            }
+        }
+        return light;
+    }
+
+    static BlockId downsample(const ChunkSnapshot& snapshot, const glm::ivec3& origin, int cellSize) {
+        if (cellSize == 1) {
+            return snapshot.get(origin.x, origin.y, origin.z);
+        }
+
+        int solid = 0;
+        BlockId top = AIR;
+        for (int z = 0; z < cellSize; z++) {
+            for (int y = 0; y < cellSize; y++) {
+                for (int x = 0; x < cellSize; x++) {
+                    BlockId block = snapshot.get(origin.x + x, origin.y + y, origin.z + z);
+                    if (block != AIR) {
+                        solid++;
+                        top = block;
+                    }
+                }
+            }
+        }
+        return 2 * solid >= cellSize * cellSize * cellSize ? top : AIR;
+    }
+
+    static void addFace(ChunkMesh& mesh, const glm::ivec3& origin, int size, int face, BlockId block, uint8_t light) {
+        uint32_t first = static_cast<uint32_t>(mesh.vertices.size());
+        for (const auto& corner : FACE_CORNERS[face]) {
+            ChunkVertex vertex = {};
+            vertex.position[0] = static_cast<float>(origin.x + corner[0] * size);
+            vertex.position[1] = static_cast<float>(origin.y + corner[1] * size);
+            vertex.position[2] = static_cast<float>(origin.z + corner[2] * size);
+            vertex.normal = static_cast<uint8_t>(face);
+            vertex.block = block;
+            vertex.light = light;
+            mesh.vertices.push_back(vertex);
+        }
+        const uint32_t quad[6] = {0, 1, 2, 0, 2, 3};
+        for (uint32_t index : quad) {
+            mesh.indices.push_back(first + index);
+        }
+    }
+};
@@ -0,0 +1,353 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+#include "job_system.hpp"
+
+// Index into the entity tables plus a generation, so that handles to destroyed
+// entities can be told apart from their reused slots.
+struct Entity {
+    uint32_t index;
+    uint32_t generation;
+
+    bool operator==(const Entity& other) const {
+        return index == other.index && generation == other.generation;
+    }
+};
+
+constexpr Entity NULL_ENTITY = {UINT32_MAX, 0};
+
+// Type-erased part of a component pool, only used for bookkeeping that is not
+// on any per-entity path: removing all components of a destroyed entity and
+// clearing change bits.
+class ComponentPoolBase {
+    public:
+    virtual ~ComponentPoolBase() = default;
+    virtual void remove(Entity entity) = 0;
+    virtual void clearChanged() = 0;
+};
+
+// Sparse set: a sparse table maps entity indices to positions in dense arrays of
+// entities and components, so every component type is one contiguous array and
+// removal swaps the last element into the hole.
+//
+// Each dense slot has a changed bit, set whenever the component is added or
+// written through getMutable() or markChanged(). Systems reacting to changes
+// iterate the set bits, and the owner clears them once everyone has seen them,
+// usually once a frame. A word of bits covers 64 slots, so threads may mark
+// slots concurrently only when they work on disjoint 64-slot ranges.
+template <typename T>
+class ComponentPool : public ComponentPoolBase {
+    public:
+    static constexpr uint32_t ABSENT = UINT32_MAX;
+
+    T& add(Entity entity, const T& component) {
+        if (entity.index >= sparse.size()) {
+            sparse.resize(entity.index + 1, ABSENT);
+        }
+        if (sparse[entity.index] != ABSENT) {
+            uint32_t slot = sparse[entity.index];
+            components[slot] = component;
+            markChanged(slot);
+            return components[slot];
+        }
+
+        uint32_t slot = static_cast<uint32_t>(entities.size());
+        sparse[entity.index] = slot;
+        entities.push_back(entity);
+        components.push_back(component);
+        if (slot / 64 >= changed.size()) {
+            changed.push_back(0);
+        }
+        markChanged(slot);
+        return components.back();
+    }
+
+    void remove(Entity entity) override {
+        if (!contains(entity)) {
+            return;
+        }
+
+        uint32_t slot = sparse[entity.index];
+        uint32_t last = static_cast<uint32_t>(entities.size()) - 1;
+        if (slot != last) {
+            entities[slot] = entities[last];
+            components[slot] = std::move(components[last]);
+            sparse[entities[slot].index] = slot;
+            // The moved component is changed as far as anyone indexing by slot knows.
+            markChanged(slot);
+        }
+        clearChangedSlot(last);
+
+        entities.pop_back();
+        components.pop_back();
+        sparse[entity.index] = ABSENT;
+    }
+
+    bool contains(Entity entity) const {
+        return entity.index < sparse.size() && sparse[entity.index] != ABSENT && entities[sparse[entity.index]] == entity;
+    }
+
+    const T& get(Entity entity) const {
+        return components[sparse[entity.index]];
+    }
+
+    T& getMutable(Entity entity) {
+        uint32_t slot = sparse[entity.index];
+        markChanged(slot);
+        return components[slot];
+    }
+
+    // Write access that leaves the change bit alone, for iteration helpers.
+    T& getUnmarked(Entity entity) {
+        return components[sparse[entity.index]];
+    }
+
+    uint32_t slotOf(Entity entity) const {
+        return sparse[entity.index];
+    }
+
+    size_t size() const {
+        return entities.size();
+    }
+
+    // Dense arrays, for systems that iterate the pool directly.
+    const Entity *entityData() const {
+        return entities.data();
+    }
+
+    T *data() {
+        return components.data();
+    }
+
+    const T *data() const {
+        return components.data();
+    }
+
+    bool isChanged(uint32_t slot) const {
+        return (changed[slot / 64] >> (slot % 64)) & 1;
+    }
+
+    void markChanged(uint32_t slot) {
+        changed[slot / 64] |= uint64_t(1) << (slot % 64);
+    }
+
+    // Calls function(slot) for every changed slot, 64 at a time.
+    template <typename Function>
+    void eachChanged(Function&& function) const {
+        for (size_t word = 0; word < changed.size(); word++) {
+            uint64_t bits = changed[word];
+            while (bits != 0) {
+                uint32_t bit = countTrailingZeros(bits);
+                function(static_cast<uint32_t>(word * 64 + bit));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    void clearChanged() override {
+        std::fill(changed.begin(), changed.end(), 0);
+    }
+
+    private:
+    std::vector<uint32_t> sparse;
+    std::vector<Entity> entities;
+    std::vector<T> components;
+    std::vector<uint64_t> changed;
+
+    void clearChangedSlot(uint32_t slot) {
+        changed[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+    }
+
+    static uint32_t countTrailingZeros(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<uint32_t>(__builtin_ctzll(bits));
+#else
+        uint32_t count = 0;
+        while ((bits & 1) == 0) {
+            bits >>= 1;
+            count++;
+        }
+        return count;
+#endif
+    }
+};
+
+// Entities and their component pools. Pools are created on first use; systems
+// look them up once and then work on the dense arrays, so iteration never goes
+// through a virtual call or a hash lookup per entity.
+class World {
+    public:
+    Entity create() {
+        if (!freeIndices.empty()) {
+            uint32_t index = freeIndices.back();
+            freeIndices.pop_back();
+            return {index, generations[index]};
+        }
+
+        generations.push_back(0);
+        return {static_cast<uint32_t>(generations.size() - 1), 0};
+    }
+
+    void destroy(Entity entity) {
+        if (!isAlive(entity)) {
+            return;
+        }
+
+        for (auto& [type, pool] : pools) {
+            pool->remove(entity);
+        }
+        generations[entity.index]++;
+        freeIndices.push_back(entity.index);
+    }
+
+    bool isAlive(Entity entity) const {
+        return entity.index < generations.size() && generations[entity.index] == entity.generation;
+    }
+
+    template <typename T>
+    T& add(Entity entity, const T& component) {
+        return pool<T>().add(entity, component);
+    }
+
+    template <typename T>
+    void remove(Entity entity) {
+        pool<T>().remove(entity);
+    }
+
+    template <typename T>
+    bool has(Entity entity) const {
+        const ComponentPool<T> *components = findPool<T>();
+        return components != nullptr && components->contains(entity);
+    }
+
+    template <typename T>
+    const T& get(Entity entity) const {
+        return findPool<T>()->get(entity);
+    }
+
+    template <typename T>
+    T& getMutable(Entity entity) {
+        return pool<T>().getMutable(entity);
+    }
+
+    template <typename T>
+    ComponentPool<T>& pool() {
+        auto& pool = pools[std::type_index(typeid(T))];
+        if (!pool) {
+            pool = std::make_unique<ComponentPool<T>>();
+        }
+        return static_cast<ComponentPool<T>&>(*pool);
+    }
+
+    // Calls function(entity, first&, others&...) for every entity having all the
+    // listed components. The first component's pool drives the iteration, so
+    // list the rarest component first. Writes are not tracked; see update().
+    template <typename First, typename... Others, typename Function>
+    void each(Function&& function) {
+        update<First, Others...>([&](Entity entity, First& first, Others&... others) {
+            function(entity, first, others...);
+            return false;
+        });
+    }
+
+    // As each(), but the function returns whether it wrote the first component,
+    // which is then marked changed.
+    template <typename First, typename... Others, typename Function>
+    void update(Function&& function) {
+        ComponentPool<First>& driver = pool<First>();
+        std::tuple<ComponentPool<Others>&...> others(pool<Others>()...);
+        eachInRange(driver, others, 0, driver.size(), function);
+    }
+
+    // As each(), with the driving pool split into batches run on the job system.
+    // The function may only write the components it is given.
+    template <typename First, typename... Others, typename Function>
+    void parallelEach(JobSystem& jobSystem, size_t minBatchSize, Function&& function) {
+        parallelUpdate<First, Others...>(jobSystem, minBatchSize, [&](Entity entity, First& first, Others&... others) {
+            function(entity, first, others...);
+            return false;
+        });
+    }
+
+    // As update(), on the job system. Batches cover whole words of change bits,
+    // so marking needs no synchronization.
+    template <typename First, typename... Others, typename Function>
+    void parallelUpdate(JobSystem& jobSystem, size_t minBatchSize, Function&& function) {
+        // Looked up here, as pool() may insert into the map, which the workers
+        // must not race on.
+        ComponentPool<First>& driver = pool<First>();
+        std::tuple<ComponentPool<Others>&...> others(pool<Others>()...);
+
+        size_t count = driver.size();
+        size_t batchSize = (jobSystem.batchSizeFor(count, minBatchSize) + 63) / 64 * 64;
+        jobSystem.parallelFor(0, count, batchSize, [&](size_t first, size_t last) {
+            eachInRange(driver, others, first, last, function);
+        });
+    }
+
+    // Calls function(entity, first&, others&...) for every entity whose first
+    // component changed since the last clearChanged() and that has all the others.
+    template <typename First, typename... Others, typename Function>
+    void eachChanged(Function&& function) {
+        ComponentPool<First>& driver = pool<First>();
+        std::tuple<ComponentPool<Others>&...> others(pool<Others>()...);
+        const Entity *entities = driver.entityData();
+        First *components = driver.data();
+
+        driver.eachChanged([&](uint32_t slot) {
+            Entity entity = entities[slot];
+            if ((std::get<ComponentPool<Others>&>(others).contains(entity) && ...)) {
+                function(entity, components[slot], std::get<ComponentPool<Others>&>(others).getUnmarked(entity)...);
+            }
+        });
+    }
+
+    template <typename T>
+    void markChanged(Entity entity) {
+        ComponentPool<T>& components = pool<T>();
+        components.markChanged(components.slotOf(entity));
+    }
+
+    // Forgets all changes, for all component types.
+    void clearChanged() {
+        for (auto& [type, pool] : pools) {
+            (void)type;
+            pool->clearChanged();
+        }
+    }
+
+    private:
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> freeIndices;
+    std::unordered_map<std::type_index, std::unique_ptr<ComponentPoolBase>> pools;
+
+    template <typename T>
+    const ComponentPool<T> *findPool() const {
+        auto pool = pools.find(std::type_index(typeid(T)));
+        return pool != pools.end() ? static_cast<const ComponentPool<T> *>(pool->second.get()) : nullptr;
+    }
+
+    template <typename First, typename... Others, typename Function>
+    static void eachInRange(ComponentPool<First>& driver, std::tuple<ComponentPool<Others>&...>& others, size_t first, size_t last, Function&& function) {
+        const Entity *entities = driver.entityData();
+        First *components = driver.data();
+
+        for (size_t slot = first; slot < last; slot++) {
+            Entity entity = entities[slot];
+            if (!(std::get<ComponentPool<Others>&>(others).contains(entity) && ...)) {
+                continue;
+            }
+            if (function(entity, components[slot], std::get<ComponentPool<Others>&>(others).getUnmarked(entity)...)) {
+                driver.markChanged(static_cast<uint32_t>(slot));
+            }
+        }
+    }
+};
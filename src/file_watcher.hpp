@@ -0,0 +1,124 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <filesystem>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Reports files written in a set of watched directories. On Linux this is backed
+// by inotify; elsewhere the directories are rescanned for modification times.
+// Paths are reported relative to the root the watcher was created with.
+class FileWatcher {
+    public:
+    explicit FileWatcher(const std::string& root) : root(root) {
+#ifdef __linux__
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd < 0) {
+            throw std::runtime_error("Failed to initialize inotify");
+        }
+#endif
+    }
+
+    ~FileWatcher() {
+#ifdef __linux__
+        ::close(inotifyFd);
+#endif
+    }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Directories that do not exist yet are skipped.
+    void watchDirectory(const std::string& directory) {
+        std::filesystem::path path = std::filesystem::path(root) / directory;
+        if (!std::filesystem::is_directory(path)) {
+            return;
+        }
+
+#ifdef __linux__
+        // Editors commonly save by writing a temporary and renaming it over the original.
+        int watch = inotify_add_watch(inotifyFd, path.string().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watch < 0) {
+            throw std::runtime_error("Failed to watch " + path.string());
+        }
+        watchedDirectories[watch] = directory;
+#else
+        watchedDirectories.push_back(directory);
+        for (const auto& entry : std::filesystem::directory_iterator(path)) {
+            if (entry.is_regular_file()) {
+                modificationTimes[entry.path().string()] = entry.last_write_time();
+            }
+        }
+#endif
+    }
+
+    // Blocks for up to timeout and returns the files that changed in that time.
+    std::vector<std::string> wait(std::chrono::milliseconds timeout) {
+        std::vector<std::string> changed;
+
+#ifdef __linux__
+        pollfd descriptor = {};
+        descriptor.fd = inotifyFd;
+        descriptor.events = POLLIN;
+        if (poll(&descriptor, 1, static_cast<int>(timeout.count())) <= 0) {
+            return changed;
+        }
+
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+            for (char *position = buffer; position < buffer + length;) {
+                const inotify_event *event = reinterpret_cast<const inotify_event*>(position);
+                auto directory = watchedDirectories.find(event->wd);
+                if (event->len > 0 && directory != watchedDirectories.end()) {
+                    changed.push_back(directory->second + "/" + event->name);
+                }
+                position += sizeof(inotify_event) + event->len;
+            }
+        }
+#else
+        std::this_thread::sleep_for(timeout);
+
+        for (const auto& directory : watchedDirectories) {
+            std::filesystem::path path = std::filesystem::path(root) / directory;
+            if (!std::filesystem::is_directory(path)) {
+                continue;
+            }
+
+            for (const auto& entry : std::filesystem::directory_iterator(path)) {
+                if (!entry.is_regular_file()) {
+                    continue;
+                }
+
+                auto modificationTime = entry.last_write_time();
+                auto& knownTime = modificationTimes[entry.path().string()];
+                if (knownTime != modificationTime) {
+                    knownTime = modificationTime;
+                    changed.push_back(directory + "/" + entry.path().filename().string());
+                }
+            }
+        }
+#endif
+
+        return changed;
+    }
+
+    private:
+    std::string root;
+#ifdef __linux__
+    int inotifyFd = -1;
+    std::map<int, std::string> watchedDirectories;
+#else
+    std::vector<std::string> watchedDirectories;
+    std::map<std::string, std::filesystem::file_time_type> modificationTimes;
+#endif
+};
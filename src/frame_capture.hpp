@@ -0,0 +1,291 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "gpu_memory_tracker.hpp"
+#include "job_system.hpp"
+#include "png.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+
+enum class CaptureFormat {
+    Png,
+    // 8-bit RGB rows with no header; the size is in the file name.
+    Raw
+};
+
+struct CaptureStatistics {
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    // Average time a worker spent converting, encoding and writing a frame.
+    float encodeMilliseconds = 0.0f;
+};
+
+// Copies rendered frames back to the host and writes them out as files, without
+// stalling the frame.
+//
+// Each captured frame is copied by a pass at the end of its render graph into
+// one of RING_SIZE host-visible buffers. Nothing waits on the copy: the buffer
+// is only looked at by collect(), once the frame's fence has signaled, and is
+// then handed to a job that converts, encodes and writes it. The buffer goes
+// back into the ring when the job finishes.
+//
+// When every buffer is taken, a lossy capture skips the frame and counts it as
+// dropped; a lossless one waits for the oldest write to finish.
+class FrameCapture {
+    public:
+    static constexpr uint32_t RING_SIZE = 4;
+
+    void init(VkDevice device, VkPhysicalDevice physicalDevice, GpuMemoryTracker& memoryTracker, JobSystem& jobSystem, VkExtent2D extent, VkFormat format, const std::string& directory, CaptureFormat fileFormat, bool lossless) {
+        this->device = device;
+        this->memoryTracker = &memoryTracker;
+        this->jobSystem = &jobSystem;
+        this->extent = extent;
+        this->directory = directory;
+        this->fileFormat = fileFormat;
+        this->lossless = lossless;
+
+        switch (format) {
+            case VK_FORMAT_B8G8R8A8_UNORM:
+            case VK_FORMAT_B8G8R8A8_SRGB:
+                swapRedBlue = true;
+                break;
+            case VK_FORMAT_R8G8B8A8_UNORM:
+            case VK_FORMAT_R8G8B8A8_SRGB:
+                swapRedBlue = false;
+                break;
+            default:
+                throw std::runtime_error("Failed to set up frame capture: unsupported image format");
+        }
+
+        std::filesystem::create_directories(directory);
+
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        VkDeviceSize size = imageSize();
+        for (Slot& slot : slots) {
+            slot.state = SlotState::Free;
+
+            VkBufferCreateInfo bufferInfo = {};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = size;
+            bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            if (vkCreateBuffer(device, &bufferInfo, nullptr, &slot.buffer) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create capture buffer");
+            }
+            memoryTracker.trackObject(slot.buffer, VK_OBJECT_TYPE_BUFFER, MemoryCategory::Staging);
+
+            VkMemoryRequirements memoryRequirements;
+            vkGetBufferMemoryRequirements(device, slot.buffer, &memoryRequirements);
+
+            // Cached memory reads back an order of magnitude faster than
+            // write-combined memory does.
+            VkMemoryAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.allocationSize = memoryRequirements.size;
+            allocInfo.memoryTypeIndex = findMemoryType(memoryProperties, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+            if (allocInfo.memoryTypeIndex == UINT32_MAX) {
+                allocInfo.memoryTypeIndex = findMemoryType(memoryProperties, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            }
+            if (allocInfo.memoryTypeIndex == UINT32_MAX) {
+                throw std::runtime_error("Failed to find suitable memory type");
+            }
+            coherent = (memoryProperties.memoryTypes[allocInfo.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+            if (memoryTracker.allocate(allocInfo, MemoryCategory::Staging, &slot.memory) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to allocate capture buffer memory");
+            }
+            vkBindBufferMemory(device, slot.buffer, slot.memory, 0);
+            vkMapMemory(device, slot.memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&slot.mapped));
+        }
+    }
+
+    // Waits for the files still being written.
+    void destroy() {
+        for (Slot& slot : slots) {
+            jobSystem->wait(slot.job);
+            memoryTracker->untrackObject(slot.buffer);
+            vkDestroyBuffer(device, slot.buffer, nullptr);
+            memoryTracker->free(slot.memory);
+        }
+    }
+
+    // Copies image, which must have the extent and format given to init, into a
+    // free buffer at the end of the graph. frame numbers the file.
+    void addReadbackPass(RenderGraph& graph, RenderGraphImage image, uint64_t frame) {
+        Slot *slot = acquireSlot();
+        if (slot == nullptr) {
+            dropped++;
+            return;
+        }
+        slot->state = SlotState::Copying;
+        slot->frame = frame;
+
+        RenderGraphBuffer buffer = graph.importBuffer("capture", slot->buffer, imageSize(), {VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT});
+        graph.addPass("capture readback", [&](RenderPassBuilder& pass) {
+            pass.useImage(image, ImageUsage::TransferSrc);
+            pass.useBuffer(buffer, BufferUsage::TransferDst);
+        }, [this, image, buffer](VkCommandBuffer commandBuffer, const RenderGraph& graph) {
+            VkBufferImageCopy region = {};
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = {extent.width, extent.height, 1};
+            vkCmdCopyImageToBuffer(commandBuffer, graph.getImage(image), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, graph.getBuffer(buffer), 1, &region);
+        });
+        graph.addPass("capture host read", [&](RenderPassBuilder& pass) {
+            pass.useBuffer(buffer, BufferUsage::HostRead);
+        }, [](VkCommandBuffer, const RenderGraph&) {});
+    }
+
+    // Called once the fence of every frame submitted so far has signaled: hands
+    // the finished copies to workers to write out.
+    void collect() {
+        for (Slot& slot : slots) {
+            if (slot.state != SlotState::Copying) {
+                continue;
+            }
+            if (!coherent) {
+                VkMappedMemoryRange range = {};
+                range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+                range.memory = slot.memory;
+                range.size = VK_WHOLE_SIZE;
+                vkInvalidateMappedMemoryRanges(device, 1, &range);
+            }
+            slot.state = SlotState::Writing;
+            jobSystem->run([this, &slot]() {
+                PROFILE_ZONE("FrameCapture::write");
+                write(slot);
+            }, slot.job);
+        }
+    }
+
+    CaptureStatistics getStatistics() const {
+        CaptureStatistics statistics;
+        statistics.written = written.load(std::memory_order_relaxed);
+        statistics.dropped = dropped;
+        uint64_t microseconds = encodeMicroseconds.load(std::memory_order_relaxed);
+        statistics.encodeMilliseconds = statistics.written > 0 ? microseconds / 1000.0f / statistics.written : 0.0f;
+        return statistics;
+    }
+
+    private:
+    enum class SlotState {
+        Free,
+        // A copy into the buffer has been recorded.
+        Copying,
+        // A job is writing the buffer out.
+        Writing
+    };
+
+    struct Slot {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        uint8_t *mapped = nullptr;
+        SlotState state = SlotState::Free;
+        uint64_t frame = 0;
+        JobCounter job;
+    };
+
+    VkDevice device;
+    GpuMemoryTracker *memoryTracker;
+    JobSystem *jobSystem;
+    VkExtent2D extent;
+    std::string directory;
+    CaptureFormat fileFormat;
+    bool lossless;
+    bool swapRedBlue;
+    bool coherent;
+    std::array<Slot, RING_SIZE> slots;
+    uint64_t dropped = 0;
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> encodeMicroseconds{0};
+
+    VkDeviceSize imageSize() const {
+        return static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+    }
+
+    Slot *acquireSlot() {
+        Slot *oldest = nullptr;
+        for (Slot& slot : slots) {
+            if (slot.state == SlotState::Writing && slot.job.isDone()) {
+                slot.state = SlotState::Free;
+            }
+            if (slot.state == SlotState::Free) {
+                return &slot;
+            }
+            if (slot.state == SlotState::Writing && (oldest == nullptr || slot.frame < oldest->frame)) {
+                oldest = &slot;
+            }
+        }
+        if (!lossless || oldest == nullptr) {
+            return nullptr;
+        }
+        PROFILE_ZONE("FrameCapture::wait");
+        jobSystem->wait(oldest->job);
+        oldest->state = SlotState::Free;
+        return oldest;
+    }
+
+    void write(const Slot& slot) {
+        auto start = std::chrono::steady_clock::now();
+
+        size_t pixelCount = static_cast<size_t>(extent.width) * extent.height;
+        std::vector<uint8_t> rgb(pixelCount * 3);
+        int red = swapRedBlue ? 2 : 0;
+        int blue = swapRedBlue ? 0 : 2;
+        for (size_t i = 0; i < pixelCount; i++) {
+            const uint8_t *pixel = slot.mapped + i * 4;
+            rgb[i * 3] = pixel[red];
+            rgb[i * 3 + 1] = pixel[1];
+            rgb[i * 3 + 2] = pixel[blue];
+        }
+
+        char name[64];
+        std::vector<uint8_t> encoded;
+        const std::vector<uint8_t> *data = &rgb;
+        if (fileFormat == CaptureFormat::Png) {
+            std::snprintf(name, sizeof(name), "frame-%06llu.png", static_cast<unsigned long long>(slot.frame));
+            encoded = pngEncode(extent.width, extent.height, rgb.data(), static_cast<size_t>(extent.width) * 3);
+            data = &encoded;
+        }
+        else {
+            std::snprintf(name, sizeof(name), "frame-%06llu-%ux%u.rgb", static_cast<unsigned long long>(slot.frame), extent.width, extent.height);
+        }
+
+        std::string path = directory + "/" + name;
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(data->data()), data->size());
+        if (!file) {
+            std::cerr << "Failed to write capture " << path << std::endl;
+            return;
+        }
+
+        auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        encodeMicroseconds.fetch_add(static_cast<uint64_t>(microseconds), std::memory_order_relaxed);
+        written.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static uint32_t findMemoryType(const VkPhysicalDeviceMemoryProperties& memoryProperties, uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+        return UINT32_MAX;
+    }
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "simulation.hpp"
+
+// Binary recording of a run (.diglog), enough to replay it frame for frame: the
+// input each frame handled, the simulation tick and blend it drew, its render
+// scale, and the assets read along the way.
+//
+// [FrameLogHeader][record...]
+//
+// A record is a FrameLogTag byte and its payload, in host byte order. Input and
+// load records belong to the frame record that follows them.
+
+const uint32_t FRAME_LOG_MAGIC = 0x4c474944; // "DIGL"
+const uint32_t FRAME_LOG_VERSION = 1;
+
+struct FrameLogHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    double tickSeconds;
+};
+
+enum class FrameLogTag : uint8_t {
+    // uint16_t path length, path, uint64_t size.
+    Load = 1,
+    // uint8_t InputAction, float x, float y.
+    Input = 2,
+    // uint64_t tick, float blend, double time, float modelAngle, float renderScale,
+    // double wallSeconds.
+    Frame = 3
+};
+
+enum class InputAction : uint8_t {
+    ToggleDepthPrepass,
+    ToggleOcclusionCulling,
+    ToggleTerrainLod,
+    // Digs at point, in normalized device coordinates.
+    Dig,
+    CycleDebugView
+};
+
+struct InputEvent {
+    InputAction action;
+    glm::vec2 point = glm::vec2(0.0f);
+};
+
+struct ResourceLoad {
+    std::string path;
+    uint64_t size;
+
+    bool operator==(const ResourceLoad& other) const {
+        return path == other.path && size == other.size;
+    }
+};
+
+struct FrameRecord {
+    SimulationState state;
+    // How far the frame was between the state's tick and the one before it.
+    float blend = 0.0f;
+    float renderScale = 1.0f;
+    // Since the start of the recording, to replay at the recorded pace.
+    double wallSeconds = 0.0;
+    std::vector<InputEvent> inputs;
+    std::vector<ResourceLoad> loads;
+};
+
+struct FrameLog {
+    FrameLogHeader header;
+    std::vector<FrameRecord> frames;
+};
+
+class FrameLogWriter {
+    public:
+    void open(const std::string& path, uint32_t width, uint32_t height, double tickSeconds) {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Failed to open frame log " + path);
+        }
+        this->path = path;
+
+        FrameLogHeader header = {};
+        header.magic = FRAME_LOG_MAGIC;
+        header.version = FRAME_LOG_VERSION;
+        header.width = width;
+        header.height = height;
+        header.tickSeconds = tickSeconds;
+        writeValue(header);
+    }
+
+    bool isOpen() const {
+        return file.is_open();
+    }
+
+    // Records one frame, with the input and loads that led up to it.
+    void writeFrame(const FrameRecord& frame) {
+        for (const ResourceLoad& load : frame.loads) {
+            writeValue(FrameLogTag::Load);
+            writeValue(static_cast<uint16_t>(load.path.size()));
+            file.write(load.path.data(), static_cast<std::streamsize>(load.path.size()));
+            writeValue(load.size);
+        }
+        for (const InputEvent& input : frame.inputs) {
+            writeValue(FrameLogTag::Input);
+            writeValue(input.action);
+            writeValue(input.point.x);
+            writeValue(input.point.y);
+        }
+        writeValue(FrameLogTag::Frame);
+        writeValue(frame.state.tick);
+        writeValue(frame.blend);
+        writeValue(frame.state.time);
+        writeValue(frame.state.modelAngle);
+        writeValue(frame.renderScale);
+        writeValue(frame.wallSeconds);
+    }
+
+    void close() {
+        file.close();
+        if (file.fail()) {
+            throw std::runtime_error("Failed to write frame log " + path);
+        }
+    }
+
+    private:
+    std::ofstream file;
+    std::string path;
+
+    template <typename T>
+    void writeValue(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+};
+
+class FrameLogReader {
+    public:
+    static FrameLog read(const std::string& path) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            throw std::runtime_error("Failed to open frame log " + path);
+        }
+        std::vector<char> bytes(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+
+        FrameLogReader reader(bytes, path);
+        FrameLog log;
+        log.header = reader.readValue<FrameLogHeader>();
+        if (log.header.magic != FRAME_LOG_MAGIC) {
+            throw std::runtime_error("Not a frame log: " + path);
+        }
+        if (log.header.version != FRAME_LOG_VERSION) {
+            throw std::runtime_error("Unsupported frame log version in " + path);
+        }
+
+        FrameRecord frame;
+        while (reader.offset < bytes.size()) {
+            FrameLogTag tag = reader.readValue<FrameLogTag>();
+            if (tag == FrameLogTag::Load) {
+                ResourceLoad load;
+                uint16_t length = reader.readValue<uint16_t>();
+                load.path.assign(reader.take(length), length);
+                load.size = reader.readValue<uint64_t>();
+                frame.loads.push_back(std::move(load));
+            }
+            else if (tag == FrameLogTag::Input) {
+                InputEvent input;
+                input.action = reader.readValue<InputAction>();
+                input.point.x = reader.readValue<float>();
+                input.point.y = reader.readValue<float>();
+                frame.inputs.push_back(input);
+            }
+            else if (tag == FrameLogTag::Frame) {
+                frame.state.tick = reader.readValue<uint64_t>();
+                frame.blend = reader.readValue<float>();
+                frame.state.time = reader.readValue<double>();
+                frame.state.modelAngle = reader.readValue<float>();
+                frame.renderScale = reader.readValue<float>();
+                frame.wallSeconds = reader.readValue<double>();
+                log.frames.push_back(std::move(frame));
+                frame = FrameRecord();
+            }
+            else {
+                throw std::runtime_error("Corrupt frame log " + path);
+            }
+        }
+        if (log.frames.empty()) {
+            throw std::runtime_error("Frame log has no frames to replay: " + path);
+        }
+        return log;
+    }
+
+    private:
+    const std::vector<char>& bytes;
+    const std::string& path;
+    size_t offset = 0;
+
+    FrameLogReader(const std::vector<char>& bytes, const std::string& path) : bytes(bytes), path(path) {}
+
+    const char *take(size_t size) {
+        if (bytes.size() - offset < size) {
+            throw std::runtime_error("Frame log is truncated: " + path);
+        }
+        const char *data = bytes.data() + offset;
+        offset += size;
+        return data;
+    }
+
+    template <typename T>
+    T readValue() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+};
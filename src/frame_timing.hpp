@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Per-frame timings of a replayed run, and their comparison with a baseline run
+// of the same recording. Kept as CSV (frame,cpu_ms,gpu_ms) so runs can also be
+// looked at in a spreadsheet.
+
+struct FrameTiming {
+    // Time the render thread spent on the frame, not counting the fence wait.
+    float cpuMilliseconds = 0.0f;
+    // 0 where the device has no timestamp queries.
+    float gpuMilliseconds = 0.0f;
+};
+
+struct TimingComparison {
+    bool regressed = false;
+    std::string report;
+};
+
+inline void writeFrameTimings(const std::string& path, const std::vector<FrameTiming>& timings) {
+    std::ofstream file(path, std::ios::trunc);
+    file << "frame,cpu_ms,gpu_ms\n";
+    char line[64];
+    for (size_t i = 0; i < timings.size(); i++) {
+        std::snprintf(line, sizeof(line), "%zu,%.4f,%.4f\n", i, timings[i].cpuMilliseconds, timings[i].gpuMilliseconds);
+        file << line;
+    }
+    if (!file) {
+        throw std::runtime_error("Failed to write frame timings " + path);
+    }
+}
+
+inline std::vector<FrameTiming> readFrameTimings(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to open frame timings " + path);
+    }
+
+    std::vector<FrameTiming> timings;
+    std::string line;
+    std::getline(file, line);
+    while (std::getline(file, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        size_t frame;
+        FrameTiming timing;
+        if (std::sscanf(line.c_str(), "%zu,%f,%f", &frame, &timing.cpuMilliseconds, &timing.gpuMilliseconds) != 3 || frame != timings.size()) {
+            throw std::runtime_error("Corrupt frame timings " + path);
+        }
+        timings.push_back(timing);
+    }
+    return timings;
+}
+
+// Quantile q of values, which it reorders.
+inline float timingQuantile(std::vector<float>& values, float q) {
+    if (values.empty()) {
+        return 0.0f;
+    }
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(q * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+// Compares two runs of the same recording, past the first warmupFrames, in which
+// pipelines and chunk meshes are still being built. A run regresses when the
+// median or 95th percentile CPU or GPU time is more than threshold (a fraction)
+// over the baseline's. Single frames are too noisy to fail on, but the ones past
+// the threshold by more than minMilliseconds are listed, worst first, as a
+// starting point for finding the cause.
+inline TimingComparison compareFrameTimings(const std::vector<FrameTiming>& baseline, const std::vector<FrameTiming>& current, float threshold, size_t warmupFrames, float minMilliseconds = 0.1f) {
+    if (baseline.size() != current.size()) {
+        throw std::runtime_error("Failed to compare frame timings: the baseline has " + std::to_string(baseline.size()) + " frames and the run " + std::to_string(current.size()));
+    }
+
+    TimingComparison comparison;
+    char line[160];
+    size_t first = std::min(warmupFrames, current.size());
+
+    for (int metric = 0; metric < 2; metric++) {
+        const char *name = metric == 0 ? "CPU" : "GPU";
+        auto value = [metric](const FrameTiming& timing) {
+            return metric == 0 ? timing.cpuMilliseconds : timing.gpuMilliseconds;
+        };
+
+        std::vector<float> baselineValues;
+        std::vector<float> currentValues;
+        for (size_t i = first; i < current.size(); i++) {
+            baselineValues.push_back(value(baseline[i]));
+            currentValues.push_back(value(current[i]));
+        }
+        bool measured = std::any_of(baselineValues.begin(), baselineValues.end(), [](float v) { return v > 0.0f; })
+                        && std::any_of(currentValues.begin(), currentValues.end(), [](float v) { return v > 0.0f; });
+        if (!measured) {
+            comparison.report += std::string(name) + " times not measured in both runs\n";
+            continue;
+        }
+
+        struct Regression {
+            size_t frame;
+            float ratio;
+        };
+        std::vector<Regression> frames;
+        for (size_t i = first; i < current.size(); i++) {
+            float was = value(baseline[i]);
+            float is = value(current[i]);
+            if (is > was * (1.0f + threshold) && is - was > minMilliseconds) {
+                frames.push_back({i, was > 0.0f ? is / was : INFINITY});
+            }
+        }
+
+        const float quantiles[] = {0.5f, 0.95f};
+        const char *quantileNames[] = {"median", "p95"};
+        for (int q = 0; q < 2; q++) {
+            float was = timingQuantile(baselineValues, quantiles[q]);
+            float is = timingQuantile(currentValues, quantiles[q]);
+            bool regressed = is > was * (1.0f + threshold);
+            comparison.regressed = comparison.regressed || regressed;
+            std::snprintf(line, sizeof(line), "%s %s %.3f ms, baseline %.3f ms (%+.1f%%)%s\n", name, quantileNames[q], is, was,
+                          was > 0.0f ? (is / was - 1.0f) * 100.0f : 0.0f, regressed ? " REGRESSED" : "");
+            comparison.report += line;
+        }
+
+        if (!frames.empty()) {
+            std::sort(frames.begin(), frames.end(), [](const Regression& a, const Regression& b) {
+                return a.ratio > b.ratio;
+            });
+            std::snprintf(line, sizeof(line), "%s: %zu of %zu frames over the threshold, worst:", name, frames.size(), current.size() - first);
+            comparison.report += line;
+            for (size_t i = 0; i < std::min<size_t>(frames.size(), 5); i++) {
+                std::snprintf(line, sizeof(line), " %zu (%.2fx)", frames[i].frame, frames[i].ratio);
+                comparison.report += line;
+            }
+            comparison.report += "\n";
+        }
+    }
+    return comparison;
+}
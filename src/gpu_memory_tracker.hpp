@@ -0,0 +1,298 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+#include <vulkan/vulkan.h>
+
+enum class MemoryCategory {
+    Texture,
+    Buffer,
+    Staging,
+    Attachment,
+    Count
+};
+
+inline const char *memoryCategoryName(MemoryCategory category) {
+    switch (category) {
+        case MemoryCategory::Texture: return "textures";
+        case MemoryCategory::Buffer: return "buffers";
+        case MemoryCategory::Staging: return "staging";
+        case MemoryCategory::Attachment: return "attachments";
+        default: return "unknown";
+    }
+}
+
+enum class MemoryPressure {
+    Normal,
+    High,
+    Critical
+};
+
+struct MemoryHeapUsage {
+    VkDeviceSize size;
+    VkDeviceSize budget;
+    // Process usage as reported by VK_EXT_memory_budget, or what the tracker has
+    // seen allocated when the extension is missing.
+    VkDeviceSize usage;
+    bool deviceLocal;
+};
+
+// Tracks device memory allocations and resource objects by category, and the
+// device-local heaps against their budget. Allocations go through allocate()
+// and free(); objects are registered with trackObject() so that anything still
+// alive at shutdown can be reported. When usage approaches the budget, the
+// registered pressure handlers are asked to release memory.
+class GpuMemoryTracker {
+    public:
+    using PressureHandler = std::function<void(MemoryPressure)>;
+
+    static bool isBudgetExtensionSupported(VkPhysicalDevice physicalDevice) {
+        uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> extensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+
+        return std::any_of(extensions.begin(), extensions.end(), [](const VkExtensionProperties& extension) {
+            return std::strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0;
+        });
+    }
+
+    void init(VkDevice device, VkPhysicalDevice physicalDevice, bool budgetExtensionEnabled) {
+        this->device = device;
+        this->physicalDevice = physicalDevice;
+        this->budgetExtensionEnabled = budgetExtensionEnabled;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        heaps = queryHeaps();
+        lastLogTime = std::chrono::steady_clock::now();
+    }
+
+    void addPressureHandler(PressureHandler handler) {
+        pressureHandlers.push_back(std::move(handler));
+    }
+
+    VkResult allocate(const VkMemoryAllocateInfo& allocInfo, MemoryCategory category, VkDeviceMemory *memory) {
+        VkResult result = vkAllocateMemory(device, &allocInfo, nullptr, memory);
+        if (result != VK_SUCCESS) {
+            return result;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t heap = memoryProperties.memoryTypes[allocInfo.memoryTypeIndex].heapIndex;
+        allocations[*memory] = {allocInfo.allocationSize, heap, category};
+        categoryBytes[static_cast<size_t>(category)] += allocInfo.allocationSize;
+        heapBytes[heap] += allocInfo.allocationSize;
+        allocationCount++;
+        return result;
+    }
+
+    void free(VkDeviceMemory memory) {
+        if (memory == VK_NULL_HANDLE) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto allocation = allocations.find(memory);
+            if (allocation != allocations.end()) {
+                categoryBytes[static_cast<size_t>(allocation->second.category)] -= allocation->second.size;
+                heapBytes[allocation->second.heap] -= allocation->second.size;
+                allocations.erase(allocation);
+                allocationCount--;
+            }
+        }
+
+        vkFreeMemory(device, memory, nullptr);
+    }
+
+    template <typename Handle>
+    void trackObject(Handle handle, VkObjectType type, MemoryCategory category) {
+        std::lock_guard<std::mutex> lock(mutex);
+        objects[reinterpret_cast<uint64_t>(handle)] = {type, category};
+        objectCounts[static_cast<size_t>(category)]++;
+    }
+
+    template <typename Handle>
+    void untrackObject(Handle handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto object = objects.find(reinterpret_cast<uint64_t>(handle));
+        if (object != objects.end()) {
+            objectCounts[static_cast<size_t>(object->second.category)]--;
+            objects.erase(object);
+        }
+    }
+
+    // Call once a frame, at a point where pressure handlers may free resources
+    // the GPU is done with. Budgets are re-queried a few times a second.
+    void update() {
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastQueryTime < QUERY_INTERVAL) {
+            return;
+        }
+        lastQueryTime = now;
+        heaps = queryHeaps();
+
+        MemoryPressure previous = pressure;
+        double ratio = getBudgetRatio();
+        if (ratio >= CRITICAL_RATIO) {
+            pressure = MemoryPressure::Critical;
+        }
+        else if (ratio >= HIGH_RATIO) {
+            pressure = MemoryPressure::High;
+        }
+        else if (ratio < NORMAL_RATIO) {
+            pressure = MemoryPressure::Normal;
+        }
+
+        // Handlers are told about every change, and asked again every few
+        // seconds while pressure persists, giving what they released time to
+        // show in the budget before they release more.
+        bool repeat = pressure != MemoryPressure::Normal && now - lastPressureTime >= PRESSURE_REPEAT_INTERVAL;
+        if (pressure != previous || repeat) {
+            lastPressureTime = now;
+            for (const auto& handler : pressureHandlers) {
+                handler(pressure);
+            }
+        }
+
+        if (now - lastLogTime >= LOG_INTERVAL) {
+            lastLogTime = now;
+            log(std::cout);
+        }
+    }
+
+    MemoryPressure getPressure() const {
+        return pressure;
+    }
+
+    // Highest usage/budget ratio over the device-local heaps.
+    double getBudgetRatio() const {
+        double ratio = 0.0;
+        for (const auto& heap : heaps) {
+            if (heap.deviceLocal && heap.budget > 0) {
+                ratio = std::max(ratio, static_cast<double>(heap.usage) / static_cast<double>(heap.budget));
+            }
+        }
+        return ratio;
+    }
+
+    // One line for the window title.
+    std::string getSummary() const {
+        VkDeviceSize usage = 0;
+        VkDeviceSize budget = 0;
+        for (const auto& heap : heaps) {
+            if (heap.deviceLocal) {
+                usage += heap.usage;
+                budget += heap.budget;
+            }
+        }
+
+        std::ostringstream summary;
+        summary << "VRAM " << usage / MEBIBYTE << "/" << budget / MEBIBYTE << " MiB";
+        return summary.str();
+    }
+
+    void log(std::ostream& out) const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        out << "GPU memory: " << allocationCount << " allocations";
+        for (size_t category = 0; category < CATEGORY_COUNT; category++) {
+            out << ", " << memoryCategoryName(static_cast<MemoryCategory>(category)) << " "
+                << categoryBytes[category] / KIBIBYTE << " KiB/" << objectCounts[category] << " objects";
+        }
+        out << std::endl;
+
+        for (size_t i = 0; i < heaps.size(); i++) {
+            out << "  heap " << i << (heaps[i].deviceLocal ? " (device local)" : "") << ": "
+                << heaps[i].usage / MEBIBYTE << " MiB used of " << heaps[i].budget / MEBIBYTE << " MiB budget, "
+                << heapBytes[i] / MEBIBYTE << " MiB allocated by the engine" << std::endl;
+        }
+    }
+
+    // Anything still registered at shutdown was never destroyed.
+    void reportLeaks(std::ostream& out) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& [handle, object] : objects) {
+            out << "Leaked Vulkan object 0x" << std::hex << handle << std::dec << " (type " << object.type << ", "
+                << memoryCategoryName(object.category) << ")" << std::endl;
+        }
+        for (const auto& [memory, allocation] : allocations) {
+            out << "Leaked " << allocation.size << " bytes of " << memoryCategoryName(allocation.category) << " memory" << std::endl;
+        }
+    }
+
+    private:
+    static constexpr size_t CATEGORY_COUNT = static_cast<size_t>(MemoryCategory::Count);
+    static constexpr VkDeviceSize KIBIBYTE = 1024;
+    static constexpr VkDeviceSize MEBIBYTE = 1024 * 1024;
+    static constexpr double HIGH_RATIO = 0.8;
+    static constexpr double CRITICAL_RATIO = 0.95;
+    static constexpr double NORMAL_RATIO = 0.7;
+    static constexpr std::chrono::milliseconds QUERY_INTERVAL{500};
+    static constexpr std::chrono::seconds LOG_INTERVAL{10};
+    static constexpr std::chrono::seconds PRESSURE_REPEAT_INTERVAL{5};
+
+    struct Allocation {
+        VkDeviceSize size;
+        uint32_t heap;
+        MemoryCategory category;
+    };
+
+    struct TrackedObject {
+        VkObjectType type;
+        MemoryCategory category;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    bool budgetExtensionEnabled = false;
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+
+    mutable std::mutex mutex;
+    std::unordered_map<VkDeviceMemory, Allocation> allocations;
+    std::unordered_map<uint64_t, TrackedObject> objects;
+    std::array<VkDeviceSize, CATEGORY_COUNT> categoryBytes = {};
+    std::array<size_t, CATEGORY_COUNT> objectCounts = {};
+    std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> heapBytes = {};
+    size_t allocationCount = 0;
+
+    std::vector<MemoryHeapUsage> heaps;
+    MemoryPressure pressure = MemoryPressure::Normal;
+    std::vector<PressureHandler> pressureHandlers;
+    std::chrono::steady_clock::time_point lastQueryTime;
+    std::chrono::steady_clock::time_point lastLogTime;
+    std::chrono::steady_clock::time_point lastPressureTime;
+
+    // Without the budget extension, the heap size stands in for the budget and the
+    // engine's own allocations for the usage.
+    std::vector<MemoryHeapUsage> queryHeaps() const {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 properties = {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties.pNext = budgetExtensionEnabled ? &budgetProperties : nullptr;
+        vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<MemoryHeapUsage> usage(properties.memoryProperties.memoryHeapCount);
+        for (uint32_t i = 0; i < properties.memoryProperties.memoryHeapCount; i++) {
+            const VkMemoryHeap& heap = properties.memoryProperties.memoryHeaps[i];
+            usage[i].size = heap.size;
+            usage[i].deviceLocal = (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+            usage[i].budget = budgetExtensionEnabled ? budgetProperties.heapBudget[i] : heap.size;
+            usage[i].usage = budgetExtensionEnabled ? budgetProperties.heapUsage[i] : heapBytes[i];
+        }
+        return usage;
+    }
+};
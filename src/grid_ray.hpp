@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+// Amanatides-Woo traversal of a uniform grid: steps through the cells a ray
+// passes, in order, one face crossing at a time. Shared by the voxel raycast and
+// the spatial hash grid.
+struct GridRay {
+    // Current cell, and the ray distances at which it was entered and is left
+    // along each axis.
+    glm::ivec3 cell;
+    glm::ivec3 step;
+    glm::vec3 tMax;
+    glm::vec3 tDelta;
+    float t;
+    // Axis whose face was crossed to enter the current cell, or -1 for the
+    // starting cell.
+    int axis = -1;
+
+    // The direction must be normalized.
+    GridRay(const glm::vec3& origin, const glm::vec3& direction, float cellSize)
+        : GridRay(origin, direction, cellSize, 0.0f, glm::ivec3(glm::floor(origin / cellSize))) {}
+
+    // Starts at distance tStart in the given cell, for resuming a traversal
+    // inside a cell found by a coarser one. Face distances are measured from the
+    // origin, so no error builds up from the restart.
+    GridRay(const glm::vec3& origin, const glm::vec3& direction, float cellSize, float tStart, const glm::ivec3& startCell)
+        : cell(startCell), t(tStart) {
+        const float infinity = std::numeric_limits<float>::infinity();
+        for (int i = 0; i < 3; i++) {
+            if (direction[i] > 0.0f) {
+                step[i] = 1;
+                tDelta[i] = cellSize / direction[i];
+                tMax[i] = ((cell[i] + 1) * cellSize - origin[i]) / direction[i];
+            }
+            else if (direction[i] < 0.0f) {
+                step[i] = -1;
+                tDelta[i] = -cellSize / direction[i];
+                tMax[i] = (cell[i] * cellSize - origin[i]) / direction[i];
+            }
+            else {
+                step[i] = 0;
+                tDelta[i] = infinity;
+                tMax[i] = infinity;
+            }
+        }
+    }
+
+    // Distance at which the ray leaves the current cell.
+    float exitDistance() const {
+        return std::fmin(tMax.x, std::fmin(tMax.y, tMax.z));
+    }
+
+    void advance() {
+        axis = tMax.x < tMax.y ? (tMax.x < tMax.z ? 0 : 2) : (tMax.y < tMax.z ? 1 : 2);
+        cell[axis] += step[axis];
+        t = tMax[axis];
+        tMax[axis] += tDelta[axis];
+    }
+
+    // Outward normal of the face the ray entered the current cell through.
+    glm::ivec3 entryNormal() const {
+        glm::ivec3 normal(0);
+        if (axis >= 0) {
+            normal[axis] = -step[axis];
+        }
+        return normal;
+    }
+};
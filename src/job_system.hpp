@@ -0,0 +1,302 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "profiler.hpp"
+
+// Counts unfinished jobs. A job may be made to wait on a counter from any thread
+// that belongs to the job system, which runs other jobs in the meantime.
+struct JobCounter {
+    std::atomic<uint32_t> pending{0};
+
+    bool isDone() const {
+        return pending.load(std::memory_order_acquire) == 0;
+    }
+};
+
+struct Job {
+    std::function<void()> function;
+    JobCounter *counter;
+};
+
+// Chase-Lev work-stealing deque of fixed capacity. The owning thread pushes and
+// pops at the bottom; any other thread may steal from the top.
+class JobDeque {
+    public:
+    static constexpr int64_t CAPACITY = 1 << 12;
+
+    JobDeque() : jobs(new std::atomic<Job *>[CAPACITY]) {}
+
+    // Owner only. Returns false when full.
+    bool push(Job *job) {
+        int64_t bottom = this->bottom.load(std::memory_order_relaxed);
+        int64_t top = this->top.load(std::memory_order_acquire);
+        if (bottom - top >= CAPACITY) {
+            return false;
+        }
+
+        jobs[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+        this->bottom.store(bottom + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Owner only.
+    Job *pop() {
+        int64_t bottom = this->bottom.load(std::memory_order_relaxed) - 1;
+        this->bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = this->top.load(std::memory_order_relaxed);
+
+        if (top > bottom) {
+            this->bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Job *job = jobs[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (top == bottom) {
+            // Last job: race the thieves for it.
+            if (!this->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                job = nullptr;
+            }
+            this->bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    // Any thread.
+    Job *steal() {
+        int64_t top = this->top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = this->bottom.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return nullptr;
+        }
+
+        Job *job = jobs[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!this->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return job;
+    }
+
+    private:
+    std::unique_ptr<std::atomic<Job *>[]> jobs;
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+};
+
+// Engine-wide work-stealing scheduler: one worker per core besides the main
+// thread, each with its own deque. Jobs pushed from a worker or the main thread
+// go to that thread's deque; idle threads steal from the others. Jobs submitted
+// from threads outside the system go through a shared queue.
+//
+// Waiting never blocks while there is work: wait() runs queued jobs until the
+// counter reaches zero, so jobs may themselves spawn and wait on other jobs.
+class JobSystem {
+    public:
+    explicit JobSystem(unsigned workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1) {
+        // Slot 0 belongs to the thread that created the system.
+        for (unsigned i = 0; i <= workerCount; i++) {
+            queues.push_back(std::make_unique<JobDeque>());
+        }
+        threadIndex() = 0;
+        threadOwner() = this;
+
+        running = true;
+        for (unsigned i = 1; i <= workerCount; i++) {
+            workers.emplace_back([this, i]() {
+                threadIndex() = i;
+                threadOwner() = this;
+                PROFILE_THREAD("job worker");
+                workerLoop(i);
+            });
+        }
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            running = false;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    unsigned getThreadCount() const {
+        return static_cast<unsigned>(queues.size());
+    }
+
+    void run(std::function<void()> function, JobCounter& counter) {
+        counter.pending.fetch_add(1, std::memory_order_relaxed);
+        Job *job = new Job{std::move(function), &counter};
+
+        size_t index = threadOwner() == this ? threadIndex() : SIZE_MAX;
+        if (index == SIZE_MAX) {
+            std::lock_guard<std::mutex> lock(submittedMutex);
+            submitted.push_back(job);
+            submittedCount.fetch_add(1, std::memory_order_release);
+        }
+        else if (!queues[index]->push(job)) {
+            // The deque is full; running the job right away still makes progress.
+            execute(job);
+            return;
+        }
+
+        queuedJobs.fetch_add(1, std::memory_order_release);
+        if (sleepingWorkers.load(std::memory_order_acquire) > 0) {
+            wake.notify_one();
+        }
+    }
+
+    // Runs other jobs until the counter reaches zero.
+    void wait(const JobCounter& counter) {
+        PROFILE_ZONE("JobSystem::wait");
+        size_t index = threadOwner() == this ? threadIndex() : SIZE_MAX;
+        while (!counter.isDone()) {
+            if (!runOne(index)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Calls function(first, last) over [begin, end) in batches of at most
+    // batchSize, spread over all threads, and returns once all are done.
+    template <typename Function>
+    void parallelFor(size_t begin, size_t end, size_t batchSize, Function&& function) {
+        if (begin >= end) {
+            return;
+        }
+
+        batchSize = std::max<size_t>(1, batchSize);
+        JobCounter counter;
+        size_t first = begin;
+        // The calling thread takes the last batch itself.
+        for (; end - first > batchSize; first += batchSize) {
+            size_t last = first + batchSize;
+            run([&function, first, last]() {
+                function(first, last);
+            }, counter);
+        }
+        function(first, end);
+        wait(counter);
+    }
+
+    // Picks a batch size giving each thread a few batches to balance with.
+    size_t batchSizeFor(size_t count, size_t minBatchSize = 1) const {
+        size_t batches = static_cast<size_t>(getThreadCount()) * BATCHES_PER_THREAD;
+        return std::max(minBatchSize, (count + batches - 1) / batches);
+    }
+
+    private:
+    static constexpr size_t BATCHES_PER_THREAD = 4;
+    static constexpr int IDLE_SPINS = 64;
+
+    std::vector<std::unique_ptr<JobDeque>> queues;
+    std::vector<std::thread> workers;
+    std::mutex submittedMutex;
+    std::deque<Job *> submitted;
+    std::atomic<size_t> submittedCount{0};
+    std::atomic<int64_t> queuedJobs{0};
+    std::atomic<int> sleepingWorkers{0};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool running;
+
+    static size_t& threadIndex() {
+        thread_local size_t index = SIZE_MAX;
+        return index;
+    }
+
+    static JobSystem *& threadOwner() {
+        thread_local JobSystem *owner = nullptr;
+        return owner;
+    }
+
+    void workerLoop(size_t index) {
+        int idle = 0;
+        while (true) {
+            if (runOne(index)) {
+                idle = 0;
+                continue;
+            }
+
+            if (++idle < IDLE_SPINS) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // A notify can slip in between the check and the wait; the timeout
+            // bounds how long such a job sits unnoticed.
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            if (!running) {
+                return;
+            }
+            sleepingWorkers.fetch_add(1, std::memory_order_acq_rel);
+            wake.wait_for(lock, std::chrono::milliseconds(1), [this]() {
+                return !running || queuedJobs.load(std::memory_order_acquire) > 0;
+            });
+            sleepingWorkers.fetch_sub(1, std::memory_order_acq_rel);
+            idle = 0;
+        }
+    }
+
+    bool runOne(size_t index) {
+        Job *job = index != SIZE_MAX ? queues[index]->pop() : nullptr;
+        if (job == nullptr) {
+            job = steal(index);
+        }
+        if (job == nullptr) {
+            return false;
+        }
+
+        queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+        execute(job);
+        return true;
+    }
+
+    Job *steal(size_t index) {
+        if (submittedCount.load(std::memory_order_acquire) > 0) {
+            std::lock_guard<std::mutex> lock(submittedMutex);
+            if (!submitted.empty()) {
+                Job *job = submitted.front();
+                submitted.pop_front();
+                submittedCount.fetch_sub(1, std::memory_order_relaxed);
+                return job;
+            }
+        }
+
+        // Start at the next thread over, so thieves spread across victims.
+        size_t count = queues.size();
+        size_t start = index != SIZE_MAX ? index + 1 : 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t victim = (start + i) % count;
+            if (victim == index) {
+                continue;
+            }
+            if (Job *job = queues[victim]->steal()) {
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    void execute(Job *job) {
+        job->function();
+        job->counter->pending.fetch_sub(1, std::memory_order_release);
+        delete job;
+    }
+};
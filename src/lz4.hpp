@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <stdexcept>
+
+// Minimal LZ4 block format codec (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md).
+// The compressor is a plain greedy single-probe matcher, which is plenty for
+// offline packing; the decompressor is what runs at load time.
+
+inline size_t lz4CompressBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+inline void lz4WriteLength(std::vector<uint8_t>& output, size_t length) {
+    while (length >= 255) {
+        output.push_back(255);
+        length -= 255;
+    }
+    output.push_back(static_cast<uint8_t>(length));
+}
+
+inline void lz4WriteSequence(std::vector<uint8_t>& output, const uint8_t *literals, size_t literalLength, size_t offset, size_t matchLength) {
+    size_t tokenPosition = output.size();
+    output.push_back(static_cast<uint8_t>((literalLength >= 15 ? 15 : literalLength) << 4));
+    if (literalLength >= 15) {
+        lz4WriteLength(output, literalLength - 15);
+    }
+    output.insert(output.end(), literals, literals + literalLength);
+
+    // The final sequence carries literals only.
+    if (matchLength == 0) {
+        return;
+    }
+
+    output.push_back(static_cast<uint8_t>(offset & 0xff));
+    output.push_back(static_cast<uint8_t>(offset >> 8));
+
+    size_t encodedMatchLength = matchLength - 4;
+    output[tokenPosition] |= static_cast<uint8_t>(encodedMatchLength >= 15 ? 15 : encodedMatchLength);
+    if (encodedMatchLength >= 15) {
+        lz4WriteLength(output, encodedMatchLength - 15);
+    }
+}
+
+inline std::vector<uint8_t> lz4Compress(const uint8_t *input, size_t size) {
+    const size_t minMatch = 4;
+    const size_t lastLiterals = 5;
+    const size_t matchFindLimit = 12;
+    const int hashBits = 16;
+    const size_t maxOffset = 65535;
+
+    std::vector<uint8_t> output;
+    output.reserve(lz4CompressBound(size));
+
+    size_t anchor = 0;
+    if (size > matchFindLimit) {
+        std::vector<uint32_t> table(size_t(1) << hashBits, UINT32_MAX);
+        size_t position = 0;
+
+        while (position < size - matchFindLimit) {
+            uint32_t sequence;
+            memcpy(&sequence, input + position, sizeof(sequence));
+            uint32_t hash = (sequence * 2654435761u) >> (32 - hashBits);
+            uint32_t candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(position);
+
+            uint32_t candidateSequence = 0;
+            if (candidate != UINT32_MAX) {
+                memcpy(&candidateSequence, input + candidate, sizeof(candidateSequence));
+            }
+
+            if (candidate == UINT32_MAX || position - candidate > maxOffset || candidateSequence != sequence) {
+                position++;
+                continue;
+            }
+
+            size_t matchLength = minMatch;
+            while (position + matchLength < size - lastLiterals && input[candidate + matchLength] == input[position + matchLength]) {
+                matchLength++;
+            }
+
+            lz4WriteSequence(output, input + anchor, position - anchor, position - candidate, matchLength);
+            position += matchLength;
+            anchor = position;
+        }
+    }
+
+    lz4WriteSequence(output, input + anchor, size - anchor, 0, 0);
+    return output;
+}
+
+inline void lz4Decompress(const uint8_t *input, size_t inputSize, uint8_t *output, size_t outputSize) {
+    const uint8_t *inputEnd = input + inputSize;
+    uint8_t *outputPosition = output;
+    uint8_t *outputEnd = output + outputSize;
+
+    auto readLength = [&](size_t length) {
+        if (length == 15) {
+            uint8_t byte;
+            do {
+                if (input >= inputEnd) {
+                    throw std::runtime_error("Corrupt LZ4 block: truncated length");
+                }
+                byte = *input++;
+                length += byte;
+            } while (byte == 255);
+        }
+        return length;
+    };
+
+    while (input < inputEnd) {
+        uint8_t token = *input++;
+
+        size_t literalLength = readLength(token >> 4);
+        if (literalLength > static_cast<size_t>(inputEnd - input) || literalLength > static_cast<size_t>(outputEnd - outputPosition)) {
+            throw std::runtime_error("Corrupt LZ4 block: literals out of bounds");
+        }
+        memcpy(outputPosition, input, literalLength);
+        input += literalLength;
+        outputPosition += literalLength;
+
+        if (input == inputEnd) {
+            break;
+        }
+
+        if (inputEnd - input < 2) {
+            throw std::runtime_error("Corrupt LZ4 block: truncated offset");
+        }
+        size_t offset = input[0] | (input[1] << 8);
+        input += 2;
+
+        size_t matchLength = readLength(token & 15) + 4;
+        if (offset == 0 || offset > static_cast<size_t>(outputPosition - output) || matchLength > static_cast<size_t>(outputEnd - outputPosition)) {
+            throw std::runtime_error("Corrupt LZ4 block: match out of bounds");
+        }
+
+        // Matches may overlap their own output (offset < length), so copy forwards.
+        const uint8_t *match = outputPosition - offset;
+        for (size_t i = 0; i < matchLength; i++) {
+            outputPosition[i] = match[i];
+        }
+        outputPosition += matchLength;
+    }
+
+    if (outputPosition != outputEnd) {
+        throw std::runtime_error("Corrupt LZ4 block: size mismatch");
+    }
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. The mapping is released on close()
+// or destruction, so pointers into data() must not outlive the MappedFile.
+class MappedFile {
+    public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string& path) {
+        open(path);
+    }
+
+    ~MappedFile() {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            mappedData = other.mappedData;
+            mappedSize = other.mappedSize;
+#ifdef _WIN32
+            mappingHandle = other.mappingHandle;
+            other.mappingHandle = nullptr;
+#endif
+            other.mappedData = nullptr;
+            other.mappedSize = 0;
+        }
+        return *this;
+    }
+
+    void open(const std::string& path) {
+        close();
+
+#ifdef _WIN32
+        HANDLE fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Failed to open file " + path);
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(fileHandle);
+            throw std::runtime_error("Failed to map empty file " + path);
+        }
+
+        mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(fileHandle);
+        if (mappingHandle == nullptr) {
+            throw std::runtime_error("Failed to map file " + path);
+        }
+
+        mappedData = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+        if (mappedData == nullptr) {
+            CloseHandle(mappingHandle);
+            mappingHandle = nullptr;
+            throw std::runtime_error("Failed to map file " + path);
+        }
+        mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open file " + path);
+        }
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to map empty file " + path);
+        }
+
+        void *mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("Failed to map file " + path);
+        }
+
+        mappedData = static_cast<const uint8_t*>(mapping);
+        mappedSize = static_cast<size_t>(fileStat.st_size);
+#endif
+    }
+
+    void close() {
+        if (mappedData == nullptr) {
+            return;
+        }
+
+#ifdef _WIN32
+        UnmapViewOfFile(mappedData);
+        CloseHandle(mappingHandle);
+        mappingHandle = nullptr;
+#else
+        munmap(const_cast<uint8_t*>(mappedData), mappedSize);
+#endif
+        mappedData = nullptr;
+        mappedSize = 0;
+    }
+
+    // Asks the OS to read the whole file ahead of use, turning later page faults
+    // into one sequential read. Advisory only; failures are ignored.
+    void prefetch() const {
+        if (mappedData == nullptr) {
+            return;
+        }
+
+#ifdef _WIN32
+        WIN32_MEMORY_RANGE_ENTRY range = {const_cast<uint8_t*>(mappedData), mappedSize};
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+        madvise(const_cast<uint8_t*>(mappedData), mappedSize, MADV_WILLNEED);
+#endif
+    }
+
+    bool isOpen() const {
+        return mappedData != nullptr;
+    }
+
+    const uint8_t* data() const {
+        return mappedData;
+    }
+
+    size_t size() const {
+        return mappedSize;
+    }
+
+    private:
+    const uint8_t* mappedData = nullptr;
+    size_t mappedSize = 0;
+#ifdef _WIN32
+    HANDLE mappingHandle = nullptr;
+#endif
+};
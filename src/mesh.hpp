@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <stdexcept>
+
+#include <vulkan/vulkan.h>
+
+#include "mesh_format.hpp"
+#include "vfs.hpp"
+
+// A cooked mesh, used in place from its asset (normally a view into a mapped pack
+// or loose file). The vertex and index streams stay valid until release(); the
+// header (counts, index type, bounds) remains available afterwards for drawing.
+class Mesh {
+    public:
+    void load(const Vfs& vfs, const std::string& path) {
+        asset = vfs.read(path);
+
+        if (asset.size() < sizeof(MeshFileHeader)) {
+            throw std::runtime_error("Mesh file is truncated: " + path);
+        }
+
+        memcpy(&header, asset.data(), sizeof(MeshFileHeader));
+
+        if (header.magic != MESH_FILE_MAGIC || header.version != MESH_FILE_VERSION) {
+            throw std::runtime_error("Unsupported mesh file: " + path);
+        }
+
+        if (header.vertexLayout > static_cast<uint32_t>(MeshVertexLayout::Packed) || header.vertexStride != meshVertexStride(vertexLayout())) {
+            throw std::runtime_error("Unsupported mesh vertex layout: " + path);
+        }
+
+        if (header.indexType != static_cast<uint32_t>(MeshIndexType::Uint16) && header.indexType != static_cast<uint32_t>(MeshIndexType::Uint32)) {
+            throw std::runtime_error("Unsupported mesh index type: " + path);
+        }
+
+        if (header.vertexCount == 0 || header.indexCount == 0 || header.indexCount % 3 != 0) {
+            throw std::runtime_error("Mesh file has no triangles: " + path);
+        }
+
+        if (header.vertexOffset % MESH_STREAM_ALIGNMENT != 0 || header.indexOffset % MESH_STREAM_ALIGNMENT != 0 ||
+            header.vertexOffset + vertexDataSize() > asset.size() || header.indexOffset + indexDataSize() > asset.size()) {
+            throw std::runtime_error("Mesh file streams are out of bounds: " + path);
+        }
+    }
+
+    void release() {
+        asset = Asset();
+    }
+
+    const void* vertexData() const {
+        return asset.data() + header.vertexOffset;
+    }
+
+    VkDeviceSize vertexDataSize() const {
+        return static_cast<VkDeviceSize>(header.vertexStride) * header.vertexCount;
+    }
+
+    const void* indexData() const {
+        return asset.data() + header.indexOffset;
+    }
+
+    VkDeviceSize indexDataSize() const {
+        return static_cast<VkDeviceSize>(meshIndexSize(static_cast<MeshIndexType>(header.indexType))) * header.indexCount;
+    }
+
+    MeshVertexLayout vertexLayout() const {
+        return static_cast<MeshVertexLayout>(header.vertexLayout);
+    }
+
+    uint32_t indexCount() const {
+        return header.indexCount;
+    }
+
+    VkIndexType indexType() const {
+        return header.indexType == static_cast<uint32_t>(MeshIndexType::Uint16) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    }
+
+    const MeshFileHeader& getHeader() const {
+        return header;
+    }
+
+    private:
+    Asset asset;
+    MeshFileHeader header = {};
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+// On-disk layout of a cooked mesh (.mesh), as written by tools/meshcook.cpp.
+// The file is a MeshFileHeader followed by the vertex and index streams, each
+// starting on a MESH_STREAM_ALIGNMENT boundary so they can be copied straight
+// out of a memory mapping into a staging buffer.
+
+const uint32_t MESH_FILE_MAGIC = 0x4853454d; // "MESH"
+const uint32_t MESH_FILE_VERSION = 1;
+const uint64_t MESH_STREAM_ALIGNMENT = 16;
+
+enum class MeshVertexLayout : uint32_t {
+    Standard = 0,
+    Packed = 1
+};
+
+enum class MeshIndexType : uint32_t {
+    Uint16 = 0,
+    Uint32 = 1
+};
+
+struct MeshFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexLayout;
+    uint32_t vertexStride;
+    uint32_t vertexCount;
+    uint32_t indexType;
+    uint32_t indexCount;
+    uint32_t reserved;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+// Vertex stream element for MeshVertexLayout::Standard.
+struct MeshStandardVertex {
+    float pos[3];
+    float color[3];
+    float texCoord[2];
+};
+
+// Vertex stream element for MeshVertexLayout::Packed, for voxel and tile geometry.
+// Positions are UNORM16 relative to the mesh bounds (the chunk origin and extent),
+// colors UNORM8, texture coordinates UNORM16 and normals 10:10:10:2 UNORM.
+struct MeshPackedVertex {
+    uint16_t pos[4];
+    uint8_t color[4];
+    uint16_t texCoord[2];
+    uint32_t normal;
+};
+
+static_assert(std::is_trivially_copyable<MeshFileHeader>::value, "MeshFileHeader must be trivially copyable");
+static_assert(std::is_trivially_copyable<MeshStandardVertex>::value, "MeshStandardVertex must be trivially copyable");
+static_assert(sizeof(MeshPackedVertex) == 20, "MeshPackedVertex must be tightly packed");
+
+inline uint32_t meshVertexStride(MeshVertexLayout vertexLayout) {
+    switch (vertexLayout) {
+        case MeshVertexLayout::Standard:
+            return sizeof(MeshStandardVertex);
+        case MeshVertexLayout::Packed:
+            return sizeof(MeshPackedVertex);
+    }
+    return 0;
+}
+
+inline uint16_t quantizeUnorm16(float value) {
+    value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    return static_cast<uint16_t>(value * 65535.0f + 0.5f);
+}
+
+inline uint8_t quantizeUnorm8(float value) {
+    value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    return static_cast<uint8_t>(value * 255.0f + 0.5f);
+}
+
+// Packs a unit normal as VK_FORMAT_A2B10G10R10_UNORM_PACK32, remapped from [-1, 1]
+// to [0, 1]. The UNORM variant is used because it is mandatory for vertex buffers.
+inline uint32_t packNormal1010102(float x, float y, float z) {
+    auto quantize = [](float value) {
+        value = value * 0.5f + 0.5f;
+        value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+        return static_cast<uint32_t>(value * 1023.0f + 0.5f);
+    };
+    return quantize(x) | (quantize(y) << 10) | (quantize(z) << 20);
+}
+
+inline uint64_t alignMeshOffset(uint64_t offset) {
+    return (offset + MESH_STREAM_ALIGNMENT - 1) & ~(MESH_STREAM_ALIGNMENT - 1);
+}
+
+inline uint32_t meshIndexSize(MeshIndexType indexType) {
+    return indexType == MeshIndexType::Uint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
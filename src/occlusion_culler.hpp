@@ -0,0 +1,700 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "gpu_memory_tracker.hpp"
+#include "pipeline_layout_cache.hpp"
+#include "render_graph.hpp"
+#include "scene.hpp"
+#include "vfs.hpp"
+
+// Counts from the cull passes of one frame.
+struct OcclusionStatistics {
+    uint32_t earlyDrawn;
+    uint32_t lateDrawn;
+    uint32_t occluded;
+    uint32_t frustumCulled;
+};
+
+// Which of a frame's two draw lists to record.
+enum class CullPhase {
+    Early,
+    Late
+};
+
+// Graph resources of the culler for the frame being recorded.
+struct OcclusionFrame {
+    RenderGraphImage hiZ;
+    RenderGraphBuffer objects;
+    RenderGraphBuffer commands;
+    RenderGraphBuffer visibleInstances;
+    RenderGraphBuffer candidates;
+    RenderGraphBuffer statistics;
+};
+
+// Two-phase occlusion culling against a hierarchical depth (Hi-Z) pyramid.
+//
+// Each frame the early pass tests every object against the pyramid built at the
+// end of the previous frame, reprojected with this frame's camera, and writes
+// indirect draws for the ones it finds visible. Once those are drawn, a new
+// pyramid is built from their depth and the late pass retests only the objects
+// the early pass rejected, drawing what has come into view since. Nothing is
+// drawn late that the early pass already drew, and the pyramid left behind is
+// the one the next frame starts from.
+//
+// Draws are one indirect command per batch and phase. Visible objects are
+// written to the visible instance buffer as indices into the instance buffer,
+// which the vertex shaders look up through gl_InstanceIndex; early and late
+// commands use separate halves of it.
+class OcclusionCuller {
+    public:
+    static constexpr uint32_t MAX_HIZ_LEVELS = 16;
+
+    void init(VkDevice device, VkPhysicalDevice physicalDevice, GpuMemoryTracker& memoryTracker, PipelineLayoutCache& layoutCache, VkPipelineCache pipelineCache, const Vfs& vfs, uint32_t maxObjects, uint32_t maxBatches) {
+        this->device = device;
+        this->memoryTracker = &memoryTracker;
+        this->maxObjects = maxObjects;
+        this->maxBatches = maxBatches;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        const VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        objectBuffer = createBuffer(sizeof(InstanceBounds) * maxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+        commandTemplateBuffer = createBuffer(sizeof(VkDrawIndexedIndirectCommand) * 2 * maxBatches, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, hostVisible);
+        commandBuffer = createBuffer(sizeof(VkDrawIndexedIndirectCommand) * 2 * maxBatches, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        visibleInstanceBuffer = createBuffer(sizeof(uint32_t) * 2 * maxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        candidateBuffer = createBuffer(sizeof(uint32_t) * maxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        statisticsBuffer = createBuffer(sizeof(OcclusionStatistics), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostVisible);
+        vkMapMemory(device, objectBuffer.memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&objects));
+        vkMapMemory(device, commandTemplateBuffer.memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&commandTemplates));
+        vkMapMemory(device, statisticsBuffer.memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&statistics));
+        std::memset(statistics, 0, sizeof(OcclusionStatistics));
+
+        Asset buildShader = vfs.read("shaders/build/hiz_build.spv");
+        Asset cullShader = vfs.read("shaders/build/occlusion_cull.spv");
+        buildProgram = &layoutCache.getProgramLayout({&buildShader});
+        cullProgram = &layoutCache.getProgramLayout({&cullShader});
+        buildPipeline = createComputePipeline(buildShader, *buildProgram, pipelineCache);
+        cullPipeline = createComputePipeline(cullShader, *cullProgram, pipelineCache);
+
+        VkSamplerCreateInfo samplerInfo = {};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+        if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create Hi-Z sampler");
+        }
+
+        createDescriptorSets();
+    }
+
+    void destroy() {
+        destroyHiZ();
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        vkDestroySampler(device, sampler, nullptr);
+        vkDestroyPipeline(device, buildPipeline, nullptr);
+        vkDestroyPipeline(device, cullPipeline, nullptr);
+        destroyBuffer(objectBuffer);
+        destroyBuffer(commandTemplateBuffer);
+        destroyBuffer(commandBuffer);
+        destroyBuffer(visibleInstanceBuffer);
+        destroyBuffer(candidateBuffer);
+        destroyBuffer(statisticsBuffer);
+    }
+
+    // Bounds of the objects to cull, one per entry of the instance buffer. Filled
+    // by the draw list build before prepare().
+    InstanceBounds *getObjects() const {
+        return objects;
+    }
+
+    VkBuffer getVisibleInstanceBuffer() const {
+        return visibleInstanceBuffer.buffer;
+    }
+
+    VkDeviceSize getVisibleInstanceBufferSize() const {
+        return sizeof(uint32_t) * 2 * maxObjects;
+    }
+
+    // Disabled, every object inside the frustum is drawn in the early phase and
+    // the pyramid is not built.
+    void setEnabled(bool enabled) {
+        this->enabled = enabled;
+    }
+
+    bool isEnabled() const {
+        return enabled;
+    }
+
+    // Counts of the last frame whose submission has completed.
+    OcclusionStatistics getStatistics() const {
+        return *statistics;
+    }
+
+    // Writes the empty indirect commands the cull passes start from. The previous
+    // frame's submission must have completed.
+    void prepare(const std::vector<DrawBatch>& batches, uint32_t objectCount, uint32_t indexCount) {
+        if (batches.size() > maxBatches) {
+            throw std::runtime_error("Too many draw batches for occlusion culling");
+        }
+
+        batchCount = static_cast<uint32_t>(batches.size());
+        this->objectCount = std::min(objectCount, maxObjects);
+        for (uint32_t i = 0; i < batchCount; i++) {
+            VkDrawIndexedIndirectCommand command = {};
+            command.indexCount = indexCount;
+            command.instanceCount = 0;
+            command.firstIndex = 0;
+            command.vertexOffset = 0;
+            command.firstInstance = batches[i].firstInstance;
+            commandTemplates[i] = command;
+
+            command.firstInstance += maxObjects;
+            commandTemplates[maxBatches + i] = command;
+        }
+    }
+
+    // Adds the passes that reset this frame's draws and cull against the previous
+    // frame's pyramid. depthExtent is the full size of the depth buffer the
+    // pyramid will be built from.
+    OcclusionFrame addEarlyPasses(RenderGraph& graph, const glm::mat4& viewProjection, VkExtent2D depthExtent) {
+        if (hiZImage == VK_NULL_HANDLE || depthExtent.width != hiZDepthExtent.width || depthExtent.height != hiZDepthExtent.height) {
+            destroyHiZ();
+            createHiZ(depthExtent);
+        }
+
+        // The pyramid is only ever left sampled by the late pass; before the first
+        // frame it holds nothing.
+        ImageState hiZState = hiZInitialized ? imageUsageState(ImageUsage::SampledCompute) : imageUsageState(ImageUsage::Undefined);
+        hiZInitialized = true;
+        BufferState drawnState = {VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT};
+        BufferState computeState = {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT};
+        BufferState hostState = {VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT};
+
+        OcclusionFrame frame = {};
+        frame.hiZ = graph.importImage("hi-z", hiZImage, hiZView, VK_FORMAT_R32_SFLOAT, hiZExtent, VK_IMAGE_ASPECT_COLOR_BIT, hiZState, ImageUsage::Undefined);
+        frame.objects = graph.importBuffer("cull objects", objectBuffer.buffer, sizeof(InstanceBounds) * maxObjects, {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE});
+        frame.commands = graph.importBuffer("cull commands", commandBuffer.buffer, sizeof(VkDrawIndexedIndirectCommand) * 2 * maxBatches, drawnState);
+        frame.visibleInstances = graph.importBuffer("visible instances", visibleInstanceBuffer.buffer, getVisibleInstanceBufferSize(), drawnState);
+        frame.candidates = graph.importBuffer("cull candidates", candidateBuffer.buffer, sizeof(uint32_t) * maxObjects, computeState);
+        frame.statistics = graph.importBuffer("cull statistics", statisticsBuffer.buffer, sizeof(OcclusionStatistics), hostState);
+
+        RenderGraphBuffer templates = graph.importBuffer("cull command templates", commandTemplateBuffer.buffer, sizeof(VkDrawIndexedIndirectCommand) * 2 * maxBatches, {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE});
+        graph.addPass("occlusion reset", [&](RenderPassBuilder& pass) {
+            pass.useBuffer(templates, BufferUsage::TransferSrc);
+            pass.useBuffer(frame.commands, BufferUsage::TransferDst);
+            pass.useBuffer(frame.statistics, BufferUsage::TransferDst);
+        }, [this](VkCommandBuffer cmd, const RenderGraph&) {
+            VkBufferCopy copyRegion = {};
+            copyRegion.size = sizeof(VkDrawIndexedIndirectCommand) * 2 * maxBatches;
+            vkCmdCopyBuffer(cmd, commandTemplateBuffer.buffer, commandBuffer.buffer, 1, &copyRegion);
+            vkCmdFillBuffer(cmd, statisticsBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+        });
+
+        CullConstants constants = {};
+        constants.viewProjection = viewProjection;
+        constants.depthExtent[0] = static_cast<int32_t>(historyExtent.width);
+        constants.depthExtent[1] = static_cast<int32_t>(historyExtent.height);
+        constants.hiZLevels = static_cast<int32_t>(historyLevels);
+        constants.objectCount = objectCount;
+        constants.commandBase = 0;
+        constants.late = 0;
+        constants.testOcclusion = enabled && historyValid ? 1 : 0;
+        addCullPass(graph, "occlusion cull early", frame, constants);
+
+        lateConstants = constants;
+        lateConstants.commandBase = maxBatches;
+        lateConstants.late = 1;
+        lateConstants.testOcclusion = 1;
+        if (!enabled) {
+            historyValid = false;
+        }
+        return frame;
+    }
+
+    // Declares what a pass recording draws from this frame's lists reads.
+    static void useDraws(RenderPassBuilder& pass, const OcclusionFrame& frame) {
+        pass.useBuffer(frame.commands, BufferUsage::IndirectArgument);
+        pass.useBuffer(frame.visibleInstances, BufferUsage::StorageReadGraphics);
+    }
+
+    // Adds the passes that build the pyramid from the early phase's depth and
+    // retest what the early pass rejected. Only when enabled.
+    void addLatePasses(RenderGraph& graph, const OcclusionFrame& frame, RenderGraphImage depth, VkExtent2D renderExtent) {
+        uint32_t levels = levelCount(renderExtent);
+
+        graph.addPass("hi-z build", [&](RenderPassBuilder& pass) {
+            pass.useImage(depth, ImageUsage::SampledCompute);
+            pass.useImage(frame.hiZ, ImageUsage::StorageWriteCompute);
+        }, [this, depth, renderExtent, levels](VkCommandBuffer cmd, const RenderGraph& graph) {
+            recordHiZBuild(cmd, graph.getImageView(depth), renderExtent, levels);
+        });
+
+        historyExtent = renderExtent;
+        historyLevels = levels;
+        historyValid = true;
+
+        CullConstants constants = lateConstants;
+        constants.depthExtent[0] = static_cast<int32_t>(renderExtent.width);
+        constants.depthExtent[1] = static_cast<int32_t>(renderExtent.height);
+        constants.hiZLevels = static_cast<int32_t>(levels);
+        addCullPass(graph, "occlusion cull late", frame, constants);
+    }
+
+    // Makes this frame's counts readable by the host once it completes.
+    void finish(RenderGraph& graph, const OcclusionFrame& frame) {
+        graph.addPass("occlusion statistics", [&](RenderPassBuilder& pass) {
+            pass.useBuffer(frame.statistics, BufferUsage::HostRead);
+        }, [](VkCommandBuffer, const RenderGraph&) {});
+    }
+
+    // One indirect draw per batch, so multiDrawIndirect is not required.
+    void recordDraws(VkCommandBuffer cmd, CullPhase phase) const {
+        uint32_t base = phase == CullPhase::Early ? 0 : maxBatches;
+        for (uint32_t i = 0; i < batchCount; i++) {
+            vkCmdDrawIndexedIndirect(cmd, commandBuffer.buffer, sizeof(VkDrawIndexedIndirectCommand) * (base + i), 1, sizeof(VkDrawIndexedIndirectCommand));
+        }
+    }
+
+    private:
+    struct CullConstants {
+        glm::mat4 viewProjection;
+        int32_t depthExtent[2];
+        int32_t hiZLevels;
+        uint32_t objectCount;
+        uint32_t commandBase;
+        uint32_t late;
+        uint32_t testOcclusion;
+    };
+
+    struct HiZLevelConstants {
+        int32_t sourceExtent[2];
+        int32_t destinationExtent[2];
+    };
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+    };
+
+    static constexpr uint32_t CULL_GROUP_SIZE = 64;
+    static constexpr uint32_t BUILD_GROUP_SIZE = 8;
+
+    VkDevice device = VK_NULL_HANDLE;
+    GpuMemoryTracker *memoryTracker = nullptr;
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+    uint32_t maxObjects = 0;
+    uint32_t maxBatches = 0;
+    uint32_t objectCount = 0;
+    uint32_t batchCount = 0;
+    bool enabled = true;
+
+    Buffer objectBuffer;
+    Buffer commandTemplateBuffer;
+    Buffer commandBuffer;
+    Buffer visibleInstanceBuffer;
+    Buffer candidateBuffer;
+    Buffer statisticsBuffer;
+    InstanceBounds *objects = nullptr;
+    VkDrawIndexedIndirectCommand *commandTemplates = nullptr;
+    OcclusionStatistics *statistics = nullptr;
+
+    const ProgramLayout *buildProgram = nullptr;
+    const ProgramLayout *cullProgram = nullptr;
+    VkPipeline buildPipeline = VK_NULL_HANDLE;
+    VkPipeline cullPipeline = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet cullSet = VK_NULL_HANDLE;
+    std::array<VkDescriptorSet, MAX_HIZ_LEVELS> levelSets = {};
+
+    // The pyramid is sized for the whole depth buffer and built over the part of
+    // it that was rendered, like the scaled render targets.
+    VkImage hiZImage = VK_NULL_HANDLE;
+    VkDeviceMemory hiZMemory = VK_NULL_HANDLE;
+    VkImageView hiZView = VK_NULL_HANDLE;
+    std::array<VkImageView, MAX_HIZ_LEVELS> hiZLevelViews = {};
+    VkExtent2D hiZDepthExtent = {};
+    VkExtent2D hiZExtent = {};
+    uint32_t hiZLevels = 0;
+    bool hiZInitialized = false;
+
+    // Rendered extent and level count of the pyramid the next early pass tests
+    // against, and whether there is one.
+    VkExtent2D historyExtent = {};
+    uint32_t historyLevels = 0;
+    bool historyValid = false;
+    CullConstants lateConstants = {};
+
+    // Level 0 halves the depth buffer, rounding up, and each level after that
+    // halves the one before down to 1x1.
+    static uint32_t levelCount(VkExtent2D depthExtent) {
+        uint32_t width = (depthExtent.width + 1) / 2;
+        uint32_t height = (depthExtent.height + 1) / 2;
+        uint32_t levels = 1;
+        while ((width > 1 || height > 1) && levels < MAX_HIZ_LEVELS) {
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+            levels++;
+        }
+        return levels;
+    }
+
+    void addCullPass(RenderGraph& graph, const std::string& name, const OcclusionFrame& frame, const CullConstants& constants) {
+        bool late = constants.late != 0;
+        graph.addPass(name, [&](RenderPassBuilder& pass) {
+            pass.useBuffer(frame.objects, BufferUsage::StorageReadCompute);
+            pass.useBuffer(frame.commands, BufferUsage::StorageWriteCompute);
+            pass.useBuffer(frame.visibleInstances, BufferUsage::StorageWriteCompute);
+            pass.useBuffer(frame.candidates, late ? BufferUsage::StorageReadCompute : BufferUsage::StorageWriteCompute);
+            pass.useBuffer(frame.statistics, BufferUsage::StorageWriteCompute);
+            pass.useImage(frame.hiZ, ImageUsage::SampledCompute);
+        }, [this, constants](VkCommandBuffer cmd, const RenderGraph&) {
+            if (constants.objectCount == 0) {
+                return;
+            }
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullProgram->pipelineLayout, 0, 1, &cullSet, 0, nullptr);
+            vkCmdPushConstants(cmd, cullProgram->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatch(cmd, (constants.objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+        });
+    }
+
+    // Each level reads the one before it, so the level just written is made
+    // visible to sampling before the next dispatch. The graph has already put
+    // the whole pyramid in the general layout.
+    void recordHiZBuild(VkCommandBuffer cmd, VkImageView depthView, VkExtent2D renderExtent, uint32_t levels) {
+        VkDescriptorImageInfo depthInfo = {};
+        depthInfo.sampler = sampler;
+        depthInfo.imageView = depthView;
+        depthInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet depthWrite = {};
+        depthWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        depthWrite.dstSet = levelSets[0];
+        depthWrite.dstBinding = buildProgram->getBinding("source").binding;
+        depthWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        depthWrite.descriptorCount = 1;
+        depthWrite.pImageInfo = &depthInfo;
+        vkUpdateDescriptorSets(device, 1, &depthWrite, 0, nullptr);
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, buildPipeline);
+
+        VkExtent2D source = renderExtent;
+        for (uint32_t level = 0; level < levels; level++) {
+            VkExtent2D destination = {(source.width + 1) / 2, (source.height + 1) / 2};
+
+            HiZLevelConstants constants = {};
+            constants.sourceExtent[0] = static_cast<int32_t>(source.width);
+            constants.sourceExtent[1] = static_cast<int32_t>(source.height);
+            constants.destinationExtent[0] = static_cast<int32_t>(destination.width);
+            constants.destinationExtent[1] = static_cast<int32_t>(destination.height);
+
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, buildProgram->pipelineLayout, 0, 1, &levelSets[level], 0, nullptr);
+            vkCmdPushConstants(cmd, buildProgram->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatch(cmd, (destination.width + BUILD_GROUP_SIZE - 1) / BUILD_GROUP_SIZE, (destination.height + BUILD_GROUP_SIZE - 1) / BUILD_GROUP_SIZE, 1);
+
+            VkImageMemoryBarrier2 barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+            barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+            barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+            barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = hiZImage;
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            barrier.subresourceRange.baseMipLevel = level;
+            barrier.subresourceRange.levelCount = 1;
+            barrier.subresourceRange.baseArrayLayer = 0;
+            barrier.subresourceRange.layerCount = 1;
+
+            VkDependencyInfo dependencyInfo = {};
+            dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            dependencyInfo.imageMemoryBarrierCount = 1;
+            dependencyInfo.pImageMemoryBarriers = &barrier;
+            vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+
+            source = destination;
+        }
+    }
+
+    void createDescriptorSets() {
+        std::vector<VkDescriptorPoolSize> poolSizes = cullProgram->getPoolSizes(1);
+        for (const VkDescriptorPoolSize& size : buildProgram->getPoolSizes(MAX_HIZ_LEVELS)) {
+            poolSizes.push_back(size);
+        }
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = 1 + MAX_HIZ_LEVELS;
+
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create occlusion culling descriptor pool");
+        }
+
+        std::array<VkDescriptorSetLayout, 1 + MAX_HIZ_LEVELS> setLayouts;
+        setLayouts[0] = cullProgram->setLayouts[0];
+        std::fill(setLayouts.begin() + 1, setLayouts.end(), buildProgram->setLayouts[0]);
+        std::array<VkDescriptorSet, 1 + MAX_HIZ_LEVELS> sets;
+
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(setLayouts.size());
+        allocInfo.pSetLayouts = setLayouts.data();
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, sets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate occlusion culling descriptor sets");
+        }
+        cullSet = sets[0];
+        std::copy(sets.begin() + 1, sets.end(), levelSets.begin());
+
+        std::array<VkDescriptorBufferInfo, 5> bufferInfos = {};
+        bufferInfos[0] = {objectBuffer.buffer, 0, VK_WHOLE_SIZE};
+        bufferInfos[1] = {commandBuffer.buffer, 0, VK_WHOLE_SIZE};
+        bufferInfos[2] = {visibleInstanceBuffer.buffer, 0, VK_WHOLE_SIZE};
+        bufferInfos[3] = {candidateBuffer.buffer, 0, VK_WHOLE_SIZE};
+        bufferInfos[4] = {statisticsBuffer.buffer, 0, VK_WHOLE_SIZE};
+        const char *names[] = {"objectBuffer", "commandBuffer", "visibleInstances", "candidates", "statistics"};
+
+        std::array<VkWriteDescriptorSet, 5> descriptorWrites = {};
+        for (size_t i = 0; i < descriptorWrites.size(); i++) {
+            const ReflectedBinding& binding = cullProgram->getBinding(names[i]);
+            descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[i].dstSet = cullSet;
+            descriptorWrites[i].dstBinding = binding.binding;
+            descriptorWrites[i].dstArrayElement = 0;
+            descriptorWrites[i].descriptorType = binding.type;
+            descriptorWrites[i].descriptorCount = 1;
+            descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+
+    // Points the cull set at the whole pyramid, and each level's build set at the
+    // level it reads and the one it writes. Level 0 reads the depth buffer, which
+    // is written per frame.
+    void writeHiZDescriptors() {
+        VkDescriptorImageInfo pyramidInfo = {};
+        pyramidInfo.sampler = sampler;
+        pyramidInfo.imageView = hiZView;
+        pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        std::vector<VkDescriptorImageInfo> imageInfos(2 * hiZLevels);
+        std::vector<VkWriteDescriptorSet> descriptorWrites;
+
+        VkWriteDescriptorSet pyramidWrite = {};
+        pyramidWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        pyramidWrite.dstSet = cullSet;
+        pyramidWrite.dstBinding = cullProgram->getBinding("hiZ").binding;
+        pyramidWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pyramidWrite.descriptorCount = 1;
+        pyramidWrite.pImageInfo = &pyramidInfo;
+        descriptorWrites.push_back(pyramidWrite);
+
+        uint32_t sourceBinding = buildProgram->getBinding("source").binding;
+        uint32_t destinationBinding = buildProgram->getBinding("destination").binding;
+        for (uint32_t level = 0; level < hiZLevels; level++) {
+            VkDescriptorImageInfo& destinationInfo = imageInfos[2 * level];
+            destinationInfo.imageView = hiZLevelViews[level];
+            destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            VkWriteDescriptorSet destinationWrite = {};
+            destinationWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            destinationWrite.dstSet = levelSets[level];
+            destinationWrite.dstBinding = destinationBinding;
+            destinationWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            destinationWrite.descriptorCount = 1;
+            destinationWrite.pImageInfo = &destinationInfo;
+            descriptorWrites.push_back(destinationWrite);
+
+            if (level == 0) {
+                continue;
+            }
+            VkDescriptorImageInfo& sourceInfo = imageInfos[2 * level + 1];
+            sourceInfo.sampler = sampler;
+            sourceInfo.imageView = hiZLevelViews[level - 1];
+            sourceInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            VkWriteDescriptorSet sourceWrite = destinationWrite;
+            sourceWrite.dstBinding = sourceBinding;
+            sourceWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            sourceWrite.pImageInfo = &sourceInfo;
+            descriptorWrites.push_back(sourceWrite);
+        }
+
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+
+    void createHiZ(VkExtent2D depthExtent) {
+        hiZDepthExtent = depthExtent;
+        hiZExtent = {(depthExtent.width + 1) / 2, (depthExtent.height + 1) / 2};
+        hiZLevels = levelCount(depthExtent);
+
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {hiZExtent.width, hiZExtent.height, 1};
+        imageInfo.mipLevels = hiZLevels;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = VK_FORMAT_R32_SFLOAT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(device, &imageInfo, nullptr, &hiZImage) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create Hi-Z image");
+        }
+        memoryTracker->trackObject(hiZImage, VK_OBJECT_TYPE_IMAGE, MemoryCategory::Attachment);
+
+        VkMemoryRequirements memoryRequirements;
+        vkGetImageMemoryRequirements(device, hiZImage, &memoryRequirements);
+
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memoryRequirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        if (memoryTracker->allocate(allocInfo, MemoryCategory::Attachment, &hiZMemory) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate Hi-Z memory");
+        }
+        vkBindImageMemory(device, hiZImage, hiZMemory, 0);
+
+        hiZView = createImageView(0, hiZLevels);
+        for (uint32_t level = 0; level < hiZLevels; level++) {
+            hiZLevelViews[level] = createImageView(level, 1);
+        }
+
+        hiZInitialized = false;
+        historyValid = false;
+        writeHiZDescriptors();
+    }
+
+    void destroyHiZ() {
+        if (hiZImage == VK_NULL_HANDLE) {
+            return;
+        }
+
+        for (uint32_t level = 0; level < hiZLevels; level++) {
+            vkDestroyImageView(device, hiZLevelViews[level], nullptr);
+        }
+        vkDestroyImageView(device, hiZView, nullptr);
+        memoryTracker->untrackObject(hiZImage);
+        vkDestroyImage(device, hiZImage, nullptr);
+        memoryTracker->free(hiZMemory);
+        hiZImage = VK_NULL_HANDLE;
+    }
+
+    VkImageView createImageView(uint32_t baseLevel, uint32_t levels) {
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = hiZImage;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R32_SFLOAT;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = baseLevel;
+        viewInfo.subresourceRange.levelCount = levels;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        VkImageView view;
+        if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create Hi-Z image view");
+        }
+        return view;
+    }
+
+    VkPipeline createComputePipeline(const Asset& code, const ProgramLayout& program, VkPipelineCache pipelineCache) {
+        VkShaderModuleCreateInfo moduleInfo = {};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = code.size();
+        moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(device, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create shader module");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = program.pipelineLayout;
+
+        VkPipeline pipeline;
+        VkResult result = vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+        vkDestroyShaderModule(device, shaderModule, nullptr);
+
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create compute pipeline");
+        }
+        return pipeline;
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+        Buffer buffer;
+
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create buffer");
+        }
+        memoryTracker->trackObject(buffer.buffer, VK_OBJECT_TYPE_BUFFER, MemoryCategory::Buffer);
+
+        VkMemoryRequirements memoryRequirements;
+        vkGetBufferMemoryRequirements(device, buffer.buffer, &memoryRequirements);
+
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memoryRequirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, properties);
+
+        if (memoryTracker->allocate(allocInfo, MemoryCategory::Buffer, &buffer.memory) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate buffer memory");
+        }
+        vkBindBufferMemory(device, buffer.buffer, buffer.memory, 0);
+        return buffer;
+    }
+
+    void destroyBuffer(const Buffer& buffer) {
+        memoryTracker->untrackObject(buffer.buffer);
+        vkDestroyBuffer(device, buffer.buffer, nullptr);
+        memoryTracker->free(buffer.memory);
+    }
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+        throw std::runtime_error("Failed to find suitable memory type");
+    }
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// On-disk layout of an asset pack (.pack), as written by tools/pack.cpp.
+//
+// [PackFileHeader][PackEntry x entryCount][name table][entry data...]
+//
+// Entries are sorted by pathHash so a lookup is a binary search straight over the
+// mapped index. Names are kept to resolve hash collisions. Every entry's data
+// starts on a PACK_DATA_ALIGNMENT boundary, which keeps uncompressed entries
+// usable in place (SPIR-V words, cooked mesh streams) from the mapping.
+
+const uint32_t PACK_FILE_MAGIC = 0x4b415044; // "DPAK"
+const uint32_t PACK_FILE_VERSION = 1;
+const uint64_t PACK_DATA_ALIGNMENT = 16;
+
+enum class PackCompression : uint32_t {
+    None = 0,
+    Lz4 = 1
+};
+
+struct PackFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+    uint64_t entriesOffset;
+    uint64_t namesOffset;
+};
+
+struct PackEntry {
+    uint64_t pathHash;
+    uint64_t dataOffset;
+    uint64_t storedSize;
+    uint64_t size;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t compression;
+    uint32_t reserved;
+};
+
+static_assert(std::is_trivially_copyable<PackFileHeader>::value, "PackFileHeader must be trivially copyable");
+static_assert(sizeof(PackEntry) == 48, "PackEntry must be tightly packed");
+
+inline uint64_t alignPackOffset(uint64_t offset) {
+    return (offset + PACK_DATA_ALIGNMENT - 1) & ~(PACK_DATA_ALIGNMENT - 1);
+}
+
+// Asset paths are relative, '/'-separated and without a leading "./".
+inline std::string normalizeAssetPath(std::string path) {
+    for (char& c : path) {
+        if (c == '\\') {
+            c = '/';
+        }
+    }
+
+    while (path.compare(0, 2, "./") == 0) {
+        path.erase(0, 2);
+    }
+
+    return path;
+}
+
+// FNV-1a, 64-bit.
+inline uint64_t hashAssetPath(const std::string& path) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : path) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
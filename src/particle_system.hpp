@@ -0,0 +1,634 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "gpu_memory_tracker.hpp"
+#include "pipeline_layout_cache.hpp"
+#include "render_graph.hpp"
+#include "vfs.hpp"
+
+// A burst of particles thrown from a point, in a cone around a direction whose
+// width grows with spread.
+struct ParticleBurst {
+    glm::vec3 position;
+    glm::vec3 direction;
+    glm::vec4 color;
+    uint32_t count;
+    float speed;
+    float spread;
+    float lifetime;
+};
+
+// Counts from the particle passes of one frame.
+struct ParticleStatistics {
+    uint32_t simulated;
+    uint32_t alive;
+    uint32_t emitted;
+};
+
+// Graph resources of the particle system for the frame being recorded.
+struct ParticleFrame {
+    RenderGraphBuffer particles;
+    RenderGraphBuffer aliveList;
+    RenderGraphBuffer counters;
+    RenderGraphBuffer indirectCommands;
+};
+
+// Particles simulated and drawn entirely on the GPU. The CPU only hands over
+// the bursts requested each frame; emission, simulation and compaction run in
+// compute passes over persistent storage buffers, and the particles are drawn
+// with one indirect draw whose instance count the GPU writes itself.
+//
+// Free particles are tracked in a dead index stack and live ones in two index
+// lists that swap every frame: simulation reads the current list and compacts
+// survivors into the other, so the draw and the next frame only touch live
+// particles. Bursts that find the dead stack empty are cut short. The counters
+// are never read back; only a copy of them is, for statistics.
+class ParticleSystem {
+    public:
+    // Bursts accepted per frame; later ones are dropped.
+    static constexpr uint32_t MAX_BURSTS = 64;
+    // Longest step simulated at once, so a stall does not fling particles away.
+    static constexpr float MAX_STEP_SECONDS = 0.05f;
+    static constexpr float GRAVITY = 9.8f;
+    static constexpr float DRAG = 1.5f;
+    static constexpr float PARTICLE_SIZE = 0.04f;
+
+    void init(VkDevice device, VkPhysicalDevice physicalDevice, GpuMemoryTracker& memoryTracker, PipelineLayoutCache& layoutCache, VkPipelineCache pipelineCache, const Vfs& vfs, VkFormat colorFormat, VkFormat depthFormat, uint32_t maxParticles) {
+        this->device = device;
+        this->memoryTracker = &memoryTracker;
+        this->maxParticles = maxParticles;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        const VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        emitterBuffer = createBuffer(sizeof(EmitterData) * MAX_BURSTS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+        particleBuffer = createBuffer(sizeof(ParticleData) * maxParticles, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        deadListBuffer = createBuffer(sizeof(uint32_t) * maxParticles, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        aliveListBuffer = createBuffer(sizeof(uint32_t) * 2 * maxParticles, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        counterBuffer = createBuffer(sizeof(CounterData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        indirectBuffer = createBuffer(sizeof(IndirectData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        statisticsBuffer = createBuffer(sizeof(ParticleStatistics), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+        vkMapMemory(device, emitterBuffer.memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&emitters));
+        vkMapMemory(device, statisticsBuffer.memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&statistics));
+        std::memset(statistics, 0, sizeof(ParticleStatistics));
+
+        Asset counterShader = vfs.read("shaders/build/particle_counters.spv");
+        Asset emitShader = vfs.read("shaders/build/particle_emit.spv");
+        Asset simulateShader = vfs.read("shaders/build/particle_simulate.spv");
+        Asset vertexShader = vfs.read("shaders/build/particle_vert.spv");
+        Asset fragmentShader = vfs.read("shaders/build/particle_frag.spv");
+        counterProgram = &layoutCache.getProgramLayout({&counterShader});
+        emitProgram = &layoutCache.getProgramLayout({&emitShader});
+        simulateProgram = &layoutCache.getProgramLayout({&simulateShader});
+        drawProgram = &layoutCache.getProgramLayout({&vertexShader, &fragmentShader});
+        counterPipeline = createComputePipeline(counterShader, *counterProgram, pipelineCache);
+        emitPipeline = createComputePipeline(emitShader, *emitProgram, pipelineCache);
+        simulatePipeline = createComputePipeline(simulateShader, *simulateProgram, pipelineCache);
+        drawPipeline = createDrawPipeline(vertexShader, fragmentShader, pipelineCache, colorFormat, depthFormat);
+
+        createDescriptorSets();
+    }
+
+    void destroy() {
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        vkDestroyPipeline(device, counterPipeline, nullptr);
+        vkDestroyPipeline(device, emitPipeline, nullptr);
+        vkDestroyPipeline(device, simulatePipeline, nullptr);
+        vkDestroyPipeline(device, drawPipeline, nullptr);
+        destroyBuffer(emitterBuffer);
+        destroyBuffer(particleBuffer);
+        destroyBuffer(deadListBuffer);
+        destroyBuffer(aliveListBuffer);
+        destroyBuffer(counterBuffer);
+        destroyBuffer(indirectBuffer);
+        destroyBuffer(statisticsBuffer);
+    }
+
+    // Has the passes from emission to compaction write a timestamp to firstQuery
+    // before them and to firstQuery + 1 after them. The caller resets the queries.
+    void setTimestampQueries(VkQueryPool queryPool, uint32_t firstQuery) {
+        timestampQueryPool = queryPool;
+        firstTimestampQuery = firstQuery;
+    }
+
+    // Counts of the last frame whose submission has completed.
+    ParticleStatistics getStatistics() const {
+        return *statistics;
+    }
+
+    // Queues a burst for the next frame's emission. May be called at any point of
+    // the frame; the bursts are only written to the GPU by addSimulationPasses().
+    void emit(const ParticleBurst& burst) {
+        if (pendingBursts.size() < MAX_BURSTS && burst.count > 0) {
+            pendingBursts.push_back(burst);
+        }
+    }
+
+    // Adds the passes that emit the queued bursts and advance the particles by
+    // deltaSeconds. The previous frame's submission must have completed.
+    // Particles bounce off the plane z = floorHeight.
+    ParticleFrame addSimulationPasses(RenderGraph& graph, float deltaSeconds, float floorHeight) {
+        uint32_t requested = 0;
+        for (size_t i = 0; i < pendingBursts.size(); i++) {
+            const ParticleBurst& burst = pendingBursts[i];
+            EmitterData& emitter = emitters[i];
+            emitter.position = burst.position;
+            emitter.firstParticle = requested;
+            emitter.direction = burst.direction;
+            emitter.count = burst.count;
+            emitter.color = burst.color;
+            emitter.speed = burst.speed;
+            emitter.spread = burst.spread;
+            emitter.lifetime = burst.lifetime;
+            emitter.seed = nextSeed++ * 0x9E3779B9u;
+            requested += burst.count;
+        }
+        uint32_t emitterCount = static_cast<uint32_t>(pendingBursts.size());
+        pendingBursts.clear();
+
+        // Everything but the dead stack and the emitters was last read by the
+        // previous frame's draw.
+        BufferState drawnState = {VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT};
+        BufferState computeState = {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT};
+        BufferState hostState = {VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_WRITE_BIT};
+
+        ParticleFrame frame = {};
+        frame.particles = graph.importBuffer("particles", particleBuffer.buffer, sizeof(ParticleData) * maxParticles, drawnState);
+        frame.aliveList = graph.importBuffer("particle alive list", aliveListBuffer.buffer, sizeof(uint32_t) * 2 * maxParticles, drawnState);
+        frame.counters = graph.importBuffer("particle counters", counterBuffer.buffer, sizeof(CounterData), drawnState);
+        frame.indirectCommands = graph.importBuffer("particle indirect commands", indirectBuffer.buffer, sizeof(IndirectData), drawnState);
+        RenderGraphBuffer deadList = graph.importBuffer("particle dead list", deadListBuffer.buffer, sizeof(uint32_t) * maxParticles, computeState);
+        RenderGraphBuffer emitterInput = graph.importBuffer("particle emitters", emitterBuffer.buffer, sizeof(EmitterData) * MAX_BURSTS, hostState);
+        RenderGraphBuffer statisticsOutput = graph.importBuffer("particle statistics", statisticsBuffer.buffer, sizeof(ParticleStatistics), {VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT});
+
+        if (!initialized) {
+            initialized = true;
+            addCounterPass(graph, "particle initialize", frame, deadList, statisticsOutput, {COUNTER_INITIALIZE, maxParticles, 0}, (maxParticles + GROUP_SIZE - 1) / GROUP_SIZE);
+        }
+        addCounterPass(graph, "particle prepare", frame, deadList, statisticsOutput, {COUNTER_PREPARE, maxParticles, requested}, 1);
+
+        if (requested > 0) {
+            EmitConstants constants = {emitterCount, maxParticles};
+            graph.addPass("particle emit", [&](RenderPassBuilder& pass) {
+                pass.useBuffer(emitterInput, BufferUsage::StorageReadCompute);
+                pass.useBuffer(frame.particles, BufferUsage::StorageWriteCompute);
+                pass.useBuffer(deadList, BufferUsage::StorageReadCompute);
+                pass.useBuffer(frame.aliveList, BufferUsage::StorageWriteCompute);
+                pass.useBuffer(frame.counters, BufferUsage::StorageWriteCompute);
+            }, [this, constants, requested](VkCommandBuffer cmd, const RenderGraph&) {
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, emitPipeline);
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, emitProgram->pipelineLayout, 0, 1, &emitSet, 0, nullptr);
+                vkCmdPushConstants(cmd, emitProgram->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+                vkCmdDispatch(cmd, (requested + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+            });
+        }
+
+        SimulateConstants constants = {};
+        constants.deltaSeconds = std::min(deltaSeconds, MAX_STEP_SECONDS);
+        constants.gravity = GRAVITY;
+        constants.drag = DRAG;
+        constants.floorHeight = floorHeight;
+        constants.maxParticles = maxParticles;
+        graph.addPass("particle simulate", [&](RenderPassBuilder& pass) {
+            pass.useBuffer(frame.indirectCommands, BufferUsage::IndirectArgument);
+            pass.useBuffer(frame.particles, BufferUsage::StorageWriteCompute);
+            pass.useBuffer(deadList, BufferUsage::StorageWriteCompute);
+            pass.useBuffer(frame.aliveList, BufferUsage::StorageWriteCompute);
+            pass.useBuffer(frame.counters, BufferUsage::StorageWriteCompute);
+        }, [this, constants](VkCommandBuffer cmd, const RenderGraph&) {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, simulatePipeline);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, simulateProgram->pipelineLayout, 0, 1, &simulateSet, 0, nullptr);
+            vkCmdPushConstants(cmd, simulateProgram->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatchIndirect(cmd, indirectBuffer.buffer, offsetof(IndirectData, simulate));
+        });
+
+        addCounterPass(graph, "particle finalize", frame, deadList, statisticsOutput, {COUNTER_FINALIZE, maxParticles, 0}, 1);
+
+        graph.addPass("particle statistics", [&](RenderPassBuilder& pass) {
+            pass.useBuffer(statisticsOutput, BufferUsage::HostRead);
+        }, [](VkCommandBuffer, const RenderGraph&) {});
+        return frame;
+    }
+
+    // Declares what a pass recording the particle draw reads.
+    static void useDraws(RenderPassBuilder& pass, const ParticleFrame& frame) {
+        pass.useBuffer(frame.indirectCommands, BufferUsage::IndirectArgument);
+        pass.useBuffer(frame.particles, BufferUsage::StorageReadGraphics);
+        pass.useBuffer(frame.aliveList, BufferUsage::StorageReadGraphics);
+        pass.useBuffer(frame.counters, BufferUsage::StorageReadGraphics);
+    }
+
+    // Draws the live particles blended over the scene, depth tested against it
+    // without writing depth. Viewport and scissor are left to the caller.
+    void recordDraw(VkCommandBuffer cmd, const glm::mat4& view, const glm::mat4& projection) const {
+        // The camera's right and up axes are the first two rows of the view matrix.
+        DrawConstants constants = {};
+        constants.viewProjection = projection * view;
+        constants.cameraRight = glm::vec4(view[0][0], view[1][0], view[2][0], PARTICLE_SIZE);
+        constants.cameraUp = glm::vec4(view[0][1], view[1][1], view[2][1], 0.0f);
+        constants.maxParticles = maxParticles;
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipeline);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, drawProgram->pipelineLayout, 0, 1, &drawSet, 0, nullptr);
+        vkCmdPushConstants(cmd, drawProgram->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+        vkCmdDrawIndirect(cmd, indirectBuffer.buffer, offsetof(IndirectData, draw), 1, sizeof(VkDrawIndirectCommand));
+    }
+
+    private:
+    // Shader-side layouts (std430).
+    struct ParticleData {
+        glm::vec3 position;
+        float age;
+        glm::vec3 velocity;
+        float lifetime;
+        glm::vec4 color;
+    };
+
+    struct EmitterData {
+        glm::vec3 position;
+        uint32_t firstParticle;
+        glm::vec3 direction;
+        uint32_t count;
+        glm::vec4 color;
+        float speed;
+        float spread;
+        float lifetime;
+        uint32_t seed;
+    };
+
+    struct CounterData {
+        uint32_t deadCount;
+        uint32_t current;
+        uint32_t aliveCount[2];
+        uint32_t emitCount;
+        uint32_t emitBase;
+    };
+
+    struct IndirectData {
+        VkDispatchIndirectCommand simulate;
+        uint32_t padding;
+        VkDrawIndirectCommand draw;
+    };
+
+    struct CounterConstants {
+        uint32_t mode;
+        uint32_t maxParticles;
+        uint32_t requestedCount;
+    };
+
+    struct EmitConstants {
+        uint32_t emitterCount;
+        uint32_t maxParticles;
+    };
+
+    struct SimulateConstants {
+        float deltaSeconds;
+        float gravity;
+        float drag;
+        float floorHeight;
+        uint32_t maxParticles;
+    };
+
+    struct DrawConstants {
+        glm::mat4 viewProjection;
+        glm::vec4 cameraRight;
+        glm::vec4 cameraUp;
+        uint32_t maxParticles;
+    };
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+    };
+
+    static constexpr uint32_t GROUP_SIZE = 64;
+    static constexpr uint32_t COUNTER_INITIALIZE = 0;
+    static constexpr uint32_t COUNTER_PREPARE = 1;
+    static constexpr uint32_t COUNTER_FINALIZE = 2;
+
+    VkDevice device = VK_NULL_HANDLE;
+    GpuMemoryTracker *memoryTracker = nullptr;
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+    uint32_t maxParticles = 0;
+    bool initialized = false;
+    std::vector<ParticleBurst> pendingBursts;
+    uint32_t nextSeed = 1;
+
+    Buffer emitterBuffer;
+    Buffer particleBuffer;
+    Buffer deadListBuffer;
+    Buffer aliveListBuffer;
+    Buffer counterBuffer;
+    Buffer indirectBuffer;
+    Buffer statisticsBuffer;
+    EmitterData *emitters = nullptr;
+    ParticleStatistics *statistics = nullptr;
+    VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+    uint32_t firstTimestampQuery = 0;
+
+    const ProgramLayout *counterProgram = nullptr;
+    const ProgramLayout *emitProgram = nullptr;
+    const ProgramLayout *simulateProgram = nullptr;
+    const ProgramLayout *drawProgram = nullptr;
+    VkPipeline counterPipeline = VK_NULL_HANDLE;
+    VkPipeline emitPipeline = VK_NULL_HANDLE;
+    VkPipeline simulatePipeline = VK_NULL_HANDLE;
+    VkPipeline drawPipeline = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet counterSet = VK_NULL_HANDLE;
+    VkDescriptorSet emitSet = VK_NULL_HANDLE;
+    VkDescriptorSet simulateSet = VK_NULL_HANDLE;
+    VkDescriptorSet drawSet = VK_NULL_HANDLE;
+
+    // The timestamps bracket everything from prepare to finalize.
+    void addCounterPass(RenderGraph& graph, const std::string& name, const ParticleFrame& frame, RenderGraphBuffer deadList, RenderGraphBuffer statisticsOutput, CounterConstants constants, uint32_t groupCount) {
+        bool initialize = constants.mode == COUNTER_INITIALIZE;
+        bool finalize = constants.mode == COUNTER_FINALIZE;
+        graph.addPass(name, [&](RenderPassBuilder& pass) {
+            if (initialize) {
+                pass.useBuffer(deadList, BufferUsage::StorageWriteCompute);
+            }
+            pass.useBuffer(frame.counters, BufferUsage::StorageWriteCompute);
+            pass.useBuffer(frame.indirectCommands, BufferUsage::StorageWriteCompute);
+            if (finalize) {
+                pass.useBuffer(statisticsOutput, BufferUsage::StorageWriteCompute);
+            }
+        }, [this, constants, groupCount](VkCommandBuffer cmd, const RenderGraph&) {
+            if (constants.mode == COUNTER_PREPARE && timestampQueryPool != VK_NULL_HANDLE) {
+                vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, timestampQueryPool, firstTimestampQuery);
+            }
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, counterPipeline);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, counterProgram->pipelineLayout, 0, 1, &counterSet, 0, nullptr);
+            vkCmdPushConstants(cmd, counterProgram->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatch(cmd, groupCount, 1, 1);
+            if (constants.mode == COUNTER_FINALIZE && timestampQueryPool != VK_NULL_HANDLE) {
+                vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, timestampQueryPool, firstTimestampQuery + 1);
+            }
+        });
+    }
+
+    // Each program gets one set, pointed at whichever of the system's buffers its
+    // shaders declare, matched by block instance name.
+    void createDescriptorSets() {
+        const std::array<const ProgramLayout *, 4> programs = {counterProgram, emitProgram, simulateProgram, drawProgram};
+
+        std::vector<VkDescriptorPoolSize> poolSizes;
+        for (const ProgramLayout *program : programs) {
+            for (const VkDescriptorPoolSize& size : program->getPoolSizes(1)) {
+                poolSizes.push_back(size);
+            }
+        }
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = static_cast<uint32_t>(programs.size());
+
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create particle descriptor pool");
+        }
+
+        std::array<VkDescriptorSetLayout, 4> setLayouts;
+        for (size_t i = 0; i < programs.size(); i++) {
+            setLayouts[i] = programs[i]->setLayouts[0];
+        }
+        std::array<VkDescriptorSet, 4> sets;
+
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(setLayouts.size());
+        allocInfo.pSetLayouts = setLayouts.data();
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, sets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate particle descriptor sets");
+        }
+        counterSet = sets[0];
+        emitSet = sets[1];
+        simulateSet = sets[2];
+        drawSet = sets[3];
+
+        const std::array<std::pair<const char *, VkBuffer>, 7> buffers = {{
+            {"emitterBuffer", emitterBuffer.buffer},
+            {"particleBuffer", particleBuffer.buffer},
+            {"deadList", deadListBuffer.buffer},
+            {"aliveList", aliveListBuffer.buffer},
+            {"counters", counterBuffer.buffer},
+            {"indirectCommands", indirectBuffer.buffer},
+            {"statistics", statisticsBuffer.buffer}
+        }};
+
+        std::vector<VkDescriptorBufferInfo> bufferInfos;
+        std::vector<VkWriteDescriptorSet> descriptorWrites;
+        bufferInfos.reserve(programs.size() * buffers.size());
+        for (size_t i = 0; i < programs.size(); i++) {
+            for (const ReflectedBinding& binding : programs[i]->sets[0]) {
+                auto buffer = std::find_if(buffers.begin(), buffers.end(), [&](const std::pair<const char *, VkBuffer>& candidate) {
+                    return binding.name == candidate.first;
+                });
+                if (buffer == buffers.end()) {
+                    throw std::runtime_error("Unknown particle shader binding " + binding.name);
+                }
+                bufferInfos.push_back({buffer->second, 0, VK_WHOLE_SIZE});
+
+                VkWriteDescriptorSet descriptorWrite = {};
+                descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrite.dstSet = sets[i];
+                descriptorWrite.dstBinding = binding.binding;
+                descriptorWrite.dstArrayElement = 0;
+                descriptorWrite.descriptorType = binding.type;
+                descriptorWrite.descriptorCount = 1;
+                descriptorWrite.pBufferInfo = &bufferInfos.back();
+                descriptorWrites.push_back(descriptorWrite);
+            }
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+
+    VkPipeline createComputePipeline(const Asset& code, const ProgramLayout& program, VkPipelineCache pipelineCache) {
+        VkShaderModule shaderModule = createShaderModule(code);
+
+        VkComputePipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = program.pipelineLayout;
+
+        VkPipeline pipeline;
+        VkResult result = vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+        vkDestroyShaderModule(device, shaderModule, nullptr);
+
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create compute pipeline");
+        }
+        return pipeline;
+    }
+
+    // Quads are expanded from the vertex index, so there is no vertex input.
+    VkPipeline createDrawPipeline(const Asset& vertexCode, const Asset& fragmentCode, VkPipelineCache pipelineCache, VkFormat colorFormat, VkFormat depthFormat) {
+        VkShaderModule vertexModule = createShaderModule(vertexCode);
+        VkShaderModule fragmentModule = createShaderModule(fragmentCode);
+
+        std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {};
+        shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        shaderStages[0].module = vertexModule;
+        shaderStages[0].pName = "main";
+        shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        shaderStages[1].module = fragmentModule;
+        shaderStages[1].pName = "main";
+
+        std::array<VkDynamicState, 2> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+        VkPipelineDynamicStateCreateInfo dynamicStateInfo = {};
+        dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicStateInfo.pDynamicStates = dynamicStates.data();
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
+        inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+        VkPipelineViewportStateCreateInfo viewportInfo = {};
+        viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportInfo.viewportCount = 1;
+        viewportInfo.scissorCount = 1;
+
+        VkPipelineRasterizationStateCreateInfo rasterizerInfo = {};
+        rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizerInfo.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizerInfo.lineWidth = 1.0f;
+        rasterizerInfo.cullMode = VK_CULL_MODE_NONE;
+        rasterizerInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+        VkPipelineMultisampleStateCreateInfo multisamplingInfo = {};
+        multisamplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisamplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencilInfo = {};
+        depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencilInfo.depthTestEnable = VK_TRUE;
+        depthStencilInfo.depthWriteEnable = VK_FALSE;
+        depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        colorBlendAttachment.blendEnable = VK_TRUE;
+        colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+        colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+        VkPipelineColorBlendStateCreateInfo colorBlendInfo = {};
+        colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlendInfo.attachmentCount = 1;
+        colorBlendInfo.pAttachments = &colorBlendAttachment;
+
+        VkPipelineRenderingCreateInfo renderingInfo = {};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachmentFormats = &colorFormat;
+        renderingInfo.depthAttachmentFormat = depthFormat;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &renderingInfo;
+        pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+        pipelineInfo.pStages = shaderStages.data();
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+        pipelineInfo.pViewportState = &viewportInfo;
+        pipelineInfo.pRasterizationState = &rasterizerInfo;
+        pipelineInfo.pMultisampleState = &multisamplingInfo;
+        pipelineInfo.pDepthStencilState = &depthStencilInfo;
+        pipelineInfo.pColorBlendState = &colorBlendInfo;
+        pipelineInfo.pDynamicState = &dynamicStateInfo;
+        pipelineInfo.layout = drawProgram->pipelineLayout;
+
+        VkPipeline pipeline;
+        VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+        vkDestroyShaderModule(device, vertexModule, nullptr);
+        vkDestroyShaderModule(device, fragmentModule, nullptr);
+
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create particle pipeline");
+        }
+        return pipeline;
+    }
+
+    VkShaderModule createShaderModule(const Asset& code) {
+        VkShaderModuleCreateInfo moduleInfo = {};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = code.size();
+        moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(device, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create shader module");
+        }
+        return shaderModule;
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+        Buffer buffer;
+
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create buffer");
+        }
+        memoryTracker->trackObject(buffer.buffer, VK_OBJECT_TYPE_BUFFER, MemoryCategory::Buffer);
+
+        VkMemoryRequirements memoryRequirements;
+        vkGetBufferMemoryRequirements(device, buffer.buffer, &memoryRequirements);
+
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memoryRequirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, properties);
+
+        if (memoryTracker->allocate(allocInfo, MemoryCategory::Buffer, &buffer.memory) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate buffer memory");
+        }
+        vkBindBufferMemory(device, buffer.buffer, buffer.memory, 0);
+        return buffer;
+    }
+
+    void destroyBuffer(const Buffer& buffer) {
+        memoryTracker->untrackObject(buffer.buffer);
+        vkDestroyBuffer(device, buffer.buffer, nullptr);
+        memoryTracker->free(buffer.memory);
+    }
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+        throw std::runtime_error("Failed to find suitable memory type");
+    }
+};
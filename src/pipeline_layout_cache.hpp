@@ -0,0 +1,270 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <vulkan/vulkan.h>
+
+#include "spirv_reflect.hpp"
+#include "vertex_layout.hpp"
+#include "vfs.hpp"
+
+struct VertexInputDescription {
+    std::vector<VkVertexInputBindingDescription> bindings;
+    std::vector<VkVertexInputAttributeDescription> attributes;
+};
+
+// Resource interface of a set of shader stages, derived from their SPIR-V.
+// The Vulkan layout objects are owned by the PipelineLayoutCache and shared by
+// every program with the same interface.
+struct ProgramLayout {
+    std::vector<std::vector<ReflectedBinding>> sets;
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    std::vector<VkPushConstantRange> pushConstantRanges;
+    std::vector<ReflectedVertexInput> vertexInputs;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+
+    const ReflectedBinding& getBinding(const std::string& name) const {
+        for (const auto& set : sets) {
+            for (const auto& binding : set) {
+                if (binding.name == name) {
+                    return binding;
+                }
+            }
+        }
+
+        throw std::runtime_error("Shaders declare no binding named " + name);
+    }
+
+    std::vector<VkDescriptorPoolSize> getPoolSizes(uint32_t setCount) const {
+        std::map<VkDescriptorType, uint32_t> counts;
+        for (const auto& set : sets) {
+            for (const auto& binding : set) {
+                counts[binding.type] += binding.count * setCount;
+            }
+        }
+
+        std::vector<VkDescriptorPoolSize> poolSizes;
+        for (const auto& [type, count] : counts) {
+            poolSizes.push_back({type, count});
+        }
+        return poolSizes;
+    }
+
+    // Vertex input state for this program reading from the given vertex layout.
+    // Every shader input must be present in the layout; layout attributes the
+    // shader does not read are left out.
+    VertexInputDescription getVertexInput(const VertexLayout& vertexLayout) const {
+        VertexInputDescription description;
+        if (vertexInputs.empty()) {
+            return description;
+        }
+
+        description.bindings.push_back(vertexLayout.getBindingDescription());
+        for (const auto& input : vertexInputs) {
+            auto attribute = std::find_if(vertexLayout.attributes.begin(), vertexLayout.attributes.end(), [&](const VertexAttribute& candidate) {
+                return candidate.location == input.location;
+            });
+
+            if (attribute == vertexLayout.attributes.end()) {
+                throw std::runtime_error("Vertex layout has no attribute for shader input " + input.name + " at location " + std::to_string(input.location));
+            }
+
+            VkVertexInputAttributeDescription attributeDescription = {};
+            attributeDescription.binding = 0;
+            attributeDescription.location = attribute->location;
+            attributeDescription.format = attribute->format;
+            attributeDescription.offset = attribute->offset;
+            description.attributes.push_back(attributeDescription);
+        }
+
+        return description;
+    }
+};
+
+// Reflects shader stages into ProgramLayouts. Reflection results are cached by
+// shader content hash, and descriptor set layouts and pipeline layouts are
+// deduplicated by their description, so programs with compatible interfaces get
+// the same VkDescriptorSetLayout/VkPipelineLayout handles. Thread-safe.
+class PipelineLayoutCache {
+    public:
+    void init(VkDevice device) {
+        this->device = device;
+    }
+
+    void destroy() {
+        for (const auto& [key, pipelineLayout] : pipelineLayouts) {
+            vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        }
+        for (const auto& [key, setLayout] : setLayouts) {
+            vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+        }
+
+        pipelineLayouts.clear();
+        setLayouts.clear();
+        programs.clear();
+        reflections.clear();
+    }
+
+    const ProgramLayout& getProgramLayout(const std::vector<const Asset*>& stages) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::vector<uint64_t> programKey;
+        for (const Asset *stage : stages) {
+            programKey.push_back(hashCode(*stage));
+        }
+
+        auto found = programs.find(programKey);
+        if (found != programs.end()) {
+            return *found->second;
+        }
+
+        auto program = std::make_unique<ProgramLayout>();
+        VkShaderStageFlags pushConstantStages = 0;
+        uint32_t pushConstantSize = 0;
+
+        for (size_t i = 0; i < stages.size(); i++) {
+            auto reflection = reflections.find(programKey[i]);
+            if (reflection == reflections.end()) {
+                reflection = reflections.emplace(programKey[i], reflectSpirv(stages[i]->data(), stages[i]->size())).first;
+            }
+
+            for (const auto& binding : reflection->second.bindings) {
+                mergeBinding(*program, binding);
+            }
+
+            if (reflection->second.pushConstantSize > 0) {
+                pushConstantStages |= reflection->second.stage;
+                pushConstantSize = std::max(pushConstantSize, reflection->second.pushConstantSize);
+            }
+
+            if (reflection->second.stage == VK_SHADER_STAGE_VERTEX_BIT) {
+                program->vertexInputs = reflection->second.vertexInputs;
+            }
+        }
+
+        if (pushConstantSize > 0) {
+            program->pushConstantRanges.push_back({pushConstantStages, 0, pushConstantSize});
+        }
+
+        for (const auto& set : program->sets) {
+            program->setLayouts.push_back(getSetLayout(set));
+        }
+        program->pipelineLayout = getPipelineLayout(program->setLayouts, program->pushConstantRanges);
+
+        return *programs.emplace(programKey, std::move(program)).first->second;
+    }
+
+    private:
+    VkDevice device = VK_NULL_HANDLE;
+    std::mutex mutex;
+    std::unordered_map<uint64_t, ShaderReflection> reflections;
+    std::map<std::vector<uint64_t>, std::unique_ptr<ProgramLayout>> programs;
+    std::map<std::string, VkDescriptorSetLayout> setLayouts;
+    std::map<std::string, VkPipelineLayout> pipelineLayouts;
+
+    // FNV-1a over the module bytes.
+    static uint64_t hashCode(const Asset& code) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < code.size(); i++) {
+            hash ^= code.data()[i];
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    static void mergeBinding(ProgramLayout& program, const ReflectedBinding& binding) {
+        if (program.sets.size() <= binding.set) {
+            program.sets.resize(binding.set + 1);
+        }
+
+        auto& set = program.sets[binding.set];
+        auto existing = std::find_if(set.begin(), set.end(), [&](const ReflectedBinding& candidate) {
+            return candidate.binding == binding.binding;
+        });
+
+        if (existing == set.end()) {
+            set.push_back(binding);
+            std::sort(set.begin(), set.end(), [](const ReflectedBinding& a, const ReflectedBinding& b) {
+                return a.binding < b.binding;
+            });
+            return;
+        }
+
+        if (existing->type != binding.type || existing->count != binding.count) {
+            throw std::runtime_error("Shader stages disagree on set " + std::to_string(binding.set) + " binding " + std::to_string(binding.binding));
+        }
+        existing->stages |= binding.stages;
+    }
+
+    VkDescriptorSetLayout getSetLayout(const std::vector<ReflectedBinding>& set) {
+        std::string key;
+        std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+
+        for (const auto& binding : set) {
+            key += std::to_string(binding.binding) + ":" + std::to_string(binding.type) + ":" + std::to_string(binding.count) + ":" + std::to_string(binding.stages) + ";";
+
+            VkDescriptorSetLayoutBinding layoutBinding = {};
+            layoutBinding.binding = binding.binding;
+            layoutBinding.descriptorType = binding.type;
+            layoutBinding.descriptorCount = binding.count;
+            layoutBinding.stageFlags = binding.stages;
+            layoutBindings.push_back(layoutBinding);
+        }
+
+        auto found = setLayouts.find(key);
+        if (found != setLayouts.end()) {
+            return found->second;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+        layoutInfo.pBindings = layoutBindings.data();
+
+        VkDescriptorSetLayout setLayout;
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor set layout");
+        }
+
+        setLayouts.emplace(key, setLayout);
+        return setLayout;
+    }
+
+    VkPipelineLayout getPipelineLayout(const std::vector<VkDescriptorSetLayout>& programSetLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges) {
+        std::string key;
+        for (VkDescriptorSetLayout setLayout : programSetLayouts) {
+            key += std::to_string(reinterpret_cast<uint64_t>(setLayout)) + ";";
+        }
+        for (const auto& range : pushConstantRanges) {
+            key += "push:" + std::to_string(range.stageFlags) + ":" + std::to_string(range.offset) + ":" + std::to_string(range.size) + ";";
+        }
+
+        auto found = pipelineLayouts.find(key);
+        if (found != pipelineLayouts.end()) {
+            return found->second;
+        }
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(programSetLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = programSetLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+        pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+        VkPipelineLayout pipelineLayout;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline layout");
+        }
+
+        pipelineLayouts.emplace(key, pipelineLayout);
+        return pipelineLayout;
+    }
+};
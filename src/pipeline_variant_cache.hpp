@@ -0,0 +1,342 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "job_system.hpp"
+#include "mesh_format.hpp"
+#include "profiler.hpp"
+#include "vfs.hpp"
+
+// The full state of a graphics pipeline variant. Two keys that compare equal
+// always describe the same pipeline.
+struct PipelineVariantKey {
+    std::string vertexShader;
+    // Part of the program's layout even for depth-only variants. Neither path
+    // may contain spaces.
+    std::string fragmentShader;
+    MeshVertexLayout vertexLayout = MeshVertexLayout::Standard;
+    // Drops the fragment stage and color output.
+    bool depthOnly = false;
+    bool depthTest = true;
+    bool depthWrite = true;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+    VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+    bool blend = false;
+    VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    // Specialization constant i takes specialization[i] in every stage. Constants
+    // past the end keep the shader's default.
+    std::vector<uint32_t> specialization;
+
+    bool operator==(const PipelineVariantKey& other) const {
+        return vertexShader == other.vertexShader && fragmentShader == other.fragmentShader && vertexLayout == other.vertexLayout && depthOnly == other.depthOnly
+               && depthTest == other.depthTest && depthWrite == other.depthWrite && depthCompareOp == other.depthCompareOp && cullMode == other.cullMode
+               && blend == other.blend && colorFormat == other.colorFormat && depthFormat == other.depthFormat && specialization == other.specialization;
+    }
+
+    // The same state with every specialization constant at its default.
+    PipelineVariantKey generic() const {
+        PipelineVariantKey key = *this;
+        key.specialization.clear();
+        return key;
+    }
+
+    // One line of a variant list:
+    // vertexShader fragmentShader layout depthOnly depthTest depthWrite compareOp cullMode blend colorFormat depthFormat constantCount constants...
+    std::string toString() const {
+        std::ostringstream line;
+        line << vertexShader << ' ' << fragmentShader << ' ' << static_cast<uint32_t>(vertexLayout) << ' ' << depthOnly << ' ' << depthTest << ' ' << depthWrite << ' '
+             << depthCompareOp << ' ' << cullMode << ' ' << blend << ' ' << colorFormat << ' ' << depthFormat << ' ' << specialization.size();
+        for (uint32_t value : specialization) {
+            line << ' ' << value;
+        }
+        return line.str();
+    }
+
+    static PipelineVariantKey parse(const std::string& text) {
+        std::istringstream line(text);
+        PipelineVariantKey key;
+        uint32_t layout, compareOp, cullMode, colorFormat, depthFormat;
+        size_t constantCount;
+        line >> key.vertexShader >> key.fragmentShader >> layout >> key.depthOnly >> key.depthTest >> key.depthWrite >> compareOp >> cullMode >> key.blend >> colorFormat >> depthFormat >> constantCount;
+        key.vertexLayout = static_cast<MeshVertexLayout>(layout);
+        key.depthCompareOp = static_cast<VkCompareOp>(compareOp);
+        key.cullMode = cullMode;
+        key.colorFormat = static_cast<VkFormat>(colorFormat);
+        key.depthFormat = static_cast<VkFormat>(depthFormat);
+        key.specialization.resize(line ? constantCount : 0);
+        for (uint32_t& value : key.specialization) {
+            line >> value;
+        }
+        if (!line) {
+            throw std::runtime_error("Malformed pipeline variant: " + text);
+        }
+        return key;
+    }
+};
+
+// FNV-1a over the key's fields.
+struct PipelineVariantKeyHash {
+    size_t operator()(const PipelineVariantKey& key) const {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        auto mix = [&hash](const void *data, size_t size) {
+            const uint8_t *bytes = static_cast<const uint8_t *>(data);
+            for (size_t i = 0; i < size; i++) {
+                hash ^= bytes[i];
+                hash *= 0x100000001b3ull;
+            }
+        };
+        mix(key.vertexShader.data(), key.vertexShader.size() + 1);
+        mix(key.fragmentShader.data(), key.fragmentShader.size() + 1);
+        uint32_t state[] = {static_cast<uint32_t>(key.vertexLayout), key.depthOnly, key.depthTest, key.depthWrite, static_cast<uint32_t>(key.depthCompareOp),
+                            key.cullMode, key.blend, static_cast<uint32_t>(key.colorFormat), static_cast<uint32_t>(key.depthFormat)};
+        mix(state, sizeof(state));
+        mix(key.specialization.data(), key.specialization.size() * sizeof(uint32_t));
+        return static_cast<size_t>(hash);
+    }
+};
+
+struct PipelineVariantStatistics {
+    size_t variants = 0;
+    size_t compiling = 0;
+    // Times a generic variant was handed out in place of a specialized one.
+    uint64_t fallbacks = 0;
+    float compileMilliseconds = 0.0f;
+};
+
+// Graphics pipelines by variant key, each compiled once. A variant asked for
+// for the first time is compiled by a job while the generic variant, the same
+// state with default specialization constants, is handed out in its place, so
+// switching to a new variant never stalls a frame. Only a missing generic
+// variant is waited for; precompiling from a variant list recorded by an
+// earlier run keeps that, and the fallbacks, out of the first frames.
+//
+// Pipelines are built by a function supplied by the renderer, which must be
+// safe to call from job threads.
+class PipelineVariantCache {
+    public:
+    using BuildFunction = std::function<VkPipeline(const Vfs& shaderFiles, const PipelineVariantKey& key, const VkSpecializationInfo& specialization)>;
+
+    void init(VkDevice device, JobSystem& jobSystem, const Vfs& shaderFiles, BuildFunction build) {
+        this->device = device;
+        this->jobSystem = &jobSystem;
+        this->shaderFiles = &shaderFiles;
+        this->build = std::move(build);
+    }
+
+    void destroy() {
+        waitForCompiles();
+        for (const auto& [key, variant] : variants) {
+            if (VkPipeline pipeline = variant->pipeline.load(); pipeline != VK_NULL_HANDLE) {
+                vkDestroyPipeline(device, pipeline, nullptr);
+            }
+            if (VkPipeline pipeline = variant->reloaded.load(); pipeline != VK_NULL_HANDLE) {
+                vkDestroyPipeline(device, pipeline, nullptr);
+            }
+        }
+        variants.clear();
+    }
+
+    // The key's pipeline, or its generic variant while it is being compiled.
+    VkPipeline get(const PipelineVariantKey& key) {
+        Variant *variant = findOrCompile(key);
+        VkPipeline pipeline = variant->pipeline.load(std::memory_order_acquire);
+        if (pipeline != VK_NULL_HANDLE) {
+            return pipeline;
+        }
+
+        if (!key.specialization.empty()) {
+            fallbacks++;
+            return get(key.generic());
+        }
+
+        PROFILE_ZONE("PipelineVariantCache::wait");
+        jobSystem->wait(variant->job);
+        pipeline = variant->pipeline.load(std::memory_order_acquire);
+        if (pipeline == VK_NULL_HANDLE) {
+            throw std::runtime_error("Failed to compile pipeline variant " + key.toString());
+        }
+        return pipeline;
+    }
+
+    // Starts compiling the keys that are not compiled yet.
+    void precompile(const std::vector<PipelineVariantKey>& keys) {
+        for (const PipelineVariantKey& key : keys) {
+            findOrCompile(key);
+        }
+    }
+
+    void waitForCompiles() {
+        std::vector<Variant *> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& [key, variant] : variants) {
+                pending.push_back(variant.get());
+            }
+        }
+        for (Variant *variant : pending) {
+            jobSystem->wait(variant->job);
+        }
+    }
+
+    // Recompiles, from shaderFiles, every variant that uses the SPIR-V module at
+    // path. Later variants are read from shaderFiles too. Callable from any thread.
+    void reload(const Vfs& shaderFiles, const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->shaderFiles = &shaderFiles;
+        for (const auto& [key, variant] : variants) {
+            if (key.vertexShader == path || key.fragmentShader == path) {
+                startCompile(*variant, true);
+            }
+        }
+    }
+
+    // Swaps in variants recompiled by reload(). Must be called only once the GPU
+    // has finished with every pipeline handed out so far, since the replaced
+    // ones are destroyed.
+    void update() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& [key, variant] : variants) {
+            VkPipeline reloaded = variant->reloaded.exchange(VK_NULL_HANDLE);
+            if (reloaded == VK_NULL_HANDLE) {
+                continue;
+            }
+            VkPipeline replaced = variant->pipeline.exchange(reloaded);
+            if (replaced != VK_NULL_HANDLE) {
+                vkDestroyPipeline(device, replaced, nullptr);
+            }
+        }
+    }
+
+    std::vector<PipelineVariantKey> getKeys() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<PipelineVariantKey> keys;
+        for (const auto& [key, variant] : variants) {
+            keys.push_back(key);
+        }
+        return keys;
+    }
+
+    PipelineVariantStatistics getStatistics() {
+        std::lock_guard<std::mutex> lock(mutex);
+        PipelineVariantStatistics statistics;
+        statistics.variants = variants.size();
+        for (const auto& [key, variant] : variants) {
+            statistics.compiling += variant->job.isDone() ? 0 : 1;
+        }
+        statistics.fallbacks = fallbacks;
+        uint64_t count = compiled.load(std::memory_order_relaxed);
+        statistics.compileMilliseconds = count > 0 ? compileMicroseconds.load(std::memory_order_relaxed) / 1000.0f / count : 0.0f;
+        return statistics;
+    }
+
+    // A variant list holds one key per line. A missing list is empty.
+    static std::vector<PipelineVariantKey> readVariantList(const std::string& path) {
+        std::vector<PipelineVariantKey> keys;
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty()) {
+                keys.push_back(PipelineVariantKey::parse(line));
+            }
+        }
+        return keys;
+    }
+
+    static void writeVariantList(const std::string& path, const std::vector<PipelineVariantKey>& keys) {
+        std::ofstream file(path, std::ios::trunc);
+        for (const PipelineVariantKey& key : keys) {
+            file << key.toString() << '\n';
+        }
+        if (!file) {
+            throw std::runtime_error("Failed to write pipeline variant list " + path);
+        }
+    }
+
+    private:
+    struct Variant {
+        PipelineVariantKey key;
+        std::atomic<VkPipeline> pipeline{VK_NULL_HANDLE};
+        // A recompiled pipeline waiting for update() to swap it in.
+        std::atomic<VkPipeline> reloaded{VK_NULL_HANDLE};
+        JobCounter job;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    JobSystem *jobSystem = nullptr;
+    const Vfs *shaderFiles = nullptr;
+    BuildFunction build;
+    std::mutex mutex;
+    std::unordered_map<PipelineVariantKey, std::unique_ptr<Variant>, PipelineVariantKeyHash> variants;
+    uint64_t fallbacks = 0;
+    std::atomic<uint64_t> compiled{0};
+    std::atomic<uint64_t> compileMicroseconds{0};
+
+    Variant *findOrCompile(const PipelineVariantKey& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = variants.find(key);
+        if (found != variants.end()) {
+            return found->second.get();
+        }
+
+        auto variant = std::make_unique<Variant>();
+        variant->key = key;
+        startCompile(*variant, false);
+        return variants.emplace(key, std::move(variant)).first->second.get();
+    }
+
+    // Called with the mutex held. Variants are never removed before destroy(),
+    // which waits for their jobs.
+    void startCompile(Variant& variant, bool replace) {
+        const Vfs *files = shaderFiles;
+        jobSystem->run([this, &variant, files, replace]() {
+            const PipelineVariantKey& key = variant.key;
+            PROFILE_ZONE("compile pipeline variant");
+            auto start = std::chrono::steady_clock::now();
+
+            std::vector<VkSpecializationMapEntry> entries(key.specialization.size());
+            for (size_t i = 0; i < entries.size(); i++) {
+                entries[i].constantID = static_cast<uint32_t>(i);
+                entries[i].offset = static_cast<uint32_t>(i * sizeof(uint32_t));
+                entries[i].size = sizeof(uint32_t);
+            }
+            VkSpecializationInfo specialization = {};
+            specialization.mapEntryCount = static_cast<uint32_t>(entries.size());
+            specialization.pMapEntries = entries.data();
+            specialization.dataSize = key.specialization.size() * sizeof(uint32_t);
+            specialization.pData = key.specialization.data();
+
+            VkPipeline pipeline;
+            try {
+                pipeline = build(*files, key, specialization);
+            } catch (const std::exception& e) {
+                std::cerr << "Pipeline variant " << key.toString() << ": " << e.what() << (replace ? ", keeping the previous pipeline" : "") << std::endl;
+                return;
+            }
+
+            // A recompile that update() never picked up is simply superseded.
+            VkPipeline superseded = replace ? variant.reloaded.exchange(pipeline) : variant.pipeline.exchange(pipeline);
+            if (superseded != VK_NULL_HANDLE) {
+                vkDestroyPipeline(device, superseded, nullptr);
+            }
+
+            auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            compileMicroseconds.fetch_add(static_cast<uint64_t>(microseconds), std::memory_order_relaxed);
+            compiled.fetch_add(1, std::memory_order_relaxed);
+        }, variant.job);
+    }
+};
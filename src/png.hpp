@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Minimal PNG encoder (https://www.w3.org/TR/png/) for frame captures: 8-bit RGB,
+// no filtering, and a zlib stream of stored deflate blocks. Files come out about
+// as large as the raw pixels, but encoding is a pair of checksums over a copy,
+// fast enough to keep up with capturing every frame.
+
+inline const std::array<uint32_t, 256>& pngCrcTable() {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> entries = {};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+            }
+            entries[i] = crc;
+        }
+        return entries;
+    }();
+    return table;
+}
+
+inline uint32_t pngCrc(const uint8_t *data, size_t size, uint32_t crc = 0xffffffffu) {
+    const std::array<uint32_t, 256>& table = pngCrcTable();
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+inline void pngWriteU32(std::vector<uint8_t>& output, uint32_t value) {
+    output.push_back(static_cast<uint8_t>(value >> 24));
+    output.push_back(static_cast<uint8_t>(value >> 16));
+    output.push_back(static_cast<uint8_t>(value >> 8));
+    output.push_back(static_cast<uint8_t>(value));
+}
+
+inline void pngWriteChunk(std::vector<uint8_t>& output, const char type[4], const uint8_t *data, size_t size) {
+    pngWriteU32(output, static_cast<uint32_t>(size));
+    size_t typePosition = output.size();
+    output.insert(output.end(), type, type + 4);
+    output.insert(output.end(), data, data + size);
+    uint32_t crc = pngCrc(output.data() + typePosition, size + 4);
+    pngWriteU32(output, crc ^ 0xffffffffu);
+}
+
+// rgb holds height rows of width pixels, rowPitch bytes apart.
+inline std::vector<uint8_t> pngEncode(uint32_t width, uint32_t height, const uint8_t *rgb, size_t rowPitch) {
+    const size_t maxStoredBlock = 65535;
+    size_t rowSize = static_cast<size_t>(width) * 3;
+    size_t rawSize = (rowSize + 1) * height;
+
+    // Each scanline starts with its filter type, 0 for none.
+    std::vector<uint8_t> raw(rawSize);
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t *row = raw.data() + y * (rowSize + 1);
+        row[0] = 0;
+        std::copy(rgb + y * rowPitch, rgb + y * rowPitch + rowSize, row + 1);
+    }
+
+    size_t blockCount = (rawSize + maxStoredBlock - 1) / maxStoredBlock;
+    std::vector<uint8_t> zlib;
+    zlib.reserve(2 + rawSize + blockCount * 5 + 4);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+    for (size_t offset = 0; offset < rawSize; offset += maxStoredBlock) {
+        size_t length = std::min(maxStoredBlock, rawSize - offset);
+        zlib.push_back(offset + length == rawSize ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(length));
+        zlib.push_back(static_cast<uint8_t>(length >> 8));
+        zlib.push_back(static_cast<uint8_t>(~length));
+        zlib.push_back(static_cast<uint8_t>(~length >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+
+        // Sums stay below 2^32 for runs of up to 5552 bytes before the modulo.
+        for (size_t run = 0; run < length; run += 5552) {
+            size_t end = std::min(length, run + 5552);
+            for (size_t i = run; i < end; i++) {
+                adlerA += raw[offset + i];
+                adlerB += adlerA;
+            }
+            adlerA %= 65521;
+            adlerB %= 65521;
+        }
+    }
+    pngWriteU32(zlib, (adlerB << 16) | adlerA);
+
+    std::vector<uint8_t> output;
+    output.reserve(zlib.size() + 64);
+    const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    output.insert(output.end(), signature, signature + 8);
+
+    std::vector<uint8_t> header;
+    pngWriteU32(header, width);
+    pngWriteU32(header, height);
+    // Bit depth 8, colour type 2 (RGB), default compression, filtering and no interlace.
+    const uint8_t format[5] = {8, 2, 0, 0, 0};
+    header.insert(header.end(), format, format + 5);
+    pngWriteChunk(output, "IHDR", header.data(), header.size());
+    pngWriteChunk(output, "IDAT", zlib.data(), zlib.size());
+    pngWriteChunk(output, "IEND", nullptr, 0);
+    return output;
+}
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define DIG_PROFILER_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define DIG_PROFILER_RDTSC
+#endif
+
+enum class ProfileEventType : uint8_t {
+    Begin,
+    End,
+    Counter
+};
+
+// Names must outlive the capture; string literals are the intended use.
+struct ProfileEvent {
+    const char *name;
+    uint64_t timestamp;
+    double value;
+    ProfileEventType type;
+};
+
+// Single-producer single-consumer ring. The owning thread pushes, the collecting
+// thread drains. A full ring drops events instead of blocking, but keeps one slot
+// per open zone so that every recorded Begin gets its End.
+class ProfileEventRing {
+    public:
+    static constexpr size_t CAPACITY = 1 << 16;
+
+    ProfileEventRing() : events(new ProfileEvent[CAPACITY]) {}
+
+    bool push(const ProfileEvent& event, size_t reserved) {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        size_t tail = this->tail.load(std::memory_order_acquire);
+        if (head - tail + reserved >= CAPACITY) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        events[head & (CAPACITY - 1)] = event;
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <typename Consumer>
+    void drain(Consumer&& consume) {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        size_t head = this->head.load(std::memory_order_acquire);
+        for (; tail != head; tail++) {
+            consume(events[tail & (CAPACITY - 1)]);
+        }
+        this->tail.store(tail, std::memory_order_release);
+    }
+
+    uint64_t takeDropped() {
+        return dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    private:
+    std::unique_ptr<ProfileEvent[]> events;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+};
+
+// CPU profiler recording scoped zones and counters into per-thread rings. While
+// no capture is running, instrumentation costs one relaxed atomic load. Captures
+// are written in the Chrome trace event format, which chrome://tracing and
+// Perfetto open directly and Tracy imports with its import-chrome tool.
+//
+// Instrument with the PROFILE_* macros below, which compile to nothing unless
+// DIG_PROFILER is defined.
+class Profiler {
+    public:
+    static bool isCapturing() {
+        return state().capturing.load(std::memory_order_relaxed);
+    }
+
+    static void start() {
+        State& s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.capturing.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        // Events left over from before the capture are discarded.
+        for (auto& thread : s.threads) {
+            thread->ring.drain([](const ProfileEvent&) {});
+            thread->ring.takeDropped();
+            thread->events.clear();
+        }
+
+        s.startTicks = now();
+        s.startTime = std::chrono::steady_clock::now();
+        s.capturing.store(true, std::memory_order_relaxed);
+    }
+
+    static void stop() {
+        state().capturing.store(false, std::memory_order_relaxed);
+    }
+
+    // Moves recorded events out of the rings. Call regularly, e.g. once a frame,
+    // so that the rings do not fill up.
+    static void collect() {
+        State& s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (auto& thread : s.threads) {
+            thread->ring.drain([&](const ProfileEvent& event) {
+                thread->events.push_back(event);
+            });
+            thread->dropped += thread->ring.takeDropped();
+        }
+    }
+
+    // Writes everything collected since start() and returns the number of events
+    // that were dropped because a ring was full.
+    static uint64_t writeChromeTrace(const std::string& path) {
+        collect();
+
+        State& s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Failed to open file " + path);
+        }
+
+        double ticksPerMicrosecond = calibrate(s);
+        uint64_t dropped = 0;
+        bool first = true;
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        for (auto& thread : s.threads) {
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << thread->id
+                 << ",\"args\":{\"name\":\"" << escape(thread->name) << "\"}}";
+            first = false;
+
+            for (const auto& event : thread->events) {
+                double timestamp = static_cast<double>(event.timestamp - s.startTicks) / ticksPerMicrosecond;
+                file << ",\n{\"name\":\"" << escape(event.name) << "\",\"pid\":0,\"tid\":" << thread->id << ",\"ts\":" << std::to_string(timestamp);
+
+                switch (event.type) {
+                    case ProfileEventType::Begin:
+                        file << ",\"ph\":\"B\"}";
+                        break;
+                    case ProfileEventType::End:
+                        file << ",\"ph\":\"E\"}";
+                        break;
+                    case ProfileEventType::Counter:
+                        file << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+                        break;
+                }
+            }
+
+            dropped += thread->dropped;
+            thread->events.clear();
+            thread->dropped = 0;
+        }
+        file << "\n]}\n";
+
+        return dropped;
+    }
+
+    static void setThreadName(const char *name) {
+        ThreadState& thread = threadState();
+        std::lock_guard<std::mutex> lock(state().mutex);
+        thread.name = name;
+    }
+
+    static uint64_t now() {
+#ifdef DIG_PROFILER_RDTSC
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    // Returns whether the Begin was recorded; only then must end() follow.
+    static bool begin(const char *name) {
+        if (!isCapturing()) {
+            return false;
+        }
+
+        ThreadState& thread = threadState();
+        if (!thread.ring.push({name, now(), 0.0, ProfileEventType::Begin}, thread.openZones + 1)) {
+            return false;
+        }
+        thread.openZones++;
+        return true;
+    }
+
+    static void end(const char *name) {
+        ThreadState& thread = threadState();
+        thread.ring.push({name, now(), 0.0, ProfileEventType::End}, 0);
+        thread.openZones--;
+    }
+
+    static void counter(const char *name, double value) {
+        if (!isCapturing()) {
+            return;
+        }
+
+        ThreadState& thread = threadState();
+        thread.ring.push({name, now(), value, ProfileEventType::Counter}, thread.openZones);
+    }
+
+    private:
+    struct ThreadState {
+        ProfileEventRing ring;
+        uint32_t id;
+        std::string name;
+        size_t openZones = 0;
+        std::vector<ProfileEvent> events;
+        uint64_t dropped = 0;
+    };
+
+    struct State {
+        std::atomic<bool> capturing{false};
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadState>> threads;
+        uint64_t startTicks = 0;
+        std::chrono::steady_clock::time_point startTime;
+    };
+
+    static State& state() {
+        static State s;
+        return s;
+    }
+
+    // Registered on first use and kept until exit, so the collector never sees a
+    // ring disappear.
+    static ThreadState& threadState() {
+        thread_local ThreadState *thread = nullptr;
+        if (thread == nullptr) {
+            State& s = state();
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.threads.push_back(std::make_unique<ThreadState>());
+            thread = s.threads.back().get();
+            thread->id = static_cast<uint32_t>(s.threads.size());
+            thread->name = "thread " + std::to_string(thread->id);
+        }
+        return *thread;
+    }
+
+    // Timestamp ticks per microsecond, measured against steady_clock over the
+    // capture when timestamps come from the TSC.
+    static double calibrate(const State& s) {
+#ifdef DIG_PROFILER_RDTSC
+        uint64_t ticks = now() - s.startTicks;
+        double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - s.startTime).count();
+        return microseconds > 0.0 && ticks > 0 ? ticks / microseconds : 1.0;
+#else
+        (void)s;
+        return 1000.0;
+#endif
+    }
+
+    static std::string escape(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+};
+
+// Records the enclosing scope as a zone.
+class ProfileZone {
+    public:
+    explicit ProfileZone(const char *name) : name(name), recorded(Profiler::begin(name)) {}
+
+    ~ProfileZone() {
+        if (recorded) {
+            Profiler::end(name);
+        }
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+    private:
+    const char *name;
+    bool recorded;
+};
+
+#ifdef DIG_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) Profiler::counter(name, static_cast<double>(value))
+#define PROFILE_THREAD(name) Profiler::setThreadName(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_COUNTER(name, value) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+
+// First-fit allocator of ranges in a space of fixed size, such as the elements
+// of a buffer shared by many meshes. Free ranges are kept by offset and merged
+// with their neighbours when freed, so the space only stays fragmented for as
+// long as the ranges splitting it are in use.
+class RangeAllocator {
+    public:
+    static constexpr uint64_t INVALID = UINT64_MAX;
+
+    explicit RangeAllocator(uint64_t capacity = 0) {
+        reset(capacity);
+    }
+
+    // Frees everything, and resizes the space.
+    void reset(uint64_t capacity) {
+        this->capacity = capacity;
+        used = 0;
+        freeRanges.clear();
+        if (capacity > 0) {
+            freeRanges[0] = capacity;
+        }
+    }
+
+    // The offset of size units, or INVALID when no free range is that large.
+    uint64_t allocate(uint64_t size) {
+        for (auto range = freeRanges.begin(); range != freeRanges.end(); ++range) {
+            if (range->second < size) {
+                continue;
+            }
+
+            uint64_t offset = range->first;
+            uint64_t remaining = range->second - size;
+            freeRanges.erase(range);
+            if (remaining > 0) {
+                freeRanges[offset + size] = remaining;
+            }
+            used += size;
+            return offset;
+        }
+        return INVALID;
+    }
+
+    // Frees a range returned by allocate(), with the size it was allocated with.
+    void free(uint64_t offset, uint64_t size) {
+        used -= size;
+
+        auto next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.end() && offset + size == next->first) {
+            size += next->second;
+            next = freeRanges.erase(next);
+        }
+        if (next != freeRanges.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                previous->second += size;
+                return;
+            }
+        }
+        freeRanges.emplace_hint(next, offset, size);
+    }
+
+    uint64_t getCapacity() const {
+        return capacity;
+    }
+
+    uint64_t getUsed() const {
+        return used;
+    }
+
+    // Number of free ranges, 1 when the free space is in one piece.
+    size_t getFreeRangeCount() const {
+        return freeRanges.size();
+    }
+
+    private:
+    uint64_t capacity = 0;
+    uint64_t used = 0;
+    // Offset to size.
+    std::map<uint64_t, uint64_t> freeRanges;
+};
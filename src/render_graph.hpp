@@ -0,0 +1,1008 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <vulkan/vulkan.h>
+
+#include "gpu_memory_tracker.hpp"
+
+// How a pass uses an image. Each usage maps to one synchronization2 stage/access
+// scope and layout, which is all the render graph needs to place barriers.
+enum class ImageUsage {
+    Undefined,
+    ColorAttachment,
+    DepthAttachment,
+    DepthRead,
+    SampledGraphics,
+    SampledCompute,
+    StorageReadCompute,
+    StorageWriteCompute,
+    TransferSrc,
+    TransferDst,
+    Present
+};
+
+enum class BufferUsage {
+    VertexInput,
+    IndexInput,
+    IndirectArgument,
+    UniformGraphics,
+    StorageReadGraphics,
+    StorageReadCompute,
+    StorageWriteCompute,
+    TransferSrc,
+    TransferDst,
+    HostRead
+};
+
+struct ImageState {
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+};
+
+struct BufferState {
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+};
+
+inline ImageState imageUsageState(ImageUsage usage) {
+    const VkPipelineStageFlags2 graphicsShaders = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+    const VkPipelineStageFlags2 depthTests = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+
+    switch (usage) {
+        case ImageUsage::Undefined:
+            return {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED};
+        case ImageUsage::ColorAttachment:
+            return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+        case ImageUsage::DepthAttachment:
+            return {depthTests, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL};
+        case ImageUsage::DepthRead:
+            return {depthTests, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL};
+        case ImageUsage::SampledGraphics:
+            return {graphicsShaders, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        case ImageUsage::SampledCompute:
+            return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        case ImageUsage::StorageReadCompute:
+            return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL};
+        case ImageUsage::StorageWriteCompute:
+            return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL};
+        case ImageUsage::TransferSrc:
+            return {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+        case ImageUsage::TransferDst:
+            return {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+        case ImageUsage::Present:
+            return {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+    }
+    throw std::runtime_error("Unknown image usage");
+}
+
+inline bool isImageWrite(ImageUsage usage) {
+    return usage == ImageUsage::ColorAttachment || usage == ImageUsage::DepthAttachment ||
+           usage == ImageUsage::StorageWriteCompute || usage == ImageUsage::TransferDst;
+}
+
+inline VkImageUsageFlags imageUsageFlags(ImageUsage usage) {
+    switch (usage) {
+        case ImageUsage::ColorAttachment: return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        case ImageUsage::DepthAttachment:
+        case ImageUsage::DepthRead: return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        case ImageUsage::SampledGraphics:
+        case ImageUsage::SampledCompute: return VK_IMAGE_USAGE_SAMPLED_BIT;
+        case ImageUsage::StorageReadCompute:
+        case ImageUsage::StorageWriteCompute: return VK_IMAGE_USAGE_STORAGE_BIT;
+        case ImageUsage::TransferSrc: return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        case ImageUsage::TransferDst: return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        default: return 0;
+    }
+}
+
+inline BufferState bufferUsageState(BufferUsage usage) {
+    const VkPipelineStageFlags2 graphicsShaders = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+
+    switch (usage) {
+        case BufferUsage::VertexInput:
+            return {VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT};
+        case BufferUsage::IndexInput:
+            return {VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT};
+        case BufferUsage::IndirectArgument:
+            return {VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT};
+        case BufferUsage::UniformGraphics:
+            return {graphicsShaders, VK_ACCESS_2_UNIFORM_READ_BIT};
+        case BufferUsage::StorageReadGraphics:
+            return {graphicsShaders, VK_ACCESS_2_SHADER_STORAGE_READ_BIT};
+        case BufferUsage::StorageReadCompute:
+            return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT};
+        case BufferUsage::StorageWriteCompute:
+            return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT};
+        case BufferUsage::TransferSrc:
+            return {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT};
+        case BufferUsage::TransferDst:
+            return {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT};
+        case BufferUsage::HostRead:
+            return {VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT};
+    }
+    throw std::runtime_error("Unknown buffer usage");
+}
+
+inline bool isBufferWrite(BufferUsage usage) {
+    return usage == BufferUsage::StorageWriteCompute || usage == BufferUsage::TransferDst;
+}
+
+inline VkBufferUsageFlags bufferUsageFlags(BufferUsage usage) {
+    switch (usage) {
+        case BufferUsage::VertexInput: return VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        case BufferUsage::IndexInput: return VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+        case BufferUsage::IndirectArgument: return VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+        case BufferUsage::UniformGraphics: return VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        case BufferUsage::StorageReadGraphics:
+        case BufferUsage::StorageReadCompute:
+        case BufferUsage::StorageWriteCompute: return VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        case BufferUsage::TransferSrc: return VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        case BufferUsage::TransferDst: return VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        default: return 0;
+    }
+}
+
+// Records a single layout transition between two usages outside of a graph,
+// e.g. for one-off uploads.
+inline void recordImageTransition(VkCommandBuffer commandBuffer, VkImage image, VkImageAspectFlags aspect, ImageUsage oldUsage, ImageUsage newUsage, uint32_t mipLevels = 1) {
+    ImageState oldState = imageUsageState(oldUsage);
+    ImageState newState = imageUsageState(newUsage);
+
+    VkImageMemoryBarrier2 barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = oldState.stages;
+    barrier.srcAccessMask = isImageWrite(oldUsage) ? oldState.access : VK_ACCESS_2_NONE;
+    barrier.dstStageMask = newState.stages;
+    barrier.dstAccessMask = newState.access;
+    barrier.oldLayout = oldState.layout;
+    barrier.newLayout = newState.layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = aspect;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    VkDependencyInfo dependencyInfo = {};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.imageMemoryBarrierCount = 1;
+    dependencyInfo.pImageMemoryBarriers = &barrier;
+
+    vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+}
+
+struct RenderGraphImage {
+    uint32_t index;
+};
+
+struct RenderGraphBuffer {
+    uint32_t index;
+};
+
+class RenderGraph;
+
+// Declares what a pass reads and writes. Handed to the setup callback of addPass().
+class RenderPassBuilder {
+    public:
+    void useImage(RenderGraphImage image, ImageUsage usage);
+    void useBuffer(RenderGraphBuffer buffer, BufferUsage usage);
+    void colorAttachment(RenderGraphImage image, VkAttachmentLoadOp loadOp, VkClearColorValue clearColor = {});
+    void depthAttachment(RenderGraphImage image, VkAttachmentLoadOp loadOp, bool depthWrite, float clearDepth = 1.0f);
+    // Renders into the top-left corner of the attachments only; by default the
+    // render area covers them entirely.
+    void renderArea(VkExtent2D extent);
+    // Keeps the pass even when nothing in the graph consumes its output.
+    void sideEffect();
+
+    private:
+    friend class RenderGraph;
+    RenderPassBuilder(RenderGraph& graph, uint32_t passIndex) : graph(graph), passIndex(passIndex) {}
+
+    RenderGraph& graph;
+    uint32_t passIndex;
+};
+
+// Frame graph of passes over images and buffers. Each frame the passes and the
+// resources they touch are declared, then compile() culls passes whose results
+// are never consumed, aliases the memory of transient resources whose lifetimes
+// do not overlap and plans the barriers, and execute() records everything with
+// one batched vkCmdPipelineBarrier2 per pass at most.
+//
+// Transient resources are created on the first compile and kept for as long as
+// later frames declare the same set of them. Reusing them across frames relies
+// on the caller having waited for the previous frame's submission.
+class RenderGraph {
+    public:
+    using SetupFunction = std::function<void(RenderPassBuilder&)>;
+    using ExecuteFunction = std::function<void(VkCommandBuffer, const RenderGraph&)>;
+
+    // Transient memory is reported to the tracker as attachments when one is given.
+    void init(VkDevice device, VkPhysicalDevice physicalDevice, GpuMemoryTracker *memoryTracker = nullptr) {
+        this->device = device;
+        this->memoryTracker = memoryTracker;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    }
+
+    void destroy() {
+        destroyTransients();
+    }
+
+    void reset() {
+        resources.clear();
+        passes.clear();
+        compiled = false;
+    }
+
+    // initialState is the last access before the graph runs. A finalUsage other
+    // than Undefined is transitioned to at the end and counts as a consumer, so
+    // the passes producing the image are never culled.
+    RenderGraphImage importImage(const std::string& name, VkImage image, VkImageView view, VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect, ImageState initialState, ImageUsage finalUsage) {
+        Resource resource = {};
+        resource.name = name;
+        resource.isImage = true;
+        resource.imported = true;
+        resource.image = image;
+        resource.view = view;
+        resource.format = format;
+        resource.extent = extent;
+        resource.aspect = aspect;
+        resource.initialState = initialState;
+        resource.hasFinalUsage = finalUsage != ImageUsage::Undefined;
+        resource.finalImageUsage = finalUsage;
+        resources.push_back(resource);
+        return {static_cast<uint32_t>(resources.size() - 1)};
+    }
+
+    RenderGraphBuffer importBuffer(const std::string& name, VkBuffer buffer, VkDeviceSize size, BufferState initialState) {
+        Resource resource = {};
+        resource.name = name;
+        resource.isImage = false;
+        resource.imported = true;
+        resource.buffer = buffer;
+        resource.size = size;
+        resource.initialState = {initialState.stages, initialState.access, VK_IMAGE_LAYOUT_UNDEFINED};
+        resources.push_back(resource);
+        return {static_cast<uint32_t>(resources.size() - 1)};
+    }
+
+    // Transient images live only within the frame; their usage flags are derived
+    // from how passes use them.
+    RenderGraphImage createImage(const std::string& name, VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect) {
+        Resource resource = {};
+        resource.name = name;
+        resource.isImage = true;
+        resource.format = format;
+        resource.extent = extent;
+        resource.aspect = aspect;
+        resource.initialState = imageUsageState(ImageUsage::Undefined);
+        resources.push_back(resource);
+        return {static_cast<uint32_t>(resources.size() - 1)};
+    }
+
+    RenderGraphBuffer createBuffer(const std::string& name, VkDeviceSize size) {
+        Resource resource = {};
+        resource.name = name;
+        resource.isImage = false;
+        resource.size = size;
+        resource.initialState = imageUsageState(ImageUsage::Undefined);
+        resources.push_back(resource);
+        return {static_cast<uint32_t>(resources.size() - 1)};
+    }
+
+    void addPass(const std::string& name, const SetupFunction& setup, ExecuteFunction execute) {
+        Pass pass = {};
+        pass.name = name;
+        pass.execute = std::move(execute);
+        passes.push_back(std::move(pass));
+
+        RenderPassBuilder builder(*this, static_cast<uint32_t>(passes.size() - 1));
+        setup(builder);
+    }
+
+    void compile() {
+        cullPasses();
+        computeLifetimes();
+        allocateTransients();
+        planBarriers();
+        compiled = true;
+    }
+
+    void execute(VkCommandBuffer commandBuffer) const {
+        if (!compiled) {
+            throw std::runtime_error("Render graph executed before compile");
+        }
+
+        for (size_t p = 0; p < passes.size(); p++) {
+            const Pass& pass = passes[p];
+            if (pass.culled) {
+                continue;
+            }
+
+            recordBarriers(commandBuffer, pass.barriers);
+
+            if (pass.colorAttachments.empty() && !pass.hasDepthAttachment) {
+                pass.execute(commandBuffer, *this);
+                continue;
+            }
+
+            std::vector<VkRenderingAttachmentInfo> colorInfos;
+            VkExtent2D extent = {};
+            for (const auto& attachment : pass.colorAttachments) {
+                const Resource& resource = resources[attachment.resource];
+                VkRenderingAttachmentInfo info = {};
+                info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+                info.imageView = resource.view;
+                info.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+                info.loadOp = attachment.loadOp;
+                info.storeOp = storeOp(resource, p);
+                info.clearValue = attachment.clearValue;
+                colorInfos.push_back(info);
+                extent = resource.extent;
+            }
+
+            VkRenderingAttachmentInfo depthInfo = {};
+            if (pass.hasDepthAttachment) {
+                const Resource& resource = resources[pass.depthAttachment.resource];
+                depthInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+                depthInfo.imageView = resource.view;
+                depthInfo.imageLayout = imageUsageState(pass.depthAttachment.usage).layout;
+                depthInfo.loadOp = pass.depthAttachment.loadOp;
+                depthInfo.storeOp = storeOp(resource, p);
+                depthInfo.clearValue = pass.depthAttachment.clearValue;
+                extent = resource.extent;
+            }
+
+            VkRenderingInfo renderingInfo = {};
+            renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+            renderingInfo.renderArea.offset = {0, 0};
+            renderingInfo.renderArea.extent = pass.renderArea.width > 0 ? pass.renderArea : extent;
+            renderingInfo.layerCount = 1;
+            renderingInfo.colorAttachmentCount = static_cast<uint32_t>(colorInfos.size());
+            renderingInfo.pColorAttachments = colorInfos.data();
+            renderingInfo.pDepthAttachment = pass.hasDepthAttachment ? &depthInfo : nullptr;
+
+            vkCmdBeginRendering(commandBuffer, &renderingInfo);
+            pass.execute(commandBuffer, *this);
+            vkCmdEndRendering(commandBuffer);
+        }
+
+        recordBarriers(commandBuffer, finalBarriers);
+    }
+
+    VkImage getImage(RenderGraphImage image) const {
+        return resources[image.index].image;
+    }
+
+    VkImageView getImageView(RenderGraphImage image) const {
+        return resources[image.index].view;
+    }
+
+    VkExtent2D getImageExtent(RenderGraphImage image) const {
+        return resources[image.index].extent;
+    }
+
+    VkBuffer getBuffer(RenderGraphBuffer buffer) const {
+        return resources[buffer.index].buffer;
+    }
+
+    bool isPassCulled(const std::string& name) const {
+        for (const auto& pass : passes) {
+            if (pass.name == name) {
+                return pass.culled;
+            }
+        }
+        return true;
+    }
+
+    private:
+    friend class RenderPassBuilder;
+
+    struct Access {
+        uint32_t resource;
+        VkPipelineStageFlags2 stages;
+        VkAccessFlags2 access;
+        VkImageLayout layout;
+        bool write;
+    };
+
+    struct ColorAttachment {
+        uint32_t resource;
+        VkAttachmentLoadOp loadOp;
+        VkClearValue clearValue;
+    };
+
+    struct DepthAttachment {
+        uint32_t resource;
+        VkAttachmentLoadOp loadOp;
+        VkClearValue clearValue;
+        ImageUsage usage;
+    };
+
+    struct Barriers {
+        std::vector<VkImageMemoryBarrier2> images;
+        std::vector<VkBufferMemoryBarrier2> buffers;
+    };
+
+    struct Pass {
+        std::string name;
+        std::vector<Access> accesses;
+        std::vector<ColorAttachment> colorAttachments;
+        DepthAttachment depthAttachment;
+        bool hasDepthAttachment;
+        VkExtent2D renderArea;
+        bool hasSideEffect;
+        bool culled;
+        ExecuteFunction execute;
+        Barriers barriers;
+    };
+
+    // Synchronization state of a resource while barriers are planned: the last
+    // write, and the reads since then that a later write has to wait for.
+    struct SyncState {
+        VkImageLayout layout;
+        VkPipelineStageFlags2 writeStages;
+        VkAccessFlags2 writeAccess;
+        VkPipelineStageFlags2 readStages;
+        VkAccessFlags2 readAccess;
+    };
+
+    struct Resource {
+        std::string name;
+        bool isImage;
+        bool imported;
+        VkImage image;
+        VkImageView view;
+        VkFormat format;
+        VkExtent2D extent;
+        VkImageAspectFlags aspect;
+        VkImageUsageFlags imageUsage;
+        VkBuffer buffer;
+        VkDeviceSize size;
+        VkBufferUsageFlags bufferUsage;
+        ImageState initialState;
+        bool hasFinalUsage;
+        ImageUsage finalImageUsage;
+        uint32_t readerCount;
+        uint32_t firstPass;
+        uint32_t lastPass;
+        int aliasPredecessor;
+        SyncState sync;
+    };
+
+    struct TransientAllocation {
+        VkImage image;
+        VkImageView view;
+        VkBuffer buffer;
+        uint32_t block;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    GpuMemoryTracker *memoryTracker = nullptr;
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    Barriers finalBarriers;
+    bool compiled = false;
+
+    std::string transientSignature;
+    std::vector<TransientAllocation> transientAllocations;
+    std::vector<VkDeviceMemory> transientMemory;
+
+    void addAccess(uint32_t passIndex, uint32_t resourceIndex, VkPipelineStageFlags2 stages, VkAccessFlags2 access, VkImageLayout layout, bool write) {
+        Pass& pass = passes[passIndex];
+        for (auto& existing : pass.accesses) {
+            if (existing.resource == resourceIndex) {
+                if (existing.layout != layout) {
+                    throw std::runtime_error("Pass " + pass.name + " uses " + resources[resourceIndex].name + " in two layouts");
+                }
+                existing.stages |= stages;
+                existing.access |= access;
+                existing.write = existing.write || write;
+                return;
+            }
+        }
+        pass.accesses.push_back({resourceIndex, stages, access, layout, write});
+    }
+
+    void cullPasses() {
+        std::vector<uint32_t> writeCounts(passes.size(), 0);
+        for (auto& resource : resources) {
+            resource.readerCount = resource.hasFinalUsage ? 1 : 0;
+        }
+
+        for (size_t p = 0; p < passes.size(); p++) {
+            passes[p].culled = false;
+            for (const auto& access : passes[p].accesses) {
+                if (access.write) {
+                    writeCounts[p]++;
+                }
+                else {
+                    resources[access.resource].readerCount++;
+                }
+            }
+        }
+
+        std::vector<uint32_t> unreferenced;
+        for (size_t r = 0; r < resources.size(); r++) {
+            if (resources[r].readerCount == 0) {
+                unreferenced.push_back(static_cast<uint32_t>(r));
+            }
+        }
+
+        while (!unreferenced.empty()) {
+            uint32_t resourceIndex = unreferenced.back();
+            unreferenced.pop_back();
+
+            for (size_t p = 0; p < passes.size(); p++) {
+                Pass& pass = passes[p];
+                if (pass.culled || pass.hasSideEffect) {
+                    continue;
+                }
+
+                bool writesResource = std::any_of(pass.accesses.begin(), pass.accesses.end(), [&](const Access& access) {
+                    return access.resource == resourceIndex && access.write;
+                });
+                if (!writesResource || --writeCounts[p] > 0) {
+                    continue;
+                }
+
+                pass.culled = true;
+                for (const auto& access : pass.accesses) {
+                    if (!access.write && --resources[access.resource].readerCount == 0) {
+                        unreferenced.push_back(access.resource);
+                    }
+                }
+            }
+        }
+    }
+
+    void computeLifetimes() {
+        for (auto& resource : resources) {
+            resource.firstPass = UINT32_MAX;
+            resource.lastPass = 0;
+            resource.aliasPredecessor = -1;
+        }
+
+        for (size_t p = 0; p < passes.size(); p++) {
+            if (passes[p].culled) {
+                continue;
+            }
+            for (const auto& access : passes[p].accesses) {
+                Resource& resource = resources[access.resource];
+                resource.firstPass = std::min(resource.firstPass, static_cast<uint32_t>(p));
+                resource.lastPass = std::max(resource.lastPass, static_cast<uint32_t>(p));
+            }
+        }
+    }
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+        return UINT32_MAX;
+    }
+
+    void destroyTransients() {
+        for (const auto& allocation : transientAllocations) {
+            if (allocation.view != VK_NULL_HANDLE) {
+                vkDestroyImageView(device, allocation.view, nullptr);
+            }
+            if (allocation.image != VK_NULL_HANDLE) {
+                vkDestroyImage(device, allocation.image, nullptr);
+            }
+            if (allocation.buffer != VK_NULL_HANDLE) {
+                vkDestroyBuffer(device, allocation.buffer, nullptr);
+            }
+        }
+        for (VkDeviceMemory memory : transientMemory) {
+            if (memoryTracker != nullptr) {
+                memoryTracker->free(memory);
+            }
+            else {
+                vkFreeMemory(device, memory, nullptr);
+            }
+        }
+
+        transientAllocations.clear();
+        transientMemory.clear();
+        transientSignature.clear();
+    }
+
+    // Transients that are live (not culled) in this frame, in declaration order.
+    std::vector<uint32_t> liveTransients() const {
+        std::vector<uint32_t> live;
+        for (size_t r = 0; r < resources.size(); r++) {
+            if (!resources[r].imported && resources[r].firstPass != UINT32_MAX) {
+                live.push_back(static_cast<uint32_t>(r));
+            }
+        }
+        return live;
+    }
+
+    void allocateTransients() {
+        std::vector<uint32_t> live = liveTransients();
+
+        std::string signature;
+        for (uint32_t r : live) {
+            const Resource& resource = resources[r];
+            signature += resource.isImage
+                ? "i" + std::to_string(resource.format) + "x" + std::to_string(resource.extent.width) + "x" + std::to_string(resource.extent.height) + "u" + std::to_string(resource.imageUsage)
+                : "b" + std::to_string(resource.size) + "u" + std::to_string(resource.bufferUsage);
+            signature += "@" + std::to_string(resource.firstPass) + "-" + std::to_string(resource.lastPass) + ";";
+        }
+
+        if (signature != transientSignature) {
+            destroyTransients();
+            createTransients(live);
+            transientSignature = signature;
+        }
+
+        // Rebind this frame's declarations to the cached objects, and link each
+        // transient to the one that used its memory before it.
+        std::vector<int> blockOwners;
+        std::vector<uint32_t> order = live;
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return resources[a].firstPass < resources[b].firstPass;
+        });
+
+        for (size_t i = 0; i < live.size(); i++) {
+            Resource& resource = resources[live[i]];
+            resource.image = transientAllocations[i].image;
+            resource.view = transientAllocations[i].view;
+            resource.buffer = transientAllocations[i].buffer;
+        }
+
+        for (uint32_t r : order) {
+            size_t allocationIndex = std::find(live.begin(), live.end(), r) - live.begin();
+            uint32_t block = transientAllocations[allocationIndex].block;
+            if (blockOwners.size() <= block) {
+                blockOwners.resize(block + 1, -1);
+            }
+            resources[r].aliasPredecessor = blockOwners[block];
+            blockOwners[block] = static_cast<int>(r);
+        }
+    }
+
+    void createTransients(const std::vector<uint32_t>& live) {
+        struct Block {
+            uint32_t memoryType;
+            VkDeviceSize size;
+            VkDeviceSize alignment;
+            std::vector<std::pair<uint32_t, uint32_t>> lifetimes;
+        };
+
+        std::vector<VkMemoryRequirements> requirements(live.size());
+        std::vector<uint32_t> memoryTypes(live.size());
+        transientAllocations.assign(live.size(), {VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, 0});
+
+        for (size_t i = 0; i < live.size(); i++) {
+            const Resource& resource = resources[live[i]];
+            VkMemoryPropertyFlags preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+            if (resource.isImage) {
+                // Attachments that never leave the tile can live in lazily allocated memory.
+                VkImageUsageFlags usage = resource.imageUsage;
+                bool attachmentOnly = (usage & ~(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) == 0;
+                if (attachmentOnly) {
+                    usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+                }
+
+                VkImageCreateInfo imageInfo = {};
+                imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+                imageInfo.imageType = VK_IMAGE_TYPE_2D;
+                imageInfo.extent = {resource.extent.width, resource.extent.height, 1};
+                imageInfo.mipLevels = 1;
+                imageInfo.arrayLayers = 1;
+                imageInfo.format = resource.format;
+                imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+                imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                imageInfo.usage = usage;
+                imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+                imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+
+                if (vkCreateImage(device, &imageInfo, nullptr, &transientAllocations[i].image) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to create transient image " + resource.name);
+                }
+                vkGetImageMemoryRequirements(device, transientAllocations[i].image, &requirements[i]);
+
+                if (attachmentOnly && findMemoryType(requirements[i].memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != UINT32_MAX) {
+                    preferred = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+                }
+            }
+            else {
+                VkBufferCreateInfo bufferInfo = {};
+                bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+                bufferInfo.size = resource.size;
+                bufferInfo.usage = resource.bufferUsage;
+                bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+                if (vkCreateBuffer(device, &bufferInfo, nullptr, &transientAllocations[i].buffer) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to create transient buffer " + resource.name);
+                }
+                vkGetBufferMemoryRequirements(device, transientAllocations[i].buffer, &requirements[i]);
+            }
+
+            memoryTypes[i] = findMemoryType(requirements[i].memoryTypeBits, preferred);
+            if (memoryTypes[i] == UINT32_MAX) {
+                throw std::runtime_error("Failed to find memory type for transient " + resource.name);
+            }
+        }
+
+        // Greedy first fit, largest first: a resource shares a block with others
+        // whose lifetimes it does not overlap.
+        std::vector<size_t> bySize(live.size());
+        for (size_t i = 0; i < bySize.size(); i++) {
+            bySize[i] = i;
+        }
+        std::sort(bySize.begin(), bySize.end(), [&](size_t a, size_t b) {
+            return requirements[a].size > requirements[b].size;
+        });
+
+        std::vector<Block> blocks;
+        for (size_t i : bySize) {
+            const Resource& resource = resources[live[i]];
+            std::pair<uint32_t, uint32_t> lifetime = {resource.firstPass, resource.lastPass};
+
+            auto fits = [&](const Block& block) {
+                if (block.memoryType != memoryTypes[i]) {
+                    return false;
+                }
+                return std::none_of(block.lifetimes.begin(), block.lifetimes.end(), [&](const std::pair<uint32_t, uint32_t>& other) {
+                    return lifetime.first <= other.second && other.first <= lifetime.second;
+                });
+            };
+
+            auto block = std::find_if(blocks.begin(), blocks.end(), fits);
+            if (block == blocks.end()) {
+                blocks.push_back({memoryTypes[i], 0, 1, {}});
+                block = blocks.end() - 1;
+            }
+
+            block->size = std::max(block->size, requirements[i].size);
+            block->alignment = std::max(block->alignment, requirements[i].alignment);
+            block->lifetimes.push_back(lifetime);
+            transientAllocations[i].block = static_cast<uint32_t>(block - blocks.begin());
+        }
+
+        for (const auto& block : blocks) {
+            VkMemoryAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.allocationSize = (block.size + block.alignment - 1) / block.alignment * block.alignment;
+            allocInfo.memoryTypeIndex = block.memoryType;
+
+            VkDeviceMemory memory;
+            VkResult result = memoryTracker != nullptr
+                ? memoryTracker->allocate(allocInfo, MemoryCategory::Attachment, &memory)
+                : vkAllocateMemory(device, &allocInfo, nullptr, &memory);
+            if (result != VK_SUCCESS) {
+                throw std::runtime_error("Failed to allocate transient memory");
+            }
+            transientMemory.push_back(memory);
+        }
+
+        for (size_t i = 0; i < live.size(); i++) {
+            const Resource& resource = resources[live[i]];
+            VkDeviceMemory memory = transientMemory[transientAllocations[i].block];
+
+            if (!resource.isImage) {
+                vkBindBufferMemory(device, transientAllocations[i].buffer, memory, 0);
+                continue;
+            }
+
+            vkBindImageMemory(device, transientAllocations[i].image, memory, 0);
+
+            VkImageViewCreateInfo viewInfo = {};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = transientAllocations[i].image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = resource.format;
+            viewInfo.subresourceRange.aspectMask = resource.aspect;
+            viewInfo.subresourceRange.baseMipLevel = 0;
+            viewInfo.subresourceRange.levelCount = 1;
+            viewInfo.subresourceRange.baseArrayLayer = 0;
+            viewInfo.subresourceRange.layerCount = 1;
+
+            if (vkCreateImageView(device, &viewInfo, nullptr, &transientAllocations[i].view) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create transient image view " + resource.name);
+            }
+        }
+    }
+
+    // Adds whatever barrier is needed to go from the resource's current state to
+    // `access`, then advances the state. Read-after-read in the same layout needs
+    // nothing; read-after-write needs a memory dependency on the write; write-after-
+    // read only needs an execution dependency on the reads.
+    void transition(Resource& resource, const Access& access, Barriers& barriers) {
+        SyncState& state = resource.sync;
+        bool layoutChange = resource.isImage && state.layout != access.layout;
+
+        VkPipelineStageFlags2 srcStages = 0;
+        VkAccessFlags2 srcAccess = 0;
+        bool needed = false;
+
+        if (layoutChange || access.write) {
+            srcStages = state.writeStages | state.readStages;
+            srcAccess = state.writeAccess;
+            needed = layoutChange || srcStages != 0;
+        }
+        else if (state.writeStages != 0 && ((access.stages & ~state.readStages) != 0 || (access.access & ~state.readAccess) != 0)) {
+            srcStages = state.writeStages;
+            srcAccess = state.writeAccess;
+            needed = true;
+        }
+
+        if (needed) {
+            if (resource.isImage) {
+                VkImageMemoryBarrier2 barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+                barrier.srcStageMask = srcStages;
+                barrier.srcAccessMask = srcAccess;
+                barrier.dstStageMask = access.stages;
+                barrier.dstAccessMask = access.access;
+                barrier.oldLayout = state.layout;
+                barrier.newLayout = access.layout;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = resource.image;
+                barrier.subresourceRange.aspectMask = resource.aspect;
+                barrier.subresourceRange.baseMipLevel = 0;
+                barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+                barrier.subresourceRange.baseArrayLayer = 0;
+                barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+                barriers.images.push_back(barrier);
+            }
+            else {
+                VkBufferMemoryBarrier2 barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+                barrier.srcStageMask = srcStages;
+                barrier.srcAccessMask = srcAccess;
+                barrier.dstStageMask = access.stages;
+                barrier.dstAccessMask = access.access;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.buffer = resource.buffer;
+                barrier.offset = 0;
+                barrier.size = VK_WHOLE_SIZE;
+                barriers.buffers.push_back(barrier);
+            }
+        }
+
+        // A layout transition behaves like a write that later accesses must wait for.
+        if (access.write || layoutChange) {
+            state.layout = access.layout;
+            state.writeStages = access.stages;
+            state.writeAccess = access.write ? access.access & writeAccessMask() : VK_ACCESS_2_NONE;
+            state.readStages = access.write ? 0 : access.stages;
+            state.readAccess = access.write ? 0 : access.access;
+        }
+        else {
+            state.readStages |= access.stages;
+            state.readAccess |= access.access;
+        }
+    }
+
+    static VkAccessFlags2 writeAccessMask() {
+        return VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+               VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT |
+               VK_ACCESS_2_MEMORY_WRITE_BIT;
+    }
+
+    void planBarriers() {
+        for (auto& resource : resources) {
+            const ImageState& initial = resource.initialState;
+            VkAccessFlags2 initialWrites = initial.access & writeAccessMask();
+
+            // An initial state without writes still orders later writes after it,
+            // e.g. the swapchain acquire semaphore wait.
+            if (initialWrites != 0) {
+                resource.sync = {initial.layout, initial.stages, initialWrites, 0, 0};
+            }
+            else {
+                resource.sync = {initial.layout, 0, 0, initial.stages, initial.access};
+            }
+        }
+
+        for (size_t p = 0; p < passes.size(); p++) {
+            Pass& pass = passes[p];
+            pass.barriers = {};
+            if (pass.culled) {
+                continue;
+            }
+
+            for (const auto& access : pass.accesses) {
+                Resource& resource = resources[access.resource];
+
+                // An aliased transient starts where the previous user of the same
+                // memory left off, with its contents discarded.
+                if (!resource.imported && resource.aliasPredecessor >= 0 && resource.firstPass == p) {
+                    const SyncState& previous = resources[resource.aliasPredecessor].sync;
+                    resource.sync = {VK_IMAGE_LAYOUT_UNDEFINED, previous.writeStages | previous.readStages, previous.writeAccess, 0, 0};
+                }
+
+                transition(resource, access, pass.barriers);
+            }
+        }
+
+        finalBarriers = {};
+        for (auto& resource : resources) {
+            if (!resource.hasFinalUsage) {
+                continue;
+            }
+
+            ImageState finalState = imageUsageState(resource.finalImageUsage);
+            Access finalAccess = {0, finalState.stages, finalState.access, finalState.layout, false};
+            transition(resource, finalAccess, finalBarriers);
+        }
+    }
+
+    // Nothing reads a transient after its last pass, so tilers can skip writing it back.
+    static VkAttachmentStoreOp storeOp(const Resource& resource, size_t passIndex) {
+        return !resource.imported && resource.lastPass == passIndex ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+    }
+
+    static void recordBarriers(VkCommandBuffer commandBuffer, const Barriers& barriers) {
+        if (barriers.images.empty() && barriers.buffers.empty()) {
+            return;
+        }
+
+        VkDependencyInfo dependencyInfo = {};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(barriers.images.size());
+        dependencyInfo.pImageMemoryBarriers = barriers.images.data();
+        dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(barriers.buffers.size());
+        dependencyInfo.pBufferMemoryBarriers = barriers.buffers.data();
+
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    }
+};
+
+inline void RenderPassBuilder::useImage(RenderGraphImage image, ImageUsage usage) {
+    ImageState state = imageUsageState(usage);
+    graph.resources[image.index].imageUsage |= imageUsageFlags(usage);
+    graph.addAccess(passIndex, image.index, state.stages, state.access, state.layout, isImageWrite(usage));
+}
+
+inline void RenderPassBuilder::useBuffer(RenderGraphBuffer buffer, BufferUsage usage) {
+    BufferState state = bufferUsageState(usage);
+    graph.resources[buffer.index].bufferUsage |= bufferUsageFlags(usage);
+    graph.addAccess(passIndex, buffer.index, state.stages, state.access, VK_IMAGE_LAYOUT_UNDEFINED, isBufferWrite(usage));
+}
+
+inline void RenderPassBuilder::colorAttachment(RenderGraphImage image, VkAttachmentLoadOp loadOp, VkClearColorValue clearColor) {
+    useImage(image, ImageUsage::ColorAttachment);
+
+    VkClearValue clearValue = {};
+    clearValue.color = clearColor;
+    graph.passes[passIndex].colorAttachments.push_back({image.index, loadOp, clearValue});
+}
+
+inline void RenderPassBuilder::depthAttachment(RenderGraphImage image, VkAttachmentLoadOp loadOp, bool depthWrite, float clearDepth) {
+    ImageUsage usage = depthWrite ? ImageUsage::DepthAttachment : ImageUsage::DepthRead;
+    useImage(image, usage);
+
+    VkClearValue clearValue = {};
+    clearValue.depthStencil = {clearDepth, 0};
+
+    RenderGraph::Pass& pass = graph.passes[passIndex];
+    pass.hasDepthAttachment = true;
+    pass.depthAttachment = {image.index, loadOp, clearValue, usage};
+}
+
+inline void RenderPassBuilder::renderArea(VkExtent2D extent) {
+    graph.passes[passIndex].renderArea = extent;
+}
+
+inline void RenderPassBuilder::sideEffect() {
+    graph.passes[passIndex].hasSideEffect = true;
+}
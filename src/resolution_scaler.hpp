@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include <vulkan/vulkan.h>
+
+// Chooses the render resolution scale that keeps GPU frame time within a budget.
+// GPU time is taken to be proportional to pixel count, so the scale moves by the
+// square root of budget/time. The time is smoothed, every change is followed by
+// a settle period and limited in size, and the scale only goes up once there is
+// clear headroom, so the resolution does not oscillate from frame to frame.
+class ResolutionScaler {
+    public:
+    ResolutionScaler(float budgetMilliseconds, float minScale, float maxScale)
+        : budgetMilliseconds(budgetMilliseconds), minScale(minScale), maxScale(maxScale), scale(maxScale) {}
+
+    void update(float gpuMilliseconds) {
+        if (gpuMilliseconds <= 0.0f) {
+            return;
+        }
+
+        smoothedMilliseconds = smoothedMilliseconds == 0.0f ? gpuMilliseconds : smoothedMilliseconds + (gpuMilliseconds - smoothedMilliseconds) * SMOOTHING;
+        if (++framesSinceChange < SETTLE_FRAMES) {
+            return;
+        }
+
+        bool overBudget = smoothedMilliseconds > budgetMilliseconds;
+        bool underBudget = smoothedMilliseconds < budgetMilliseconds * UPSCALE_THRESHOLD;
+        if (!overBudget && !underBudget) {
+            return;
+        }
+
+        float desired = scale * std::sqrt(budgetMilliseconds * UPSCALE_THRESHOLD / smoothedMilliseconds);
+        desired = std::clamp(desired, scale * (1.0f - MAX_STEP), scale * (1.0f + MAX_STEP));
+        desired = std::clamp(std::round(desired * SCALE_STEPS) / SCALE_STEPS, minScale, maxScale);
+        if (desired == scale) {
+            return;
+        }
+
+        // Predict the time at the new scale rather than waiting for it to be measured.
+        smoothedMilliseconds *= (desired * desired) / (scale * scale);
+        scale = desired;
+        framesSinceChange = 0;
+    }
+
+    float getScale() const {
+        return scale;
+    }
+
+    // Overrides the chosen scale, as when replaying a recorded run.
+    void setScale(float newScale) {
+        scale = std::clamp(newScale, minScale, maxScale);
+        framesSinceChange = 0;
+    }
+
+    VkExtent2D scaleExtent(VkExtent2D extent) const {
+        VkExtent2D scaled;
+        scaled.width = std::max(1u, static_cast<uint32_t>(std::lround(extent.width * scale)));
+        scaled.height = std::max(1u, static_cast<uint32_t>(std::lround(extent.height * scale)));
+        return scaled;
+    }
+
+    private:
+    static constexpr float SMOOTHING = 0.1f;
+    static constexpr int SETTLE_FRAMES = 8;
+    static constexpr float UPSCALE_THRESHOLD = 0.85f;
+    static constexpr float MAX_STEP = 0.1f;
+    static constexpr float SCALE_STEPS = 64.0f;
+
+    float budgetMilliseconds;
+    float minScale;
+    float maxScale;
+    float scale;
+    float smoothedMilliseconds = 0.0f;
+    int framesSinceChange = 0;
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "ecs.hpp"
+#include "job_system.hpp"
+#include "profiler.hpp"
+#include "simd_math.hpp"
+#include "spatial_hash_grid.hpp"
+
+struct Transform {
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+};
+
+// Indices into the renderer's mesh and texture tables.
+struct MeshId {
+    uint32_t index;
+};
+
+struct TextureId {
+    uint32_t index;
+};
+
+// Axis-aligned bounds in model space, and in world space as of the last
+// updateBounds().
+struct Bounds {
+    glm::vec3 localMin;
+    glm::vec3 localMax;
+    glm::vec3 worldMin;
+    glm::vec3 worldMax;
+};
+
+// Turns the entity about an axis by the simulation's model angle.
+struct Spin {
+    glm::vec3 axis;
+};
+
+// Instances [firstInstance, firstInstance + instanceCount) of the instance
+// buffer, all drawn with one mesh and texture.
+struct DrawBatch {
+    uint32_t mesh;
+    uint32_t texture;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+// World bounds of one entry of the instance buffer and the index of the batch
+// drawing it, laid out as the occlusion cull shader reads them (std430).
+struct InstanceBounds {
+    glm::vec3 min;
+    uint32_t batch;
+    glm::vec3 max;
+    uint32_t padding;
+};
+
+inline glm::mat4 modelMatrix(const Transform& transform) {
+    glm::mat4 model = glm::mat4_cast(transform.rotation);
+    model[0] *= transform.scale.x;
+    model[1] *= transform.scale.y;
+    model[2] *= transform.scale.z;
+    model[3] = glm::vec4(transform.position, 1.0f);
+    return model;
+}
+
+// Systems run by the render thread once a frame, in this order, followed by
+// World::clearChanged().
+class SceneSystems {
+    public:
+    static constexpr size_t MIN_BATCH = 256;
+
+    static void applySpin(World& world, JobSystem& jobSystem, float angle) {
+        PROFILE_ZONE("applySpin");
+        world.parallelUpdate<Transform, Spin>(jobSystem, MIN_BATCH, [angle](Entity, Transform& transform, Spin& spin) {
+            transform.rotation = glm::angleAxis(angle, spin.axis);
+            return true;
+        });
+    }
+
+    // Only entities whose transform changed get new world bounds.
+    static void updateBounds(World& world) {
+        PROFILE_ZONE("updateBounds");
+        world.eachChanged<Transform, Bounds>([](Entity, Transform& transform, Bounds& bounds) {
+            // Arvo's method: each world axis takes the smaller and larger of every
+            // matrix term times the local extent along it.
+            glm::mat4 model = modelMatrix(transform);
+            glm::vec3 worldMin = glm::vec3(model[3]);
+            glm::vec3 worldMax = worldMin;
+            for (int column = 0; column < 3; column++) {
+                glm::vec3 a = glm::vec3(model[column]) * bounds.localMin[column];
+                glm::vec3 b = glm::vec3(model[column]) * bounds.localMax[column];
+                worldMin += glm::min(a, b);
+                worldMax += glm::max(a, b);
+            }
+            bounds.worldMin = worldMin;
+            bounds.worldMax = worldMax;
+        });
+    }
+
+    // Moves the entities whose bounds updateBounds() just recomputed in the
+    // broadphase, then commits the batch. Entities destroyed in the world must
+    // be removed from the grid by whoever destroys them.
+    static void updateSpatialGrid(World& world, SpatialHashGrid& grid) {
+        PROFILE_ZONE("updateSpatialGrid");
+        world.eachChanged<Transform, Bounds>([&grid](Entity entity, Transform&, Bounds& bounds) {
+            grid.insert(entity, bounds.worldMin, bounds.worldMax);
+        });
+        grid.commit();
+    }
+
+    // Frustum-culls every drawable entity and writes model matrices for the
+    // visible ones straight into the mapped instance buffer, grouped into one
+    // batch per mesh and texture. Entities past the buffer's capacity are not
+    // drawn. Transforms and bounds are gathered into SoA streams in draw order
+    // first, so culling and matrix composition run on the SIMD kernels. When
+    // given, instanceBounds receives the world bounds of each instance written.
+    void buildDrawList(World& world, JobSystem& jobSystem, const glm::mat4& viewProjection, glm::mat4 *instances, uint32_t capacity, std::vector<DrawBatch>& batches, InstanceBounds *instanceBounds = nullptr) {
+        PROFILE_ZONE("buildDrawList");
+
+        drawables.clear();
+        ComponentPool<Transform>& transforms = world.pool<Transform>();
+        ComponentPool<Bounds>& bounds = world.pool<Bounds>();
+        world.each<MeshId, TextureId, Transform, Bounds>([&](Entity entity, MeshId& mesh, TextureId& texture, Transform&, Bounds&) {
+            uint64_t key = (static_cast<uint64_t>(mesh.index) << 32) | texture.index;
+            drawables.push_back({key, transforms.slotOf(entity), bounds.slotOf(entity)});
+        });
+        std::sort(drawables.begin(), drawables.end(), [](const Drawable& a, const Drawable& b) {
+            return a.key < b.key || (a.key == b.key && a.transform < b.transform);
+        });
+
+        batches.clear();
+        size_t count = drawables.size();
+        if (count == 0) {
+            culledCount = 0;
+            instanceCount = 0;
+            return;
+        }
+
+        boundsStreams.resize(6 * count);
+        const Bounds *boundsData = bounds.data();
+        for (size_t i = 0; i < count; i++) {
+            const Bounds& box = boundsData[drawables[i].bounds];
+            glm::vec3 center = (box.worldMin + box.worldMax) * 0.5f;
+            glm::vec3 extent = (box.worldMax - box.worldMin) * 0.5f;
+            for (int axis = 0; axis < 3; axis++) {
+                boundsStreams[axis * count + i] = center[axis];
+                boundsStreams[(3 + axis) * count + i] = extent[axis];
+            }
+        }
+
+        visible.resize(count);
+        FrustumPlanes frustum = extractFrustumPlanes(&viewProjection[0][0]);
+        BoundsStreams boundsIn = {&boundsStreams[0], &boundsStreams[count], &boundsStreams[2 * count], &boundsStreams[3 * count], &boundsStreams[4 * count], &boundsStreams[5 * count]};
+        size_t visibleCount = cullBounds(boundsIn, count, frustum, visible.data());
+        culledCount = static_cast<uint32_t>(count - visibleCount);
+        visibleCount = std::min<size_t>(visibleCount, capacity);
+
+        transformStreams.resize(10 * visibleCount);
+        const Transform *transformData = transforms.data();
+        for (size_t i = 0; i < visibleCount; i++) {
+            const Transform& transform = transformData[drawables[visible[i]].transform];
+            const float values[10] = {
+                transform.position.x, transform.position.y, transform.position.z,
+                transform.rotation.x, transform.rotation.y, transform.rotation.z, transform.rotation.w,
+                transform.scale.x, transform.scale.y, transform.scale.z
+            };
+            for (int stream = 0; stream < 10; stream++) {
+                transformStreams[stream * visibleCount + i] = values[stream];
+            }
+        }
+
+        jobSystem.parallelFor(0, visibleCount, jobSystem.batchSizeFor(visibleCount, MIN_BATCH), [&](size_t first, size_t last) {
+            const float *stream = transformStreams.data() + first;
+            TransformStreams transformsIn = {};
+            const float **fields[10] = {
+                &transformsIn.positionX, &transformsIn.positionY, &transformsIn.positionZ,
+                &transformsIn.rotationX, &transformsIn.rotationY, &transformsIn.rotationZ, &transformsIn.rotationW,
+                &transformsIn.scaleX, &transformsIn.scaleY, &transformsIn.scaleZ
+            };
+            for (int field = 0; field < 10; field++) {
+                *fields[field] = stream + field * visibleCount;
+            }
+            composeTransforms(transformsIn, last - first, &instances[first][0][0]);
+        });
+
+        for (size_t i = 0; i < visibleCount; i++) {
+            uint64_t key = drawables[visible[i]].key;
+            uint32_t mesh = static_cast<uint32_t>(key >> 32);
+            uint32_t texture = static_cast<uint32_t>(key);
+            if (batches.empty() || batches.back().mesh != mesh || batches.back().texture != texture) {
+                batches.push_back({mesh, texture, static_cast<uint32_t>(i), 0});
+            }
+            batches.back().instanceCount++;
+
+            if (instanceBounds != nullptr) {
+                const Bounds& box = boundsData[drawables[visible[i]].bounds];
+                instanceBounds[i] = {box.worldMin, static_cast<uint32_t>(batches.size() - 1), box.worldMax, 0};
+            }
+        }
+        instanceCount = static_cast<uint32_t>(visibleCount);
+    }
+
+    // Drawable entities left out of the last draw list by frustum culling.
+    uint32_t getCulledCount() const {
+        return culledCount;
+    }
+
+    // Instances written by the last draw list.
+    uint32_t getInstanceCount() const {
+        return instanceCount;
+    }
+
+    private:
+    struct Drawable {
+        uint64_t key;
+        uint32_t transform;
+        uint32_t bounds;
+    };
+
+    // Reused from frame to frame.
+    std::vector<Drawable> drawables;
+    std::vector<float> boundsStreams;
+    std::vector<float> transformStreams;
+    std::vector<uint32_t> visible;
+    uint32_t culledCount = 0;
+    uint32_t instanceCount = 0;
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "file_watcher.hpp"
+#include "profiler.hpp"
+#include "vfs.hpp"
+
+struct ShaderSource {
+    std::string sourcePath;
+    std::string spirvPath;
+};
+
+// Watches shader sources and their compiled SPIR-V in the asset directory. A
+// changed source is recompiled with glslc in the background, and every changed
+// file is passed on to the listeners, on the same worker thread. Pipelines are
+// not rebuilt here: the listener invalidates the PipelineVariantCache entries
+// using the file, which recompiles them and swaps them in between frames.
+class ShaderHotReload {
+    public:
+    // Told on the worker thread about every changed file. It must only touch
+    // state that is immutable or synchronized while the hot reload is running.
+    using ChangeFunction = std::function<void(const Vfs& shaderFiles, const std::string& path)>;
+
+    ~ShaderHotReload() {
+        stop();
+    }
+
+    void addShader(const ShaderSource& shader) {
+        shaders.push_back(shader);
+    }
+
+    void addListener(ChangeFunction listener) {
+        listeners.push_back(std::move(listener));
+    }
+
+    // compiler is the glslc to run, found on the PATH by default.
+    void start(const std::string& assetDirectory, const std::string& compiler = "glslc") {
+        this->assetDirectory = assetDirectory;
+        this->compiler = compiler;
+        shaderFiles.mountDirectory(assetDirectory);
+
+        watcher = std::make_unique<FileWatcher>(assetDirectory);
+        std::set<std::string> directories;
+        for (const auto& shader : shaders) {
+            directories.insert(std::filesystem::path(shader.sourcePath).parent_path().generic_string());
+            directories.insert(std::filesystem::path(shader.spirvPath).parent_path().generic_string());
+        }
+        for (const auto& directory : directories) {
+            watcher->watchDirectory(directory);
+        }
+
+        running = true;
+        worker = std::thread([this]() {
+            run();
+        });
+    }
+
+    void stop() {
+        if (!worker.joinable()) {
+            return;
+        }
+
+        running = false;
+        worker.join();
+    }
+
+    private:
+    std::string assetDirectory;
+    std::string compiler;
+    Vfs shaderFiles;
+    std::vector<ShaderSource> shaders;
+    std::vector<ChangeFunction> listeners;
+    std::unique_ptr<FileWatcher> watcher;
+    std::atomic<bool> running{false};
+    std::thread worker;
+
+    void run() {
+        PROFILE_THREAD("shader hot reload");
+        const auto pollInterval = std::chrono::milliseconds(100);
+        const auto settleInterval = std::chrono::milliseconds(50);
+
+        while (running) {
+            std::vector<std::string> changed = watcher->wait(pollInterval);
+            if (changed.empty()) {
+                continue;
+            }
+
+            // Editors and compilers tend to touch a file several times per save.
+            for (auto& more : watcher->wait(settleInterval)) {
+                changed.push_back(std::move(more));
+            }
+            std::sort(changed.begin(), changed.end());
+            changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+            // Recompiled SPIR-V arrives back here as its own change event, which is
+            // what the listeners rebuild pipelines on.
+            for (const auto& path : changed) {
+                for (const auto& shader : shaders) {
+                    if (shader.sourcePath == path) {
+                        compile(shader);
+                    }
+                }
+            }
+
+            for (const auto& path : changed) {
+                for (const auto& listener : listeners) {
+                    listener(shaderFiles, path);
+                }
+            }
+        }
+    }
+
+    void compile(const ShaderSource& shader) {
+        PROFILE_ZONE("compile shader");
+        std::filesystem::path root = assetDirectory;
+        std::string command = "\"" + compiler + "\" \"" + (root / shader.sourcePath).string() + "\" -o \"" + (root / shader.spirvPath).string() + "\"";
+#ifdef _WIN32
+        // cmd.exe strips the outer pair of quotes off a command line starting with one.
+        command = "\"" + command + "\"";
+#endif
+
+        if (std::system(command.c_str()) != 0) {
+            std::cerr << "Shader hot reload: failed to compile " << shader.sourcePath << ", keeping the previous SPIR-V" << std::endl;
+        }
+    }
+};
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define DIG_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#define DIG_SIMD_SSE2
+#endif
+
+// Batch math kernels over structure-of-arrays streams: TRS composition, matrix
+// multiplication and AABB-vs-frustum tests. Each kernel is written once against
+// a small lane type and instantiated for the widest instruction set the build
+// targets (AVX2 with DIG_AVX2, SSE2 on any x86-64 build) plus a scalar version
+// that handles the remainder of every stream and other architectures.
+//
+// Matrices are 16 floats, column-major, matching GLM and the shaders.
+
+struct TransformStreams {
+    const float *positionX;
+    const float *positionY;
+    const float *positionZ;
+    const float *rotationX;
+    const float *rotationY;
+    const float *rotationZ;
+    const float *rotationW;
+    const float *scaleX;
+    const float *scaleY;
+    const float *scaleZ;
+};
+
+struct BoundsStreams {
+    const float *centerX;
+    const float *centerY;
+    const float *centerZ;
+    const float *extentX;
+    const float *extentY;
+    const float *extentZ;
+};
+
+// Planes as ax + by + cz + d >= 0 inside, normalized, one array per coefficient
+// so that tests can broadcast them.
+struct FrustumPlanes {
+    static constexpr int COUNT = 6;
+    float a[COUNT];
+    float b[COUNT];
+    float c[COUNT];
+    float d[COUNT];
+};
+
+struct ScalarLanes {
+    static constexpr size_t WIDTH = 1;
+    float value;
+
+    static ScalarLanes load(const float *p) { return {*p}; }
+    static ScalarLanes broadcast(float f) { return {f}; }
+    void store(float *p) const { *p = value; }
+    friend ScalarLanes operator+(ScalarLanes x, ScalarLanes y) { return {x.value + y.value}; }
+    friend ScalarLanes operator-(ScalarLanes x, ScalarLanes y) { return {x.value - y.value}; }
+    friend ScalarLanes operator*(ScalarLanes x, ScalarLanes y) { return {x.value * y.value}; }
+    // Multiply-add, fused where the instruction set has it.
+    static ScalarLanes multiplyAdd(ScalarLanes x, ScalarLanes y, ScalarLanes z) { return {x.value * y.value + z.value}; }
+    static ScalarLanes abs(ScalarLanes x) { return {std::fabs(x.value)}; }
+    // Bit per lane set where x < 0.
+    static uint32_t negativeMask(ScalarLanes x) { return x.value < 0.0f ? 1u : 0u; }
+    // Writes (x, y, z, w) of lane k to out + 16 * k, i.e. one column of each matrix.
+    static void storeColumns(ScalarLanes x, ScalarLanes y, ScalarLanes z, ScalarLanes w, float *out) {
+        out[0] = x.value;
+        out[1] = y.value;
+        out[2] = z.value;
+        out[3] = w.value;
+    }
+};
+
+#if defined(DIG_SIMD_AVX2)
+struct SimdLanes {
+    static constexpr size_t WIDTH = 8;
+    __m256 value;
+
+    static SimdLanes load(const float *p) { return {_mm256_loadu_ps(p)}; }
+    static SimdLanes broadcast(float f) { return {_mm256_set1_ps(f)}; }
+    void store(float *p) const { _mm256_storeu_ps(p, value); }
+    friend SimdLanes operator+(SimdLanes x, SimdLanes y) { return {_mm256_add_ps(x.value, y.value)}; }
+    friend SimdLanes operator-(SimdLanes x, SimdLanes y) { return {_mm256_sub_ps(x.value, y.value)}; }
+    friend SimdLanes operator*(SimdLanes x, SimdLanes y) { return {_mm256_mul_ps(x.value, y.value)}; }
+    static SimdLanes multiplyAdd(SimdLanes x, SimdLanes y, SimdLanes z) { return {_mm256_fmadd_ps(x.value, y.value, z.value)}; }
+    static SimdLanes abs(SimdLanes x) { return {_mm256_andnot_ps(_mm256_set1_ps(-0.0f), x.value)}; }
+    static uint32_t negativeMask(SimdLanes x) { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(x.value, _mm256_setzero_ps(), _CMP_LT_OQ))); }
+    static void storeColumns(SimdLanes x, SimdLanes y, SimdLanes z, SimdLanes w, float *out) {
+        for (int half = 0; half < 2; half++) {
+            __m128 a = half == 0 ? _mm256_castps256_ps128(x.value) : _mm256_extractf128_ps(x.value, 1);
+            __m128 b = half == 0 ? _mm256_castps256_ps128(y.value) : _mm256_extractf128_ps(y.value, 1);
+            __m128 c = half == 0 ? _mm256_castps256_ps128(z.value) : _mm256_extractf128_ps(z.value, 1);
+            __m128 d = half == 0 ? _mm256_castps256_ps128(w.value) : _mm256_extractf128_ps(w.value, 1);
+            _MM_TRANSPOSE4_PS(a, b, c, d);
+            float *o = out + half * 64;
+            _mm_storeu_ps(o, a);
+            _mm_storeu_ps(o + 16, b);
+            _mm_storeu_ps(o + 32, c);
+            _mm_storeu_ps(o + 48, d);
+        }
+    }
+};
+#elif defined(DIG_SIMD_SSE2)
+struct SimdLanes {
+    static constexpr size_t WIDTH = 4;
+    __m128 value;
+
+    static SimdLanes load(const float *p) { return {_mm_loadu_ps(p)}; }
+    static SimdLanes broadcast(float f) { return {_mm_set1_ps(f)}; }
+    void store(float *p) const { _mm_storeu_ps(p, value); }
+    friend SimdLanes operator+(SimdLanes x, SimdLanes y) { return {_mm_add_ps(x.value, y.value)}; }
+    friend SimdLanes operator-(SimdLanes x, SimdLanes y) { return {_mm_sub_ps(x.value, y.value)}; }
+    friend SimdLanes operator*(SimdLanes x, SimdLanes y) { return {_mm_mul_ps(x.value, y.value)}; }
+    static SimdLanes multiplyAdd(SimdLanes x, SimdLanes y, SimdLanes z) { return {_mm_add_ps(_mm_mul_ps(x.value, y.value), z.value)}; }
+    static SimdLanes abs(SimdLanes x) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), x.value)}; }
+    static uint32_t negativeMask(SimdLanes x) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(x.value, _mm_setzero_ps()))); }
+    static void storeColumns(SimdLanes x, SimdLanes y, SimdLanes z, SimdLanes w, float *out) {
+        __m128 a = x.value, b = y.value, c = z.value, d = w.value;
+        _MM_TRANSPOSE4_PS(a, b, c, d);
+        _mm_storeu_ps(out, a);
+        _mm_storeu_ps(out + 16, b);
+        _mm_storeu_ps(out + 32, c);
+        _mm_storeu_ps(out + 48, d);
+    }
+};
+#else
+using SimdLanes = ScalarLanes;
+#endif
+
+// Composes translation * rotation * scale for objects [first, last), which must
+// be a multiple of Lanes::WIDTH long.
+template <typename Lanes>
+inline void composeTransformRange(const TransformStreams& in, size_t first, size_t last, float *matrices) {
+    const Lanes one = Lanes::broadcast(1.0f);
+    const Lanes two = Lanes::broadcast(2.0f);
+
+    for (size_t i = first; i < last; i += Lanes::WIDTH) {
+        Lanes x = Lanes::load(in.rotationX + i), y = Lanes::load(in.rotationY + i);
+        Lanes z = Lanes::load(in.rotationZ + i), w = Lanes::load(in.rotationW + i);
+        Lanes sx = Lanes::load(in.scaleX + i), sy = Lanes::load(in.scaleY + i), sz = Lanes::load(in.scaleZ + i);
+
+        Lanes x2 = x * two, y2 = y * two, z2 = z * two;
+        Lanes xx = x * x2, yy = y * y2, zz = z * z2;
+        Lanes xy = x * y2, xz = x * z2, yz = y * z2;
+        Lanes wx = w * x2, wy = w * y2, wz = w * z2;
+
+        const Lanes zero = Lanes::broadcast(0.0f);
+        float *m = matrices + i * 16;
+        Lanes::storeColumns((one - (yy + zz)) * sx, (xy + wz) * sx, (xz - wy) * sx, zero, m);
+        Lanes::storeColumns((xy - wz) * sy, (one - (xx + zz)) * sy, (yz + wx) * sy, zero, m + 4);
+        Lanes::storeColumns((xz + wy) * sz, (yz - wx) * sz, (one - (xx + yy)) * sz, zero, m + 8);
+        Lanes::storeColumns(Lanes::load(in.positionX + i), Lanes::load(in.positionY + i), Lanes::load(in.positionZ + i), one, m + 12);
+    }
+}
+
+// Writes count model matrices, 16 floats apart. Rotations must be unit
+// quaternions.
+inline void composeTransforms(const TransformStreams& in, size_t count, float *matrices) {
+    size_t wide = count / SimdLanes::WIDTH * SimdLanes::WIDTH;
+    composeTransformRange<SimdLanes>(in, 0, wide, matrices);
+    composeTransformRange<ScalarLanes>(in, wide, count, matrices);
+}
+
+// out[i] = left * right[i] for count matrices. Each output column is a linear
+// combination of left's columns, which maps onto four-wide lanes directly.
+inline void multiplyMatrices(const float *left, const float *right, size_t count, float *out) {
+#if defined(DIG_SIMD_AVX2) || defined(DIG_SIMD_SSE2)
+    __m128 c0 = _mm_loadu_ps(left), c1 = _mm_loadu_ps(left + 4), c2 = _mm_loadu_ps(left + 8), c3 = _mm_loadu_ps(left + 12);
+    for (size_t i = 0; i < count; i++) {
+        const float *r = right + i * 16;
+        float *o = out + i * 16;
+        for (int column = 0; column < 4; column++) {
+            const float *rc = r + column * 4;
+            __m128 result = _mm_mul_ps(c0, _mm_set1_ps(rc[0]));
+            result = _mm_add_ps(result, _mm_mul_ps(c1, _mm_set1_ps(rc[1])));
+            result = _mm_add_ps(result, _mm_mul_ps(c2, _mm_set1_ps(rc[2])));
+            result = _mm_add_ps(result, _mm_mul_ps(c3, _mm_set1_ps(rc[3])));
+            _mm_storeu_ps(o + column * 4, result);
+        }
+    }
+#else
+    for (size_t i = 0; i < count; i++) {
+        const float *r = right + i * 16;
+        float *o = out + i * 16;
+        for (int column = 0; column < 4; column++) {
+            for (int row = 0; row < 4; row++) {
+                o[column * 4 + row] = left[row] * r[column * 4] + left[4 + row] * r[column * 4 + 1] + left[8 + row] * r[column * 4 + 2] + left[12 + row] * r[column * 4 + 3];
+            }
+        }
+    }
+#endif
+}
+
+// Gribb-Hartmann extraction from a column-major view-projection matrix with
+// Vulkan's [0, 1] depth range.
+inline FrustumPlanes extractFrustumPlanes(const float *m) {
+    auto row = [m](int r, int column) {
+        return m[column * 4 + r];
+    };
+
+    float planes[FrustumPlanes::COUNT][4];
+    for (int column = 0; column < 4; column++) {
+        planes[0][column] = row(3, column) + row(0, column);
+        planes[1][column] = row(3, column) - row(0, column);
+        planes[2][column] = row(3, column) + row(1, column);
+        planes[3][column] = row(3, column) - row(1, column);
+        planes[4][column] = row(2, column);
+        planes[5][column] = row(3, column) - row(2, column);
+    }
+
+    FrustumPlanes frustum;
+    for (int i = 0; i < FrustumPlanes::COUNT; i++) {
+        float length = std::sqrt(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+        float scale = length > 0.0f ? 1.0f / length : 0.0f;
+        frustum.a[i] = planes[i][0] * scale;
+        frustum.b[i] = planes[i][1] * scale;
+        frustum.c[i] = planes[i][2] * scale;
+        frustum.d[i] = planes[i][3] * scale;
+    }
+    return frustum;
+}
+
+// Tests boxes [first, last) against the frustum and appends the indices of those
+// at least partly inside. A box is outside when it lies entirely behind any one
+// plane, i.e. its center's distance plus its projected radius is negative.
+template <typename Lanes>
+inline size_t cullBoundsRange(const BoundsStreams& in, size_t first, size_t last, const FrustumPlanes& frustum, uint32_t *visible) {
+    size_t visibleCount = 0;
+    for (size_t i = first; i < last; i += Lanes::WIDTH) {
+        Lanes cx = Lanes::load(in.centerX + i), cy = Lanes::load(in.centerY + i), cz = Lanes::load(in.centerZ + i);
+        Lanes ex = Lanes::load(in.extentX + i), ey = Lanes::load(in.extentY + i), ez = Lanes::load(in.extentZ + i);
+
+        uint32_t outside = 0;
+        for (int plane = 0; plane < FrustumPlanes::COUNT; plane++) {
+            Lanes a = Lanes::broadcast(frustum.a[plane]), b = Lanes::broadcast(frustum.b[plane]), c = Lanes::broadcast(frustum.c[plane]);
+            Lanes distance = Lanes::multiplyAdd(a, cx, Lanes::multiplyAdd(b, cy, Lanes::multiplyAdd(c, cz, Lanes::broadcast(frustum.d[plane]))));
+            Lanes radius = Lanes::multiplyAdd(Lanes::abs(a), ex, Lanes::multiplyAdd(Lanes::abs(b), ey, Lanes::abs(c) * ez));
+            outside |= Lanes::negativeMask(distance + radius);
+        }
+
+        uint32_t inside = ~outside & ((1u << Lanes::WIDTH) - 1);
+        while (inside != 0) {
+            uint32_t lane = 0;
+            while (((inside >> lane) & 1) == 0) {
+                lane++;
+            }
+            visible[visibleCount++] = static_cast<uint32_t>(i + lane);
+            inside &= inside - 1;
+        }
+    }
+    return visibleCount;
+}
+
+// Writes the indices of visible boxes in ascending order and returns how many
+// there are. visible must have room for count indices.
+inline size_t cullBounds(const BoundsStreams& in, size_t count, const FrustumPlanes& frustum, uint32_t *visible) {
+    size_t wide = count / SimdLanes::WIDTH * SimdLanes::WIDTH;
+    size_t visibleCount = cullBoundsRange<SimdLanes>(in, 0, wide, frustum, visible);
+    return visibleCount + cullBoundsRange<ScalarLanes>(in, wide, count, frustum, visible + visibleCount);
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include "profiler.hpp"
+#include "triple_buffer.hpp"
+
+// Everything the renderer needs from the game world. Kept small and trivially
+// copyable, since a new one is published every tick.
+struct SimulationState {
+    uint64_t tick = 0;
+    double time = 0.0;
+    float modelAngle = 0.0f;
+};
+
+inline SimulationState interpolate(const SimulationState& previous, const SimulationState& current, float alpha) {
+    SimulationState state = current;
+    state.time = previous.time + (current.time - previous.time) * alpha;
+    state.modelAngle = previous.modelAngle + (current.modelAngle - previous.modelAngle) * alpha;
+    return state;
+}
+
+// The last two states, and the point in time at which the current one became due.
+struct SimulationSnapshot {
+    SimulationState previous;
+    SimulationState current;
+    std::chrono::steady_clock::time_point currentTime;
+};
+
+// Runs game logic on its own thread at a fixed timestep and publishes snapshots
+// through a triple buffer. The renderer draws one tick behind the simulation,
+// blending the last two states by how far it is into the current tick, so motion
+// stays smooth at any frame rate and neither thread waits on the other.
+class Simulation {
+    public:
+    // Advances the state by one tick. Called on the simulation thread, or by
+    // sampleTick when replaying.
+    using StepFunction = std::function<void(SimulationState& state, double deltaSeconds)>;
+
+    Simulation(double ticksPerSecond, StepFunction step)
+        : tickDuration(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / ticksPerSecond))), step(std::move(step)) {}
+
+    ~Simulation() {
+        stop();
+    }
+
+    void start() {
+        if (worker.joinable()) {
+            return;
+        }
+
+        running = true;
+        worker = std::thread([this]() {
+            run();
+        });
+    }
+
+    void stop() {
+        if (!worker.joinable()) {
+            return;
+        }
+
+        running = false;
+        worker.join();
+    }
+
+    // Called by the render thread. The result is valid until the next call. The
+    // blend between the last two ticks goes to blend when given.
+    SimulationState sample(std::chrono::steady_clock::time_point now, float *blend = nullptr) {
+        snapshots.update();
+        const SimulationSnapshot& snapshot = snapshots.front();
+
+        float alpha = std::chrono::duration<float>(now - snapshot.currentTime) / std::chrono::duration<float>(tickDuration);
+        alpha = std::clamp(alpha, 0.0f, 1.0f);
+        if (blend != nullptr) {
+            *blend = alpha;
+        }
+        return interpolate(snapshot.previous, snapshot.current, alpha);
+    }
+
+    // Replaces the thread when replaying a recording: steps on the calling thread
+    // up to tick and blends it with the tick before, reproducing what sample()
+    // returned. Ticks never go backwards, and the thread must not be running.
+    SimulationState sampleTick(uint64_t tick, float blend) {
+        double deltaSeconds = getTickSeconds();
+        while (replayCurrent.tick < tick) {
+            replayPrevious = replayCurrent;
+            step(replayCurrent, deltaSeconds);
+            replayCurrent.tick++;
+            replayCurrent.time += deltaSeconds;
+        }
+        return interpolate(replayPrevious, replayCurrent, blend);
+    }
+
+    double getTickSeconds() const {
+        return std::chrono::duration<double>(tickDuration).count();
+    }
+
+    private:
+    // Past this many ticks behind, the simulation drops time instead of trying to
+    // catch up, so a stall does not turn into a burst of ticks.
+    static constexpr int MAX_CATCH_UP_TICKS = 5;
+
+    std::chrono::steady_clock::duration tickDuration;
+    StepFunction step;
+    TripleBuffer<SimulationSnapshot> snapshots;
+    std::atomic<bool> running{false};
+    std::thread worker;
+    SimulationState replayPrevious;
+    SimulationState replayCurrent;
+
+    void run() {
+        PROFILE_THREAD("simulation");
+
+        double deltaSeconds = getTickSeconds();
+        SimulationState previous;
+        SimulationState current;
+        auto nextTick = std::chrono::steady_clock::now();
+
+        while (running) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - nextTick > tickDuration * MAX_CATCH_UP_TICKS) {
+                nextTick = now;
+            }
+
+            bool ticked = false;
+            while (nextTick <= now) {
+                PROFILE_ZONE("simulation tick");
+                previous = current;
+                step(current, deltaSeconds);
+                current.tick++;
+                current.time += deltaSeconds;
+                nextTick += tickDuration;
+                ticked = true;
+            }
+
+            if (ticked) {
+                SimulationSnapshot& snapshot = snapshots.back();
+                snapshot.previous = previous;
+                snapshot.current = current;
+                snapshot.currentTime = nextTick - tickDuration;
+                snapshots.publish();
+            }
+
+            std::this_thread::sleep_until(nextTick);
+        }
+    }
+};
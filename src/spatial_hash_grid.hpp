@@ -0,0 +1,307 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ecs.hpp"
+#include "grid_ray.hpp"
+
+struct SpatialRayHit {
+    Entity entity = NULL_ENTITY;
+    float distance = 0.0f;
+};
+
+// Broadphase for dynamic entities: a uniform grid of cubic cells, hashed into a
+// table of buckets so that only occupied space costs memory. Each entity's box
+// is recorded in every cell it overlaps.
+//
+// Updates are batched. insert(), update() and remove() only touch the entity's
+// own record; if any entity entered or left a cell, the table is rebuilt once
+// by the next commit(). Queries see the state as of the last commit(), except
+// that a box moving within the cells it already occupies takes effect at once,
+// and a removed entity is no longer reported. Removed records stay in place,
+// marked, until the commit drops them, so the table never points past them.
+// Queries are const and may run concurrently with each other.
+//
+// The table is stored flat: one array of (cell, entity) entries sorted by
+// bucket, and one of bucket start offsets. Entity records are kept in the order
+// of their first cell's bucket, so entities sharing a cell are also adjacent in
+// memory. Pick a cell size a little larger than a typical entity.
+class SpatialHashGrid {
+    public:
+    explicit SpatialHashGrid(float cellSize) : cellSize(cellSize), inverseCellSize(1.0f / cellSize) {}
+
+    void insert(Entity entity, const glm::vec3& min, const glm::vec3& max) {
+        if (contains(entity)) {
+            update(entity, min, max);
+            return;
+        }
+
+        if (entity.index >= sparse.size()) {
+            sparse.resize(entity.index + 1, ABSENT);
+        }
+        else if (sparse[entity.index] != ABSENT) {
+            // An earlier generation of the index that was never removed.
+            remove(proxies[sparse[entity.index]].entity);
+        }
+        sparse[entity.index] = static_cast<uint32_t>(proxies.size());
+        proxies.push_back({entity, min, max, cellOf(min), cellOf(max)});
+        dirty = true;
+    }
+
+    void update(Entity entity, const glm::vec3& min, const glm::vec3& max) {
+        Proxy& proxy = proxies[sparse[entity.index]];
+        proxy.min = min;
+        proxy.max = max;
+
+        glm::ivec3 cellMin = cellOf(min);
+        glm::ivec3 cellMax = cellOf(max);
+        if (cellMin != proxy.cellMin || cellMax != proxy.cellMax) {
+            proxy.cellMin = cellMin;
+            proxy.cellMax = cellMax;
+            dirty = true;
+        }
+    }
+
+    void remove(Entity entity) {
+        if (!contains(entity)) {
+            return;
+        }
+
+        proxies[sparse[entity.index]].removed = true;
+        sparse[entity.index] = ABSENT;
+        removedCount++;
+        dirty = true;
+    }
+
+    bool contains(Entity entity) const {
+        return entity.index < sparse.size() && sparse[entity.index] != ABSENT && proxies[sparse[entity.index]].entity == entity;
+    }
+
+    size_t size() const {
+        return proxies.size() - removedCount;
+    }
+
+    // Brings the table up to date with all changes since the last commit.
+    void commit() {
+        if (dirty) {
+            rebuild();
+            dirty = false;
+        }
+    }
+
+    // Calls function(entity) once for every entity whose box overlaps [min, max].
+    template <typename Function>
+    void queryBox(const glm::vec3& min, const glm::vec3& max, Function&& function) const {
+        if (size() == 0) {
+            return;
+        }
+
+        glm::ivec3 first = cellOf(min);
+        glm::ivec3 last = cellOf(max);
+        int64_t cellCount = (int64_t(last.x) - first.x + 1) * (int64_t(last.y) - first.y + 1) * (int64_t(last.z) - first.z + 1);
+        // Past this many cells, checking every entity is cheaper.
+        if (cellCount > static_cast<int64_t>(proxies.size())) {
+            for (const Proxy& proxy : proxies) {
+                if (!proxy.removed && overlaps(proxy, min, max)) {
+                    function(proxy.entity);
+                }
+            }
+            return;
+        }
+
+        for (int z = first.z; z <= last.z; z++) {
+            for (int y = first.y; y <= last.y; y++) {
+                for (int x = first.x; x <= last.x; x++) {
+                    glm::ivec3 cell(x, y, z);
+                    uint32_t bucket = bucketOf(cell);
+                    for (uint32_t i = bucketStarts[bucket]; i < bucketStarts[bucket + 1]; i++) {
+                        if (entries[i].cell != cell) {
+                            continue;
+                        }
+                        // An entity spanning several cells is reported only from
+                        // the first of them inside the query.
+                        const Proxy& proxy = proxies[entries[i].proxy];
+                        if (!proxy.removed && cell == glm::max(proxy.cellMin, first) && overlaps(proxy, min, max)) {
+                            function(proxy.entity);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Finds the nearest entity whose box a ray hits within maxDistance, walking
+    // the cells along the ray and stopping at the first cell that yields a hit
+    // closer than its far side.
+    SpatialRayHit raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const {
+        SpatialRayHit best;
+        best.distance = maxDistance;
+        float length = glm::length(direction);
+        if (size() == 0 || length == 0.0f) {
+            return best;
+        }
+        glm::vec3 unit = direction / length;
+        glm::vec3 inverseDirection = 1.0f / unit;
+
+        for (GridRay ray(origin, unit, cellSize); ray.t <= best.distance; ray.advance()) {
+            uint32_t bucket = bucketOf(ray.cell);
+            for (uint32_t i = bucketStarts[bucket]; i < bucketStarts[bucket + 1]; i++) {
+                if (entries[i].cell != ray.cell) {
+                    continue;
+                }
+                const Proxy& proxy = proxies[entries[i].proxy];
+                float distance;
+                if (!proxy.removed && intersectRay(proxy, origin, inverseDirection, best.distance, distance)) {
+                    best.entity = proxy.entity;
+                    best.distance = distance;
+                }
+            }
+            if (!(best.entity == NULL_ENTITY) && best.distance <= ray.exitDistance()) {
+                break;
+            }
+        }
+        return best;
+    }
+
+    private:
+    static constexpr uint32_t ABSENT = UINT32_MAX;
+    static constexpr uint32_t MIN_BUCKETS = 64;
+
+    struct Proxy {
+        Entity entity;
+        glm::vec3 min;
+        glm::vec3 max;
+        glm::ivec3 cellMin;
+        glm::ivec3 cellMax;
+        bool removed = false;
+    };
+
+    struct Entry {
+        glm::ivec3 cell;
+        uint32_t proxy;
+    };
+
+    float cellSize;
+    float inverseCellSize;
+    std::vector<uint32_t> sparse;
+    std::vector<Proxy> proxies;
+    std::vector<Entry> entries;
+    std::vector<uint32_t> bucketStarts = std::vector<uint32_t>(MIN_BUCKETS + 1, 0);
+    uint32_t bucketMask = MIN_BUCKETS - 1;
+    size_t removedCount = 0;
+    bool dirty = false;
+
+    // Reused between rebuilds.
+    std::vector<Proxy> sortedProxies;
+    std::vector<uint32_t> bucketCursors;
+
+    glm::ivec3 cellOf(const glm::vec3& position) const {
+        return glm::ivec3(glm::floor(position * inverseCellSize));
+    }
+
+    // Hashes 4x4x4 blocks of cells and numbers the cells within a block, so that
+    // neighbouring cells land in neighbouring buckets: a query touching a few
+    // adjacent cells, or a rebuild walking records in bucket order, stays within
+    // a few cache lines instead of jumping across the whole table.
+    uint32_t bucketOf(const glm::ivec3& cell) const {
+        uint32_t block = static_cast<uint32_t>(cell.x >> 2) * 73856093u ^ static_cast<uint32_t>(cell.y >> 2) * 19349663u ^ static_cast<uint32_t>(cell.z >> 2) * 83492791u;
+        uint32_t local = (cell.x & 3) | (cell.y & 3) << 2 | (cell.z & 3) << 4;
+        return (block << 6 | local) & bucketMask;
+    }
+
+    static bool overlaps(const Proxy& proxy, const glm::vec3& min, const glm::vec3& max) {
+        return proxy.min.x <= max.x && proxy.max.x >= min.x
+            && proxy.min.y <= max.y && proxy.max.y >= min.y
+            && proxy.min.z <= max.z && proxy.max.z >= min.z;
+    }
+
+    // Slab test; distance is where the ray enters the box, or 0 from inside it.
+    static bool intersectRay(const Proxy& proxy, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& distance) {
+        glm::vec3 t0 = (proxy.min - origin) * inverseDirection;
+        glm::vec3 t1 = (proxy.max - origin) * inverseDirection;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+        float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+        if (enter > exit || enter >= maxDistance) {
+            return false;
+        }
+        distance = enter;
+        return true;
+    }
+
+    void rebuild() {
+        size_t entryCount = 0;
+        for (const Proxy& proxy : proxies) {
+            if (proxy.removed) {
+                continue;
+            }
+            glm::ivec3 cells = proxy.cellMax - proxy.cellMin + 1;
+            entryCount += static_cast<size_t>(cells.x) * cells.y * cells.z;
+        }
+
+        // One to two buckets per entry keeps chains short.
+        uint32_t bucketCount = MIN_BUCKETS;
+        while (bucketCount < entryCount) {
+            bucketCount *= 2;
+        }
+        bucketMask = bucketCount - 1;
+
+        // Counting sort of the records by their first cell's bucket, dropping the
+        // removed ones.
+        bucketCursors.assign(bucketCount + 1, 0);
+        for (const Proxy& proxy : proxies) {
+            if (proxy.removed) {
+                continue;
+            }
+            bucketCursors[bucketOf(proxy.cellMin) + 1]++;
+        }
+        for (uint32_t bucket = 0; bucket < bucketCount; bucket++) {
+            bucketCursors[bucket + 1] += bucketCursors[bucket];
+        }
+        sortedProxies.resize(proxies.size() - removedCount);
+        for (const Proxy& proxy : proxies) {
+            if (proxy.removed) {
+                continue;
+            }
+            uint32_t slot = bucketCursors[bucketOf(proxy.cellMin)]++;
+            sortedProxies[slot] = proxy;
+            sparse[proxy.entity.index] = slot;
+        }
+        proxies.swap(sortedProxies);
+        removedCount = 0;
+
+        // Counting sort of the (cell, record) entries by bucket.
+        bucketStarts.assign(bucketCount + 1, 0);
+        forEachEntry([&](const glm::ivec3& cell, uint32_t) {
+            bucketStarts[bucketOf(cell) + 1]++;
+        });
+        for (uint32_t bucket = 0; bucket < bucketCount; bucket++) {
+            bucketStarts[bucket + 1] += bucketStarts[bucket];
+        }
+        bucketCursors.assign(bucketStarts.begin(), bucketStarts.end() - 1);
+        entries.resize(entryCount);
+        forEachEntry([&](const glm::ivec3& cell, uint32_t proxy) {
+            entries[bucketCursors[bucketOf(cell)]++] = {cell, proxy};
+        });
+    }
+
+    template <typename Function>
+    void forEachEntry(Function&& function) const {
+        for (uint32_t slot = 0; slot < proxies.size(); slot++) {
+            const Proxy& proxy = proxies[slot];
+            for (int z = proxy.cellMin.z; z <= proxy.cellMax.z; z++) {
+                for (int y = proxy.cellMin.y; y <= proxy.cellMax.y; y++) {
+                    for (int x = proxy.cellMin.x; x <= proxy.cellMax.x; x++) {
+                        function(glm::ivec3(x, y, z), slot);
+                    }
+                }
+            }
+        }
+    }
+};
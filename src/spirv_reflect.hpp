@@ -0,0 +1,424 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+
+#include <vulkan/vulkan.h>
+
+// Reflection over SPIR-V modules: the descriptor bindings, push constant block
+// size and vertex inputs a shader declares. Only the subset of SPIR-V that glslc
+// emits for graphics and compute shaders is understood.
+
+struct ReflectedBinding {
+    uint32_t set;
+    uint32_t binding;
+    VkDescriptorType type;
+    uint32_t count;
+    VkShaderStageFlags stages;
+    std::string name;
+};
+
+struct ReflectedVertexInput {
+    uint32_t location;
+    VkFormat format;
+    std::string name;
+};
+
+struct ShaderReflection {
+    VkShaderStageFlagBits stage;
+    std::vector<ReflectedBinding> bindings;
+    std::vector<ReflectedVertexInput> vertexInputs;
+    uint32_t pushConstantSize = 0;
+};
+
+class SpirvReflector {
+    public:
+    SpirvReflector(const uint32_t *words, size_t wordCount) : words(words), wordCount(wordCount) {
+        if (wordCount < 5 || words[0] != MAGIC) {
+            throw std::runtime_error("Invalid SPIR-V module");
+        }
+    }
+
+    ShaderReflection reflect() {
+        parse();
+
+        ShaderReflection reflection = {};
+        reflection.stage = stage;
+
+        for (const auto& [id, variable] : variables) {
+            const Decorations& variableDecorations = decorations[id];
+            const Type& pointer = types.at(variable.typeId);
+            uint32_t typeId = pointer.elementType;
+
+            switch (variable.storageClass) {
+                case STORAGE_CLASS_UNIFORM_CONSTANT:
+                case STORAGE_CLASS_UNIFORM:
+                case STORAGE_CLASS_STORAGE_BUFFER: {
+                    ReflectedBinding binding = {};
+                    binding.set = variableDecorations.set;
+                    binding.binding = variableDecorations.binding;
+                    binding.count = 1;
+                    binding.stages = stage;
+                    binding.name = names[id];
+
+                    if (types.at(typeId).op == OP_TYPE_ARRAY) {
+                        binding.count = types.at(typeId).length;
+                        typeId = types.at(typeId).elementType;
+                    }
+                    else if (types.at(typeId).op == OP_TYPE_RUNTIME_ARRAY) {
+                        throw std::runtime_error("Unbounded descriptor arrays are not supported: " + binding.name);
+                    }
+
+                    binding.type = descriptorType(variable.storageClass, typeId);
+                    reflection.bindings.push_back(binding);
+                    break;
+                }
+                case STORAGE_CLASS_PUSH_CONSTANT:
+                    reflection.pushConstantSize = std::max(reflection.pushConstantSize, typeSize(typeId));
+                    break;
+                case STORAGE_CLASS_INPUT:
+                    if (stage == VK_SHADER_STAGE_VERTEX_BIT && variableDecorations.hasLocation && !variableDecorations.builtIn) {
+                        reflection.vertexInputs.push_back({variableDecorations.location, vertexFormat(typeId), names[id]});
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        std::sort(reflection.bindings.begin(), reflection.bindings.end(), [](const ReflectedBinding& a, const ReflectedBinding& b) {
+            return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+        });
+        std::sort(reflection.vertexInputs.begin(), reflection.vertexInputs.end(), [](const ReflectedVertexInput& a, const ReflectedVertexInput& b) {
+            return a.location < b.location;
+        });
+
+        return reflection;
+    }
+
+    private:
+    static const uint32_t MAGIC = 0x07230203;
+
+    static const uint32_t OP_NAME = 5;
+    static const uint32_t OP_ENTRY_POINT = 15;
+    static const uint32_t OP_TYPE_BOOL = 20;
+    static const uint32_t OP_TYPE_INT = 21;
+    static const uint32_t OP_TYPE_FLOAT = 22;
+    static const uint32_t OP_TYPE_VECTOR = 23;
+    static const uint32_t OP_TYPE_MATRIX = 24;
+    static const uint32_t OP_TYPE_IMAGE = 25;
+    static const uint32_t OP_TYPE_SAMPLER = 26;
+    static const uint32_t OP_TYPE_SAMPLED_IMAGE = 27;
+    static const uint32_t OP_TYPE_ARRAY = 28;
+    static const uint32_t OP_TYPE_RUNTIME_ARRAY = 29;
+    static const uint32_t OP_TYPE_STRUCT = 30;
+    static const uint32_t OP_TYPE_POINTER = 32;
+    static const uint32_t OP_CONSTANT = 43;
+    static const uint32_t OP_SPEC_CONSTANT = 50;
+    static const uint32_t OP_VARIABLE = 59;
+    static const uint32_t OP_DECORATE = 71;
+    static const uint32_t OP_MEMBER_DECORATE = 72;
+
+    static const uint32_t DECORATION_BLOCK = 2;
+    static const uint32_t DECORATION_BUFFER_BLOCK = 3;
+    static const uint32_t DECORATION_ARRAY_STRIDE = 6;
+    static const uint32_t DECORATION_MATRIX_STRIDE = 7;
+    static const uint32_t DECORATION_BUILT_IN = 11;
+    static const uint32_t DECORATION_LOCATION = 30;
+    static const uint32_t DECORATION_BINDING = 33;
+    static const uint32_t DECORATION_DESCRIPTOR_SET = 34;
+    static const uint32_t DECORATION_OFFSET = 35;
+
+    static const uint32_t STORAGE_CLASS_UNIFORM_CONSTANT = 0;
+    static const uint32_t STORAGE_CLASS_INPUT = 1;
+    static const uint32_t STORAGE_CLASS_UNIFORM = 2;
+    static const uint32_t STORAGE_CLASS_PUSH_CONSTANT = 9;
+    static const uint32_t STORAGE_CLASS_STORAGE_BUFFER = 12;
+
+    static const uint32_t DIM_BUFFER = 5;
+    static const uint32_t DIM_SUBPASS_DATA = 6;
+
+    struct Type {
+        uint32_t op = 0;
+        uint32_t width = 0;
+        bool isSigned = false;
+        uint32_t elementType = 0;
+        uint32_t length = 0;
+        uint32_t storageClass = 0;
+        uint32_t dim = 0;
+        uint32_t sampled = 0;
+        std::vector<uint32_t> members;
+    };
+
+    struct Decorations {
+        uint32_t set = 0;
+        uint32_t binding = 0;
+        uint32_t location = 0;
+        uint32_t arrayStride = 0;
+        bool hasLocation = false;
+        bool builtIn = false;
+        bool block = false;
+        bool bufferBlock = false;
+        std::vector<uint32_t> memberOffsets;
+        std::vector<uint32_t> memberMatrixStrides;
+    };
+
+    struct Variable {
+        uint32_t typeId;
+        uint32_t storageClass;
+    };
+
+    const uint32_t *words;
+    size_t wordCount;
+    VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL_GRAPHICS;
+    std::unordered_map<uint32_t, Type> types;
+    std::unordered_map<uint32_t, Decorations> decorations;
+    std::unordered_map<uint32_t, std::string> names;
+    std::unordered_map<uint32_t, uint32_t> constants;
+    std::unordered_map<uint32_t, Variable> variables;
+
+    static std::string readString(const uint32_t *operands, size_t operandCount) {
+        const char *text = reinterpret_cast<const char*>(operands);
+        return std::string(text, strnlen(text, operandCount * sizeof(uint32_t)));
+    }
+
+    static void setMemberDecoration(std::vector<uint32_t>& values, uint32_t member, uint32_t value) {
+        if (values.size() <= member) {
+            values.resize(member + 1, 0);
+        }
+        values[member] = value;
+    }
+
+    void parse() {
+        size_t position = 5;
+        while (position < wordCount) {
+            uint32_t opcode = words[position] & 0xffff;
+            uint32_t count = words[position] >> 16;
+            if (count == 0 || position + count > wordCount) {
+                throw std::runtime_error("Malformed SPIR-V instruction stream");
+            }
+
+            const uint32_t *operands = words + position + 1;
+            size_t operandCount = count - 1;
+
+            switch (opcode) {
+                case OP_ENTRY_POINT:
+                    stage = executionModelStage(operands[0]);
+                    break;
+                case OP_NAME:
+                    names[operands[0]] = readString(operands + 1, operandCount - 1);
+                    break;
+                case OP_DECORATE: {
+                    Decorations& target = decorations[operands[0]];
+                    switch (operands[1]) {
+                        case DECORATION_DESCRIPTOR_SET: target.set = operands[2]; break;
+                        case DECORATION_BINDING: target.binding = operands[2]; break;
+                        case DECORATION_LOCATION: target.location = operands[2]; target.hasLocation = true; break;
+                        case DECORATION_ARRAY_STRIDE: target.arrayStride = operands[2]; break;
+                        case DECORATION_BUILT_IN: target.builtIn = true; break;
+                        case DECORATION_BLOCK: target.block = true; break;
+                        case DECORATION_BUFFER_BLOCK: target.bufferBlock = true; break;
+                        default: break;
+                    }
+                    break;
+                }
+                case OP_MEMBER_DECORATE: {
+                    Decorations& target = decorations[operands[0]];
+                    if (operands[2] == DECORATION_OFFSET) {
+                        setMemberDecoration(target.memberOffsets, operands[1], operands[3]);
+                    }
+                    else if (operands[2] == DECORATION_MATRIX_STRIDE) {
+                        setMemberDecoration(target.memberMatrixStrides, operands[1], operands[3]);
+                    }
+                    else if (operands[2] == DECORATION_BUILT_IN) {
+                        target.builtIn = true;
+                    }
+                    break;
+                }
+                case OP_TYPE_BOOL:
+                    types[operands[0]].op = opcode;
+                    break;
+                case OP_TYPE_INT:
+                case OP_TYPE_FLOAT: {
+                    Type& type = types[operands[0]];
+                    type.op = opcode;
+                    type.width = operands[1];
+                    type.isSigned = opcode == OP_TYPE_INT && operands[2] != 0;
+                    break;
+                }
+                case OP_TYPE_VECTOR:
+                case OP_TYPE_MATRIX: {
+                    Type& type = types[operands[0]];
+                    type.op = opcode;
+                    type.elementType = operands[1];
+                    type.length = operands[2];
+                    break;
+                }
+                case OP_TYPE_IMAGE: {
+                    Type& type = types[operands[0]];
+                    type.op = opcode;
+                    type.dim = operands[2];
+                    type.sampled = operands[6];
+                    break;
+                }
+                case OP_TYPE_SAMPLER:
+                    types[operands[0]].op = opcode;
+                    break;
+                case OP_TYPE_SAMPLED_IMAGE:
+                case OP_TYPE_RUNTIME_ARRAY: {
+                    Type& type = types[operands[0]];
+                    type.op = opcode;
+                    type.elementType = operands[1];
+                    break;
+                }
+                case OP_TYPE_ARRAY: {
+                    Type& type = types[operands[0]];
+                    type.op = opcode;
+                    type.elementType = operands[1];
+                    type.length = constants.at(operands[2]);
+                    break;
+                }
+                case OP_TYPE_STRUCT: {
+                    Type& type = types[operands[0]];
+                    type.op = opcode;
+                    type.members.assign(operands + 1, operands + operandCount);
+                    break;
+                }
+                case OP_TYPE_POINTER: {
+                    Type& type = types[operands[0]];
+                    type.op = opcode;
+                    type.storageClass = operands[1];
+                    type.elementType = operands[2];
+                    break;
+                }
+                case OP_CONSTANT:
+                case OP_SPEC_CONSTANT:
+                    constants[operands[1]] = operands[2];
+                    break;
+                case OP_VARIABLE:
+                    variables[operands[1]] = {operands[0], operands[2]};
+                    break;
+                default:
+                    break;
+            }
+
+            position += count;
+        }
+    }
+
+    static VkShaderStageFlagBits executionModelStage(uint32_t executionModel) {
+        switch (executionModel) {
+            case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+            case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+            case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+            case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+            case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+            case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+            default: throw std::runtime_error("Unsupported SPIR-V execution model");
+        }
+    }
+
+    VkDescriptorType descriptorType(uint32_t storageClass, uint32_t typeId) {
+        const Type& type = types.at(typeId);
+
+        if (storageClass == STORAGE_CLASS_STORAGE_BUFFER) {
+            return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        }
+
+        if (storageClass == STORAGE_CLASS_UNIFORM) {
+            return decorations[typeId].bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        }
+
+        switch (type.op) {
+            case OP_TYPE_SAMPLER:
+                return VK_DESCRIPTOR_TYPE_SAMPLER;
+            case OP_TYPE_SAMPLED_IMAGE:
+                return types.at(type.elementType).dim == DIM_BUFFER ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            case OP_TYPE_IMAGE:
+                if (type.dim == DIM_SUBPASS_DATA) {
+                    return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+                }
+                if (type.dim == DIM_BUFFER) {
+                    return type.sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+                }
+                return type.sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            default:
+                throw std::runtime_error("Unsupported SPIR-V descriptor type");
+        }
+    }
+
+    // Size of a type laid out with explicit offsets/strides, as in a push constant block.
+    uint32_t typeSize(uint32_t typeId, uint32_t matrixStride = 0) {
+        const Type& type = types.at(typeId);
+
+        switch (type.op) {
+            case OP_TYPE_BOOL:
+                return 4;
+            case OP_TYPE_INT:
+            case OP_TYPE_FLOAT:
+                return type.width / 8;
+            case OP_TYPE_VECTOR:
+                return typeSize(type.elementType) * type.length;
+            case OP_TYPE_MATRIX:
+                return (matrixStride != 0 ? matrixStride : typeSize(type.elementType)) * type.length;
+            case OP_TYPE_ARRAY: {
+                uint32_t stride = decorations[typeId].arrayStride;
+                return (stride != 0 ? stride : typeSize(type.elementType)) * type.length;
+            }
+            case OP_TYPE_STRUCT: {
+                const Decorations& structDecorations = decorations[typeId];
+                uint32_t size = 0;
+                for (size_t i = 0; i < type.members.size(); i++) {
+                    uint32_t offset = i < structDecorations.memberOffsets.size() ? structDecorations.memberOffsets[i] : size;
+                    uint32_t stride = i < structDecorations.memberMatrixStrides.size() ? structDecorations.memberMatrixStrides[i] : 0;
+                    size = std::max(size, offset + typeSize(type.members[i], stride));
+                }
+                return size;
+            }
+            default:
+                throw std::runtime_error("Unsupported SPIR-V type in block");
+        }
+    }
+
+    VkFormat vertexFormat(uint32_t typeId) {
+        const Type& type = types.at(typeId);
+        uint32_t components = 1;
+        const Type *scalar = &type;
+        if (type.op == OP_TYPE_VECTOR) {
+            components = type.length;
+            scalar = &types.at(type.elementType);
+        }
+
+        if (scalar->width != 32 || components < 1 || components > 4) {
+            throw std::runtime_error("Unsupported SPIR-V vertex input type");
+        }
+
+        static const VkFormat floatFormats[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+        static const VkFormat intFormats[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+        static const VkFormat uintFormats[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+
+        if (scalar->op == OP_TYPE_FLOAT) {
+            return floatFormats[components - 1];
+        }
+        if (scalar->op == OP_TYPE_INT) {
+            return scalar->isSigned ? intFormats[components - 1] : uintFormats[components - 1];
+        }
+        throw std::runtime_error("Unsupported SPIR-V vertex input type");
+    }
+};
+
+inline ShaderReflection reflectSpirv(const void *code, size_t size) {
+    if (size % sizeof(uint32_t) != 0) {
+        throw std::runtime_error("SPIR-V module size is not a multiple of four");
+    }
+
+    // Copy into aligned words; pack entries are aligned, but loose buffers need not be.
+    std::vector<uint32_t> words(size / sizeof(uint32_t));
+    memcpy(words.data(), code, size);
+    return SpirvReflector(words.data(), words.size()).reflect();
+}
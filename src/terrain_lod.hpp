@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "chunk_mesher.hpp"
+#include "job_system.hpp"
+#include "profiler.hpp"
+#include "voxel_light.hpp"
+#include "voxel_world.hpp"
+
+struct TerrainLodStatistics {
+    uint32_t chunks = 0;
+    uint32_t pending = 0;
+    uint32_t chunksPerLod[4] = {};
+    size_t triangles = 0;
+    size_t meshBytes = 0;
+};
+
+// Picks a level of detail for every chunk within the view distance and keeps a
+// mesh of each at that level, built on the job system.
+//
+// A chunk meshed at LOD n is off from the blocks by up to 2^n - 1 blocks. The
+// LOD chosen is the coarsest whose error, projected to the screen from the
+// nearest point of the chunk, stays within maxPixelError pixels. To keep chunks
+// near a threshold from switching back and forth as the camera moves, a chunk
+// only coarsens once the coarser level would be under the threshold by a margin
+// of HYSTERESIS; it refines as soon as its current level is over it.
+//
+// Meshes are rebuilt when the chunk's LOD changes or it, or one of the
+// neighbours its border looks at, is edited or relit. Until a new mesh arrives the old
+// one stays in place, so chunks never disappear while they are rebuilt.
+class TerrainLod {
+    public:
+    static constexpr uint32_t MAX_LOD = 3;
+    static constexpr float HYSTERESIS = 0.25f;
+    // Mesh jobs in flight at once; the nearest chunks are scheduled first.
+    static constexpr size_t MAX_PENDING_MESHES = 64;
+
+    TerrainLod(JobSystem& jobSystem, float viewDistance, float maxPixelError) : jobSystem(jobSystem), viewDistance(viewDistance), maxPixelError(maxPixelError) {}
+
+    ~TerrainLod() {
+        jobSystem.wait(jobs);
+    }
+
+    TerrainLod(const TerrainLod&) = delete;
+    TerrainLod& operator=(const TerrainLod&) = delete;
+
+    // With LOD disabled every chunk is meshed at full detail.
+    void setLodEnabled(bool enabled) {
+        lodEnabled = enabled;
+    }
+
+    bool isLodEnabled() const {
+        return lodEnabled;
+    }
+
+    // Called once a frame by the thread that edits the world, while the light is
+    // not being updated. projectionScale converts a size at unit distance to
+    // pixels: the viewport height divided by 2 tan(fovY / 2).
+    void update(const VoxelWorld& world, const VoxelLight& light, const glm::vec3& cameraPosition, float projectionScale) {
+        PROFILE_ZONE("TerrainLod::update");
+
+        adoptFinishedMeshes();
+
+        // Chunks past the view distance, with some slack so that chunks on the
+        // edge are not dropped and rebuilt over and over, or gone from the
+        // world, are forgotten. Their meshes are dropped when their jobs finish.
+        float evictDistance = viewDistance * (1.0f + HYSTERESIS);
+        for (auto it = entries.begin(); it != entries.end();) {
+            const Chunk *chunk = world.findChunk(it->first);
+            if (chunk == nullptr || chunk->getSolidCount() == 0 || distanceTo(it->first, cameraPosition) > evictDistance) {
+                it = entries.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        candidates.clear();
+        world.forEachChunk([&](const ChunkCoord& coord, const Chunk& chunk) {
+            if (chunk.getSolidCount() == 0) {
+                return;
+            }
+            float distance = distanceTo(coord, cameraPosition);
+            if (distance > viewDistance) {
+                return;
+            }
+
+            Entry& entry = entries[coord];
+            entry.target = lodEnabled ? selectLod(entry.hasMesh ? entry.lod : MAX_LOD, distance, projectionScale, maxPixelError) : 0;
+            if (entry.pending) {
+                return;
+            }
+            Revisions revisions = revisionsOf(world, light, coord);
+            if (!entry.hasMesh || entry.lod != entry.target || entry.revisions != revisions) {
+                candidates.push_back({coord, distance});
+            }
+        });
+
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            return a.distance < b.distance;
+        });
+        for (const Candidate& candidate : candidates) {
+            if (pendingCount >= MAX_PENDING_MESHES) {
+                break;
+            }
+            dispatch(world, light, candidate.coord);
+        }
+    }
+
+    // Visits every chunk that has a mesh, with the mesh drawn for it and a serial
+    // number that changes whenever the mesh does.
+    template <typename Function>
+    void forEachMesh(Function&& function) const {
+        for (const auto& [coord, entry] : entries) {
+            if (entry.hasMesh) {
+                function(coord, entry.mesh, entry.serial);
+            }
+        }
+    }
+
+    TerrainLodStatistics getStatistics() const {
+        TerrainLodStatistics statistics;
+        statistics.pending = static_cast<uint32_t>(pendingCount);
+        for (const auto& [coord, entry] : entries) {
+            if (!entry.hasMesh) {
+                continue;
+            }
+            statistics.chunks++;
+            statistics.chunksPerLod[entry.lod]++;
+            statistics.triangles += entry.mesh.getTriangleCount();
+            statistics.meshBytes += entry.mesh.getByteSize();
+        }
+        return statistics;
+    }
+
+    // The LOD to mesh a chunk at, given the LOD it is meshed at now.
+    static uint32_t selectLod(uint32_t current, float distance, float projectionScale, float maxPixelError) {
+        uint32_t lod = 0;
+        while (lod < MAX_LOD && projectedError(lod + 1, distance, projectionScale) <= maxPixelError) {
+            lod++;
+        }
+        if (lod > current) {
+            // Coarsening only past the threshold's margin.
+            lod = current;
+            while (lod < MAX_LOD && projectedError(lod + 1, distance, projectionScale) <= maxPixelError * (1.0f - HYSTERESIS)) {
+                lod++;
+            }
+        }
+        return lod;
+    }
+
+    private:
+    // Revisions of a chunk and of its face neighbours, in the order of
+    // ChunkSnapshot's faces, followed by those of their light; 0 for a missing
+    // chunk.
+    using Revisions = std::array<uint32_t, 14>;
+
+    struct Entry {
+        ChunkMesh mesh;
+        uint32_t lod = 0;
+        bool hasMesh = false;
+        uint32_t target = 0;
+        bool pending = false;
+        Revisions revisions = {};
+        uint64_t serial = 0;
+    };
+
+    struct Candidate {
+        ChunkCoord coord;
+        float distance;
+    };
+
+    struct FinishedMesh {
+        ChunkCoord coord;
+        uint32_t lod;
+        Revisions revisions;
+        ChunkMesh mesh;
+    };
+
+    JobSystem& jobSystem;
+    JobCounter jobs;
+    float viewDistance;
+    float maxPixelError;
+    bool lodEnabled = true;
+    std::unordered_map<ChunkCoord, Entry, ChunkCoordHash> entries;
+    size_t pendingCount = 0;
+    uint64_t lastSerial = 0;
+    std::mutex finishedMutex;
+    std::vector<FinishedMesh> finished;
+
+    // Reused from frame to frame.
+    std::vector<Candidate> candidates;
+    std::vector<FinishedMesh> adopted;
+
+    static float projectedError(uint32_t lod, float distance, float projectionScale) {
+        float error = static_cast<float>((1 << lod) - 1);
+        return error * projectionScale / std::max(distance, 1.0f);
+    }
+
+    // Distance from a point to the nearest point of a chunk.
+    static float distanceTo(const ChunkCoord& coord, const glm::vec3& position) {
+        glm::vec3 min = glm::vec3(VoxelWorld::chunkOrigin(coord));
+        glm::vec3 max = min + static_cast<float>(Chunk::SIZE);
+        glm::vec3 offset = glm::max(glm::max(min - position, position - max), glm::vec3(0.0f));
+        return glm::length(offset);
+    }
+
+    static Revisions revisionsOf(const VoxelWorld& world, const VoxelLight& light, const ChunkCoord& coord) {
+        static const ChunkCoord OFFSETS[7] = {
+            {0, 0, 0}, {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}
+        };
+        Revisions revisions;
+        for (int i = 0; i < 7; i++) {
+            ChunkCoord neighbour = {coord.x + OFFSETS[i].x, coord.y + OFFSETS[i].y, coord.z + OFFSETS[i].z};
+            const Chunk *chunk = world.findChunk(neighbour);
+            // Edits only ever count up from 0, so a chunk with no edits looks
+            // like a missing one; both read as air.
+            revisions[i] = chunk != nullptr ? chunk->getRevision() : 0;
+            revisions[7 + i] = light.getRevision(neighbour);
+        }
+        return revisions;
+    }
+
+    void dispatch(const VoxelWorld& world, const VoxelLight& light, const ChunkCoord& coord) {
+        Entry& entry = entries[coord];
+        entry.pending = true;
+        pendingCount++;
+
+        auto snapshot = std::make_shared<ChunkSnapshot>(world, light, coord, entry.target);
+        Revisions revisions = revisionsOf(world, light, coord);
+        jobSystem.run([this, snapshot, revisions]() {
+            PROFILE_ZONE("ChunkMesher::build");
+            ChunkMesh mesh = ChunkMesher::build(*snapshot);
+            std::lock_guard<std::mutex> lock(finishedMutex);
+            finished.push_back({snapshot->getCoord(), snapshot->getLod(), revisions, std::move(mesh)});
+        }, jobs);
+    }
+
+    void adoptFinishedMeshes() {
+        {
+            std::lock_guard<std::mutex> lock(finishedMutex);
+            adopted.swap(finished);
+        }
+        for (FinishedMesh& result : adopted) {
+            pendingCount--;
+            auto it = entries.find(result.coord);
+            if (it == entries.end()) {
+                continue;
+            }
+            Entry& entry = it->second;
+            entry.mesh = std::move(result.mesh);
+            entry.lod = result.lod;
+            entry.revisions = result.revisions;
+            entry.hasMesh = true;
+            entry.pending = false;
+            entry.serial = ++lastSerial;
+        }
+        adopted.clear();
+    }
+};
@@ -0,0 +1,503 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "chunk_mesher.hpp"
+#include "gpu_memory_tracker.hpp"
+#include "pipeline_layout_cache.hpp"
+#include "profiler.hpp"
+#include "range_allocator.hpp"
+#include "render_graph.hpp"
+#include "simd_math.hpp"
+#include "terrain_lod.hpp"
+#include "vertex_layout.hpp"
+#include "vfs.hpp"
+#include "voxel_world.hpp"
+
+struct TerrainRenderStatistics {
+    // Chunks with a mesh on the GPU, and those of them drawn this frame.
+    uint32_t chunks = 0;
+    uint32_t drawn = 0;
+    // Meshes left for a later frame for lack of staging or buffer space, and the
+    // bytes of those uploaded this frame.
+    uint32_t deferred = 0;
+    VkDeviceSize uploadedBytes = 0;
+    VkDeviceSize residentBytes = 0;
+};
+
+// Graph resources of the terrain for the frame being recorded.
+struct TerrainFrame {
+    RenderGraphBuffer vertices;
+    RenderGraphBuffer indices;
+};
+
+// Which of the scene's passes a terrain draw is recorded in.
+enum class TerrainPass {
+    DepthOnly,
+    Shaded,
+    // Shading on top of depth laid down by a DepthOnly draw.
+    ShadedDepthEqual
+};
+
+// Draws the chunk meshes TerrainLod keeps. Every mesh lives in a range of one
+// device-local vertex buffer and one index buffer shared by all chunks, so the
+// terrain draws with a single set of bindings and one indexed draw per chunk
+// inside the view frustum.
+//
+// New and rebuilt meshes are written to a host-visible staging buffer and copied
+// by an upload pass at the start of the frame. A chunk goes on drawing its old
+// mesh until the new one is resident, and meshes over the frame's staging budget
+// wait for the next frame. The range a replaced or evicted mesh held is reused
+// straight away: update() runs once the previous frame, the last to draw from
+// it, has completed, and the copies into it precede this frame's draws.
+class TerrainRenderer {
+    public:
+    void init(VkDevice device, VkPhysicalDevice physicalDevice, GpuMemoryTracker& memoryTracker, PipelineLayoutCache& layoutCache, VkPipelineCache pipelineCache, const Vfs& vfs, VkFormat colorFormat, VkFormat depthFormat, VkDeviceSize vertexBytes, VkDeviceSize indexBytes, VkDeviceSize stagingBytes) {
+        this->device = device;
+        this->memoryTracker = &memoryTracker;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        vertexRanges.reset(vertexBytes / sizeof(ChunkVertex));
+        indexRanges.reset(indexBytes / sizeof(uint32_t));
+        stagingCapacity = stagingBytes;
+        vertexBuffer = createBuffer(vertexRanges.getCapacity() * sizeof(ChunkVertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Buffer);
+        indexBuffer = createBuffer(indexRanges.getCapacity() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Buffer);
+        stagingBuffer = createBuffer(stagingCapacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging);
+        vkMapMemory(device, stagingBuffer.memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&staging));
+
+        Asset vertexShader = vfs.read("shaders/build/terrain_vert.spv");
+        Asset fragmentShader = vfs.read("shaders/build/terrain_frag.spv");
+        drawProgram = &layoutCache.getProgramLayout({&vertexShader, &fragmentShader});
+        depthPipeline = createDrawPipeline(vertexShader, fragmentShader, pipelineCache, TerrainPass::DepthOnly, colorFormat, depthFormat);
+        shadedPipeline = createDrawPipeline(vertexShader, fragmentShader, pipelineCache, TerrainPass::Shaded, colorFormat, depthFormat);
+        shadedDepthEqualPipeline = createDrawPipeline(vertexShader, fragmentShader, pipelineCache, TerrainPass::ShadedDepthEqual, colorFormat, depthFormat);
+    }
+
+    void destroy() {
+        vkDestroyPipeline(device, depthPipeline, nullptr);
+        vkDestroyPipeline(device, shadedPipeline, nullptr);
+        vkDestroyPipeline(device, shadedDepthEqualPipeline, nullptr);
+        destroyBuffer(vertexBuffer);
+        destroyBuffer(indexBuffer);
+        destroyBuffer(stagingBuffer);
+    }
+
+    // Stages the meshes that changed since the last frame, drops those of chunks
+    // TerrainLod no longer has, and culls the chunks against the view frustum.
+    // Called once a frame after TerrainLod::update(), once the previous frame's
+    // submission has completed.
+    void update(const TerrainLod& lod, const glm::mat4& viewProjection) {
+        PROFILE_ZONE("TerrainRenderer::update");
+
+        vertexCopies.clear();
+        indexCopies.clear();
+        stagingUsed = 0;
+        statistics.deferred = 0;
+        statistics.uploadedBytes = 0;
+
+        for (auto& [coord, chunk] : chunks) {
+            (void)coord;
+            chunk.seen = false;
+        }
+        lod.forEachMesh([&](const ChunkCoord& coord, const ChunkMesh& mesh, uint64_t serial) {
+            auto resident = chunks.find(coord);
+            if (resident != chunks.end()) {
+                resident->second.seen = true;
+                if (resident->second.serial == serial) {
+                    return;
+                }
+            }
+
+            GpuChunk uploaded;
+            if (!stage(mesh, uploaded)) {
+                statistics.deferred++;
+                return;
+            }
+            uploaded.serial = serial;
+            uploaded.origin = glm::vec3(VoxelWorld::chunkOrigin(coord));
+            uploaded.seen = true;
+            if (resident != chunks.end()) {
+                release(resident->second);
+                resident->second = uploaded;
+            }
+            else {
+                chunks.emplace(coord, uploaded);
+            }
+        });
+        for (auto chunk = chunks.begin(); chunk != chunks.end();) {
+            if (!chunk->second.seen) {
+                release(chunk->second);
+                chunk = chunks.erase(chunk);
+            }
+            else {
+                ++chunk;
+            }
+        }
+
+        cull(viewProjection);
+    }
+
+    // Adds the pass copying the meshes staged by update() into place, if any.
+    TerrainFrame addUploadPass(RenderGraph& graph) {
+        // Both buffers were last read by the previous frame's draws.
+        BufferState drawnState = {VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT | VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT};
+        TerrainFrame frame = {};
+        frame.vertices = graph.importBuffer("terrain vertices", vertexBuffer.buffer, vertexRanges.getCapacity() * sizeof(ChunkVertex), drawnState);
+        frame.indices = graph.importBuffer("terrain indices", indexBuffer.buffer, indexRanges.getCapacity() * sizeof(uint32_t), drawnState);
+        if (vertexCopies.empty()) {
+            return frame;
+        }
+
+        RenderGraphBuffer stagingInput = graph.importBuffer("terrain staging", stagingBuffer.buffer, stagingCapacity, {VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_WRITE_BIT});
+        graph.addPass("terrain upload", [&](RenderPassBuilder& pass) {
+            pass.useBuffer(stagingInput, BufferUsage::TransferSrc);
+            pass.useBuffer(frame.vertices, BufferUsage::TransferDst);
+            pass.useBuffer(frame.indices, BufferUsage::TransferDst);
+            // The meshes stay for later frames, whether or not this one draws them.
+            pass.sideEffect();
+        }, [this](VkCommandBuffer cmd, const RenderGraph&) {
+            vkCmdCopyBuffer(cmd, stagingBuffer.buffer, vertexBuffer.buffer, static_cast<uint32_t>(vertexCopies.size()), vertexCopies.data());
+            vkCmdCopyBuffer(cmd, stagingBuffer.buffer, indexBuffer.buffer, static_cast<uint32_t>(indexCopies.size()), indexCopies.data());
+        });
+        return frame;
+    }
+
+    // Declares what a pass recording terrain draws reads.
+    static void useDraws(RenderPassBuilder& pass, const TerrainFrame& frame) {
+        pass.useBuffer(frame.vertices, BufferUsage::VertexInput);
+        pass.useBuffer(frame.indices, BufferUsage::IndexInput);
+    }
+
+    // Draws the chunks update() found in the frustum. Viewport and scissor are
+    // left to the caller.
+    void recordDraw(VkCommandBuffer cmd, TerrainPass pass, const glm::mat4& viewProjection) const {
+        if (visible.empty()) {
+            return;
+        }
+
+        VkPipeline pipeline = pass == TerrainPass::DepthOnly ? depthPipeline : pass == TerrainPass::Shaded ? shadedPipeline : shadedDepthEqualPipeline;
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer.buffer, &offset);
+        vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+        VkShaderStageFlags stages = drawProgram->pushConstantRanges[0].stageFlags;
+        vkCmdPushConstants(cmd, drawProgram->pipelineLayout, stages, offsetof(DrawConstants, viewProjection), sizeof(glm::mat4), &viewProjection);
+        for (uint32_t index : visible) {
+            const GpuChunk& chunk = *drawOrder[index];
+            glm::vec4 origin(chunk.origin, 0.0f);
+            vkCmdPushConstants(cmd, drawProgram->pipelineLayout, stages, offsetof(DrawConstants, chunkOrigin), sizeof(glm::vec4), &origin);
+            vkCmdDrawIndexed(cmd, chunk.indexCount, 1, static_cast<uint32_t>(chunk.firstIndex), static_cast<int32_t>(chunk.firstVertex), 0);
+        }
+    }
+
+    TerrainRenderStatistics getStatistics() const {
+        TerrainRenderStatistics result = statistics;
+        result.chunks = static_cast<uint32_t>(chunks.size());
+        result.drawn = static_cast<uint32_t>(visible.size());
+        result.residentBytes = vertexRanges.getUsed() * sizeof(ChunkVertex) + indexRanges.getUsed() * sizeof(uint32_t);
+        return result;
+    }
+
+    private:
+    // Shader-side push constants.
+    struct DrawConstants {
+        glm::mat4 viewProjection;
+        glm::vec4 chunkOrigin;
+    };
+
+    struct GpuChunk {
+        uint64_t serial = 0;
+        glm::vec3 origin = glm::vec3(0.0f);
+        // In vertices and indices. Empty meshes hold no ranges.
+        uint64_t firstVertex = 0;
+        uint32_t vertexCount = 0;
+        uint64_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        bool seen = false;
+    };
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    GpuMemoryTracker *memoryTracker = nullptr;
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+
+    Buffer vertexBuffer;
+    Buffer indexBuffer;
+    Buffer stagingBuffer;
+    uint8_t *staging = nullptr;
+    VkDeviceSize stagingCapacity = 0;
+    VkDeviceSize stagingUsed = 0;
+    RangeAllocator vertexRanges;
+    RangeAllocator indexRanges;
+    std::vector<VkBufferCopy> vertexCopies;
+    std::vector<VkBufferCopy> indexCopies;
+    bool warnedFull = false;
+
+    std::unordered_map<ChunkCoord, GpuChunk, ChunkCoordHash> chunks;
+    TerrainRenderStatistics statistics;
+
+    // Reused from frame to frame: the chunks in a fixed order, their bounds as
+    // the culling kernel's streams and the indices of the visible ones.
+    std::vector<const GpuChunk *> drawOrder;
+    std::vector<float> boundsStreams;
+    std::vector<uint32_t> visible;
+
+    const ProgramLayout *drawProgram = nullptr;
+    VkPipeline depthPipeline = VK_NULL_HANDLE;
+    VkPipeline shadedPipeline = VK_NULL_HANDLE;
+    VkPipeline shadedDepthEqualPipeline = VK_NULL_HANDLE;
+
+    // Copies a mesh into the staging buffer and allocates its ranges. Fails,
+    // leaving nothing allocated, when either runs out of space.
+    bool stage(const ChunkMesh& mesh, GpuChunk& chunk) {
+        if (mesh.indices.empty()) {
+            return true;
+        }
+
+        VkDeviceSize vertexBytes = mesh.vertices.size() * sizeof(ChunkVertex);
+        VkDeviceSize indexBytes = mesh.indices.size() * sizeof(uint32_t);
+        if (stagingUsed + vertexBytes + indexBytes > stagingCapacity) {
+            return false;
+        }
+
+        chunk.firstVertex = vertexRanges.allocate(mesh.vertices.size());
+        chunk.firstIndex = indexRanges.allocate(mesh.indices.size());
+        if (chunk.firstVertex == RangeAllocator::INVALID || chunk.firstIndex == RangeAllocator::INVALID) {
+            if (chunk.firstVertex != RangeAllocator::INVALID) {
+                vertexRanges.free(chunk.firstVertex, mesh.vertices.size());
+            }
+            if (chunk.firstIndex != RangeAllocator::INVALID) {
+                indexRanges.free(chunk.firstIndex, mesh.indices.size());
+            }
+            if (!warnedFull) {
+                std::cerr << "Terrain buffers are full; some chunks keep their old meshes" << std::endl;
+                warnedFull = true;
+            }
+            return false;
+        }
+        chunk.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+        chunk.indexCount = static_cast<uint32_t>(mesh.indices.size());
+
+        std::memcpy(staging + stagingUsed, mesh.vertices.data(), vertexBytes);
+        vertexCopies.push_back({stagingUsed, chunk.firstVertex * sizeof(ChunkVertex), vertexBytes});
+        stagingUsed += vertexBytes;
+        std::memcpy(staging + stagingUsed, mesh.indices.data(), indexBytes);
+        indexCopies.push_back({stagingUsed, chunk.firstIndex * sizeof(uint32_t), indexBytes});
+        stagingUsed += indexBytes;
+
+        statistics.uploadedBytes += vertexBytes + indexBytes;
+        return true;
+    }
+
+    void release(const GpuChunk& chunk) {
+        if (chunk.indexCount > 0) {
+            vertexRanges.free(chunk.firstVertex, chunk.vertexCount);
+            indexRanges.free(chunk.firstIndex, chunk.indexCount);
+        }
+    }
+
+    void cull(const glm::mat4& viewProjection) {
+        drawOrder.clear();
+        for (const auto& [coord, chunk] : chunks) {
+            (void)coord;
+            if (chunk.indexCount > 0) {
+                drawOrder.push_back(&chunk);
+            }
+        }
+
+        size_t count = drawOrder.size();
+        visible.resize(count);
+        if (count == 0) {
+            return;
+        }
+
+        const float halfSize = Chunk::SIZE * 0.5f;
+        boundsStreams.resize(6 * count);
+        for (size_t i = 0; i < count; i++) {
+            for (int axis = 0; axis < 3; axis++) {
+                boundsStreams[axis * count + i] = drawOrder[i]->origin[axis] + halfSize;
+                boundsStreams[(3 + axis) * count + i] = halfSize;
+            }
+        }
+
+        FrustumPlanes frustum = extractFrustumPlanes(&viewProjection[0][0]);
+        BoundsStreams boundsIn = {&boundsStreams[0], &boundsStreams[count], &boundsStreams[2 * count], &boundsStreams[3 * count], &boundsStreams[4 * count], &boundsStreams[5 * count]};
+        visible.resize(cullBounds(boundsIn, count, frustum, visible.data()));
+    }
+
+    VkPipeline createDrawPipeline(const Asset& vertexCode, const Asset& fragmentCode, VkPipelineCache pipelineCache, TerrainPass pass, VkFormat colorFormat, VkFormat depthFormat) {
+        bool depthOnly = pass == TerrainPass::DepthOnly;
+        VkShaderModule vertexModule = createShaderModule(vertexCode);
+        VkShaderModule fragmentModule = createShaderModule(fragmentCode);
+
+        std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {};
+        shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        shaderStages[0].module = vertexModule;
+        shaderStages[0].pName = "main";
+        shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        shaderStages[1].module = fragmentModule;
+        shaderStages[1].pName = "main";
+
+        std::array<VkDynamicState, 2> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+        VkPipelineDynamicStateCreateInfo dynamicStateInfo = {};
+        dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicStateInfo.pDynamicStates = dynamicStates.data();
+
+        static const VertexLayout chunkLayout = {sizeof(ChunkVertex), {
+            VERTEX_ATTRIBUTE(ChunkVertex, position, 0, VK_FORMAT_R32G32B32_SFLOAT),
+            // normal, block, light and padding as one uvec4.
+            VERTEX_ATTRIBUTE(ChunkVertex, normal, 1, VK_FORMAT_R8G8B8A8_UINT)
+        }};
+        VkVertexInputBindingDescription bindingDescription = chunkLayout.getBindingDescription();
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions = chunkLayout.getAttributeDescriptions();
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
+        inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+        VkPipelineViewportStateCreateInfo viewportInfo = {};
+        viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportInfo.viewportCount = 1;
+        viewportInfo.scissorCount = 1;
+
+        // Skirts face into solid cells, so both sides of every face are drawn.
+        VkPipelineRasterizationStateCreateInfo rasterizerInfo = {};
+        rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizerInfo.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizerInfo.lineWidth = 1.0f;
+        rasterizerInfo.cullMode = VK_CULL_MODE_NONE;
+        rasterizerInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+        VkPipelineMultisampleStateCreateInfo multisamplingInfo = {};
+        multisamplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisamplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencilInfo = {};
+        depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencilInfo.depthTestEnable = VK_TRUE;
+        depthStencilInfo.depthWriteEnable = pass == TerrainPass::ShadedDepthEqual ? VK_FALSE : VK_TRUE;
+        depthStencilInfo.depthCompareOp = pass == TerrainPass::ShadedDepthEqual ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        colorBlendAttachment.blendEnable = VK_FALSE;
+
+        VkPipelineColorBlendStateCreateInfo colorBlendInfo = {};
+        colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlendInfo.attachmentCount = depthOnly ? 0 : 1;
+        colorBlendInfo.pAttachments = &colorBlendAttachment;
+
+        VkPipelineRenderingCreateInfo renderingInfo = {};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        renderingInfo.colorAttachmentCount = depthOnly ? 0 : 1;
+        renderingInfo.pColorAttachmentFormats = &colorFormat;
+        renderingInfo.depthAttachmentFormat = depthFormat;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &renderingInfo;
+        pipelineInfo.stageCount = depthOnly ? 1 : 2;
+        pipelineInfo.pStages = shaderStages.data();
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+        pipelineInfo.pViewportState = &viewportInfo;
+        pipelineInfo.pRasterizationState = &rasterizerInfo;
+        pipelineInfo.pMultisampleState = &multisamplingInfo;
+        pipelineInfo.pDepthStencilState = &depthStencilInfo;
+        pipelineInfo.pColorBlendState = &colorBlendInfo;
+        pipelineInfo.pDynamicState = &dynamicStateInfo;
+        pipelineInfo.layout = drawProgram->pipelineLayout;
+
+        VkPipeline pipeline;
+        VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+        vkDestroyShaderModule(device, vertexModule, nullptr);
+        vkDestroyShaderModule(device, fragmentModule, nullptr);
+
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create terrain pipeline");
+        }
+        return pipeline;
+    }
+
+    VkShaderModule createShaderModule(const Asset& code) {
+        VkShaderModuleCreateInfo moduleInfo = {};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = code.size();
+        moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(device, &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create shader module");
+        }
+        return shaderModule;
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryCategory category) {
+        Buffer buffer;
+
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create buffer");
+        }
+        memoryTracker->trackObject(buffer.buffer, VK_OBJECT_TYPE_BUFFER, category);
+
+        VkMemoryRequirements memoryRequirements;
+        vkGetBufferMemoryRequirements(device, buffer.buffer, &memoryRequirements);
+
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memoryRequirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, properties);
+
+        if (memoryTracker->allocate(allocInfo, category, &buffer.memory) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate buffer memory");
+        }
+        vkBindBufferMemory(device, buffer.buffer, buffer.memory, 0);
+        return buffer;
+    }
+
+    void destroyBuffer(const Buffer& buffer) {
+        memoryTracker->untrackObject(buffer.buffer);
+        vkDestroyBuffer(device, buffer.buffer, nullptr);
+        memoryTracker->free(buffer.memory);
+    }
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+        throw std::runtime_error("Failed to find suitable memory type");
+    }
+};
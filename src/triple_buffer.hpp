@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-writer single-reader triple buffer. The writer fills the back
+// slot and publishes it by swapping it with the middle slot; the reader swaps the
+// middle slot into the front when something new was published. Neither side ever
+// waits, and the reader always sees the most recent complete value.
+template <typename T>
+class TripleBuffer {
+    public:
+    // Writer side.
+    T& back() {
+        return slots[backIndex].value;
+    }
+
+    void publish() {
+        backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Reader side. Returns whether the front slot changed.
+    bool update() {
+        if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+            return false;
+        }
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    const T& front() const {
+        return slots[frontIndex].value;
+    }
+
+    private:
+    static constexpr uint8_t INDEX_MASK = 3;
+    static constexpr uint8_t FRESH = 4;
+
+    // Slots sit on their own cache lines so the two threads do not share one.
+    struct alignas(64) Slot {
+        T value = {};
+    };
+
+    std::array<Slot, 3> slots;
+    alignas(64) std::atomic<uint8_t> middle{1};
+    alignas(64) uint8_t backIndex = 0;
+    alignas(64) uint8_t frontIndex = 2;
+};
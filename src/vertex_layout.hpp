@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "mesh_format.hpp"
+
+struct VertexAttribute {
+    uint32_t location;
+    VkFormat format;
+    uint32_t offset;
+};
+
+// Declarative description of an interleaved vertex stream. The Vulkan binding and
+// attribute descriptions are generated from it rather than written out by hand.
+struct VertexLayout {
+    uint32_t stride;
+    std::vector<VertexAttribute> attributes;
+
+    VkVertexInputBindingDescription getBindingDescription(uint32_t binding = 0) const {
+        VkVertexInputBindingDescription bindingDescription = {};
+        bindingDescription.binding = binding;
+        bindingDescription.stride = stride;
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescription;
+    }
+
+    std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(uint32_t binding = 0) const {
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions(attributes.size());
+
+        for (size_t i = 0; i < attributes.size(); i++) {
+            attributeDescriptions[i].binding = binding;
+            attributeDescriptions[i].location = attributes[i].location;
+            attributeDescriptions[i].format = attributes[i].format;
+            attributeDescriptions[i].offset = attributes[i].offset;
+        }
+
+        return attributeDescriptions;
+    }
+};
+
+#define VERTEX_ATTRIBUTE(vertexType, member, location, format) \
+    VertexAttribute{location, format, static_cast<uint32_t>(offsetof(vertexType, member))}
+
+// Every format used here is in the set the spec requires for vertex buffers.
+inline const VertexLayout& getVertexLayout(MeshVertexLayout vertexLayout) {
+    static const VertexLayout standardLayout = {sizeof(MeshStandardVertex), {
+        VERTEX_ATTRIBUTE(MeshStandardVertex, pos, 0, VK_FORMAT_R32G32B32_SFLOAT),
+        VERTEX_ATTRIBUTE(MeshStandardVertex, color, 1, VK_FORMAT_R32G32B32_SFLOAT),
+        VERTEX_ATTRIBUTE(MeshStandardVertex, texCoord, 2, VK_FORMAT_R32G32_SFLOAT)
+    }};
+
+    static const VertexLayout packedLayout = {sizeof(MeshPackedVertex), {
+        VERTEX_ATTRIBUTE(MeshPackedVertex, pos, 0, VK_FORMAT_R16G16B16A16_UNORM),
+        VERTEX_ATTRIBUTE(MeshPackedVertex, color, 1, VK_FORMAT_R8G8B8A8_UNORM),
+        VERTEX_ATTRIBUTE(MeshPackedVertex, texCoord, 2, VK_FORMAT_R16G16_UNORM),
+        VERTEX_ATTRIBUTE(MeshPackedVertex, normal, 3, VK_FORMAT_A2B10G10R10_UNORM_PACK32)
+    }};
+
+    return vertexLayout == MeshVertexLayout::Packed ? packedLayout : standardLayout;
+}
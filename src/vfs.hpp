@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+#include "mapped_file.hpp"
+#include "pack_format.hpp"
+#include "lz4.hpp"
+
+// Bytes of one asset. Uncompressed pack entries point straight into the pack's
+// mapping, loose files get their own mapping and compressed entries own their
+// decompressed bytes; callers see the same thing either way.
+class Asset {
+    public:
+    const uint8_t* data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+    private:
+    friend class Vfs;
+
+    const uint8_t* bytes = nullptr;
+    size_t length = 0;
+    MappedFile file;
+    std::vector<uint8_t> storage;
+};
+
+// Virtual file system over asset packs and loose directories. Mounted packs are
+// searched first, in mount order, then directories. Assets viewing a pack stay
+// valid for as long as the Vfs does.
+class Vfs {
+    public:
+    void mountPack(const std::string& path) {
+        auto pack = std::make_unique<Pack>();
+        pack->file.open(path);
+
+        const uint8_t *base = pack->file.data();
+        size_t size = pack->file.size();
+
+        if (size < sizeof(PackFileHeader)) {
+            throw std::runtime_error("Asset pack is truncated: " + path);
+        }
+
+        memcpy(&pack->header, base, sizeof(PackFileHeader));
+        if (pack->header.magic != PACK_FILE_MAGIC || pack->header.version != PACK_FILE_VERSION) {
+            throw std::runtime_error("Unsupported asset pack: " + path);
+        }
+
+        if (pack->header.entriesOffset % alignof(PackEntry) != 0 ||
+            pack->header.entriesOffset + static_cast<uint64_t>(pack->header.entryCount) * sizeof(PackEntry) > size ||
+            pack->header.namesOffset > size) {
+            throw std::runtime_error("Asset pack index is out of bounds: " + path);
+        }
+
+        pack->entries = reinterpret_cast<const PackEntry*>(base + pack->header.entriesOffset);
+        pack->names = reinterpret_cast<const char*>(base + pack->header.namesOffset);
+
+        for (uint32_t i = 0; i < pack->header.entryCount; i++) {
+            const PackEntry& entry = pack->entries[i];
+            if (entry.dataOffset + entry.storedSize > size || pack->header.namesOffset + entry.nameOffset + entry.nameLength > size) {
+                throw std::runtime_error("Asset pack entry is out of bounds: " + path);
+            }
+        }
+
+        // The index is touched on every lookup and the data is read front to back
+        // during startup, so pull the whole pack in with one sequential read.
+        pack->file.prefetch();
+        packs.push_back(std::move(pack));
+    }
+
+    void mountDirectory(const std::string& path) {
+        directories.push_back(path);
+    }
+
+    bool exists(const std::string& path) const {
+        std::string assetPath = normalizeAssetPath(path);
+        uint64_t hash = hashAssetPath(assetPath);
+
+        for (const auto& pack : packs) {
+            if (findEntry(*pack, assetPath, hash) != nullptr) {
+                return true;
+            }
+        }
+
+        for (const auto& directory : directories) {
+            if (std::filesystem::is_regular_file(std::filesystem::path(directory) / assetPath)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Called with the path and size of every asset read, on the reading thread.
+    using ReadObserver = std::function<void(const std::string& path, size_t size)>;
+
+    void setReadObserver(ReadObserver observer) {
+        readObserver = std::move(observer);
+    }
+
+    Asset read(const std::string& path) const {
+        std::string assetPath = normalizeAssetPath(path);
+        uint64_t hash = hashAssetPath(assetPath);
+        Asset asset;
+
+        for (const auto& pack : packs) {
+            const PackEntry *entry = findEntry(*pack, assetPath, hash);
+            if (entry == nullptr) {
+                continue;
+            }
+
+            const uint8_t *stored = pack->file.data() + entry->dataOffset;
+            if (entry->compression == static_cast<uint32_t>(PackCompression::None)) {
+                asset.bytes = stored;
+            }
+            else if (entry->compression == static_cast<uint32_t>(PackCompression::Lz4)) {
+                asset.storage.resize(entry->size);
+                lz4Decompress(stored, entry->storedSize, asset.storage.data(), asset.storage.size());
+                asset.bytes = asset.storage.data();
+            }
+            else {
+                throw std::runtime_error("Unsupported compression for asset " + assetPath);
+            }
+
+            asset.length = entry->size;
+            notifyRead(assetPath, asset.length);
+            return asset;
+        }
+
+        for (const auto& directory : directories) {
+            std::filesystem::path filePath = std::filesystem::path(directory) / assetPath;
+            if (!std::filesystem::is_regular_file(filePath)) {
+                continue;
+            }
+
+            if (std::filesystem::file_size(filePath) > 0) {
+                asset.file.open(filePath.string());
+                asset.bytes = asset.file.data();
+                asset.length = asset.file.size();
+            }
+            notifyRead(assetPath, asset.length);
+            return asset;
+        }
+
+        throw std::runtime_error("Failed to find asset " + assetPath);
+    }
+
+    private:
+    struct Pack {
+        MappedFile file;
+        PackFileHeader header;
+        const PackEntry *entries;
+        const char *names;
+    };
+
+    std::vector<std::unique_ptr<Pack>> packs;
+    std::vector<std::string> directories;
+    ReadObserver readObserver;
+
+    void notifyRead(const std::string& assetPath, size_t size) const {
+        if (readObserver) {
+            readObserver(assetPath, size);
+        }
+    }
+
+    static const PackEntry* findEntry(const Pack& pack, const std::string& assetPath, uint64_t hash) {
+        const PackEntry *begin = pack.entries;
+        const PackEntry *end = pack.entries + pack.header.entryCount;
+        const PackEntry *entry = std::lower_bound(begin, end, hash, [](const PackEntry& candidate, uint64_t value) {
+            return candidate.pathHash < value;
+        });
+
+        for (; entry != end && entry->pathHash == hash; entry++) {
+            if (entry->nameLength == assetPath.size() && memcmp(pack.names + entry->nameOffset, assetPath.data(), assetPath.size()) == 0) {
+                return entry;
+            }
+        }
+
+        return nullptr;
+    }
+};
+
+// Directory containing the running executable, so asset lookup does not depend
+// on the working directory.
+inline std::string executableDirectory() {
+#if defined(_WIN32)
+    char path[MAX_PATH];
+    DWORD length = GetModuleFileNameA(nullptr, path, MAX_PATH);
+    if (length == 0 || length == MAX_PATH) {
+        throw std::runtime_error("Failed to locate executable");
+    }
+    return std::filesystem::path(std::string(path, length)).parent_path().string();
+#elif defined(__APPLE__)
+    char path[4096];
+    uint32_t length = sizeof(path);
+    if (_NSGetExecutablePath(path, &length) != 0) {
+        throw std::runtime_error("Failed to locate executable");
+    }
+    return std::filesystem::canonical(path).parent_path().string();
+#else
+    return std::filesystem::canonical("/proc/self/exe").parent_path().string();
+#endif
+}
@@ -0,0 +1,516 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "job_system.hpp"
+#include "profiler.hpp"
+#include "voxel_world.hpp"
+
+// Light of the blocks of one chunk, a byte per block in Chunk's order: sky
+// light in the low nibble, block light in the high one.
+struct ChunkLight {
+    std::array<uint8_t, Chunk::VOLUME> values;
+    // Changes whenever the light of a block of the chunk has.
+    uint32_t revision = 0;
+    // Only used while endUpdate() marks the chunks relit.
+    bool changed = false;
+};
+
+// Counts from the last batch of edits relit.
+struct VoxelLightStatistics {
+    uint32_t edits = 0;
+    // Groups of edits relit on jobs of their own.
+    uint32_t jobs = 0;
+    size_t blocksRelit = 0;
+    float milliseconds = 0.0f;
+    float maxEditMilliseconds = 0.0f;
+};
+
+// Sky light and block light of a VoxelWorld, kept up to date edit by edit.
+//
+// Light spreads between air blocks and drops by one level per block, except
+// that full sky light goes straight down without dropping. Space outside the
+// world's chunks counts as open air in full sky light. Solid blocks are dark,
+// apart from those that emit light, which also pass their light on.
+//
+// An edit relights only the blocks it affects, with breadth-first flood fills:
+// light that came through the edited block is removed first, then whatever
+// borders the removed region, and the block itself, spreads its light back
+// in. The fills cross chunk borders freely.
+//
+// The fills of an edit stay within MAX_LIGHT + 2 blocks of it sideways; only
+// full sky light goes further, and only straight down. A batch of edits is
+// therefore split into groups further apart than twice that, which touch no
+// block in common, and each group is relit on a job of its own.
+//
+// Edits are made through setBlock and relit on the job system between
+// beginUpdate and endUpdate; the light must only be read outside of that.
+class VoxelLight {
+    public:
+    static constexpr uint8_t MAX_LIGHT = 15;
+    static constexpr int SKY = 0;
+    static constexpr int BLOCK = 1;
+
+    explicit VoxelLight(JobSystem& jobSystem) : jobSystem(jobSystem) {
+        emissions.fill(0);
+    }
+
+    ~VoxelLight() {
+        jobSystem.wait(job);
+    }
+
+    VoxelLight(const VoxelLight&) = delete;
+    VoxelLight& operator=(const VoxelLight&) = delete;
+
+    static uint8_t level(uint8_t packed, int channel) {
+        return (packed >> (4 * channel)) & 0x0f;
+    }
+
+    // Light of blocks that are outside the world's chunks.
+    static constexpr uint8_t OUTSIDE = MAX_LIGHT;
+
+    void setEmission(BlockId block, uint8_t level) {
+        emissions[block] = std::min(level, MAX_LIGHT);
+    }
+
+    // Lights the whole world from scratch, on the calling thread.
+    void build(const VoxelWorld& world) {
+        PROFILE_ZONE("VoxelLight::build");
+        jobSystem.wait(job);
+        this->world = &world;
+        chunks.clear();
+        Fill fill;
+
+        std::vector<ChunkCoord> coords;
+        world.forEachChunk([&](const ChunkCoord& coord, const Chunk&) {
+            auto light = std::make_unique<ChunkLight>();
+            light->values.fill(0);
+            chunks[coord] = std::move(light);
+            coords.push_back(coord);
+        });
+
+        // Full sky light down every column, top chunks first so that each
+        // chunk knows what comes in through its top.
+        std::sort(coords.begin(), coords.end(), [](const ChunkCoord& a, const ChunkCoord& b) {
+            return a.z > b.z;
+        });
+        for (const ChunkCoord& coord : coords) {
+            const Chunk& chunk = *world.findChunk(coord);
+            ChunkLight& light = *chunks[coord];
+            const ChunkLight *above = findChunk({coord.x, coord.y, coord.z + 1});
+            for (int y = 0; y < Chunk::SIZE; y++) {
+                for (int x = 0; x < Chunk::SIZE; x++) {
+                    bool sky = above == nullptr || level(above->values[Chunk::indexOf(x, y, 0)], SKY) == MAX_LIGHT;
+                    for (int z = Chunk::MASK; z >= 0; z--) {
+                        BlockId block = chunk.get(x, y, z);
+                        sky = sky && block == AIR;
+                        uint8_t packed = static_cast<uint8_t>((sky ? MAX_LIGHT : 0) | emissions[block] << 4);
+                        light.values[Chunk::indexOf(x, y, z)] = packed;
+                    }
+                }
+            }
+        }
+
+        // Spread from every lit block that borders a darker air block, and
+        // into the chunks' borders from outside.
+        for (int channel = SKY; channel <= BLOCK; channel++) {
+            for (const ChunkCoord& coord : coords) {
+                glm::ivec3 origin = VoxelWorld::chunkOrigin(coord);
+                const ChunkLight& light = *chunks[coord];
+                for (int i = 0; i < Chunk::VOLUME; i++) {
+                    glm::ivec3 local(i & Chunk::MASK, (i >> Chunk::SHIFT) & Chunk::MASK, i >> (2 * Chunk::SHIFT));
+                    glm::ivec3 position = origin + local;
+                    uint8_t current = level(light.values[i], channel);
+                    if (current > 1 && bordersDarker(fill, position, current, channel)) {
+                        fill.addQueue.push_back(position);
+                    }
+                    bool border = glm::any(glm::equal(local, glm::ivec3(0))) || glm::any(glm::equal(local, glm::ivec3(Chunk::MASK)));
+                    if (channel == SKY && border && isAir(position)) {
+                        seedFromOutside(fill, position);
+                    }
+                }
+            }
+            propagateAdditions(fill, channel);
+        }
+    }
+
+    // Edits a block of the world the light was built for, and queues it to be
+    // relit by the next update. Waits for an update that is still running.
+    void setBlock(VoxelWorld& world, const glm::ivec3& block, BlockId id) {
+        jobSystem.wait(job);
+        if (world.getBlock(block) == id) {
+            return;
+        }
+        world.setBlock(block, id);
+        edits.push_back({block, id});
+    }
+
+    // Starts relighting the queued edits on the job system.
+    void beginUpdate() {
+        if (edits.empty() || world == nullptr || !running.empty()) {
+            return;
+        }
+        running.swap(edits);
+        jobSystem.run([this]() {
+            PROFILE_ZONE("VoxelLight::update");
+            relight();
+        }, job);
+    }
+
+    // Waits for the update begun last and marks the chunks it relit. Returns
+    // whether there was one.
+    bool endUpdate() {
+        jobSystem.wait(job);
+        if (running.empty()) {
+            return false;
+        }
+        running.clear();
+        // Groups may have relit different blocks of the same chunk.
+        std::vector<ChunkLight *> relit;
+        for (size_t i = 0; i < fillCount; i++) {
+            for (const ChunkCoord& coord : fills[i].changedChunks) {
+                ChunkLight *light = chunks[coord].get();
+                if (!light->changed) {
+                    light->changed = true;
+                    light->revision++;
+                    relit.push_back(light);
+                }
+            }
+        }
+        for (ChunkLight *light : relit) {
+            light->changed = false;
+        }
+        return true;
+    }
+
+    const ChunkLight *findChunk(const ChunkCoord& coord) const {
+        auto chunk = chunks.find(coord);
+        return chunk != chunks.end() ? chunk->second.get() : nullptr;
+    }
+
+    // 0 for a chunk without light.
+    uint32_t getRevision(const ChunkCoord& coord) const {
+        const ChunkLight *light = findChunk(coord);
+        return light != nullptr ? light->revision : 0;
+    }
+
+    // Packed light of a block, as ChunkLight stores it.
+    uint8_t getLight(const glm::ivec3& block) const {
+        const ChunkLight *light = findChunk(VoxelWorld::chunkOf(block));
+        return light != nullptr ? light->values[Chunk::indexOf(block.x & Chunk::MASK, block.y & Chunk::MASK, block.z & Chunk::MASK)] : OUTSIDE;
+    }
+
+    VoxelLightStatistics getStatistics() const {
+        return statistics;
+    }
+
+    private:
+    struct Edit {
+        glm::ivec3 position;
+        BlockId block;
+    };
+
+    struct RemoveNode {
+        glm::ivec3 position;
+        uint8_t level;
+    };
+
+    // State of the fills of one group of edits, owned by the job relighting it.
+    struct Fill {
+        std::vector<Edit> edits;
+        std::vector<RemoveNode> removeQueue;
+        std::vector<glm::ivec3> addQueue;
+        std::vector<ChunkCoord> changedChunks;
+        ChunkCoord cachedCoord = {};
+        ChunkLight *cachedChunk = nullptr;
+        ChunkLight *lastChanged = nullptr;
+        size_t blocksRelit = 0;
+        float maxEditMilliseconds = 0.0f;
+    };
+
+    // Sideways distance within which two edits' fills may touch the same blocks.
+    static constexpr int GROUP_DISTANCE = 2 * (MAX_LIGHT + 2);
+
+    // Directions between neighbours; DOWN is the one full sky light keeps to.
+    static constexpr int DOWN = 5;
+    static constexpr int DIRECTIONS[6][3] = {
+        {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}
+    };
+
+    JobSystem& jobSystem;
+    JobCounter job;
+    const VoxelWorld *world = nullptr;
+    std::unordered_map<ChunkCoord, std::unique_ptr<ChunkLight>, ChunkCoordHash> chunks;
+    std::array<uint8_t, 256> emissions;
+    std::vector<Edit> edits;
+    VoxelLightStatistics statistics;
+
+    // Owned by the update while it runs. Fills are kept between updates for
+    // their capacity; the first fillCount are the last update's.
+    std::vector<Edit> running;
+    std::vector<Fill> fills;
+    size_t fillCount = 0;
+    std::vector<uint32_t> groupOf;
+
+    static glm::ivec3 direction(int index) {
+        return glm::ivec3(DIRECTIONS[index][0], DIRECTIONS[index][1], DIRECTIONS[index][2]);
+    }
+
+    // The light a block passes on to its neighbour in a direction.
+    static uint8_t propagated(int channel, uint8_t level, int direction) {
+        if (channel == SKY && direction == DOWN && level == MAX_LIGHT) {
+            return MAX_LIGHT;
+        }
+        return level > 0 ? level - 1 : 0;
+    }
+
+    static int opposite(int direction) {
+        return direction ^ 1;
+    }
+
+    static int localIndex(const glm::ivec3& block) {
+        return Chunk::indexOf(block.x & Chunk::MASK, block.y & Chunk::MASK, block.z & Chunk::MASK);
+    }
+
+    bool isAir(const glm::ivec3& block) const {
+        return world->getBlock(block) == AIR;
+    }
+
+    // Fills run through neighbouring blocks, which are mostly in the same
+    // chunk as the last one looked up.
+    ChunkLight *lightChunk(Fill& fill, const glm::ivec3& block) const {
+        ChunkCoord coord = VoxelWorld::chunkOf(block);
+        if (fill.cachedChunk == nullptr || !(coord == fill.cachedCoord)) {
+            auto chunk = chunks.find(coord);
+            if (chunk == chunks.end()) {
+                return nullptr;
+            }
+            fill.cachedCoord = coord;
+            fill.cachedChunk = chunk->second.get();
+        }
+        return fill.cachedChunk;
+    }
+
+    uint8_t levelAt(Fill& fill, const glm::ivec3& block, int channel) const {
+        ChunkLight *chunk = lightChunk(fill, block);
+        return level(chunk != nullptr ? chunk->values[localIndex(block)] : OUTSIDE, channel);
+    }
+
+    // Chunks are listed once per run of changes to them; endUpdate() drops the
+    // repeats.
+    static void setLevel(Fill& fill, ChunkLight& chunk, const glm::ivec3& block, int channel, uint8_t value) {
+        uint8_t& packed = chunk.values[localIndex(block)];
+        packed = static_cast<uint8_t>((packed & ~(0x0f << (4 * channel))) | value << (4 * channel));
+        fill.blocksRelit++;
+        if (fill.lastChanged != &chunk) {
+            fill.lastChanged = &chunk;
+            fill.changedChunks.push_back(VoxelWorld::chunkOf(block));
+        }
+    }
+
+    bool bordersDarker(Fill& fill, const glm::ivec3& block, uint8_t current, int channel) const {
+        for (int i = 0; i < 6; i++) {
+            glm::ivec3 neighbour = block + direction(i);
+            ChunkLight *chunk = lightChunk(fill, neighbour);
+            if (chunk != nullptr && level(chunk->values[localIndex(neighbour)], channel) < propagated(channel, current, i) && isAir(neighbour)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Lets sky light in from neighbours outside the world's chunks.
+    void seedFromOutside(Fill& fill, const glm::ivec3& block) const {
+        ChunkLight *chunk = lightChunk(fill, block);
+        uint8_t current = level(chunk->values[localIndex(block)], SKY);
+        uint8_t incoming = current;
+        for (int i = 0; i < 6; i++) {
+            if (lightChunk(fill, block + direction(i)) == nullptr) {
+                incoming = std::max(incoming, propagated(SKY, level(OUTSIDE, SKY), opposite(i)));
+            }
+        }
+        if (incoming > current) {
+            setLevel(fill, *lightChunk(fill, block), block, SKY, incoming);
+            fill.addQueue.push_back(block);
+        }
+    }
+
+    // Light for the blocks of a chunk the world has gained since the build,
+    // which used to be outside of it.
+    void ensureChunk(const glm::ivec3& block) {
+        ChunkCoord coord = VoxelWorld::chunkOf(block);
+        auto& chunk = chunks[coord];
+        if (!chunk) {
+            chunk = std::make_unique<ChunkLight>();
+            chunk->values.fill(OUTSIDE);
+        }
+    }
+
+    void relight() {
+        statistics = {};
+        auto start = std::chrono::steady_clock::now();
+
+        // New chunks first, as the groups only look chunks up.
+        for (const Edit& edit : running) {
+            ensureChunk(edit.position);
+        }
+        groupEdits();
+        jobSystem.parallelFor(0, fillCount, 1, [this](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+                relightFill(fills[i]);
+            }
+        });
+
+        for (size_t i = 0; i < fillCount; i++) {
+            statistics.blocksRelit += fills[i].blocksRelit;
+            statistics.maxEditMilliseconds = std::max(statistics.maxEditMilliseconds, fills[i].maxEditMilliseconds);
+        }
+        statistics.edits = static_cast<uint32_t>(running.size());
+        statistics.jobs = static_cast<uint32_t>(fillCount);
+        statistics.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Splits the running edits into groups of edits within GROUP_DISTANCE of
+    // another edit of the group, keeping their order within each group.
+    void groupEdits() {
+        groupOf.resize(running.size());
+        for (size_t i = 0; i < running.size(); i++) {
+            groupOf[i] = static_cast<uint32_t>(i);
+        }
+        auto root = [&](uint32_t edit) {
+            while (groupOf[edit] != edit) {
+                groupOf[edit] = groupOf[groupOf[edit]];
+                edit = groupOf[edit];
+            }
+            return edit;
+        };
+        for (size_t i = 0; i < running.size(); i++) {
+            for (size_t j = 0; j < i; j++) {
+                glm::ivec3 offset = running[i].position - running[j].position;
+                if (std::abs(offset.x) <= GROUP_DISTANCE && std::abs(offset.y) <= GROUP_DISTANCE) {
+                    groupOf[root(static_cast<uint32_t>(i))] = root(static_cast<uint32_t>(j));
+                }
+            }
+        }
+
+        // Groups are numbered in the order of their first edit.
+        std::vector<uint32_t> fillOfRoot(running.size(), UINT32_MAX);
+        fillCount = 0;
+        for (size_t i = 0; i < running.size(); i++) {
+            uint32_t group = root(static_cast<uint32_t>(i));
+            if (fillOfRoot[group] == UINT32_MAX) {
+                fillOfRoot[group] = static_cast<uint32_t>(fillCount++);
+                if (fills.size() < fillCount) {
+                    fills.emplace_back();
+                }
+                Fill& fill = fills[fillCount - 1];
+                fill.edits.clear();
+                fill.changedChunks.clear();
+                fill.cachedChunk = nullptr;
+                fill.lastChanged = nullptr;
+                fill.blocksRelit = 0;
+                fill.maxEditMilliseconds = 0.0f;
+            }
+            fills[fillOfRoot[group]].edits.push_back(running[i]);
+        }
+    }
+
+    void relightFill(Fill& fill) {
+        PROFILE_ZONE("VoxelLight::relightFill");
+        for (const Edit& edit : fill.edits) {
+            auto editStart = std::chrono::steady_clock::now();
+            relightEdit(fill, edit);
+            float editMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - editStart).count();
+            fill.maxEditMilliseconds = std::max(fill.maxEditMilliseconds, editMilliseconds);
+        }
+    }
+
+    void relightEdit(Fill& fill, const Edit& edit) const {
+        bool air = edit.block == AIR;
+        for (int channel = SKY; channel <= BLOCK; channel++) {
+            ChunkLight& chunk = *lightChunk(fill, edit.position);
+            uint8_t old = levelAt(fill, edit.position, channel);
+            if (old > 0) {
+                setLevel(fill, chunk, edit.position, channel, 0);
+                fill.removeQueue.push_back({edit.position, old});
+                propagateRemovals(fill, channel);
+            }
+
+            uint8_t current = channel == BLOCK ? emissions[edit.block] : 0;
+            if (air) {
+                // The neighbours are settled, so the block takes the brightest
+                // light they pass it.
+                for (int i = 0; i < 6; i++) {
+                    current = std::max(current, propagated(channel, levelAt(fill, edit.position + direction(i), channel), opposite(i)));
+                }
+            }
+            if (current > 0) {
+                setLevel(fill, *lightChunk(fill, edit.position), edit.position, channel, current);
+                fill.addQueue.push_back(edit.position);
+            }
+            propagateAdditions(fill, channel);
+        }
+    }
+
+    // Darkens every block that took its light through a removed one. Blocks
+    // lit from elsewhere are kept and queued to spread their light back.
+    void propagateRemovals(Fill& fill, int channel) const {
+        for (size_t next = 0; next < fill.removeQueue.size(); next++) {
+            RemoveNode node = fill.removeQueue[next];
+            for (int i = 0; i < 6; i++) {
+                glm::ivec3 neighbour = node.position + direction(i);
+                ChunkLight *chunk = lightChunk(fill, neighbour);
+                if (chunk == nullptr) {
+                    if (channel == SKY && isAir(node.position)) {
+                        seedFromOutside(fill, node.position);
+                    }
+                    continue;
+                }
+                uint8_t current = level(chunk->values[localIndex(neighbour)], channel);
+                if (current == 0) {
+                    continue;
+                }
+                bool litByNode = current < node.level || (channel == SKY && i == DOWN && node.level == MAX_LIGHT);
+                bool emitter = channel == BLOCK && emissions[world->getBlock(neighbour)] > 0;
+                if (litByNode && !emitter) {
+                    setLevel(fill, *chunk, neighbour, channel, 0);
+                    fill.removeQueue.push_back({neighbour, current});
+                }
+                else {
+                    fill.addQueue.push_back(neighbour);
+                }
+            }
+        }
+        fill.removeQueue.clear();
+    }
+
+    void propagateAdditions(Fill& fill, int channel) const {
+        for (size_t next = 0; next < fill.addQueue.size(); next++) {
+            glm::ivec3 block = fill.addQueue[next];
+            uint8_t current = levelAt(fill, block, channel);
+            for (int i = 0; i < 6; i++) {
+                uint8_t passed = propagated(channel, current, i);
+                if (passed == 0) {
+                    continue;
+                }
+                glm::ivec3 neighbour = block + direction(i);
+                ChunkLight *chunk = lightChunk(fill, neighbour);
+                if (chunk == nullptr || level(chunk->values[localIndex(neighbour)], channel) >= passed || !isAir(neighbour)) {
+                    continue;
+                }
+                setLevel(fill, *chunk, neighbour, channel, passed);
+                fill.addQueue.push_back(neighbour);
+            }
+        }
+        fill.addQueue.clear();
+    }
+};
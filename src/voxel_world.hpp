@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+#include "grid_ray.hpp"
+
+using BlockId = uint8_t;
+
+constexpr BlockId AIR = 0;
+
+struct ChunkCoord {
+    int32_t x;
+    int32_t y;
+    int32_t z;
+
+    bool operator==(const ChunkCoord& other) const {
+        return x == other.x && y == other.y && z == other.z;
+    }
+};
+
+struct ChunkCoordHash {
+    size_t operator()(const ChunkCoord& coord) const {
+        return static_cast<size_t>(coord.x * 73856093u ^ coord.y * 19349663u ^ coord.z * 83492791u);
+    }
+};
+
+// A cube of blocks, stored x-major so that rows along x are contiguous. Keeps a
+// count of solid blocks so that traversals can skip empty chunks outright, and a
+// revision that changes with every edit so derived data can tell it is stale.
+class Chunk {
+    public:
+    static constexpr int SHIFT = 5;
+    static constexpr int SIZE = 1 << SHIFT;
+    static constexpr int MASK = SIZE - 1;
+    static constexpr int VOLUME = SIZE * SIZE * SIZE;
+
+    Chunk() {
+        blocks.fill(AIR);
+    }
+
+    static int indexOf(int x, int y, int z) {
+        return (z << (2 * SHIFT)) | (y << SHIFT) | x;
+    }
+
+    BlockId get(int x, int y, int z) const {
+        return blocks[indexOf(x, y, z)];
+    }
+
+    void set(int x, int y, int z, BlockId block) {
+        BlockId& current = blocks[indexOf(x, y, z)];
+        solidCount += (block != AIR) - (current != AIR);
+        current = block;
+        revision++;
+    }
+
+    uint32_t getSolidCount() const {
+        return solidCount;
+    }
+
+    uint32_t getRevision() const {
+        return revision;
+    }
+
+    const BlockId *data() const {
+        return blocks.data();
+    }
+
+    private:
+    std::array<BlockId, VOLUME> blocks;
+    uint32_t solidCount = 0;
+    uint32_t revision = 0;
+};
+
+struct VoxelHit {
+    bool hit = false;
+    glm::ivec3 block = glm::ivec3(0);
+    // Face of the block the ray entered through; zero when the ray starts inside it.
+    glm::ivec3 normal = glm::ivec3(0);
+    float distance = 0.0f;
+};
+
+// Sparse block storage for the terrain: chunks exist only where something was
+// placed, and everything outside them is air. Block coordinates are in world
+// units, one block per unit.
+class VoxelWorld {
+    public:
+    static ChunkCoord chunkOf(const glm::ivec3& block) {
+        return {block.x >> Chunk::SHIFT, block.y >> Chunk::SHIFT, block.z >> Chunk::SHIFT};
+    }
+
+    static glm::ivec3 chunkOrigin(const ChunkCoord& coord) {
+        return glm::ivec3(coord.x, coord.y, coord.z) * Chunk::SIZE;
+    }
+
+    const Chunk *findChunk(const ChunkCoord& coord) const {
+        auto chunk = chunks.find(coord);
+        return chunk != chunks.end() ? chunk->second.get() : nullptr;
+    }
+
+    Chunk& getOrCreateChunk(const ChunkCoord& coord) {
+        auto& chunk = chunks[coord];
+        if (!chunk) {
+            chunk = std::make_unique<Chunk>();
+        }
+        return *chunk;
+    }
+
+    BlockId getBlock(const glm::ivec3& block) const {
+        const Chunk *chunk = findChunk(chunkOf(block));
+        return chunk != nullptr ? chunk->get(block.x & Chunk::MASK, block.y & Chunk::MASK, block.z & Chunk::MASK) : AIR;
+    }
+
+    void setBlock(const glm::ivec3& block, BlockId id) {
+        ChunkCoord coord = chunkOf(block);
+        if (id == AIR && findChunk(coord) == nullptr) {
+            return;
+        }
+        getOrCreateChunk(coord).set(block.x & Chunk::MASK, block.y & Chunk::MASK, block.z & Chunk::MASK, id);
+    }
+
+    size_t getChunkCount() const {
+        return chunks.size();
+    }
+
+    // Calls function(coord, chunk) for every chunk, in no particular order.
+    template <typename Function>
+    void forEachChunk(Function&& function) const {
+        for (const auto& [coord, chunk] : chunks) {
+            function(coord, *chunk);
+        }
+    }
+
+    // Finds the first solid block along a ray. Walks chunks first and only steps
+    // through the blocks of chunks that hold any, so open space and missing
+    // chunks cost one lookup per chunk rather than one per block.
+    VoxelHit raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const {
+        VoxelHit hit;
+        float length = glm::length(direction);
+        if (length == 0.0f) {
+            return hit;
+        }
+        glm::vec3 unit = direction / length;
+
+        for (GridRay chunkRay(origin, unit, static_cast<float>(Chunk::SIZE)); chunkRay.t <= maxDistance; chunkRay.advance()) {
+            ChunkCoord coord = {chunkRay.cell.x, chunkRay.cell.y, chunkRay.cell.z};
+            const Chunk *chunk = findChunk(coord);
+            if (chunk == nullptr || chunk->getSolidCount() == 0) {
+                continue;
+            }
+            float exit = std::min(chunkRay.exitDistance(), maxDistance);
+            if (raycastChunk(*chunk, coord, origin, unit, chunkRay, exit, hit)) {
+                return hit;
+            }
+        }
+        return hit;
+    }
+
+    private:
+    std::unordered_map<ChunkCoord, std::unique_ptr<Chunk>, ChunkCoordHash> chunks;
+
+    static bool raycastChunk(const Chunk& chunk, const ChunkCoord& coord, const glm::vec3& origin, const glm::vec3& direction, const GridRay& chunkRay, float exit, VoxelHit& hit) {
+        glm::ivec3 chunkMin = chunkOrigin(coord);
+        glm::ivec3 chunkMax = chunkMin + (Chunk::SIZE - 1);
+        // Rounding can put the entry point just outside the chunk.
+        glm::ivec3 start = glm::clamp(glm::ivec3(glm::floor(origin + direction * chunkRay.t)), chunkMin, chunkMax);
+
+        GridRay ray(origin, direction, 1.0f, chunkRay.t, start);
+        ray.axis = chunkRay.axis;
+        while (ray.t <= exit) {
+            glm::ivec3 local = ray.cell - chunkMin;
+            if (glm::any(glm::lessThan(local, glm::ivec3(0))) || glm::any(glm::greaterThan(local, glm::ivec3(Chunk::MASK)))) {
+                return false;
+            }
+            if (chunk.get(local.x, local.y, local.z) != AIR) {
+                hit.hit = true;
+                hit.block = ray.cell;
+                hit.normal = ray.entryNormal();
+                hit.distance = ray.t;
+                return true;
+            }
+            ray.advance();
+        }
+        return false;
+    }
+};
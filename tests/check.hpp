@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+
+// Assertions for the test executables. A failed CHECK reports where it failed
+// and lets the test carry on; runTests() then fails the whole executable. CHECK
+// may be used from job system workers.
+
+inline std::atomic<int>& checkFailures() {
+    static std::atomic<int> failures{0};
+    return failures;
+}
+
+#define CHECK(condition)                                                                            \
+    do {                                                                                            \
+        if (!(condition)) {                                                                         \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+            checkFailures()++;                                                                      \
+        }                                                                                           \
+    } while (false)
+
+struct TestCase {
+    const char *name;
+    void (*run)();
+};
+
+// Runs every test, counting one that throws as failed, and returns the exit code.
+template <size_t N>
+int runTests(const TestCase (&tests)[N]) {
+    for (const TestCase& test : tests) {
+        int failuresBefore = checkFailures();
+        try {
+            test.run();
+        } catch (const std::exception& e) {
+            std::cerr << test.name << " threw: " << e.what() << std::endl;
+            checkFailures()++;
+        }
+        std::cout << (checkFailures() == failuresBefore ? "pass " : "FAIL ") << test.name << std::endl;
+    }
+    return checkFailures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
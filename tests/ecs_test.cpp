@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <vector>
+
+#include "check.hpp"
+#include "ecs.hpp"
+
+struct Position {
+    float x;
+};
+
+struct Velocity {
+    float x;
+};
+
+struct Tag {
+    int value;
+};
+
+static void testGenerations() {
+    World world;
+    Entity first = world.create();
+    world.add(first, Position{1.0f});
+    CHECK(world.isAlive(first));
+    CHECK(world.has<Position>(first));
+
+    world.destroy(first);
+    CHECK(!world.isAlive(first));
+    CHECK(!world.has<Position>(first));
+
+    // The slot is reused under a new generation; the old handle stays dead.
+    Entity second = world.create();
+    CHECK(second.index == first.index);
+    CHECK(!(second == first));
+    CHECK(world.isAlive(second));
+    CHECK(!world.isAlive(first));
+    CHECK(!world.has<Position>(second));
+}
+
+static void testRemoveKeepsOthers() {
+    World world;
+    std::vector<Entity> entities;
+    for (int i = 0; i < 10; i++) {
+        entities.push_back(world.create());
+        world.add(entities.back(), Position{static_cast<float>(i)});
+    }
+    world.remove<Position>(entities[3]);
+    world.remove<Position>(entities[0]);
+    world.remove<Position>(entities[9]);
+
+    CHECK(world.pool<Position>().size() == 7);
+    for (int i = 0; i < 10; i++) {
+        bool removed = i == 0 || i == 3 || i == 9;
+        CHECK(world.has<Position>(entities[i]) == !removed);
+        if (!removed) {
+            CHECK(world.get<Position>(entities[i]).x == static_cast<float>(i));
+        }
+    }
+}
+
+static void testEachJoinsComponents() {
+    World world;
+    std::vector<Entity> moving;
+    for (int i = 0; i < 20; i++) {
+        Entity entity = world.create();
+        world.add(entity, Position{0.0f});
+        if (i % 3 == 0) {
+            world.add(entity, Velocity{static_cast<float>(i)});
+            moving.push_back(entity);
+        }
+    }
+
+    std::vector<uint32_t> visited;
+    world.each<Velocity, Position>([&](Entity entity, Velocity& velocity, Position& position) {
+        position.x += velocity.x;
+        visited.push_back(entity.index);
+    });
+    CHECK(visited.size() == moving.size());
+    for (Entity entity : moving) {
+        CHECK(std::count(visited.begin(), visited.end(), entity.index) == 1);
+        CHECK(world.get<Position>(entity).x == world.get<Velocity>(entity).x);
+    }
+}
+
+static void testChangeTracking() {
+    World world;
+    std::vector<Entity> entities;
+    for (int i = 0; i < 100; i++) {
+        entities.push_back(world.create());
+        world.add(entities.back(), Position{0.0f});
+    }
+
+    size_t changed = 0;
+    world.eachChanged<Position>([&](Entity, Position&) {
+        changed++;
+    });
+    CHECK(changed == entities.size());
+
+    world.clearChanged();
+    world.getMutable<Position>(entities[5]).x = 1.0f;
+    world.markChanged<Position>(entities[70]);
+    world.update<Position>([&](Entity entity, Position&) {
+        return entity.index == entities[40].index;
+    });
+
+    std::vector<uint32_t> indices;
+    world.eachChanged<Position>([&](Entity entity, Position&) {
+        indices.push_back(entity.index);
+    });
+    std::sort(indices.begin(), indices.end());
+    CHECK((indices == std::vector<uint32_t>{entities[5].index, entities[40].index, entities[70].index}));
+
+    world.clearChanged();
+    changed = 0;
+    world.eachChanged<Position>([&](Entity, Position&) {
+        changed++;
+    });
+    CHECK(changed == 0);
+}
+
+// Tag has no pool until the parallel update asks for it, which must not be
+// created by the workers.
+static void testParallelUpdate() {
+    JobSystem jobSystem(2);
+    World world;
+    const int COUNT = 5000;
+    for (int i = 0; i < COUNT; i++) {
+        Entity entity = world.create();
+        world.add(entity, Position{static_cast<float>(i)});
+        world.add(entity, Velocity{1.0f});
+    }
+    world.clearChanged();
+
+    int tagged = 0;
+    world.parallelEach<Position, Tag>(jobSystem, 1, [&](Entity, Position&, Tag&) {
+        tagged++;
+    });
+    CHECK(tagged == 0);
+
+    world.parallelUpdate<Position, Velocity>(jobSystem, 1, [](Entity, Position& position, Velocity& velocity) {
+        position.x += velocity.x;
+        return static_cast<int>(position.x) % 2 == 0;
+    });
+
+    size_t changed = 0;
+    world.eachChanged<Position>([&](Entity, Position& position) {
+        CHECK(static_cast<int>(position.x) % 2 == 0);
+        changed++;
+    });
+    CHECK(changed == COUNT / 2);
+
+    float sum = 0.0f;
+    world.each<Position>([&](Entity, Position& position) {
+        sum += position.x;
+    });
+    CHECK(sum == static_cast<float>(COUNT) * (COUNT + 1) / 2);
+}
+
+int main() {
+    static const TestCase TESTS[] = {
+        {"generations", testGenerations},
+        {"removal keeps the other components", testRemoveKeepsOthers},
+        {"each joins components", testEachJoinsComponents},
+        {"change tracking", testChangeTracking},
+        {"parallel update", testParallelUpdate},
+    };
+    return runTests(TESTS);
+}
@@ -0,0 +1,158 @@
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "frame_timing.hpp"
+
+static const size_t FRAMES = 200;
+
+// A steady run with a little variation, so the quantiles are not all one frame.
+static std::vector<FrameTiming> steadyRun(float cpuMilliseconds, float gpuMilliseconds) {
+    std::vector<FrameTiming> timings(FRAMES);
+    for (size_t i = 0; i < FRAMES; i++) {
+        float wobble = 1.0f + 0.01f * static_cast<float>(i % 5);
+        timings[i].cpuMilliseconds = cpuMilliseconds * wobble;
+        timings[i].gpuMilliseconds = gpuMilliseconds * wobble;
+    }
+    return timings;
+}
+
+static bool reportHas(const TimingComparison& comparison, const std::string& text) {
+    return comparison.report.find(text) != std::string::npos;
+}
+
+static void testIdenticalRunsPass() {
+    std::vector<FrameTiming> baseline = steadyRun(4.0f, 6.0f);
+    TimingComparison comparison = compareFrameTimings(baseline, baseline, 0.1f, 0);
+    CHECK(!comparison.regressed);
+    CHECK(!reportHas(comparison, "REGRESSED"));
+    CHECK(!reportHas(comparison, "over the threshold"));
+}
+
+static void testSlowerRunRegresses() {
+    std::vector<FrameTiming> baseline = steadyRun(4.0f, 6.0f);
+
+    // 5% slower is within a 10% threshold.
+    TimingComparison within = compareFrameTimings(baseline, steadyRun(4.2f, 6.3f), 0.1f, 0);
+    CHECK(!within.regressed);
+
+    TimingComparison over = compareFrameTimings(baseline, steadyRun(4.0f, 7.2f), 0.1f, 0);
+    CHECK(over.regressed);
+    CHECK(reportHas(over, "GPU median"));
+    CHECK(reportHas(over, "REGRESSED"));
+    CHECK(reportHas(over, "GPU: 200 of 200 frames over the threshold"));
+    CHECK(!reportHas(over, "CPU: "));
+}
+
+// A few slow frames move neither quantile, so they are listed but do not fail
+// the run.
+static void testSpikesAreListed() {
+    std::vector<FrameTiming> baseline = steadyRun(4.0f, 6.0f);
+    std::vector<FrameTiming> current = baseline;
+    current[40].cpuMilliseconds = 40.0f;
+    current[150].cpuMilliseconds = 8.0f;
+
+    TimingComparison comparison = compareFrameTimings(baseline, current, 0.1f, 0);
+    CHECK(!comparison.regressed);
+    CHECK(reportHas(comparison, "CPU: 2 of 200 frames over the threshold, worst: 40 (10.00x) 150 (2.00x)"));
+}
+
+// Frames past the threshold by less than minMilliseconds are noise.
+static void testSmallDifferencesAreIgnored() {
+    std::vector<FrameTiming> baseline = steadyRun(0.2f, 0.3f);
+    std::vector<FrameTiming> current = baseline;
+    current[10].cpuMilliseconds = 0.25f;
+
+    TimingComparison comparison = compareFrameTimings(baseline, current, 0.1f, 0, 0.1f);
+    CHECK(!reportHas(comparison, "over the threshold"));
+    comparison = compareFrameTimings(baseline, current, 0.1f, 0, 0.01f);
+    CHECK(reportHas(comparison, "CPU: 1 of 200 frames over the threshold"));
+}
+
+static void testWarmupIsSkipped() {
+    std::vector<FrameTiming> baseline = steadyRun(4.0f, 6.0f);
+    std::vector<FrameTiming> current = baseline;
+    for (size_t i = 0; i < 150; i++) {
+        current[i].cpuMilliseconds *= 3.0f;
+    }
+
+    CHECK(compareFrameTimings(baseline, current, 0.1f, 0).regressed);
+    TimingComparison comparison = compareFrameTimings(baseline, current, 0.1f, 150);
+    CHECK(!comparison.regressed);
+    CHECK(!reportHas(comparison, "over the threshold"));
+}
+
+// Devices without timestamp queries record 0 GPU time; that is reported rather
+// than compared.
+static void testUnmeasuredGpuTimes() {
+    std::vector<FrameTiming> baseline = steadyRun(4.0f, 0.0f);
+    std::vector<FrameTiming> current = steadyRun(4.0f, 0.0f);
+
+    TimingComparison comparison = compareFrameTimings(baseline, current, 0.1f, 0);
+    CHECK(!comparison.regressed);
+    CHECK(reportHas(comparison, "GPU times not measured in both runs"));
+    CHECK(reportHas(comparison, "CPU median"));
+}
+
+static void testDifferentLengthsThrow() {
+    std::vector<FrameTiming> baseline = steadyRun(4.0f, 6.0f);
+    std::vector<FrameTiming> current(baseline.begin(), baseline.end() - 1);
+
+    bool threw = false;
+    try {
+        compareFrameTimings(baseline, current, 0.1f, 0);
+    }
+    catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+static void testCsvRoundTrip() {
+    std::string path = (std::filesystem::temp_directory_path() / "dig_frame_timing_test.csv").string();
+    std::vector<FrameTiming> timings = steadyRun(4.0f, 6.0f);
+    timings[3] = {12.5f, 0.0f};
+
+    writeFrameTimings(path, timings);
+    std::vector<FrameTiming> read = readFrameTimings(path);
+    CHECK(read.size() == timings.size());
+    bool same = read.size() == timings.size();
+    for (size_t i = 0; same && i < read.size(); i++) {
+        same = std::abs(read[i].cpuMilliseconds - timings[i].cpuMilliseconds) < 1e-4f
+               && std::abs(read[i].gpuMilliseconds - timings[i].gpuMilliseconds) < 1e-4f;
+    }
+    CHECK(same);
+
+    // Frames out of order are rejected rather than compared against the wrong ones.
+    {
+        std::ofstream file(path, std::ios::trunc);
+        file << "frame,cpu_ms,gpu_ms\n0,1.0,1.0\n2,1.0,1.0\n";
+    }
+    bool threw = false;
+    try {
+        readFrameTimings(path);
+    }
+    catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+    std::filesystem::remove(path);
+}
+
+int main() {
+    static const TestCase TESTS[] = {
+        {"identical runs pass", testIdenticalRunsPass},
+        {"slower run regresses", testSlowerRunRegresses},
+        {"spikes are listed", testSpikesAreListed},
+        {"small differences are ignored", testSmallDifferencesAreIgnored},
+        {"warmup is skipped", testWarmupIsSkipped},
+        {"unmeasured gpu times", testUnmeasuredGpuTimes},
+        {"different lengths throw", testDifferentLengthsThrow},
+        {"csv round trip", testCsvRoundTrip},
+    };
+    return runTests(TESTS);
+}
@@ -0,0 +1,107 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "job_system.hpp"
+
+static int fibonacci(JobSystem& jobSystem, int n) {
+    if (n < 2) {
+        return n;
+    }
+    int left = 0;
+    JobCounter counter;
+    jobSystem.run([&]() {
+        left = fibonacci(jobSystem, n - 1);
+    }, counter);
+    int right = fibonacci(jobSystem, n - 2);
+    jobSystem.wait(counter);
+    return left + right;
+}
+
+static void testParallelForCoversRangeOnce() {
+    for (unsigned workers : {0u, 2u}) {
+        JobSystem jobSystem(workers);
+        for (size_t batchSize : {1, 7, 64, 1000, 5000}) {
+            std::vector<std::atomic<int>> visits(1000);
+            jobSystem.parallelFor(0, visits.size(), batchSize, [&](size_t first, size_t last) {
+                CHECK(first < last);
+                CHECK(last - first <= batchSize);
+                for (size_t i = first; i < last; i++) {
+                    visits[i]++;
+                }
+            });
+            for (const std::atomic<int>& count : visits) {
+                CHECK(count.load() == 1);
+            }
+        }
+    }
+}
+
+static void testParallelForEmptyRange() {
+    JobSystem jobSystem(2);
+    bool called = false;
+    jobSystem.parallelFor(5, 5, 1, [&](size_t, size_t) {
+        called = true;
+    });
+    CHECK(!called);
+}
+
+static void testNestedForkJoin() {
+    for (unsigned workers : {0u, 2u}) {
+        JobSystem jobSystem(workers);
+        CHECK(fibonacci(jobSystem, 18) == 2584);
+    }
+}
+
+// More jobs than a deque holds, which then run as they are submitted.
+static void testOverflowingDeque() {
+    JobSystem jobSystem(2);
+    std::atomic<int> done{0};
+    JobCounter counter;
+    for (int i = 0; i < JobDeque::CAPACITY * 3; i++) {
+        jobSystem.run([&]() {
+            done++;
+        }, counter);
+    }
+    jobSystem.wait(counter);
+    CHECK(counter.isDone());
+    CHECK(done.load() == JobDeque::CAPACITY * 3);
+}
+
+static void testExternalSubmission() {
+    JobSystem jobSystem(2);
+    std::atomic<int> done{0};
+    JobCounter counter;
+    std::thread submitter([&]() {
+        for (int i = 0; i < 100; i++) {
+            jobSystem.run([&]() {
+                done++;
+            }, counter);
+        }
+    });
+    submitter.join();
+    jobSystem.wait(counter);
+    CHECK(done.load() == 100);
+}
+
+static void testBatchSize() {
+    JobSystem jobSystem(2);
+    CHECK(jobSystem.getThreadCount() == 3);
+    CHECK(jobSystem.batchSizeFor(0, 16) == 16);
+    CHECK(jobSystem.batchSizeFor(10, 16) == 16);
+    size_t batchSize = jobSystem.batchSizeFor(1200);
+    CHECK((1200 + batchSize - 1) / batchSize >= jobSystem.getThreadCount());
+}
+
+int main() {
+    static const TestCase TESTS[] = {
+        {"parallelFor covers the range once", testParallelForCoversRangeOnce},
+        {"parallelFor of an empty range", testParallelForEmptyRange},
+        {"nested fork-join", testNestedForkJoin},
+        {"jobs beyond the deque capacity", testOverflowingDeque},
+        {"submission from another thread", testExternalSubmission},
+        {"batch size", testBatchSize},
+    };
+    return runTests(TESTS);
+}
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "range_allocator.hpp"
+
+static void testFirstFit() {
+    RangeAllocator allocator(100);
+    CHECK(allocator.allocate(10) == 0);
+    CHECK(allocator.allocate(20) == 10);
+    CHECK(allocator.allocate(70) == 30);
+    CHECK(allocator.getUsed() == 100);
+    CHECK(allocator.allocate(1) == RangeAllocator::INVALID);
+    CHECK(allocator.getFreeRangeCount() == 0);
+
+    // The hole left at the front is reused before anything later.
+    allocator.free(0, 10);
+    CHECK(allocator.allocate(11) == RangeAllocator::INVALID);
+    CHECK(allocator.allocate(4) == 0);
+    CHECK(allocator.allocate(6) == 4);
+}
+
+static void testFreeMergesNeighbours() {
+    RangeAllocator allocator(90);
+    uint64_t a = allocator.allocate(30);
+    uint64_t b = allocator.allocate(30);
+    uint64_t c = allocator.allocate(30);
+
+    allocator.free(a, 30);
+    allocator.free(c, 30);
+    CHECK(allocator.getFreeRangeCount() == 2);
+    CHECK(allocator.allocate(40) == RangeAllocator::INVALID);
+
+    // Freeing the middle joins all three.
+    allocator.free(b, 30);
+    CHECK(allocator.getFreeRangeCount() == 1);
+    CHECK(allocator.getUsed() == 0);
+    CHECK(allocator.allocate(90) == 0);
+}
+
+static void testReset() {
+    RangeAllocator allocator;
+    CHECK(allocator.allocate(1) == RangeAllocator::INVALID);
+    allocator.reset(16);
+    CHECK(allocator.getCapacity() == 16);
+    allocator.allocate(8);
+    allocator.reset(32);
+    CHECK(allocator.getUsed() == 0);
+    CHECK(allocator.allocate(32) == 0);
+}
+
+// Random allocations and frees never hand out overlapping ranges, and freeing
+// everything leaves one range again.
+static void testRandomUse() {
+    const uint64_t CAPACITY = 1 << 16;
+    RangeAllocator allocator(CAPACITY);
+    std::mt19937 random(5);
+    struct Range {
+        uint64_t offset;
+        uint64_t size;
+    };
+    std::vector<Range> live;
+
+    for (int i = 0; i < 5000; i++) {
+        if (live.empty() || random() % 3 != 0) {
+            uint64_t size = 1 + random() % 512;
+            uint64_t offset = allocator.allocate(size);
+            if (offset != RangeAllocator::INVALID) {
+                CHECK(offset + size <= CAPACITY);
+                live.push_back({offset, size});
+            }
+        }
+        else {
+            size_t index = random() % live.size();
+            allocator.free(live[index].offset, live[index].size);
+            live[index] = live.back();
+            live.pop_back();
+        }
+    }
+
+    std::sort(live.begin(), live.end(), [](const Range& a, const Range& b) {
+        return a.offset < b.offset;
+    });
+    uint64_t used = 0;
+    for (size_t i = 0; i < live.size(); i++) {
+        used += live[i].size;
+        if (i > 0) {
+            CHECK(live[i - 1].offset + live[i - 1].size <= live[i].offset);
+        }
+    }
+    CHECK(allocator.getUsed() == used);
+
+    for (const Range& range : live) {
+        allocator.free(range.offset, range.size);
+    }
+    CHECK(allocator.getUsed() == 0);
+    CHECK(allocator.getFreeRangeCount() == 1);
+    CHECK(allocator.allocate(CAPACITY) == 0);
+}
+
+int main() {
+    static const TestCase TESTS[] = {
+        {"first fit", testFirstFit},
+        {"free merges neighbours", testFreeMergesNeighbours},
+        {"reset", testReset},
+        {"random use", testRandomUse},
+    };
+    return runTests(TESTS);
+}
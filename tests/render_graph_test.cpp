@@ -0,0 +1,297 @@
+#include <cstdint>
+#include <map>
+
+#include "check.hpp"
+#include "render_graph.hpp"
+
+// The render graph only creates, binds and frees objects while compiling, so
+// this test defines those entry points itself instead of linking the loader, and
+// records what the graph asked for.
+
+struct FakeDevice {
+    uintptr_t lastHandle = 0;
+    int imagesCreated = 0;
+    int imagesDestroyed = 0;
+    int allocations = 0;
+    int frees = 0;
+    // Object to its memory size, and to the memory bound to it.
+    std::map<uintptr_t, VkDeviceSize> sizes;
+    std::map<uintptr_t, uintptr_t> bindings;
+};
+
+static FakeDevice fake;
+
+template <typename Handle>
+static Handle newHandle() {
+    return reinterpret_cast<Handle>(++fake.lastHandle);
+}
+
+template <typename Handle>
+static uintptr_t handleId(Handle handle) {
+    return reinterpret_cast<uintptr_t>(handle);
+}
+
+extern "C" {
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice, VkPhysicalDeviceMemoryProperties *properties) {
+    *properties = {};
+    properties->memoryTypeCount = 1;
+    properties->memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    properties->memoryHeapCount = 1;
+    properties->memoryHeaps[0].size = VkDeviceSize(1) << 32;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateImage(VkDevice, const VkImageCreateInfo *info, const VkAllocationCallbacks *, VkImage *image) {
+    *image = newHandle<VkImage>();
+    fake.sizes[handleId(*image)] = VkDeviceSize(info->extent.width) * info->extent.height * 4;
+    fake.imagesCreated++;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateBuffer(VkDevice, const VkBufferCreateInfo *info, const VkAllocationCallbacks *, VkBuffer *buffer) {
+    *buffer = newHandle<VkBuffer>();
+    fake.sizes[handleId(*buffer)] = info->size;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateImageView(VkDevice, const VkImageViewCreateInfo *, const VkAllocationCallbacks *, VkImageView *view) {
+    *view = newHandle<VkImageView>();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetImageMemoryRequirements(VkDevice, VkImage image, VkMemoryRequirements *requirements) {
+    requirements->size = fake.sizes[handleId(image)];
+    requirements->alignment = 256;
+    requirements->memoryTypeBits = 1;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements(VkDevice, VkBuffer buffer, VkMemoryRequirements *requirements) {
+    requirements->size = fake.sizes[handleId(buffer)];
+    requirements->alignment = 256;
+    requirements->memoryTypeBits = 1;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice, const VkMemoryAllocateInfo *, const VkAllocationCallbacks *, VkDeviceMemory *memory) {
+    *memory = newHandle<VkDeviceMemory>();
+    fake.allocations++;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory, const VkAllocationCallbacks *) {
+    fake.frees++;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindImageMemory(VkDevice, VkImage image, VkDeviceMemory memory, VkDeviceSize) {
+    fake.bindings[handleId(image)] = handleId(memory);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory(VkDevice, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize) {
+    fake.bindings[handleId(buffer)] = handleId(memory);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyImage(VkDevice, VkImage, const VkAllocationCallbacks *) {
+    fake.imagesDestroyed++;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyImageView(VkDevice, VkImageView, const VkAllocationCallbacks *) {}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyBuffer(VkDevice, VkBuffer, const VkAllocationCallbacks *) {}
+
+}
+
+static const VkExtent2D EXTENT = {64, 64};
+
+static void initGraph(RenderGraph& graph) {
+    fake = FakeDevice();
+    graph.init(newHandle<VkDevice>(), newHandle<VkPhysicalDevice>());
+}
+
+// Presented at the end, so whatever renders into it is always kept.
+static RenderGraphImage importSwapchain(RenderGraph& graph) {
+    return graph.importImage("swapchain", newHandle<VkImage>(), newHandle<VkImageView>(), VK_FORMAT_B8G8R8A8_SRGB, EXTENT,
+                             VK_IMAGE_ASPECT_COLOR_BIT, imageUsageState(ImageUsage::Undefined), ImageUsage::Present);
+}
+
+static void testCullsUnreadPasses() {
+    RenderGraph graph;
+    initGraph(graph);
+    RenderGraphImage swapchain = importSwapchain(graph);
+    RenderGraphImage scratch = graph.createImage("scratch", VK_FORMAT_R8G8B8A8_UNORM, EXTENT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    graph.addPass("unread", [&](RenderPassBuilder& pass) {
+        pass.colorAttachment(scratch, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    }, nullptr);
+    graph.addPass("main", [&](RenderPassBuilder& pass) {
+        pass.colorAttachment(swapchain, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    }, nullptr);
+    graph.compile();
+
+    CHECK(graph.isPassCulled("unread"));
+    CHECK(!graph.isPassCulled("main"));
+    // A transient only a culled pass touches is never created.
+    CHECK(fake.imagesCreated == 0);
+    CHECK(graph.getImage(scratch) == VK_NULL_HANDLE);
+    graph.destroy();
+}
+
+// Culling a pass drops its reads, which can leave the passes feeding it unread.
+static void testCullsChains() {
+    RenderGraph graph;
+    initGraph(graph);
+    RenderGraphImage swapchain = importSwapchain(graph);
+    RenderGraphImage first = graph.createImage("first", VK_FORMAT_R8G8B8A8_UNORM, EXTENT, VK_IMAGE_ASPECT_COLOR_BIT);
+    RenderGraphImage second = graph.createImage("second", VK_FORMAT_R8G8B8A8_UNORM, EXTENT, VK_IMAGE_ASPECT_COLOR_BIT);
+    RenderGraphImage used = graph.createImage("used", VK_FORMAT_R8G8B8A8_UNORM, EXTENT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    graph.addPass("first", [&](RenderPassBuilder& pass) {
+        pass.colorAttachment(first, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    }, nullptr);
+    graph.addPass("second", [&](RenderPassBuilder& pass) {
+        pass.useImage(first, ImageUsage::SampledGraphics);
+        pass.colorAttachment(second, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    }, nullptr);
+    graph.addPass("used", [&](RenderPassBuilder& pass) {
+        pass.colorAttachment(used, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    }, nullptr);
+    graph.addPass("main", [&](RenderPassBuilder& pass) {
+        pass.useImage(used, ImageUsage::SampledGraphics);
+        pass.colorAttachment(swapchain, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    }, nullptr);
+    graph.compile();
+
+    CHECK(graph.isPassCulled("first"));
+    CHECK(graph.isPassCulled("second"));
+    CHECK(!graph.isPassCulled("used"));
+    CHECK(!graph.isPassCulled("main"));
+    CHECK(fake.imagesCreated == 1);
+    graph.destroy();
+}
+
+static void testSideEffectKeepsPass() {
+    RenderGraph graph;
+    initGraph(graph);
+    BufferState initial = {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE};
+    RenderGraphBuffer readback = graph.importBuffer("readback", newHandle<VkBuffer>(), 4096, initial);
+    RenderGraphBuffer unread = graph.importBuffer("unread", newHandle<VkBuffer>(), 4096, initial);
+
+    graph.addPass("readback", [&](RenderPassBuilder& pass) {
+        pass.useBuffer(readback, BufferUsage::StorageWriteCompute);
+        pass.sideEffect();
+    }, nullptr);
+    graph.addPass("unread", [&](RenderPassBuilder& pass) {
+        pass.useBuffer(unread, BufferUsage::StorageWriteCompute);
+    }, nullptr);
+    graph.compile();
+
+    CHECK(!graph.isPassCulled("readback"));
+    CHECK(graph.isPassCulled("unread"));
+    graph.destroy();
+}
+
+// Two transients used one after the other share one block of memory, two used
+// at the same time do not.
+static void testAliasesDisjointLifetimes() {
+    RenderGraph graph;
+    initGraph(graph);
+    RenderGraphImage swapchain = importSwapchain(graph);
+    RenderGraphImage early = graph.createImage("early", VK_FORMAT_R8G8B8A8_UNORM, EXTENT, VK_IMAGE_ASPECT_COLOR_BIT);
+    RenderGraphImage late = graph.createImage("late", VK_FORMAT_R8G8B8A8_UNORM, EXTENT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    graph.addPass("writeEarly", [&](RenderPassBuilder& pass) {
+        pass.colorAttachment(early, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    }, nullptr);
+    graph.addPass("readEarly", [&](RenderPassBuilder& pass) {
+        pass.useImage(early, ImageUsage::SampledGraphics);
+        pass.colorAttachment(swapchain, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    }, nullptr);
+    graph.addPass("writeLate", [&](RenderPassBuilder& pass) {
+        pass.colorAttachment(late, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    }, nullptr);
+    graph.addPass("readLate", [&](RenderPassBuilder& pass) {
+        pass.useImage(late, ImageUsage::SampledGraphics);
+        pass.colorAttachment(swapchain, VK_ATTACHMENT_LOAD_OP_LOAD);
+    }, nullptr);
+    graph.compile();
+
+    CHECK(fake.imagesCreated == 2);
+    CHECK(fake.allocations == 1);
+    CHECK(graph.getImage(early) != graph.getImage(late));
+    CHECK(fake.bindings[handleId(graph.getImage(early))] == fake.bindings[handleId(graph.getImage(late))]);
+    graph.destroy();
+
+    initGraph(graph);
+    graph.reset();
+    swapchain = importSwapchain(graph);
+    RenderGraphImage outer = graph.createImage("outer", VK_FORMAT_R8G8B8A8_UNORM, EXTENT, VK_IMAGE_ASPECT_COLOR_BIT);
+    RenderGraphImage inner = graph.createImage("inner", VK_FORMAT_R8G8B8A8_UNORM, EXTENT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    graph.addPass("writeOuter", [&](RenderPassBuilder& pass) {
+        pass.colorAttachment(outer, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    }, nullptr);
+    graph.addPass("writeInner", [&](RenderPassBuilder& pass) {
+        pass.colorAttachment(inner, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    }, nullptr);
+    graph.addPass("readInner", [&](RenderPassBuilder& pass) {
+        pass.useImage(inner, ImageUsage::SampledGraphics);
+        pass.colorAttachment(swapchain, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    }, nullptr);
+    graph.addPass("readOuter", [&](RenderPassBuilder& pass) {
+        pass.useImage(outer, ImageUsage::SampledGraphics);
+        pass.colorAttachment(swapchain, VK_ATTACHMENT_LOAD_OP_LOAD);
+    }, nullptr);
+    graph.compile();
+
+    CHECK(fake.imagesCreated == 2);
+    CHECK(fake.allocations == 2);
+    CHECK(fake.bindings[handleId(graph.getImage(outer))] != fake.bindings[handleId(graph.getImage(inner))]);
+    graph.destroy();
+    CHECK(fake.frees == 2);
+}
+
+// Declaring the same transients the next frame reuses them; declaring different
+// ones replaces them.
+static void testReusesTransientsAcrossFrames() {
+    RenderGraph graph;
+    initGraph(graph);
+
+    auto declareFrame = [&](VkExtent2D extent) {
+        graph.reset();
+        RenderGraphImage swapchain = importSwapchain(graph);
+        RenderGraphImage scene = graph.createImage("scene", VK_FORMAT_R8G8B8A8_UNORM, extent, VK_IMAGE_ASPECT_COLOR_BIT);
+        graph.addPass("scene", [&](RenderPassBuilder& pass) {
+            pass.colorAttachment(scene, VK_ATTACHMENT_LOAD_OP_CLEAR);
+        }, nullptr);
+        graph.addPass("resolve", [&](RenderPassBuilder& pass) {
+            pass.useImage(scene, ImageUsage::SampledGraphics);
+            pass.colorAttachment(swapchain, VK_ATTACHMENT_LOAD_OP_CLEAR);
+        }, nullptr);
+        graph.compile();
+        return graph.getImage(scene);
+    };
+
+    VkImage first = declareFrame(EXTENT);
+    VkImage second = declareFrame(EXTENT);
+    CHECK(first == second);
+    CHECK(fake.imagesCreated == 1);
+    CHECK(fake.allocations == 1);
+
+    VkImage resized = declareFrame({128, 128});
+    CHECK(resized != first);
+    CHECK(fake.imagesCreated == 2);
+    CHECK(fake.imagesDestroyed == 1);
+    CHECK(fake.frees == 1);
+    graph.destroy();
+}
+
+int main() {
+    static const TestCase TESTS[] = {
+        {"culls unread passes", testCullsUnreadPasses},
+        {"culls chains", testCullsChains},
+        {"side effect keeps pass", testSideEffectKeepsPass},
+        {"aliases disjoint lifetimes", testAliasesDisjointLifetimes},
+        {"reuses transients across frames", testReusesTransientsAcrossFrames},
+    };
+    return runTests(TESTS);
+}
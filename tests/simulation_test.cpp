@@ -0,0 +1,116 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+
+#include "check.hpp"
+#include "simulation.hpp"
+#include "triple_buffer.hpp"
+
+// Both halves are written together, so a torn read shows up as a mismatch.
+struct Sample {
+    uint64_t sequence;
+    uint64_t check;
+};
+
+static void testTripleBufferHandoff() {
+    TripleBuffer<Sample> buffer;
+    CHECK(!buffer.update());
+    CHECK(buffer.front().sequence == 0);
+
+    buffer.back() = {1, ~uint64_t(1)};
+    buffer.publish();
+    CHECK(buffer.update());
+    CHECK(buffer.front().sequence == 1);
+    CHECK(!buffer.update());
+    CHECK(buffer.front().sequence == 1);
+
+    // Only the latest of several publishes is seen.
+    for (uint64_t i = 2; i <= 5; i++) {
+        buffer.back() = {i, ~i};
+        buffer.publish();
+    }
+    CHECK(buffer.update());
+    CHECK(buffer.front().sequence == 5);
+}
+
+static void testTripleBufferAcrossThreads() {
+    const uint64_t COUNT = 200000;
+    TripleBuffer<Sample> buffer;
+    std::thread writer([&]() {
+        for (uint64_t i = 1; i <= COUNT; i++) {
+            buffer.back() = {i, ~i};
+            buffer.publish();
+        }
+    });
+
+    uint64_t last = 0;
+    bool consistent = true;
+    bool ordered = true;
+    while (last < COUNT) {
+        if (!buffer.update()) {
+            std::this_thread::yield();
+            continue;
+        }
+        const Sample& sample = buffer.front();
+        consistent = consistent && sample.check == ~sample.sequence;
+        ordered = ordered && sample.sequence > last;
+        last = sample.sequence;
+    }
+    writer.join();
+    CHECK(consistent);
+    CHECK(ordered);
+}
+
+static void step(SimulationState& state, double deltaSeconds) {
+    state.modelAngle += static_cast<float>(deltaSeconds);
+}
+
+// Replaying a tick gives the same state whatever ticks were sampled before it.
+static void testSampleTickIsDeterministic() {
+    Simulation direct(60.0, step);
+    SimulationState jumped = direct.sampleTick(90, 0.25f);
+
+    Simulation stepped(60.0, step);
+    SimulationState state;
+    for (uint64_t tick = 0; tick <= 90; tick += 7) {
+        state = stepped.sampleTick(tick, 0.5f);
+    }
+    state = stepped.sampleTick(90, 0.25f);
+
+    CHECK(jumped.tick == 90);
+    CHECK(state.tick == jumped.tick);
+    CHECK(state.time == jumped.time);
+    CHECK(state.modelAngle == jumped.modelAngle);
+    // A quarter of the way from tick 89 to tick 90.
+    CHECK(std::abs(jumped.time - 89.25 / 60.0) < 1e-6);
+}
+
+static void testThreadPublishesTicks() {
+    Simulation simulation(1000.0, step);
+    simulation.start();
+    uint64_t lastTick = 0;
+    bool forward = true;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (lastTick < 20 && std::chrono::steady_clock::now() < deadline) {
+        float blend = -1.0f;
+        SimulationState state = simulation.sample(std::chrono::steady_clock::now(), &blend);
+        forward = forward && state.tick >= lastTick && blend >= 0.0f && blend <= 1.0f;
+        lastTick = state.tick;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    simulation.stop();
+    CHECK(forward);
+    CHECK(lastTick >= 20);
+}
+
+int main() {
+    static const TestCase TESTS[] = {
+        {"triple buffer handoff", testTripleBufferHandoff},
+        {"triple buffer across threads", testTripleBufferAcrossThreads},
+        {"sampleTick is deterministic", testSampleTickIsDeterministic},
+        {"simulation thread publishes ticks", testThreadPublishesTicks},
+    };
+    return runTests(TESTS);
+}
@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "check.hpp"
+#include "grid_ray.hpp"
+#include "spatial_hash_grid.hpp"
+#include "voxel_world.hpp"
+
+static Entity entityAt(uint32_t index) {
+    return Entity{index, 0};
+}
+
+static std::vector<uint32_t> queryIndices(const SpatialHashGrid& grid, const glm::vec3& min, const glm::vec3& max) {
+    std::vector<uint32_t> indices;
+    grid.queryBox(min, max, [&](Entity entity) {
+        indices.push_back(entity.index);
+    });
+    std::sort(indices.begin(), indices.end());
+    return indices;
+}
+
+static void testGridRayWalksCellsInOrder() {
+    GridRay ray(glm::vec3(0.5f, 0.5f, 0.5f), glm::normalize(glm::vec3(1.0f, 0.5f, 0.0f)), 1.0f);
+    CHECK(ray.cell == glm::ivec3(0, 0, 0));
+    CHECK(ray.entryNormal() == glm::ivec3(0, 0, 0));
+
+    // Leaves through x = 1 before y = 1.
+    ray.advance();
+    CHECK(ray.cell == glm::ivec3(1, 0, 0));
+    CHECK(ray.entryNormal() == glm::ivec3(-1, 0, 0));
+    ray.advance();
+    CHECK(ray.cell == glm::ivec3(1, 1, 0));
+    CHECK(ray.entryNormal() == glm::ivec3(0, -1, 0));
+    ray.advance();
+    CHECK(ray.cell == glm::ivec3(2, 1, 0));
+
+    GridRay back(glm::vec3(-0.5f, 2.5f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), 2.0f);
+    CHECK(back.cell == glm::ivec3(-1, 1, 0));
+    CHECK(std::fabs(back.exitDistance() - 1.5f) < 1e-6f);
+    back.advance();
+    CHECK(back.cell == glm::ivec3(-2, 1, 0));
+    CHECK(back.entryNormal() == glm::ivec3(1, 0, 0));
+    CHECK(std::fabs(back.t - 1.5f) < 1e-6f);
+}
+
+static void testQueryReportsEachEntityOnce() {
+    SpatialHashGrid grid(1.0f);
+    // Spans many cells.
+    grid.insert(entityAt(0), glm::vec3(0.0f), glm::vec3(5.5f));
+    grid.insert(entityAt(1), glm::vec3(10.0f), glm::vec3(10.5f));
+    grid.insert(entityAt(2), glm::vec3(-3.0f), glm::vec3(-2.5f));
+    grid.commit();
+
+    CHECK((queryIndices(grid, glm::vec3(-1.0f), glm::vec3(6.0f)) == std::vector<uint32_t>{0}));
+    CHECK((queryIndices(grid, glm::vec3(-4.0f), glm::vec3(11.0f)) == std::vector<uint32_t>{0, 1, 2}));
+    CHECK(queryIndices(grid, glm::vec3(6.0f), glm::vec3(9.0f)).empty());
+}
+
+static void testUpdatesAndRemoval() {
+    SpatialHashGrid grid(4.0f);
+    grid.insert(entityAt(0), glm::vec3(0.0f), glm::vec3(1.0f));
+    grid.insert(entityAt(1), glm::vec3(20.0f), glm::vec3(21.0f));
+    grid.commit();
+
+    // Within the same cell, a move shows without a commit.
+    grid.update(entityAt(0), glm::vec3(2.0f), glm::vec3(3.0f));
+    CHECK(queryIndices(grid, glm::vec3(0.0f), glm::vec3(1.0f)).empty());
+    CHECK((queryIndices(grid, glm::vec3(2.5f), glm::vec3(2.6f)) == std::vector<uint32_t>{0}));
+
+    // Into other cells, it shows after the commit.
+    grid.update(entityAt(0), glm::vec3(40.0f), glm::vec3(41.0f));
+    grid.commit();
+    CHECK((queryIndices(grid, glm::vec3(39.0f), glm::vec3(42.0f)) == std::vector<uint32_t>{0}));
+    CHECK(queryIndices(grid, glm::vec3(0.0f), glm::vec3(4.0f)).empty());
+
+    grid.remove(entityAt(1));
+    grid.commit();
+    CHECK(!grid.contains(entityAt(1)));
+    CHECK(grid.contains(entityAt(0)));
+    CHECK(grid.size() == 1);
+    CHECK(queryIndices(grid, glm::vec3(19.0f), glm::vec3(22.0f)).empty());
+}
+
+// Until the next commit, the table still lists the removed entity's cells.
+static void testQueriesBetweenRemoveAndCommit() {
+    SpatialHashGrid grid(2.0f);
+    grid.insert(entityAt(0), glm::vec3(5.0f, -1.0f, -1.0f), glm::vec3(6.0f, 1.0f, 1.0f));
+    grid.insert(entityAt(1), glm::vec3(10.0f, -1.0f, -1.0f), glm::vec3(11.0f, 1.0f, 1.0f));
+    grid.insert(entityAt(2), glm::vec3(20.0f, -1.0f, -1.0f), glm::vec3(21.0f, 1.0f, 1.0f));
+    grid.commit();
+
+    // The first and the last record.
+    grid.remove(entityAt(0));
+    grid.remove(entityAt(2));
+    CHECK(grid.size() == 1);
+    CHECK(!grid.contains(entityAt(0)));
+    CHECK((queryIndices(grid, glm::vec3(0.0f, -2.0f, -2.0f), glm::vec3(30.0f, 2.0f, 2.0f)) == std::vector<uint32_t>{1}));
+    CHECK(queryIndices(grid, glm::vec3(19.0f, -2.0f, -2.0f), glm::vec3(22.0f, 2.0f, 2.0f)).empty());
+    CHECK(grid.raycast(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 100.0f).entity == entityAt(1));
+    CHECK(grid.raycast(glm::vec3(30.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), 25.0f).entity == entityAt(1));
+
+    grid.commit();
+    CHECK(grid.size() == 1);
+    CHECK((queryIndices(grid, glm::vec3(0.0f, -2.0f, -2.0f), glm::vec3(30.0f, 2.0f, 2.0f)) == std::vector<uint32_t>{1}));
+    CHECK(grid.raycast(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 100.0f).entity == entityAt(1));
+}
+
+// A destroyed entity whose index is reused replaces the stale record.
+static void testReusedIndexReplacesStaleEntity() {
+    SpatialHashGrid grid(2.0f);
+    grid.insert(Entity{0, 0}, glm::vec3(0.0f), glm::vec3(1.0f));
+    grid.commit();
+
+    grid.insert(Entity{0, 1}, glm::vec3(10.0f), glm::vec3(11.0f));
+    CHECK(!grid.contains(Entity{0, 0}));
+    CHECK(grid.contains(Entity{0, 1}));
+    CHECK(grid.size() == 1);
+    grid.commit();
+
+    std::vector<Entity> found;
+    grid.queryBox(glm::vec3(-1.0f), glm::vec3(12.0f), [&](Entity entity) {
+        found.push_back(entity);
+    });
+    CHECK(found.size() == 1 && found[0] == (Entity{0, 1}));
+
+    grid.remove(Entity{0, 1});
+    grid.commit();
+    CHECK(grid.size() == 0);
+    CHECK(queryIndices(grid, glm::vec3(-1.0f), glm::vec3(12.0f)).empty());
+}
+
+static void testRaycastFindsNearest() {
+    SpatialHashGrid grid(2.0f);
+    grid.insert(entityAt(0), glm::vec3(10.0f, -1.0f, -1.0f), glm::vec3(11.0f, 1.0f, 1.0f));
+    grid.insert(entityAt(1), glm::vec3(5.0f, -1.0f, -1.0f), glm::vec3(6.0f, 1.0f, 1.0f));
+    grid.insert(entityAt(2), glm::vec3(5.0f, 5.0f, 5.0f), glm::vec3(6.0f, 6.0f, 6.0f));
+    grid.commit();
+
+    SpatialRayHit hit = grid.raycast(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 100.0f);
+    CHECK(hit.entity == entityAt(1));
+    CHECK(std::fabs(hit.distance - 5.0f) < 1e-5f);
+
+    CHECK(grid.raycast(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 4.0f).entity == NULL_ENTITY);
+    CHECK(grid.raycast(glm::vec3(0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), 100.0f).entity == NULL_ENTITY);
+}
+
+// Random boxes and queries against a scan of every box.
+static void testMatchesLinearScan() {
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const uint32_t COUNT = 2000;
+    const float SIDE = 60.0f;
+
+    SpatialHashGrid grid(3.0f);
+    std::vector<glm::vec3> mins(COUNT);
+    std::vector<glm::vec3> maxs(COUNT);
+    for (uint32_t i = 0; i < COUNT; i++) {
+        mins[i] = glm::vec3(unit(random), unit(random), unit(random)) * SIDE - SIDE * 0.5f;
+        maxs[i] = mins[i] + glm::vec3(0.5f + unit(random) * 4.0f);
+        grid.insert(entityAt(i), mins[i], maxs[i]);
+    }
+    grid.commit();
+
+    for (int query = 0; query < 200; query++) {
+        glm::vec3 min = glm::vec3(unit(random), unit(random), unit(random)) * SIDE - SIDE * 0.5f;
+        glm::vec3 max = min + glm::vec3(unit(random) * 10.0f);
+        std::vector<uint32_t> expected;
+        for (uint32_t i = 0; i < COUNT; i++) {
+            if (mins[i].x <= max.x && maxs[i].x >= min.x && mins[i].y <= max.y && maxs[i].y >= min.y && mins[i].z <= max.z && maxs[i].z >= min.z) {
+                expected.push_back(i);
+            }
+        }
+        CHECK(queryIndices(grid, min, max) == expected);
+    }
+}
+
+static void testVoxelRaycast() {
+    VoxelWorld world;
+    CHECK(!world.raycast(glm::vec3(0.5f), glm::vec3(1.0f, 0.0f, 0.0f), 100.0f).hit);
+
+    // Across a chunk border, in negative coordinates.
+    world.setBlock(glm::ivec3(-40, 3, 7), 1);
+    world.setBlock(glm::ivec3(-45, 3, 7), 1);
+    VoxelHit hit = world.raycast(glm::vec3(0.5f, 3.5f, 7.5f), glm::vec3(-1.0f, 0.0f, 0.0f), 100.0f);
+    CHECK(hit.hit);
+    CHECK(hit.block == glm::ivec3(-40, 3, 7));
+    CHECK(hit.normal == glm::ivec3(1, 0, 0));
+    CHECK(std::fabs(hit.distance - 39.5f) < 1e-4f);
+
+    CHECK(!world.raycast(glm::vec3(0.5f, 3.5f, 7.5f), glm::vec3(-1.0f, 0.0f, 0.0f), 30.0f).hit);
+
+    // Straight down onto a floor.
+    for (int x = -2; x <= 2; x++) {
+        for (int y = -2; y <= 2; y++) {
+            world.setBlock(glm::ivec3(x, y, -1), 1);
+        }
+    }
+    hit = world.raycast(glm::vec3(0.2f, 0.7f, 50.0f), glm::vec3(0.0f, 0.0f, -3.0f), 100.0f);
+    CHECK(hit.hit);
+    CHECK(hit.block == glm::ivec3(0, 0, -1));
+    CHECK(hit.normal == glm::ivec3(0, 0, 1));
+    CHECK(std::fabs(hit.distance - 50.0f) < 1e-4f);
+}
+
+int main() {
+    static const TestCase TESTS[] = {
+        {"grid ray walks cells in order", testGridRayWalksCellsInOrder},
+        {"box query reports each entity once", testQueryReportsEachEntityOnce},
+        {"updates and removal", testUpdatesAndRemoval},
+        {"queries between remove and commit", testQueriesBetweenRemoveAndCommit},
+        {"reused index replaces stale entity", testReusedIndexReplacesStaleEntity},
+        {"raycast finds the nearest entity", testRaycastFindsNearest},
+        {"box queries match a linear scan", testMatchesLinearScan},
+        {"voxel raycast", testVoxelRaycast},
+    };
+    return runTests(TESTS);
+}
@@ -0,0 +1,116 @@
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+#include "check.hpp"
+#include "job_system.hpp"
+#include "terrain_lod.hpp"
+#include "voxel_light.hpp"
+#include "voxel_world.hpp"
+
+// With a projection scale of 1000 and 4 pixels allowed, LOD n is within the
+// error from 1000 (2^n - 1) / 4 blocks away: 250 for LOD 1, 750 for LOD 2 and
+// 1750 for LOD 3.
+static const float SCALE = 1000.0f;
+static const float MAX_ERROR = 4.0f;
+
+static void testSelectLodByDistance() {
+    const uint32_t FRESH = TerrainLod::MAX_LOD;
+    CHECK(TerrainLod::selectLod(FRESH, 10.0f, SCALE, MAX_ERROR) == 0);
+    CHECK(TerrainLod::selectLod(FRESH, 249.0f, SCALE, MAX_ERROR) == 0);
+    CHECK(TerrainLod::selectLod(FRESH, 251.0f, SCALE, MAX_ERROR) == 1);
+    CHECK(TerrainLod::selectLod(FRESH, 800.0f, SCALE, MAX_ERROR) == 2);
+    CHECK(TerrainLod::selectLod(FRESH, 5000.0f, SCALE, MAX_ERROR) == 3);
+
+    uint32_t previous = 0;
+    for (float distance = 0.0f; distance < 4000.0f; distance += 10.0f) {
+        uint32_t lod = TerrainLod::selectLod(FRESH, distance, SCALE, MAX_ERROR);
+        CHECK(lod >= previous);
+        previous = lod;
+    }
+}
+
+static void testSelectLodHysteresis() {
+    // Coarsening waits until the coarser level is a quarter under the error,
+    // past 333 blocks for LOD 1.
+    CHECK(TerrainLod::selectLod(0, 300.0f, SCALE, MAX_ERROR) == 0);
+    CHECK(TerrainLod::selectLod(0, 340.0f, SCALE, MAX_ERROR) == 1);
+    // Refining does not wait.
+    CHECK(TerrainLod::selectLod(1, 240.0f, SCALE, MAX_ERROR) == 0);
+    // Between the two, the current level stays.
+    CHECK(TerrainLod::selectLod(1, 300.0f, SCALE, MAX_ERROR) == 1);
+}
+
+static void waitForMeshes(TerrainLod& lod, const VoxelWorld& world, const VoxelLight& light, const glm::vec3& camera, float projectionScale) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    do {
+        lod.update(world, light, camera, projectionScale);
+        std::this_thread::yield();
+    } while (lod.getStatistics().pending > 0 && std::chrono::steady_clock::now() < deadline);
+    lod.update(world, light, camera, projectionScale);
+}
+
+static std::unordered_map<int, uint64_t> serialsByX(const TerrainLod& lod) {
+    std::unordered_map<int, uint64_t> serials;
+    lod.forEachMesh([&](const ChunkCoord& coord, const ChunkMesh&, uint64_t serial) {
+        serials[coord.x] = serial;
+    });
+    return serials;
+}
+
+// A row of single-chunk slabs along x, meshed from a camera at its start.
+static void testMeshesFollowEdits() {
+    JobSystem jobSystem(1);
+    VoxelWorld world;
+    const int CHUNKS = 6;
+    for (int chunk = 0; chunk < CHUNKS; chunk++) {
+        for (int y = 0; y < Chunk::SIZE; y++) {
+            for (int x = 0; x < Chunk::SIZE; x++) {
+                for (int z = 0; z < 4; z++) {
+                    world.setBlock(glm::ivec3(chunk * Chunk::SIZE + x, y, z), 1);
+                }
+            }
+        }
+    }
+    VoxelLight light(jobSystem);
+    light.build(world);
+
+    // Close enough for every chunk, with LOD rising along the row.
+    TerrainLod lod(jobSystem, 1000.0f, 2.0f);
+    glm::vec3 camera(0.0f, 16.0f, 20.0f);
+    waitForMeshes(lod, world, light, camera, 100.0f);
+
+    TerrainLodStatistics statistics = lod.getStatistics();
+    CHECK(statistics.chunks == CHUNKS);
+    CHECK(statistics.pending == 0);
+    CHECK(statistics.triangles > 0);
+    CHECK(statistics.chunksPerLod[0] > 0);
+    CHECK(statistics.chunksPerLod[0] < CHUNKS);
+
+    // Editing one chunk rebuilds it and leaves chunks that do not border it.
+    std::unordered_map<int, uint64_t> before = serialsByX(lod);
+    light.setBlock(world, glm::ivec3(2 * Chunk::SIZE + 5, 5, 3), AIR);
+    light.beginUpdate();
+    light.endUpdate();
+    waitForMeshes(lod, world, light, camera, 100.0f);
+    std::unordered_map<int, uint64_t> after = serialsByX(lod);
+    CHECK(after[2] != before[2]);
+    CHECK(after[0] == before[0]);
+    CHECK(after[5] == before[5]);
+
+    // Without LOD, everything is remeshed at full detail.
+    lod.setLodEnabled(false);
+    waitForMeshes(lod, world, light, camera, 100.0f);
+    CHECK(lod.getStatistics().chunksPerLod[0] == CHUNKS);
+}
+
+int main() {
+    static const TestCase TESTS[] = {
+        {"selectLod by distance", testSelectLodByDistance},
+        {"selectLod hysteresis", testSelectLodHysteresis},
+        {"meshes follow edits", testMeshesFollowEdits},
+    };
+    return runTests(TESTS);
+}
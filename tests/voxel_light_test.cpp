@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include <glm/glm.hpp>
+
+#include "check.hpp"
+#include "job_system.hpp"
+#include "voxel_light.hpp"
+#include "voxel_world.hpp"
+
+static const BlockId STONE = 1;
+static const BlockId LAMP = 2;
+static const uint8_t LAMP_LEVEL = 14;
+
+// A solid chunk with a sealed 9x9x9 cave in its middle, centered on CAVE, and a
+// second solid chunk far away.
+static const glm::ivec3 CAVE(16, 16, 16);
+static const ChunkCoord FAR_CHUNK = {4, 0, 0};
+
+static void buildWorld(VoxelWorld& world) {
+    for (const ChunkCoord& coord : {ChunkCoord{0, 0, 0}, FAR_CHUNK}) {
+        glm::ivec3 origin = VoxelWorld::chunkOrigin(coord);
+        for (int z = 0; z < Chunk::SIZE; z++) {
+            for (int y = 0; y < Chunk::SIZE; y++) {
+                for (int x = 0; x < Chunk::SIZE; x++) {
+                    world.setBlock(origin + glm::ivec3(x, y, z), STONE);
+                }
+            }
+        }
+    }
+    for (int z = -4; z <= 4; z++) {
+        for (int y = -4; y <= 4; y++) {
+            for (int x = -4; x <= 4; x++) {
+                world.setBlock(CAVE + glm::ivec3(x, y, z), AIR);
+            }
+        }
+    }
+}
+
+static uint8_t sky(const VoxelLight& light, const glm::ivec3& block) {
+    return VoxelLight::level(light.getLight(block), VoxelLight::SKY);
+}
+
+static uint8_t blockLight(const VoxelLight& light, const glm::ivec3& block) {
+    return VoxelLight::level(light.getLight(block), VoxelLight::BLOCK);
+}
+
+static void edit(VoxelWorld& world, VoxelLight& light, const glm::ivec3& block, BlockId id) {
+    light.setBlock(world, block, id);
+    light.beginUpdate();
+    light.endUpdate();
+}
+
+// Incremental relighting must end where lighting the edited world from scratch does.
+static bool matchesFreshBuild(JobSystem& jobSystem, const VoxelWorld& world, const VoxelLight& light) {
+    VoxelLight fresh(jobSystem);
+    fresh.setEmission(LAMP, LAMP_LEVEL);
+    fresh.build(world);
+    bool same = true;
+    world.forEachChunk([&](const ChunkCoord& coord, const Chunk&) {
+        const ChunkLight *kept = light.findChunk(coord);
+        same = same && kept != nullptr && kept->values == fresh.findChunk(coord)->values;
+    });
+    return same;
+}
+
+static void testOpenAirAndSealedCave() {
+    JobSystem jobSystem(1);
+    VoxelWorld world;
+    buildWorld(world);
+    VoxelLight light(jobSystem);
+    light.setEmission(LAMP, LAMP_LEVEL);
+    light.build(world);
+
+    CHECK(light.getLight(glm::ivec3(0, 0, 100)) == VoxelLight::OUTSIDE);
+    CHECK(sky(light, CAVE) == 0);
+    CHECK(blockLight(light, CAVE) == 0);
+    CHECK(light.getLight(glm::ivec3(3, 3, 3)) == 0);
+}
+
+static void testLampFallsOffWithDistance() {
+    JobSystem jobSystem(1);
+    VoxelWorld world;
+    buildWorld(world);
+    VoxelLight light(jobSystem);
+    light.setEmission(LAMP, LAMP_LEVEL);
+    light.build(world);
+
+    edit(world, light, CAVE, LAMP);
+    CHECK(blockLight(light, CAVE) == LAMP_LEVEL);
+    CHECK(blockLight(light, CAVE + glm::ivec3(1, 0, 0)) == LAMP_LEVEL - 1);
+    CHECK(blockLight(light, CAVE + glm::ivec3(0, -3, 0)) == LAMP_LEVEL - 3);
+    CHECK(blockLight(light, CAVE + glm::ivec3(2, 2, 2)) == LAMP_LEVEL - 6);
+    // Solid rock around the cave stays dark.
+    CHECK(blockLight(light, CAVE + glm::ivec3(6, 0, 0)) == 0);
+    CHECK(sky(light, CAVE) == 0);
+    CHECK(matchesFreshBuild(jobSystem, world, light));
+
+    edit(world, light, CAVE, AIR);
+    CHECK(blockLight(light, CAVE + glm::ivec3(1, 0, 0)) == 0);
+    CHECK(matchesFreshBuild(jobSystem, world, light));
+}
+
+static void testShaftLetsSkyIn() {
+    JobSystem jobSystem(1);
+    VoxelWorld world;
+    buildWorld(world);
+    VoxelLight light(jobSystem);
+    light.setEmission(LAMP, LAMP_LEVEL);
+    light.build(world);
+    uint32_t farRevision = light.getRevision(FAR_CHUNK);
+    uint32_t caveRevision = light.getRevision({0, 0, 0});
+
+    // Full sky light runs straight down the shaft to the cave floor and
+    // spreads sideways from there.
+    for (int z = Chunk::MASK; z > CAVE.z + 4; z--) {
+        edit(world, light, glm::ivec3(CAVE.x, CAVE.y, z), AIR);
+    }
+    glm::ivec3 floor(CAVE.x, CAVE.y, CAVE.z - 4);
+    CHECK(sky(light, floor) == VoxelLight::MAX_LIGHT);
+    CHECK(sky(light, floor + glm::ivec3(2, 0, 0)) == VoxelLight::MAX_LIGHT - 2);
+    CHECK(matchesFreshBuild(jobSystem, world, light));
+    CHECK(light.getRevision({0, 0, 0}) != caveRevision);
+    CHECK(light.getRevision(FAR_CHUNK) == farRevision);
+
+    // Sealing the top takes it all away again.
+    edit(world, light, glm::ivec3(CAVE.x, CAVE.y, Chunk::MASK), STONE);
+    CHECK(sky(light, floor) == 0);
+    CHECK(sky(light, glm::ivec3(CAVE.x, CAVE.y, Chunk::MASK - 1)) == 0);
+    CHECK(matchesFreshBuild(jobSystem, world, light));
+}
+
+static void testRandomEditsMatchFreshBuild() {
+    JobSystem jobSystem(1);
+    VoxelWorld world;
+    const int HALF = Chunk::SIZE;
+    for (int y = -HALF; y < HALF; y++) {
+        for (int x = -HALF; x < HALF; x++) {
+            int height = 20 + static_cast<int>(6.0f * std::sin(x * 0.2f) + 6.0f * std::cos(y * 0.15f));
+            for (int z = 0; z < height; z++) {
+                world.setBlock(glm::ivec3(x, y, z), z == 8 && x % 8 == 0 && y % 8 == 0 ? LAMP : STONE);
+            }
+        }
+    }
+    VoxelLight light(jobSystem);
+    light.setEmission(LAMP, LAMP_LEVEL);
+    light.build(world);
+
+    std::mt19937 random(3);
+    for (int i = 0; i < 200; i++) {
+        glm::ivec3 block(static_cast<int>(random() % (2 * HALF)) - HALF, static_cast<int>(random() % (2 * HALF)) - HALF, static_cast<int>(random() % 30));
+        BlockId id = i % 3 == 0 ? STONE : (i % 11 == 0 ? LAMP : AIR);
+        light.setBlock(world, block, id);
+        // Several edits relit as one batch, every few edits.
+        if (i % 4 == 3) {
+            light.beginUpdate();
+            light.endUpdate();
+        }
+    }
+    light.beginUpdate();
+    light.endUpdate();
+    CHECK(matchesFreshBuild(jobSystem, world, light));
+}
+
+// Edits further apart than their fills reach are relit on jobs of their own,
+// and nearby ones together, in order.
+static void testDistantEditsRelightInParallel() {
+    JobSystem jobSystem(4);
+    VoxelWorld world;
+    buildWorld(world);
+    VoxelLight light(jobSystem);
+    light.setEmission(LAMP, LAMP_LEVEL);
+    light.build(world);
+
+    glm::ivec3 farTop = VoxelWorld::chunkOrigin(FAR_CHUNK) + glm::ivec3(16, 16, Chunk::MASK);
+    light.setBlock(world, CAVE, LAMP);
+    light.setBlock(world, farTop, AIR);
+    light.beginUpdate();
+    light.endUpdate();
+    CHECK(light.getStatistics().edits == 2);
+    CHECK(light.getStatistics().jobs == 2);
+    CHECK(blockLight(light, CAVE + glm::ivec3(1, 0, 0)) == LAMP_LEVEL - 1);
+    CHECK(sky(light, farTop) == VoxelLight::MAX_LIGHT);
+
+    // The lamp is put out before the block next to it is lit.
+    light.setBlock(world, CAVE, AIR);
+    light.setBlock(world, CAVE + glm::ivec3(1, 0, 0), LAMP);
+    light.beginUpdate();
+    light.endUpdate();
+    CHECK(light.getStatistics().jobs == 1);
+    CHECK(blockLight(light, CAVE) == LAMP_LEVEL - 1);
+    CHECK(matchesFreshBuild(jobSystem, world, light));
+}
+
+static void testWideRandomBatchesMatchFreshBuild() {
+    JobSystem jobSystem(4);
+    VoxelWorld world;
+    const int HALF = 3 * Chunk::SIZE;
+    for (int y = -HALF; y < HALF; y++) {
+        for (int x = -HALF; x < HALF; x++) {
+            int height = 20 + static_cast<int>(6.0f * std::sin(x * 0.2f) + 6.0f * std::cos(y * 0.15f));
+            for (int z = 0; z < height; z++) {
+                world.setBlock(glm::ivec3(x, y, z), z == 8 && x % 8 == 0 && y % 8 == 0 ? LAMP : STONE);
+            }
+        }
+    }
+    VoxelLight light(jobSystem);
+    light.setEmission(LAMP, LAMP_LEVEL);
+    light.build(world);
+
+    std::mt19937 random(5);
+    uint32_t mostJobs = 0;
+    for (int i = 0; i < 400; i++) {
+        glm::ivec3 block(static_cast<int>(random() % (2 * HALF)) - HALF, static_cast<int>(random() % (2 * HALF)) - HALF, static_cast<int>(random() % 30));
+        BlockId id = i % 3 == 0 ? STONE : (i % 11 == 0 ? LAMP : AIR);
+        light.setBlock(world, block, id);
+        if (i % 16 == 15) {
+            light.beginUpdate();
+            light.endUpdate();
+            mostJobs = std::max(mostJobs, light.getStatistics().jobs);
+        }
+    }
+    CHECK(mostJobs > 1);
+    CHECK(matchesFreshBuild(jobSystem, world, light));
+}
+
+int main() {
+    static const TestCase TESTS[] = {
+        {"open air and a sealed cave", testOpenAirAndSealedCave},
+        {"lamp light falls off with distance", testLampFallsOffWithDistance},
+        {"a shaft lets sky light in", testShaftLetsSkyIn},
+        {"random edits match a fresh build", testRandomEditsMatchFreshBuild},
+        {"distant edits relight in parallel", testDistantEditsRelightInParallel},
+        {"wide random batches match a fresh build", testWideRandomBatchesMatchFreshBuild},
+    };
+    return runTests(TESTS);
+}
@@ -0,0 +1,638 @@
+// CPU benchmarks of the engine's hot kernels, each timed against the plain
+// version it replaced on the same data, with the results compared so that a
+// faster kernel cannot hide a wrong one.
+//
+// Usage: dig_bench [section]...
+// Runs the named sections, or all of them. Times are the mean over a number of
+// repeats after one warm-up run.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "job_system.hpp"
+#include "particle_system.hpp"
+#include "simd_math.hpp"
+#include "spatial_hash_grid.hpp"
+#include "voxel_light.hpp"
+#include "voxel_world.hpp"
+
+using BenchClock = std::chrono::steady_clock;
+
+template <typename Function>
+static double timeMilliseconds(int repeats, Function&& function) {
+    function();
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < repeats; i++) {
+        function();
+    }
+    return std::chrono::duration<double, std::milli>(BenchClock::now() - start).count() / repeats;
+}
+
+static void printRow(const std::string& label, double milliseconds, double baselineMilliseconds) {
+    char line[160];
+    std::snprintf(line, sizeof(line), "  %-34s %9.3f ms  %9.3f ms  %5.1fx", label.c_str(), baselineMilliseconds, milliseconds, baselineMilliseconds / milliseconds);
+    std::cout << line << std::endl;
+}
+
+static void check(bool condition, const std::string& what) {
+    if (!condition) {
+        throw std::runtime_error("Mismatch against the baseline: " + what);
+    }
+}
+
+// The scalar path multiplyMatrices takes on architectures without SSE2.
+static void multiplyMatricesScalar(const float *left, const float *right, size_t count, float *out) {
+    for (size_t i = 0; i < count; i++) {
+        const float *r = right + i * 16;
+        float *o = out + i * 16;
+        for (int column = 0; column < 4; column++) {
+            for (int row = 0; row < 4; row++) {
+                o[column * 4 + row] = left[row] * r[column * 4] + left[4 + row] * r[column * 4 + 1] + left[8 + row] * r[column * 4 + 2] + left[12 + row] * r[column * 4 + 3];
+            }
+        }
+    }
+}
+
+static float maxRelativeError(const std::vector<float>& values, const std::vector<float>& reference) {
+    float error = 0.0f;
+    for (size_t i = 0; i < values.size(); i++) {
+        error = std::max(error, std::fabs(values[i] - reference[i]) / (1.0f + std::fabs(reference[i])));
+    }
+    return error;
+}
+
+// SIMD math kernels against their ScalarLanes instantiations, which is what
+// every build runs for the remainder of a stream.
+static void benchSimdMath() {
+    const size_t COUNT = 100000;
+    const int REPEATS = 50;
+    // FMA and the scalar path round differently.
+    const float TOLERANCE = 1e-5f;
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    std::vector<float> px(COUNT), py(COUNT), pz(COUNT), qx(COUNT), qy(COUNT), qz(COUNT), qw(COUNT), sx(COUNT), sy(COUNT), sz(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        float q[4] = {unit(random), unit(random), unit(random), unit(random)};
+        float length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+        px[i] = unit(random) * 50.0f;
+        py[i] = unit(random) * 50.0f;
+        pz[i] = unit(random) * 50.0f;
+        qx[i] = q[0] / length;
+        qy[i] = q[1] / length;
+        qz[i] = q[2] / length;
+        qw[i] = q[3] / length;
+        sx[i] = 1.0f + unit(random) * 0.5f;
+        sy[i] = 1.0f + unit(random) * 0.5f;
+        sz[i] = 1.0f + unit(random) * 0.5f;
+    }
+    TransformStreams transforms = {px.data(), py.data(), pz.data(), qx.data(), qy.data(), qz.data(), qw.data(), sx.data(), sy.data(), sz.data()};
+
+    std::cout << "simd: " << COUNT << " objects, " << SimdLanes::WIDTH << " lanes" << std::endl;
+    std::cout << "  kernel                               scalar        simd   speedup" << std::endl;
+
+    std::vector<float> matrices(COUNT * 16), reference(COUNT * 16);
+    double scalar = timeMilliseconds(REPEATS, [&] {
+        composeTransformRange<ScalarLanes>(transforms, 0, COUNT, reference.data());
+    });
+    double simd = timeMilliseconds(REPEATS, [&] {
+        composeTransforms(transforms, COUNT, matrices.data());
+    });
+    check(maxRelativeError(matrices, reference) <= TOLERANCE, "composeTransforms");
+    printRow("compose TRS", simd, scalar);
+
+    float viewProjection[16];
+    for (float& value : viewProjection) {
+        value = unit(random);
+    }
+    std::vector<float> products(COUNT * 16), referenceProducts(COUNT * 16);
+    scalar = timeMilliseconds(REPEATS, [&] {
+        multiplyMatricesScalar(viewProjection, matrices.data(), COUNT, referenceProducts.data());
+    });
+    simd = timeMilliseconds(REPEATS, [&] {
+        multiplyMatrices(viewProjection, matrices.data(), COUNT, products.data());
+    });
+    check(maxRelativeError(products, referenceProducts) <= TOLERANCE, "multiplyMatrices");
+    printRow("multiply matrices", simd, scalar);
+
+    // A 60 degree camera at the origin looking down -z, with boxes scattered
+    // around it so that a few percent are visible.
+    float focal = 1.0f / std::tan(0.5236f);
+    float nearPlane = 0.1f;
+    float farPlane = 100.0f;
+    float projection[16] = {
+        focal / 1.333f, 0.0f, 0.0f, 0.0f,
+        0.0f, -focal, 0.0f, 0.0f,
+        0.0f, 0.0f, farPlane / (nearPlane - farPlane), -1.0f,
+        0.0f, 0.0f, farPlane * nearPlane / (nearPlane - farPlane), 0.0f
+    };
+    FrustumPlanes frustum = extractFrustumPlanes(projection);
+
+    std::vector<float> cx(COUNT), cy(COUNT), cz(COUNT), ex(COUNT), ey(COUNT), ez(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        cx[i] = unit(random) * 150.0f;
+        cy[i] = unit(random) * 150.0f;
+        cz[i] = unit(random) * 150.0f;
+        ex[i] = 1.0f + std::fabs(unit(random));
+        ey[i] = 1.0f + std::fabs(unit(random));
+        ez[i] = 1.0f + std::fabs(unit(random));
+    }
+    BoundsStreams bounds = {cx.data(), cy.data(), cz.data(), ex.data(), ey.data(), ez.data()};
+
+    std::vector<uint32_t> visible(COUNT), referenceVisible(COUNT);
+    size_t visibleCount = 0;
+    size_t referenceCount = 0;
+    scalar = timeMilliseconds(REPEATS, [&] {
+        referenceCount = cullBoundsRange<ScalarLanes>(bounds, 0, COUNT, frustum, referenceVisible.data());
+    });
+    simd = timeMilliseconds(REPEATS, [&] {
+        visibleCount = cullBounds(bounds, COUNT, frustum, visible.data());
+    });
+    check(visibleCount == referenceCount && std::equal(visible.begin(), visible.begin() + visibleCount, referenceVisible.begin()), "cullBounds");
+    printRow("frustum cull (" + std::to_string(visibleCount) + " visible)", simd, scalar);
+}
+
+// JobSystem scaling: a fork-join parallelFor over a large array against a plain
+// loop, and the throughput of many jobs too small to amortize scheduling, at a
+// range of thread counts. Counts above the core count show how it oversubscribes.
+static void benchJobSystem() {
+    const size_t COUNT = 1 << 22;
+    const int REPEATS = 10;
+    const int SMALL_JOBS = 100000;
+    const int SMALL_JOB_WAVE = 1000;
+
+    std::vector<float> input(COUNT), output(COUNT), reference(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        input[i] = static_cast<float>(i) * 0.001f;
+    }
+    auto transform = [&](size_t first, size_t last, std::vector<float>& out) {
+        for (size_t i = first; i < last; i++) {
+            out[i] = std::sqrt(input[i]) * std::sin(input[i]);
+        }
+    };
+
+    double serial = timeMilliseconds(REPEATS, [&] {
+        transform(0, COUNT, reference);
+    });
+
+    std::vector<unsigned> threadCounts = {1, 2, 4, 8};
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    if (std::find(threadCounts.begin(), threadCounts.end(), cores) == threadCounts.end()) {
+        threadCounts.push_back(cores);
+        std::sort(threadCounts.begin(), threadCounts.end());
+    }
+
+    std::cout << "jobs: " << COUNT << " element parallelFor, " << SMALL_JOBS << " small jobs, " << cores << " cores" << std::endl;
+    char line[160];
+    std::snprintf(line, sizeof(line), "  serial loop %.3f ms", serial);
+    std::cout << line << std::endl;
+    std::cout << "  threads  parallelFor   speedup   small jobs/ms" << std::endl;
+
+    for (unsigned threads : threadCounts) {
+        JobSystem jobSystem(threads - 1);
+        size_t batchSize = jobSystem.batchSizeFor(COUNT, 1024);
+        double parallel = timeMilliseconds(REPEATS, [&] {
+            jobSystem.parallelFor(0, COUNT, batchSize, [&](size_t first, size_t last) {
+                transform(first, last, output);
+            });
+        });
+        check(output == reference, "parallelFor with " + std::to_string(threads) + " threads");
+
+        std::atomic<uint64_t> sum{0};
+        double small = timeMilliseconds(1, [&] {
+            // In waves that fit a deque, so that no job runs inline on a full one.
+            for (int wave = 0; wave < SMALL_JOBS; wave += SMALL_JOB_WAVE) {
+                JobCounter counter;
+                for (int i = wave; i < std::min(wave + SMALL_JOB_WAVE, SMALL_JOBS); i++) {
+                    jobSystem.run([&sum, i]() {
+                        sum.fetch_add(static_cast<uint64_t>(i), std::memory_order_relaxed);
+                    }, counter);
+                }
+                jobSystem.wait(counter);
+            }
+        });
+        check(sum.load() == 2 * static_cast<uint64_t>(SMALL_JOBS) * (SMALL_JOBS - 1) / 2, "small jobs with " + std::to_string(threads) + " threads");
+
+        std::snprintf(line, sizeof(line), "  %7u  %8.3f ms  %7.2fx  %14.0f", threads, parallel, serial / parallel, SMALL_JOBS / small);
+        std::cout << line << std::endl;
+    }
+}
+
+struct BenchBox {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// Ray against box by slabs, as the grid does it, for the linear scan.
+static bool rayHitsBox(const BenchBox& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& distance) {
+    glm::vec3 t0 = (box.min - origin) * inverseDirection;
+    glm::vec3 t1 = (box.max - origin) * inverseDirection;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+    float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+    float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+    if (enter > exit || enter >= maxDistance) {
+        return false;
+    }
+    distance = enter;
+    return true;
+}
+
+// The per-block walk VoxelWorld::raycast replaced.
+static VoxelHit raycastBlocks(const VoxelWorld& world, const glm::vec3& origin, const glm::vec3& direction, float maxDistance) {
+    VoxelHit hit;
+    for (GridRay ray(origin, direction, 1.0f); ray.t <= maxDistance; ray.advance()) {
+        if (world.getBlock(ray.cell) != AIR) {
+            hit.hit = true;
+            hit.block = ray.cell;
+            hit.distance = ray.t;
+            return hit;
+        }
+    }
+    return hit;
+}
+
+// Dig queries: SpatialHashGrid box queries and raycasts against a linear scan of
+// every entity, and the chunked VoxelWorld raycast against a per-block walk.
+// Entities are 1-4 unit boxes at one per 64 cubic units, in 4 unit cells.
+static void benchSpatialQueries() {
+    const size_t ENTITY_COUNTS[] = {10000, 100000, 1000000};
+    const float CELL_SIZE = 4.0f;
+    const float QUERY_SIZE = 4.0f;
+    const float RAY_LENGTH = 32.0f;
+    const int QUERIES = 20000;
+    // The linear scan is checked and timed on fewer queries, and fewer still
+    // past 100k entities.
+    const int SCAN_QUERIES = 200;
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    auto randomDirection = [&]() {
+        glm::vec3 direction(unit(random) * 2.0f - 1.0f, unit(random) * 2.0f - 1.0f, unit(random) * 2.0f - 1.0f);
+        return glm::normalize(direction + glm::vec3(1e-3f));
+    };
+    auto queriesPerSecond = [](int queries, double milliseconds) {
+        return queries / milliseconds * 1000.0;
+    };
+
+    char line[160];
+    std::cout << "spatial: " << QUERY_SIZE << " unit box queries, " << RAY_LENGTH << " unit rays" << std::endl;
+    std::cout << "  entities    box q/s   scan q/s    ray q/s   scan q/s   move + commit" << std::endl;
+
+    for (size_t entityCount : ENTITY_COUNTS) {
+        float side = std::cbrt(64.0f * entityCount);
+        std::vector<BenchBox> boxes(entityCount);
+        SpatialHashGrid grid(CELL_SIZE);
+        for (size_t i = 0; i < entityCount; i++) {
+            glm::vec3 min(unit(random) * side, unit(random) * side, unit(random) * side);
+            glm::vec3 size(1.0f + unit(random) * 3.0f, 1.0f + unit(random) * 3.0f, 1.0f + unit(random) * 3.0f);
+            boxes[i] = {min, min + size};
+            grid.insert(Entity{static_cast<uint32_t>(i), 0}, boxes[i].min, boxes[i].max);
+        }
+        grid.commit();
+        int scanQueries = entityCount > 100000 ? SCAN_QUERIES / 10 : SCAN_QUERIES;
+
+        std::vector<glm::vec3> points(QUERIES);
+        std::vector<glm::vec3> directions(QUERIES);
+        for (int i = 0; i < QUERIES; i++) {
+            points[i] = glm::vec3(unit(random) * side, unit(random) * side, unit(random) * side);
+            directions[i] = randomDirection();
+        }
+
+        // Box queries, with the sets compared on the scanned queries.
+        size_t found = 0;
+        double boxMilliseconds = timeMilliseconds(1, [&] {
+            for (const glm::vec3& point : points) {
+                grid.queryBox(point, point + QUERY_SIZE, [&](Entity) {
+                    found++;
+                });
+            }
+        });
+        std::vector<uint32_t> gridSet;
+        std::vector<uint32_t> scanSet;
+        double scanMilliseconds = timeMilliseconds(1, [&] {
+            for (int q = 0; q < scanQueries; q++) {
+                glm::vec3 min = points[q];
+                glm::vec3 max = points[q] + QUERY_SIZE;
+                for (size_t i = 0; i < entityCount; i++) {
+                    const BenchBox& box = boxes[i];
+                    if (box.min.x <= max.x && box.max.x >= min.x && box.min.y <= max.y && box.max.y >= min.y && box.min.z <= max.z && box.max.z >= min.z) {
+                        found++;
+                    }
+                }
+            }
+        });
+        for (int q = 0; q < scanQueries; q++) {
+            glm::vec3 min = points[q];
+            glm::vec3 max = points[q] + QUERY_SIZE;
+            gridSet.clear();
+            scanSet.clear();
+            grid.queryBox(min, max, [&](Entity entity) {
+                gridSet.push_back(entity.index);
+            });
+            for (size_t i = 0; i < entityCount; i++) {
+                const BenchBox& box = boxes[i];
+                if (box.min.x <= max.x && box.max.x >= min.x && box.min.y <= max.y && box.max.y >= min.y && box.min.z <= max.z && box.max.z >= min.z) {
+                    scanSet.push_back(static_cast<uint32_t>(i));
+                }
+            }
+            std::sort(gridSet.begin(), gridSet.end());
+            check(gridSet == scanSet, "queryBox at " + std::to_string(entityCount) + " entities");
+        }
+
+        // Raycasts. Boxes overlap, so the nearest hit is compared by distance.
+        double rayMilliseconds = timeMilliseconds(1, [&] {
+            for (int q = 0; q < QUERIES; q++) {
+                found += grid.raycast(points[q], directions[q], RAY_LENGTH).entity == NULL_ENTITY ? 0 : 1;
+            }
+        });
+        std::vector<float> scanDistances(scanQueries);
+        double rayScanMilliseconds = timeMilliseconds(1, [&] {
+            for (int q = 0; q < scanQueries; q++) {
+                glm::vec3 inverseDirection = 1.0f / directions[q];
+                float nearest = RAY_LENGTH;
+                for (const BenchBox& box : boxes) {
+                    float distance;
+                    if (rayHitsBox(box, points[q], inverseDirection, nearest, distance)) {
+                        nearest = distance;
+                    }
+                }
+                scanDistances[q] = nearest;
+            }
+        });
+        for (int q = 0; q < scanQueries; q++) {
+            SpatialRayHit hit = grid.raycast(points[q], directions[q], RAY_LENGTH);
+            check(std::fabs(hit.distance - scanDistances[q]) <= 1e-4f, "raycast at " + std::to_string(entityCount) + " entities");
+        }
+
+        // Every entity moves by up to a cell, then the table is rebuilt.
+        double moveMilliseconds = timeMilliseconds(1, [&] {
+            for (size_t i = 0; i < entityCount; i++) {
+                glm::vec3 offset(unit(random) * CELL_SIZE, unit(random) * CELL_SIZE, unit(random) * CELL_SIZE);
+                grid.update(Entity{static_cast<uint32_t>(i), 0}, boxes[i].min + offset, boxes[i].max + offset);
+            }
+            grid.commit();
+        });
+
+        std::snprintf(line, sizeof(line), "  %8zu  %9.0f  %9.0f  %9.0f  %9.0f  %11.2f ms%s", entityCount,
+            queriesPerSecond(QUERIES, boxMilliseconds), queriesPerSecond(scanQueries, scanMilliseconds),
+            queriesPerSecond(QUERIES, rayMilliseconds), queriesPerSecond(scanQueries, rayScanMilliseconds),
+            moveMilliseconds, found == 0 ? " (no hits)" : "");
+        std::cout << line << std::endl;
+    }
+
+    // A hilly heightmap 16 chunks across, with rays cast down at it from above
+    // as when digging.
+    VoxelWorld world;
+    const int HALF = 8 * Chunk::SIZE;
+    for (int y = -HALF; y < HALF; y++) {
+        for (int x = -HALF; x < HALF; x++) {
+            int height = static_cast<int>(8.0f * std::sin(x * 0.05f) + 8.0f * std::cos(y * 0.07f));
+            for (int z = -Chunk::SIZE; z < height; z++) {
+                world.setBlock(glm::ivec3(x, y, z), 1);
+            }
+        }
+    }
+    std::vector<glm::vec3> origins(QUERIES);
+    std::vector<glm::vec3> rays(QUERIES);
+    for (int i = 0; i < QUERIES; i++) {
+        origins[i] = glm::vec3((unit(random) * 2.0f - 1.0f) * HALF, (unit(random) * 2.0f - 1.0f) * HALF, 20.0f + unit(random) * 40.0f);
+        glm::vec3 direction = randomDirection();
+        direction.z = -std::fabs(direction.z);
+        rays[i] = glm::normalize(direction);
+    }
+
+    const float DIG_DISTANCE = 128.0f;
+    std::vector<VoxelHit> hits(QUERIES);
+    double chunked = timeMilliseconds(1, [&] {
+        for (int i = 0; i < QUERIES; i++) {
+            hits[i] = world.raycast(origins[i], rays[i], DIG_DISTANCE);
+        }
+    });
+    std::vector<VoxelHit> blockHits(QUERIES);
+    double perBlock = timeMilliseconds(1, [&] {
+        for (int i = 0; i < QUERIES; i++) {
+            blockHits[i] = raycastBlocks(world, origins[i], rays[i], DIG_DISTANCE);
+        }
+    });
+    for (int i = 0; i < QUERIES; i++) {
+        check(hits[i].hit == blockHits[i].hit && (!hits[i].hit || hits[i].block == blockHits[i].block), "VoxelWorld::raycast");
+    }
+    std::snprintf(line, sizeof(line), "  voxel raycast, %zu chunks: %.0f rays/s, per-block walk %.0f rays/s", world.getChunkCount(),
+        queriesPerSecond(QUERIES, chunked), queriesPerSecond(QUERIES, perBlock));
+    std::cout << line << std::endl;
+}
+
+// Laid out as particle_simulate.comp sees a particle.
+struct BenchParticle {
+    glm::vec3 position;
+    float age;
+    glm::vec3 velocity;
+    float lifetime;
+    glm::vec4 color;
+};
+
+// Particles: the simulation runs on the GPU, and the app prints its GPU time
+// and particles per millisecond once a second. This times a CPU loop doing
+// what particle_simulate.comp does per frame, list compaction included, with
+// ParticleSystem's constants, as the cost the compute pass takes off the CPU.
+static void benchParticles() {
+    const uint32_t COUNT = 1 << 16;
+    const int FRAMES = 120;
+    const float DELTA_SECONDS = 1.0f / 60.0f;
+    const float BOUNCE = 0.3f;
+    const float FRICTION = 0.6f;
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<BenchParticle> particles(COUNT);
+    for (BenchParticle& particle : particles) {
+        particle.position = glm::vec3(unit(random), unit(random), 1.0f + unit(random));
+        particle.age = 0.0f;
+        particle.velocity = glm::vec3(unit(random), unit(random), 2.0f + unit(random)) * 3.0f;
+        // Some expire within the run so that the dead stack is exercised.
+        particle.lifetime = 2.0f + unit(random);
+        particle.color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+    }
+
+    std::vector<uint32_t> alive[2];
+    std::vector<uint32_t> dead;
+    alive[0].reserve(COUNT);
+    alive[1].reserve(COUNT);
+    dead.reserve(COUNT);
+    for (uint32_t i = 0; i < COUNT; i++) {
+        alive[0].push_back(i);
+    }
+
+    // Timed by hand, as the run changes the state it starts from.
+    uint64_t simulated = 0;
+    int current = 0;
+    BenchClock::time_point start = BenchClock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        std::vector<uint32_t>& next = alive[current ^ 1];
+        next.clear();
+        for (uint32_t index : alive[current]) {
+            BenchParticle particle = particles[index];
+            particle.age += DELTA_SECONDS;
+            if (particle.age >= particle.lifetime) {
+                dead.push_back(index);
+                continue;
+            }
+            particle.velocity.z -= ParticleSystem::GRAVITY * DELTA_SECONDS;
+            particle.velocity = particle.velocity * std::max(1.0f - ParticleSystem::DRAG * DELTA_SECONDS, 0.0f);
+            particle.position = particle.position + particle.velocity * DELTA_SECONDS;
+            if (particle.position.z < 0.0f) {
+                particle.position.z = 0.0f;
+                particle.velocity.z = -particle.velocity.z * BOUNCE;
+                particle.velocity.x *= FRICTION;
+                particle.velocity.y *= FRICTION;
+            }
+            particles[index] = particle;
+            next.push_back(index);
+        }
+        simulated += alive[current].size();
+        current ^= 1;
+    }
+    double milliseconds = std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+    check(alive[current].size() + dead.size() == COUNT, "particle lists");
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "particles: %u on the CPU, %.3f ms per frame, %.0f particles/ms, %zu expired", COUNT, milliseconds / FRAMES, simulated / milliseconds, dead.size());
+    std::cout << line << std::endl;
+}
+
+// Voxel light: incremental relighting of single edits against building the
+// light of the whole world again, which is what every edit would cost without
+// it. Afterwards the incrementally kept light must equal a fresh build.
+static void benchVoxelLight() {
+    const int HALF = 4 * Chunk::SIZE;
+    const int EDITS = 400;
+    const BlockId STONE = 1;
+    const BlockId LAMP = 2;
+
+    // Hills with a grid of buried lamps under them.
+    VoxelWorld world;
+    for (int y = -HALF; y < HALF; y++) {
+        for (int x = -HALF; x < HALF; x++) {
+            int height = 32 + static_cast<int>(12.0f * std::sin(x * 0.05f) + 12.0f * std::cos(y * 0.067f));
+            for (int z = 0; z < height; z++) {
+                world.setBlock(glm::ivec3(x, y, z), STONE);
+            }
+        }
+    }
+    for (int y = -HALF + 8; y < HALF; y += 16) {
+        for (int x = -HALF + 8; x < HALF; x += 16) {
+            world.setBlock(glm::ivec3(x, y, 10), LAMP);
+        }
+    }
+
+    JobSystem jobSystem(1);
+    VoxelLight light(jobSystem);
+    light.setEmission(LAMP, 14);
+    double build = timeMilliseconds(1, [&] {
+        light.build(world);
+    });
+
+    // Random digs and placements, then a shaft dug from the surface down to a
+    // lamp, one edit per update as when digging by hand.
+    std::mt19937 random(1);
+    std::vector<float> latencies;
+    size_t blocksRelit = 0;
+    auto edit = [&](const glm::ivec3& block, BlockId id) {
+        light.setBlock(world, block, id);
+        light.beginUpdate();
+        light.endUpdate();
+        VoxelLightStatistics statistics = light.getStatistics();
+        if (statistics.edits > 0) {
+            latencies.push_back(statistics.milliseconds);
+            blocksRelit += statistics.blocksRelit;
+        }
+    };
+    for (int i = 0; i < EDITS; i++) {
+        int x = static_cast<int>(random() % (2 * HALF)) - HALF;
+        int y = static_cast<int>(random() % (2 * HALF)) - HALF;
+        int z = static_cast<int>(random() % 50);
+        edit(glm::ivec3(x, y, z), i % 3 == 0 ? STONE : (i % 17 == 0 ? LAMP : AIR));
+    }
+    for (int z = 60; z > 10; z--) {
+        edit(glm::ivec3(8 - HALF, 8 - HALF, z), AIR);
+    }
+
+    VoxelLight fresh(jobSystem);
+    fresh.setEmission(LAMP, 14);
+    fresh.build(world);
+    world.forEachChunk([&](const ChunkCoord& coord, const Chunk&) {
+        check(light.findChunk(coord)->values == fresh.findChunk(coord)->values, "VoxelLight after edits");
+    });
+
+    std::sort(latencies.begin(), latencies.end());
+    double total = 0.0;
+    for (float latency : latencies) {
+        total += latency;
+    }
+    char line[200];
+    std::snprintf(line, sizeof(line), "light: %zu chunks, full build %.1f ms", world.getChunkCount(), build);
+    std::cout << line << std::endl;
+    std::snprintf(line, sizeof(line), "  %zu edits: mean %.3f ms, median %.3f ms, p99 %.3f ms, max %.3f ms, %.0f blocks relit each",
+        latencies.size(), total / latencies.size(), latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], latencies.back(),
+        static_cast<double>(blocksRelit) / latencies.size());
+    std::cout << line << std::endl;
+}
+
+struct BenchSection {
+    const char *name;
+    void (*run)();
+};
+
+static const BenchSection SECTIONS[] = {
+    {"simd", benchSimdMath},
+    {"jobs", benchJobSystem},
+    {"spatial", benchSpatialQueries},
+    {"particles", benchParticles},
+    {"light", benchVoxelLight},
+};
+
+int main(int argc, char **argv) {
+    try {
+        std::vector<const BenchSection *> selected;
+        for (int i = 1; i < argc; i++) {
+            auto section = std::find_if(std::begin(SECTIONS), std::end(SECTIONS), [&](const BenchSection& candidate) {
+                return argv[i] == std::string(candidate.name);
+            });
+            if (section == std::end(SECTIONS)) {
+                std::string names;
+                for (const BenchSection& candidate : SECTIONS) {
+                    names += std::string(" ") + candidate.name;
+                }
+                std::cerr << "Usage: dig_bench [section]...\nSections:" << names << std::endl;
+                return EXIT_FAILURE;
+            }
+            selected.push_back(section);
+        }
+        if (selected.empty()) {
+            for (const BenchSection& section : SECTIONS) {
+                selected.push_back(&section);
+            }
+        }
+
+        for (const BenchSection *section : selected) {
+            section->run();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
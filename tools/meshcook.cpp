@@ -0,0 +1,662 @@
+// Offline mesh cooker: converts a Wavefront OBJ into the binary .mesh format
+// loaded by the game (see src/mesh_format.hpp).
+//
+// Besides the format conversion, the index buffer is reordered for the
+// post-transform vertex cache (Forsyth, "Linear-Speed Vertex Cache
+// Optimisation") and then for overdraw (clusters sorted outside-in, after
+// Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw"). The vertex stream is finally reordered by first use so vertex
+// fetch walks memory linearly. ACMR (average cache miss ratio, transformed
+// vertices per triangle) is reported before and after each step.
+//
+// The vertex stream is written either as full-precision floats (--layout
+// standard) or quantized for voxel/tile geometry (--layout packed, see
+// MeshPackedVertex). The memory footprint and the estimated vertex fetch
+// traffic of both layouts are reported so the two can be compared.
+//
+// Usage: meshcook <input.obj> <output.mesh> [--layout standard|packed] [--cache-size N] [--overdraw-threshold T]
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <numeric>
+
+#include "mesh_format.hpp"
+
+struct Float3 {
+    float x, y, z;
+};
+
+static Float3 operator-(const Float3& a, const Float3& b) {
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+static Float3 cross(const Float3& a, const Float3& b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+static float dot(const Float3& a, const Float3& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static Float3 normalize(const Float3& v) {
+    float length = std::sqrt(dot(v, v));
+    return length > 0.0f ? Float3{v.x / length, v.y / length, v.z / length} : Float3{0.0f, 0.0f, 1.0f};
+}
+
+struct CookVertex {
+    Float3 pos;
+    Float3 color;
+    float texCoord[2];
+    Float3 normal;
+};
+
+struct CookedMesh {
+    std::vector<CookVertex> vertices;
+    std::vector<uint32_t> indices;
+    bool hasNormals = false;
+};
+
+struct CookOptions {
+    MeshVertexLayout vertexLayout = MeshVertexLayout::Standard;
+    uint32_t cacheSize = 16;
+    float overdrawThreshold = 1.05f;
+};
+
+static int resolveObjIndex(int index, size_t count) {
+    int resolved = index < 0 ? static_cast<int>(count) + index : index - 1;
+    if (resolved < 0 || static_cast<size_t>(resolved) >= count) {
+        throw std::runtime_error("OBJ face references missing element " + std::to_string(index));
+    }
+    return resolved;
+}
+
+static CookedMesh loadObj(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+
+    std::vector<Float3> positions;
+    std::vector<Float3> colors;
+    std::vector<std::array<float, 2>> texCoords;
+    std::vector<Float3> normals;
+    std::map<std::tuple<int, int, int>, uint32_t> uniqueVertices;
+    CookedMesh mesh;
+    mesh.hasNormals = true;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::string keyword;
+        stream >> keyword;
+
+        if (keyword == "v") {
+            // Vertex colors are the common "v x y z r g b" extension; default to white.
+            Float3 position = {};
+            Float3 color = {1.0f, 1.0f, 1.0f};
+            stream >> position.x >> position.y >> position.z;
+            if (!(stream >> color.x >> color.y >> color.z)) {
+                color = {1.0f, 1.0f, 1.0f};
+            }
+            positions.push_back(position);
+            colors.push_back(color);
+        }
+        else if (keyword == "vt") {
+            std::array<float, 2> texCoord = {};
+            stream >> texCoord[0] >> texCoord[1];
+            texCoords.push_back(texCoord);
+        }
+        else if (keyword == "vn") {
+            Float3 normal = {};
+            stream >> normal.x >> normal.y >> normal.z;
+            normals.push_back(normalize(normal));
+        }
+        else if (keyword == "f") {
+            std::vector<uint32_t> polygon;
+            std::string corner;
+            while (stream >> corner) {
+                // Corners are "p", "p/t", "p//n" or "p/t/n"; texture and normal
+                // indices are stored one-based here so zero means "absent".
+                int texCoordIndex = 0;
+                int normalIndex = 0;
+                size_t firstSlash = corner.find('/');
+                size_t secondSlash = firstSlash == std::string::npos ? std::string::npos : corner.find('/', firstSlash + 1);
+                int positionIndex = resolveObjIndex(std::stoi(corner.substr(0, firstSlash)), positions.size());
+                if (firstSlash != std::string::npos && firstSlash + 1 < corner.size() && corner[firstSlash + 1] != '/') {
+                    texCoordIndex = resolveObjIndex(std::stoi(corner.substr(firstSlash + 1)), texCoords.size()) + 1;
+                }
+                if (secondSlash != std::string::npos && secondSlash + 1 < corner.size()) {
+                    normalIndex = resolveObjIndex(std::stoi(corner.substr(secondSlash + 1)), normals.size()) + 1;
+                }
+                mesh.hasNormals = mesh.hasNormals && normalIndex > 0;
+
+                auto key = std::make_tuple(positionIndex, texCoordIndex, normalIndex);
+                auto found = uniqueVertices.find(key);
+                if (found == uniqueVertices.end()) {
+                    CookVertex vertex = {};
+                    vertex.pos = positions[positionIndex];
+                    vertex.color = colors[positionIndex];
+                    if (texCoordIndex > 0) {
+                        vertex.texCoord[0] = texCoords[texCoordIndex - 1][0];
+                        vertex.texCoord[1] = texCoords[texCoordIndex - 1][1];
+                    }
+                    if (normalIndex > 0) {
+                        vertex.normal = normals[normalIndex - 1];
+                    }
+
+                    found = uniqueVertices.emplace(key, static_cast<uint32_t>(mesh.vertices.size())).first;
+                    mesh.vertices.push_back(vertex);
+                }
+                polygon.push_back(found->second);
+            }
+
+            if (polygon.size() < 3) {
+                throw std::runtime_error("OBJ face with fewer than three corners in " + path);
+            }
+
+            for (size_t i = 1; i + 1 < polygon.size(); i++) {
+                mesh.indices.push_back(polygon[0]);
+                mesh.indices.push_back(polygon[i]);
+                mesh.indices.push_back(polygon[i + 1]);
+            }
+        }
+    }
+
+    if (mesh.indices.empty()) {
+        throw std::runtime_error("No triangles in " + path);
+    }
+
+    return mesh;
+}
+
+// Area-weighted smooth normals, for sources that do not provide their own.
+static void generateNormals(CookedMesh& mesh) {
+    for (auto& vertex : mesh.vertices) {
+        vertex.normal = {0.0f, 0.0f, 0.0f};
+    }
+
+    for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+        CookVertex& a = mesh.vertices[mesh.indices[t]];
+        CookVertex& b = mesh.vertices[mesh.indices[t + 1]];
+        CookVertex& c = mesh.vertices[mesh.indices[t + 2]];
+        Float3 faceNormal = cross(b.pos - a.pos, c.pos - a.pos);
+
+        for (CookVertex *vertex : {&a, &b, &c}) {
+            vertex->normal.x += faceNormal.x;
+            vertex->normal.y += faceNormal.y;
+            vertex->normal.z += faceNormal.z;
+        }
+    }
+
+    for (auto& vertex : mesh.vertices) {
+        vertex.normal = normalize(vertex.normal);
+    }
+}
+
+// Transformed vertices per triangle through a FIFO cache of the given size,
+// which is how most post-transform caches behave in practice. 0.5 is the
+// theoretical best for a regular grid, 3.0 the worst.
+static double computeAcmr(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) {
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    size_t misses = 0;
+
+    for (uint32_t index : indices) {
+        if (time - timestamps[index] > cacheSize) {
+            timestamps[index] = time++;
+            misses++;
+        }
+    }
+
+    return static_cast<double>(misses) / static_cast<double>(indices.size() / 3);
+}
+
+static std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount) {
+    const int cacheSize = 32;
+    const float cacheDecayPower = 1.5f;
+    const float lastTriangleScore = 0.75f;
+    const float valenceBoostScale = 2.0f;
+    const float valenceBoostPower = 0.5f;
+
+    size_t triangleCount = indices.size() / 3;
+
+    // Per-vertex adjacency in CSR form: the triangles each vertex still belongs to.
+    std::vector<uint32_t> valence(vertexCount, 0);
+    for (uint32_t index : indices) {
+        valence[index]++;
+    }
+
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < vertexCount; i++) {
+        adjacencyOffsets[i + 1] = adjacencyOffsets[i] + valence[i];
+    }
+
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    auto vertexScore = [&](int cachePosition, uint32_t remaining) {
+        if (remaining == 0) {
+            return -1.0f;
+        }
+
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            if (cachePosition < 3) {
+                score = lastTriangleScore;
+            }
+            else {
+                float scaler = 1.0f / (cacheSize - 3);
+                score = std::pow(1.0f - (cachePosition - 3) * scaler, cacheDecayPower);
+            }
+        }
+
+        return score + valenceBoostScale * std::pow(static_cast<float>(remaining), -valenceBoostPower);
+    };
+
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        vertexScores[i] = vertexScore(-1, valence[i]);
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> nextCache;
+    size_t scanCursor = 0;
+
+    while (result.size() < indices.size()) {
+        // Best triangle among those touching the cache; fall back to a linear scan
+        // for the first not-yet-emitted triangle when the cache has gone cold.
+        int bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (uint32_t vertex : cache) {
+            for (uint32_t i = adjacencyOffsets[vertex]; i < adjacencyOffsets[vertex] + valence[vertex]; i++) {
+                uint32_t triangle = adjacency[i];
+                if (triangleScores[triangle] > bestScore) {
+                    bestScore = triangleScores[triangle];
+                    bestTriangle = static_cast<int>(triangle);
+                }
+            }
+        }
+
+        if (bestTriangle < 0) {
+            while (emitted[scanCursor]) {
+                scanCursor++;
+            }
+            bestTriangle = static_cast<int>(scanCursor);
+        }
+
+        emitted[bestTriangle] = true;
+        triangleScores[bestTriangle] = -1.0f;
+
+        nextCache.clear();
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t vertex = indices[bestTriangle * 3 + corner];
+            result.push_back(vertex);
+            nextCache.push_back(vertex);
+
+            // Drop the emitted triangle from this vertex's remaining adjacency.
+            uint32_t begin = adjacencyOffsets[vertex];
+            uint32_t end = begin + valence[vertex];
+            for (uint32_t i = begin; i < end; i++) {
+                if (adjacency[i] == static_cast<uint32_t>(bestTriangle)) {
+                    std::swap(adjacency[i], adjacency[end - 1]);
+                    break;
+                }
+            }
+            valence[vertex]--;
+        }
+
+        for (uint32_t vertex : cache) {
+            if (std::find(nextCache.begin(), nextCache.end(), vertex) == nextCache.end()) {
+                nextCache.push_back(vertex);
+            }
+        }
+
+        for (size_t i = 0; i < nextCache.size(); i++) {
+            uint32_t vertex = nextCache[i];
+            cachePositions[vertex] = i < static_cast<size_t>(cacheSize) ? static_cast<int>(i) : -1;
+        }
+
+        for (uint32_t vertex : nextCache) {
+            float score = vertexScore(cachePositions[vertex], valence[vertex]);
+            float delta = score - vertexScores[vertex];
+            vertexScores[vertex] = score;
+
+            for (uint32_t i = adjacencyOffsets[vertex]; i < adjacencyOffsets[vertex] + valence[vertex]; i++) {
+                triangleScores[adjacency[i]] += delta;
+            }
+        }
+
+        if (nextCache.size() > static_cast<size_t>(cacheSize)) {
+            nextCache.resize(cacheSize);
+        }
+        cache.swap(nextCache);
+    }
+
+    return result;
+}
+
+// Splits the cache-optimized order into clusters and sorts them so that
+// clusters facing away from the mesh center (likely occluders) draw first.
+// Cluster boundaries are placed where the FIFO cache restarts anyway, plus
+// wherever the cluster's local ACMR is still within threshold of the whole
+// mesh, so the reordering costs at most that much cache efficiency.
+static std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<CookVertex>& vertices, uint32_t cacheSize, float threshold) {
+    size_t triangleCount = indices.size() / 3;
+    double meshAcmr = computeAcmr(indices, vertices.size(), cacheSize);
+
+    std::vector<size_t> clusterStarts;
+    std::vector<uint32_t> timestamps(vertices.size(), 0);
+    uint32_t time = cacheSize + 1;
+    size_t clusterMisses = 0;
+    size_t clusterTriangles = 0;
+
+    for (size_t t = 0; t < triangleCount; t++) {
+        int misses = 0;
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t index = indices[t * 3 + corner];
+            if (time - timestamps[index] > cacheSize) {
+                timestamps[index] = time++;
+                misses++;
+            }
+        }
+
+        bool hardBoundary = misses == 3;
+        bool softBoundary = clusterTriangles > 0 && static_cast<double>(clusterMisses) / clusterTriangles <= meshAcmr * threshold && misses > 1;
+        if (t == 0 || hardBoundary || softBoundary) {
+            clusterStarts.push_back(t);
+            clusterMisses = 0;
+            clusterTriangles = 0;
+        }
+
+        clusterMisses += misses;
+        clusterTriangles++;
+    }
+
+    Float3 meshCenter = {0.0f, 0.0f, 0.0f};
+    for (const auto& vertex : vertices) {
+        meshCenter.x += vertex.pos.x;
+        meshCenter.y += vertex.pos.y;
+        meshCenter.z += vertex.pos.z;
+    }
+    float inverseCount = 1.0f / static_cast<float>(vertices.size());
+    meshCenter = {meshCenter.x * inverseCount, meshCenter.y * inverseCount, meshCenter.z * inverseCount};
+
+    std::vector<float> clusterSortKeys(clusterStarts.size());
+    for (size_t c = 0; c < clusterStarts.size(); c++) {
+        size_t begin = clusterStarts[c];
+        size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+
+        Float3 centroid = {0.0f, 0.0f, 0.0f};
+        Float3 normal = {0.0f, 0.0f, 0.0f};
+        float area = 0.0f;
+
+        for (size_t t = begin; t < end; t++) {
+            const Float3& a = vertices[indices[t * 3]].pos;
+            const Float3& b = vertices[indices[t * 3 + 1]].pos;
+            const Float3& c2 = vertices[indices[t * 3 + 2]].pos;
+
+            // Area-weighted, so the un-normalized cross product is used as is.
+            Float3 faceNormal = cross(b - a, c2 - a);
+            float faceArea = std::sqrt(dot(faceNormal, faceNormal));
+
+            centroid.x += (a.x + b.x + c2.x) / 3.0f * faceArea;
+            centroid.y += (a.y + b.y + c2.y) / 3.0f * faceArea;
+            centroid.z += (a.z + b.z + c2.z) / 3.0f * faceArea;
+            normal.x += faceNormal.x;
+            normal.y += faceNormal.y;
+            normal.z += faceNormal.z;
+            area += faceArea;
+        }
+
+        if (area > 0.0f) {
+            centroid = {centroid.x / area, centroid.y / area, centroid.z / area};
+        }
+
+        clusterSortKeys[c] = dot(centroid - meshCenter, normal);
+    }
+
+    std::vector<size_t> clusterOrder(clusterStarts.size());
+    std::iota(clusterOrder.begin(), clusterOrder.end(), 0);
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](size_t a, size_t b) {
+        return clusterSortKeys[a] > clusterSortKeys[b];
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (size_t c : clusterOrder) {
+        size_t begin = clusterStarts[c];
+        size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+        result.insert(result.end(), indices.begin() + begin * 3, indices.begin() + end * 3);
+    }
+
+    return result;
+}
+
+// Renumbers vertices in order of first use so vertex fetch reads sequentially.
+static void optimizeVertexFetch(CookedMesh& mesh) {
+    std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+    std::vector<CookVertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+
+    for (uint32_t& index : mesh.indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    mesh.vertices.swap(vertices);
+}
+
+static void writePadding(std::ofstream& file, uint64_t& offset, uint64_t target) {
+    static const char zeros[MESH_STREAM_ALIGNMENT] = {};
+    file.write(zeros, static_cast<std::streamsize>(target - offset));
+    offset = target;
+}
+
+static std::vector<uint8_t> encodeVertices(const CookedMesh& mesh, MeshVertexLayout vertexLayout, const MeshFileHeader& header) {
+    std::vector<uint8_t> stream(static_cast<size_t>(meshVertexStride(vertexLayout)) * mesh.vertices.size());
+
+    if (vertexLayout == MeshVertexLayout::Standard) {
+        auto *vertices = reinterpret_cast<MeshStandardVertex*>(stream.data());
+        for (size_t i = 0; i < mesh.vertices.size(); i++) {
+            const CookVertex& source = mesh.vertices[i];
+            vertices[i] = {{source.pos.x, source.pos.y, source.pos.z}, {source.color.x, source.color.y, source.color.z}, {source.texCoord[0], source.texCoord[1]}};
+        }
+        return stream;
+    }
+
+    // Positions are stored relative to the bounds, which the runtime passes back
+    // to the vertex shader as the chunk origin and extent.
+    float inverseExtent[3];
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = header.boundsMax[axis] - header.boundsMin[axis];
+        inverseExtent[axis] = extent > 0.0f ? 1.0f / extent : 0.0f;
+    }
+
+    bool texCoordsClamped = false;
+    auto *vertices = reinterpret_cast<MeshPackedVertex*>(stream.data());
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        const CookVertex& source = mesh.vertices[i];
+        MeshPackedVertex& vertex = vertices[i];
+
+        vertex.pos[0] = quantizeUnorm16((source.pos.x - header.boundsMin[0]) * inverseExtent[0]);
+        vertex.pos[1] = quantizeUnorm16((source.pos.y - header.boundsMin[1]) * inverseExtent[1]);
+        vertex.pos[2] = quantizeUnorm16((source.pos.z - header.boundsMin[2]) * inverseExtent[2]);
+        vertex.pos[3] = 0;
+        vertex.color[0] = quantizeUnorm8(source.color.x);
+        vertex.color[1] = quantizeUnorm8(source.color.y);
+        vertex.color[2] = quantizeUnorm8(source.color.z);
+        vertex.color[3] = 255;
+        vertex.texCoord[0] = quantizeUnorm16(source.texCoord[0]);
+        vertex.texCoord[1] = quantizeUnorm16(source.texCoord[1]);
+        vertex.normal = packNormal1010102(source.normal.x, source.normal.y, source.normal.z);
+
+        for (float texCoord : source.texCoord) {
+            texCoordsClamped = texCoordsClamped || texCoord < 0.0f || texCoord > 1.0f;
+        }
+    }
+
+    if (texCoordsClamped) {
+        std::cerr << "Warning: texture coordinates outside [0, 1] were clamped by the packed layout" << std::endl;
+    }
+
+    return stream;
+}
+
+static void writeMesh(const std::string& path, const CookedMesh& mesh, MeshVertexLayout vertexLayout) {
+    MeshFileHeader header = {};
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.vertexLayout = static_cast<uint32_t>(vertexLayout);
+    header.vertexStride = meshVertexStride(vertexLayout);
+    header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+
+    MeshIndexType indexType = mesh.vertices.size() <= UINT16_MAX ? MeshIndexType::Uint16 : MeshIndexType::Uint32;
+    header.indexType = static_cast<uint32_t>(indexType);
+
+    header.boundsMin[0] = header.boundsMax[0] = mesh.vertices[0].pos.x;
+    header.boundsMin[1] = header.boundsMax[1] = mesh.vertices[0].pos.y;
+    header.boundsMin[2] = header.boundsMax[2] = mesh.vertices[0].pos.z;
+    for (const auto& vertex : mesh.vertices) {
+        const float position[3] = {vertex.pos.x, vertex.pos.y, vertex.pos.z};
+        for (int axis = 0; axis < 3; axis++) {
+            header.boundsMin[axis] = std::min(header.boundsMin[axis], position[axis]);
+            header.boundsMax[axis] = std::max(header.boundsMax[axis], position[axis]);
+        }
+    }
+
+    std::vector<uint8_t> vertexStream = encodeVertices(mesh, vertexLayout, header);
+    header.vertexOffset = alignMeshOffset(sizeof(MeshFileHeader));
+    header.indexOffset = alignMeshOffset(header.vertexOffset + vertexStream.size());
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path + " for writing");
+    }
+
+    uint64_t offset = sizeof(MeshFileHeader);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    writePadding(file, offset, header.vertexOffset);
+    file.write(reinterpret_cast<const char*>(vertexStream.data()), static_cast<std::streamsize>(vertexStream.size()));
+    offset += vertexStream.size();
+
+    writePadding(file, offset, header.indexOffset);
+    if (indexType == MeshIndexType::Uint16) {
+        std::vector<uint16_t> narrowIndices(mesh.indices.begin(), mesh.indices.end());
+        file.write(reinterpret_cast<const char*>(narrowIndices.data()), static_cast<std::streamsize>(narrowIndices.size() * sizeof(uint16_t)));
+    }
+    else {
+        file.write(reinterpret_cast<const char*>(mesh.indices.data()), static_cast<std::streamsize>(mesh.indices.size() * sizeof(uint32_t)));
+    }
+
+    if (!file) {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+// Memory footprint of each layout and the vertex fetch traffic implied by the
+// cache simulation: every cache miss fetches one full vertex from memory.
+static void reportLayouts(const CookedMesh& mesh, double acmr) {
+    size_t triangleCount = mesh.indices.size() / 3;
+    double fetchedVertices = acmr * static_cast<double>(triangleCount);
+
+    for (MeshVertexLayout vertexLayout : {MeshVertexLayout::Standard, MeshVertexLayout::Packed}) {
+        uint32_t stride = meshVertexStride(vertexLayout);
+        std::cout << "  " << (vertexLayout == MeshVertexLayout::Standard ? "standard" : "packed  ")
+                  << ": " << stride << " bytes/vertex, " << stride * mesh.vertices.size() << " bytes resident, "
+                  << static_cast<uint64_t>(fetchedVertices * stride) << " bytes fetched per draw" << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: meshcook <input.obj> <output.mesh> [--layout standard|packed] [--cache-size N] [--overdraw-threshold T]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        CookOptions options;
+        for (int i = 3; i < argc; i += 2) {
+            std::string option = argv[i];
+            if (i + 1 == argc) {
+                std::cerr << "Usage: meshcook <input.obj> <output.mesh> [--layout standard|packed] [--cache-size N] [--overdraw-threshold T]" << std::endl;
+                throw std::runtime_error("Missing value for option " + option);
+            }
+            if (option == "--layout") {
+                std::string layout = argv[i + 1];
+                if (layout == "standard") {
+                    options.vertexLayout = MeshVertexLayout::Standard;
+                }
+                else if (layout == "packed") {
+                    options.vertexLayout = MeshVertexLayout::Packed;
+                }
+                else {
+                    throw std::runtime_error("Unknown vertex layout " + layout);
+                }
+            }
+            else if (option == "--cache-size") {
+                options.cacheSize = static_cast<uint32_t>(std::stoul(argv[i + 1]));
+            }
+            else if (option == "--overdraw-threshold") {
+                options.overdrawThreshold = std::stof(argv[i + 1]);
+            }
+            else {
+                throw std::runtime_error("Unknown option " + option);
+            }
+        }
+
+        CookedMesh mesh = loadObj(argv[1]);
+        if (!mesh.hasNormals && options.vertexLayout == MeshVertexLayout::Packed) {
+            generateNormals(mesh);
+        }
+        size_t vertexCount = mesh.vertices.size();
+
+        double acmrBefore = computeAcmr(mesh.indices, vertexCount, options.cacheSize);
+        mesh.indices = optimizeVertexCache(mesh.indices, vertexCount);
+        double acmrVertexCache = computeAcmr(mesh.indices, vertexCount, options.cacheSize);
+        mesh.indices = optimizeOverdraw(mesh.indices, mesh.vertices, options.cacheSize, options.overdrawThreshold);
+        double acmrAfter = computeAcmr(mesh.indices, vertexCount, options.cacheSize);
+        optimizeVertexFetch(mesh);
+
+        writeMesh(argv[2], mesh, options.vertexLayout);
+
+        std::cout << argv[1] << ": " << mesh.vertices.size() << " vertices, " << mesh.indices.size() / 3 << " triangles" << std::endl;
+        std::cout << "  ACMR (FIFO " << options.cacheSize << "): before " << acmrBefore
+                  << ", vertex cache " << acmrVertexCache
+                  << ", overdraw " << acmrAfter << std::endl;
+        reportLayouts(mesh, acmrAfter);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
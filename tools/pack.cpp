@@ -0,0 +1,167 @@
+// Offline asset packer: bundles files into the .pack archive read by the game's
+// virtual file system (see src/pack_format.hpp and src/vfs.hpp).
+//
+// Each entry is LZ4-compressed when that saves at least 5%; already-compressed
+// data such as PNG is stored as is so it can be used straight from the mapping.
+//
+// Usage: pack <output.pack> <root> <path relative to root>... [--no-compress]
+// Directories are added recursively; missing paths are skipped with a warning.
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+
+#include "pack_format.hpp"
+#include "lz4.hpp"
+
+struct PackInput {
+    std::string assetPath;
+    std::vector<uint8_t> stored;
+    uint64_t size;
+    PackCompression compression;
+};
+
+static std::vector<uint8_t> readWholeFile(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path.string());
+    }
+
+    std::vector<uint8_t> buffer(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+    return buffer;
+}
+
+static void collectFiles(const std::filesystem::path& root, const std::string& relativePath, std::vector<std::string>& files) {
+    std::filesystem::path path = root / relativePath;
+
+    if (std::filesystem::is_regular_file(path)) {
+        files.push_back(normalizeAssetPath(relativePath));
+    }
+    else if (std::filesystem::is_directory(path)) {
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+            if (entry.is_regular_file()) {
+                files.push_back(normalizeAssetPath(std::filesystem::relative(entry.path(), root).generic_string()));
+            }
+        }
+    }
+    else {
+        std::cerr << "Warning: skipping missing path " << path.string() << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        std::cerr << "Usage: pack <output.pack> <root> <path>... [--no-compress]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        std::filesystem::path root = argv[2];
+        bool compress = true;
+        std::vector<std::string> files;
+
+        for (int i = 3; i < argc; i++) {
+            std::string argument = argv[i];
+            if (argument == "--no-compress") {
+                compress = false;
+            }
+            else {
+                collectFiles(root, argument, files);
+            }
+        }
+
+        std::sort(files.begin(), files.end());
+        files.erase(std::unique(files.begin(), files.end()), files.end());
+
+        std::vector<PackInput> inputs;
+        uint64_t totalSize = 0;
+        uint64_t totalStored = 0;
+
+        for (const auto& assetPath : files) {
+            PackInput input;
+            input.assetPath = assetPath;
+            input.stored = readWholeFile(root / assetPath);
+            input.size = input.stored.size();
+            input.compression = PackCompression::None;
+
+            if (compress && !input.stored.empty()) {
+                std::vector<uint8_t> compressed = lz4Compress(input.stored.data(), input.stored.size());
+                if (compressed.size() < input.stored.size() - input.stored.size() / 20) {
+                    input.stored.swap(compressed);
+                    input.compression = PackCompression::Lz4;
+                }
+            }
+
+            totalSize += input.size;
+            totalStored += input.stored.size();
+            inputs.push_back(std::move(input));
+        }
+
+        std::sort(inputs.begin(), inputs.end(), [](const PackInput& a, const PackInput& b) {
+            return hashAssetPath(a.assetPath) < hashAssetPath(b.assetPath);
+        });
+
+        PackFileHeader header = {};
+        header.magic = PACK_FILE_MAGIC;
+        header.version = PACK_FILE_VERSION;
+        header.entryCount = static_cast<uint32_t>(inputs.size());
+        header.entriesOffset = alignPackOffset(sizeof(PackFileHeader));
+        header.namesOffset = header.entriesOffset + inputs.size() * sizeof(PackEntry);
+
+        std::vector<PackEntry> entries(inputs.size());
+        std::string names;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            entries[i].pathHash = hashAssetPath(inputs[i].assetPath);
+            entries[i].nameOffset = static_cast<uint32_t>(names.size());
+            entries[i].nameLength = static_cast<uint32_t>(inputs[i].assetPath.size());
+            names += inputs[i].assetPath;
+        }
+
+        uint64_t dataOffset = alignPackOffset(header.namesOffset + names.size());
+        for (size_t i = 0; i < inputs.size(); i++) {
+            entries[i].dataOffset = dataOffset;
+            entries[i].storedSize = inputs[i].stored.size();
+            entries[i].size = inputs[i].size;
+            entries[i].compression = static_cast<uint32_t>(inputs[i].compression);
+            dataOffset = alignPackOffset(dataOffset + inputs[i].stored.size());
+        }
+
+        std::ofstream file(argv[1], std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error(std::string("Failed to open ") + argv[1] + " for writing");
+        }
+
+        auto padTo = [&](uint64_t offset) {
+            static const char zeros[PACK_DATA_ALIGNMENT] = {};
+            file.write(zeros, static_cast<std::streamsize>(offset - static_cast<uint64_t>(file.tellp())));
+        };
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        padTo(header.entriesOffset);
+        file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(PackEntry)));
+        file.write(names.data(), static_cast<std::streamsize>(names.size()));
+
+        for (size_t i = 0; i < inputs.size(); i++) {
+            padTo(entries[i].dataOffset);
+            file.write(reinterpret_cast<const char*>(inputs[i].stored.data()), static_cast<std::streamsize>(inputs[i].stored.size()));
+        }
+
+        if (!file) {
+            throw std::runtime_error(std::string("Failed to write ") + argv[1]);
+        }
+
+        std::cout << argv[1] << ": " << inputs.size() << " entries, " << totalSize << " bytes, " << totalStored << " bytes stored" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}